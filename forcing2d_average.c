@@ -0,0 +1,2753 @@
+/*
+ * forcing2d_average_v0/v1 共用的主流程
+ * 功能：根据指定的变量类型、年份和月份，找到对应的NetCDF文件
+ * M个进程按time维度（或按y维度）分割读取一个文件，对自己的部分求和
+ * 然后进程间归约，最后得到[y,x]大小的时间平均
+ * 写入时按y维度分割，每个进程负责一部分
+ */
+
+#include <unistd.h>  /* 用于getopt */
+#include <getopt.h>  /* 用于getopt_long */
+#include <limits.h>
+#include <math.h>
+#include <zstd.h>    /* 压缩归约：无损 */
+#include <sz.h>      /* 压缩归约：有损 */
+#include "forcing2d_lib.h"
+#include "forcing2d_codec.h"
+
+/* 只有长选项的参数编号 */
+#define OPT_BBOX 1001
+#define OPT_YBOX 1002
+#define OPT_XBOX 1003
+#define OPT_SPLIT 1004
+#define OPT_CHUNK_CACHE 1005
+#define OPT_AGGREGATORS 1006
+#define OPT_THREADS 1007
+#define OPT_SIDECAR 1008
+#define OPT_COMBINE 1009
+#define OPT_CLIMATOLOGY 1010
+#define OPT_QUANTILES 1011
+#define OPT_HIST_BINS 1012
+#define OPT_HIST_RANGE 1013
+#define OPT_REGRID 1014
+#define OPT_REGIONS 1015
+#define OPT_EXPR 1016
+#define OPT_COUNT 1017
+#define OPT_INTERP 1018
+#define OPT_INTERP_METHOD 1019
+#define OPT_PROFILE 1020
+#define OPT_TRACE 1021
+#define OPT_COUNTERS 1022
+#define OPT_HINTS 1023
+#define OPT_ALIGN 1024
+#define OPT_REDUCE_COMPRESS 1025
+#define OPT_REDUCE_COMPARE 1026
+
+/* 最多估计的分位数个数 */
+#define MAX_QUANTILES 8
+
+/* 最多的用户表达式个数 */
+#define MAX_EXPRS 16
+
+/* 逐月统计量文件名：forcing2d_stats_YYYY_MM.nc */
+#define STATS_FILE_FORMAT "%s/forcing2d_stats_%04d_%02d.nc"
+
+/* 输出文件的网格描述：维度、格点索引、子区域属性和经纬度，平均结果和统计量文件共用。
+ * 格点索引和经纬度只保存本进程写出的那部分 */
+typedef struct {
+    int gridcell_layout;
+    char dim_names[3][NC_MAX_NAME+1];
+    MPI_Offset ny, nx;              /* 输出的y和x大小，压缩格式下ny为格点数、nx为1 */
+    int raster_shape[2];
+    int *gridcell_y, *gridcell_x;
+    MPI_Offset index_start, index_count;
+    int use_roi, use_bbox;
+    MPI_Offset roi[4];
+    double bbox[4];
+    int has_coords;
+    nc_type coord_types[2];
+    double *coord_lat, *coord_lon;
+    MPI_Offset coord_start[2], coord_count[2];
+} output_grid_t;
+
+/* 显示使用帮助 */
+static void show_usage(const char *program_name) {
+    printf("Usage: %s [options]\n", program_name);
+    printf("Options:\n");
+    printf("  -i <input_path>  指定输入路径\n");
+    printf("  -o <output_path> 指定输出文件路径(文件名将自动生成为forcing2d_average_YYYY_MM.nc)\n");
+    printf("  -y <year>        指定年份(--combine 时可以是范围 Y0-Y1)\n");
+    printf("  -m <month>       指定月份(--combine 时可以是逗号分隔的列表，省略时为全年)\n");
+    printf("  -v <variables>   指定变量列表，以逗号分隔；RH、EA、ESAT、VPD 为由 QBOT/TBOT/PSRF 计算的派生变量\n");
+    printf("  --bbox lat0,lat1,lon0,lon1  只处理经纬度范围内的区域(根据LATIXY/LONGXY换算，结果缓存在输出目录)\n");
+    printf("  --ybox y0,y1     只处理y下标范围[y0,y1]\n");
+    printf("  --xbox x0,x1     只处理x下标范围[x0,x1]\n");
+    printf("  --aggregators N  每个节点只由N个进程读取数据，经共享内存分发给节点内其他进程\n");
+    printf("  --threads N      每个进程用N个线程并行解压自己负责的chunk(需要MPI_THREAD_MULTIPLE)\n");
+    printf("  --split time|y   组内按time(默认)或按y划分读取；按y划分时读取与累加融合，无需组内归约\n");
+    printf("  --chunk-cache <MB>  节点内共享的解压chunk缓存(每节点内存预算)，隐含 --split y\n");
+    printf("  --sidecar        同时写出逐月统计量文件 forcing2d_stats_YYYY_MM.nc(逐格点时间和、时间步数和离差平方和)\n");
+    printf("  --combine        不读取原始数据，合并 -i 目录下的逐月统计量文件，写出季节、年或多年平均值和方差\n");
+    printf("  --climatology    对 -y Y0-Y1 中每年的同一月份求多年平均，并写出每年相对该平均的距平\n");
+    printf("  --quantiles q1,q2,...  用逐格点定宽直方图估计各变量的百分位数(如 95,99)\n");
+    printf("  --hist-bins N    直方图的箱数(默认100)，误差不超过 (hi-lo)/N，内存为每格点 2N 字节\n");
+    printf("  --hist-range lo,hi  直方图的取值范围，默认取变量的 valid_min/valid_max 或 valid_range 属性\n");
+    printf("  --regrid <weights.nc>  用 ESMF/SCRIP 格式的权重文件把时间平均重网格化到目标网格后写出\n");
+    printf("  --expr NAME=EXPR 定义逐格点表达式变量(如 TC=TBOT-273.15)，NAME 需出现在 -v 中，写出其时间平均\n");
+    printf("  --count NAME=EXPR  同 --expr，但写出时间和，比较式(如 WET=PRECTmms>1e-4)即为超过阈值的时间步数\n");
+    printf("  --interp N       不求平均，把每个输入时间步插值为N个子步，逐变量写出 forcing2d_interp_VAR_YYYY_MM.nc\n");
+    printf("  --interp-method linear|coszen  插值方法：时刻值线性插值(默认)，或时段平均按太阳天顶角余弦分配(FSDS)\n");
+    printf("  --regions <mask.nc>[:VAR]  按整型分区变量(默认 region)写出逐时间步的分区均值/最小值/最大值\n");
+    printf("  --profile <file.json>  把各进程分阶段的时间、数据量和内存峰值写成 JSON\n");
+    printf("  --trace <file.json>    把各进程每个阶段的时间线写成 Chrome trace (chrome://tracing 或 Perfetto)\n");
+    printf("  --hints <file>   打开和创建文件时使用的 MPI-IO/PnetCDF 提示(每行 key = value，如 cb_buffer_size = 16777216)\n");
+    printf("  --align          组内 time/y 划分的边界尽量落在 chunk 边界和文件系统条带边界上(条带大小取 --hints 的 striping_unit 或文件的实际值)\n");
+    printf("  --reduce-compress zstd|sz:E  组内归约前压缩部分和：字节重排+zstd 无损，或 SZ 有损且均值的绝对误差不超过E\n");
+    printf("  --reduce-compare 同时计时一次 MPI_Allreduce，报告加速比和与其结果的最大误差\n");
+    printf("  --counters       用 perf_event_open 测量累加、归一化、复制和读写(解压/压缩)区域的周期、指令和缓存缺失\n");
+    printf("  -h               显示帮助信息\n");
+    printf("Example:\n");
+    printf("  mpiexec -n 14 %s -i /input/path -o output/path -y 2014 -m 12 -v FLDS,FSDS,WIND\n", program_name);
+    printf("  mpiexec -n 14 %s -i /input/path -o output/path -y 2014 -m 12 -v TBOT --bbox 35.0,37.0,-85.0,-82.0\n", program_name);
+    printf("  mpiexec -n 14 %s -i /stats/path -o output/path -y 2010-2014 -m 12,1,2 -v FLDS,TBOT --combine\n", program_name);
+    printf("  mpiexec -n 70 %s -i /input/path -o output/path -y 2010-2014 -m 7 -v FLDS,TBOT --climatology\n", program_name);
+}
+
+/* 定义输出网格的维度、格点索引、子区域属性和经纬度变量。
+ * dimids 返回 (y, x) 维度，grid_varids 返回 gridcell_y/gridcell_x/LATIXY/LONGXY 的ID */
+static int def_output_grid(int ncid, const output_grid_t *g, int chunked, int *dimids, int *grid_varids) {
+    int ret;
+
+    grid_varids[0] = grid_varids[1] = grid_varids[2] = grid_varids[3] = -1;
+
+    /* 创建y维度，压缩格式下只有一个 gridcell 维度 */
+    ret = ncmpi_def_dim(ncid, g->dim_names[1], g->ny, &dimids[0]);
+    CHECK_ERR(ret);
+
+    /* 创建x维度 */
+    if (!g->gridcell_layout) {
+        ret = ncmpi_def_dim(ncid, g->dim_names[2], g->nx, &dimids[1]);
+        CHECK_ERR(ret);
+    }
+
+    /* 压缩格式：输出同样保留格点索引和栅格形状 */
+    if (g->gridcell_layout) {
+        ret = ncmpi_def_var(ncid, GRIDCELL_Y_NAME, NC_INT, 1, dimids, &grid_varids[0]);
+        CHECK_ERR(ret);
+        ret = ncmpi_def_var(ncid, GRIDCELL_X_NAME, NC_INT, 1, dimids, &grid_varids[1]);
+        CHECK_ERR(ret);
+        if (chunked) {
+            ret = ncmpi_var_set_filter(ncid, grid_varids[0], NC_FILTER_NONE);
+            CHECK_ERR(ret);
+            ret = ncmpi_var_set_filter(ncid, grid_varids[1], NC_FILTER_NONE);
+            CHECK_ERR(ret);
+        }
+        ret = ncmpi_put_att_int(ncid, NC_GLOBAL, "gridcell_ny", NC_INT, 1, &g->raster_shape[0]);
+        CHECK_ERR(ret);
+        ret = ncmpi_put_att_int(ncid, NC_GLOBAL, "gridcell_nx", NC_INT, 1, &g->raster_shape[1]);
+        CHECK_ERR(ret);
+    }
+
+    /* 子区域：记录在原网格中的位置，并带上对应的经纬度 */
+    if (g->use_roi) {
+        int roi_offset[2] = {(int)g->roi[0], (int)g->roi[2]};
+        ret = ncmpi_put_att_int(ncid, NC_GLOBAL, "roi_y_offset", NC_INT, 1, &roi_offset[0]);
+        CHECK_ERR(ret);
+        ret = ncmpi_put_att_int(ncid, NC_GLOBAL, "roi_x_offset", NC_INT, 1, &roi_offset[1]);
+        CHECK_ERR(ret);
+        if (g->use_bbox) {
+            ret = ncmpi_put_att_double(ncid, NC_GLOBAL, "roi_bbox", NC_DOUBLE, 4, g->bbox);
+            CHECK_ERR(ret);
+        }
+    }
+    if (g->has_coords) {
+        ret = ncmpi_def_var(ncid, "LATIXY", g->coord_types[0], 2, dimids, &grid_varids[2]);
+        CHECK_ERR(ret);
+        ret = ncmpi_def_var(ncid, "LONGXY", g->coord_types[1], 2, dimids, &grid_varids[3]);
+        CHECK_ERR(ret);
+        if (chunked) {
+            ret = ncmpi_var_set_filter(ncid, grid_varids[2], NC_FILTER_NONE);
+            CHECK_ERR(ret);
+            ret = ncmpi_var_set_filter(ncid, grid_varids[3], NC_FILTER_NONE);
+            CHECK_ERR(ret);
+        }
+        ret = ncmpi_put_att_text(ncid, grid_varids[2], "units", strlen("degrees_north"), "degrees_north");
+        CHECK_ERR(ret);
+        ret = ncmpi_put_att_text(ncid, grid_varids[3], "units", strlen("degrees_east"), "degrees_east");
+        CHECK_ERR(ret);
+    }
+    return 0;
+}
+
+/* 写出本进程负责的格点索引和经纬度（集合调用，没有数据的进程 count 为0） */
+static int put_output_grid(int ncid, const output_grid_t *g, const int *grid_varids) {
+    int ret;
+    if (g->gridcell_layout) {
+        ret = ncmpi_put_vara_int_all(ncid, grid_varids[0], &g->index_start, &g->index_count, g->gridcell_y);
+        CHECK_ERR(ret);
+        ret = ncmpi_put_vara_int_all(ncid, grid_varids[1], &g->index_start, &g->index_count, g->gridcell_x);
+        CHECK_ERR(ret);
+    }
+    if (g->has_coords) {
+        ret = ncmpi_put_vara_double_all(ncid, grid_varids[2], g->coord_start, g->coord_count, g->coord_lat);
+        CHECK_ERR(ret);
+        ret = ncmpi_put_vara_double_all(ncid, grid_varids[3], g->coord_start, g->coord_count, g->coord_lon);
+        CHECK_ERR(ret);
+    }
+    return 0;
+}
+
+/* 释放网格描述中本进程持有的索引和经纬度 */
+static void free_output_grid(output_grid_t *g) {
+    free(g->gridcell_y);
+    free(g->gridcell_x);
+    free(g->coord_lat);
+    free(g->coord_lon);
+}
+
+/* 写出逐月统计量文件：每个变量的逐格点时间和 <VAR>_sum 与离差平方和 <VAR>_m2（均为 double），
+ * 时间步数记在 <VAR>_sum 的属性 count 中。统计量要能被精确合并，所以不使用有损压缩。
+ * 每个组只写出自己变量的 [row_start, row_start + row_count) 行 */
+static int write_stats_file(const char *path, const output_grid_t *g, char **var_types, int num_files,
+                            const int *out_types, const long long *counts, int file_group, int year, int month,
+                            MPI_Offset row_start, MPI_Offset row_count, const double *sum, const double *m2,
+                            MPI_Info hints) {
+    int ret, i, ncid, dimids[2], grid_varids[4];
+    int *varid_sum = (int *)malloc(num_files * sizeof(int));
+    int *varid_m2 = (int *)malloc(num_files * sizeof(int));
+    char name[NC_MAX_NAME+1];
+
+    ret = ncmpi_create(MPI_COMM_WORLD, path, NC_CLOBBER | NC_64BIT_DATA, hints, &ncid);
+    CHECK_ERR(ret);
+    ret = def_output_grid(ncid, g, 0, dimids, grid_varids);
+    if (ret != 0) return ret;
+    for (i = 0; i < num_files; i++) {
+        sprintf(name, "%s_sum", var_types[i]);
+        ret = ncmpi_def_var(ncid, name, NC_DOUBLE, g->gridcell_layout ? 1 : 2, dimids, &varid_sum[i]);
+        CHECK_ERR(ret);
+        ret = ncmpi_put_att_longlong(ncid, varid_sum[i], "count", NC_INT64, 1, &counts[i]);
+        CHECK_ERR(ret);
+        /* 合并后的平均结果沿用原来的输出类型 */
+        ret = ncmpi_put_att_int(ncid, varid_sum[i], "average_type", NC_INT, 1, &out_types[i]);
+        CHECK_ERR(ret);
+        sprintf(name, "%s_m2", var_types[i]);
+        ret = ncmpi_def_var(ncid, name, NC_DOUBLE, g->gridcell_layout ? 1 : 2, dimids, &varid_m2[i]);
+        CHECK_ERR(ret);
+    }
+    ret = ncmpi_put_att_int(ncid, NC_GLOBAL, "year", NC_INT, 1, &year);
+    CHECK_ERR(ret);
+    ret = ncmpi_put_att_int(ncid, NC_GLOBAL, "month", NC_INT, 1, &month);
+    CHECK_ERR(ret);
+    ret = ncmpi_enddef(ncid);
+    CHECK_ERR(ret);
+
+    /* 其他组的变量 count 设为0，不实际写入数据 */
+    for (i = 0; i < num_files; i++) {
+        MPI_Offset start[2] = {row_start, 0}, count[2] = {row_count, g->nx};
+        if (i != file_group) {
+            start[0] = count[0] = count[1] = 0;
+        }
+        ret = ncmpi_put_vara_double_all(ncid, varid_sum[i], start, count, i == file_group ? sum : NULL);
+        CHECK_ERR(ret);
+        ret = ncmpi_put_vara_double_all(ncid, varid_m2[i], start, count, i == file_group ? m2 : NULL);
+        CHECK_ERR(ret);
+    }
+    ret = put_output_grid(ncid, g, grid_varids);
+    if (ret != 0) return ret;
+    ret = ncmpi_close(ncid);
+    CHECK_ERR(ret);
+    free(varid_sum);
+    free(varid_m2);
+    return 0;
+}
+
+/* 写出一年的距平文件 (time, y, x)：comm 为处理该年所有变量的进程，每个进程逐个时间步
+ * 计算自己时间段的距平并写出，不需要额外保存整段距平。my_var 为本进程的变量编号 */
+static int write_anomaly_file(const char *path, MPI_Comm comm, MPI_Info info, int chunked, const output_grid_t *g,
+                              char **var_types, int num_vars, const int *out_types, int my_var,
+                              const forcing_var_t *var, const void *buffer, MPI_Offset time_start,
+                              MPI_Offset time_count, MPI_Offset time_len, const void *clim, int year, int month) {
+    int ret, v, ncid, dimids[3], grid_varids[4];
+    int ndims = g->gridcell_layout ? 2 : 3;
+    int *varids = (int *)malloc(num_vars * sizeof(int));
+    MPI_Offset plane = g->ny * g->nx, t, max_steps;
+    char attr_text[200];
+
+    /* 同一年各变量的文件必须有相同的时间步数 */
+    MPI_Offset len_min, len_max;
+    MPI_Allreduce(&time_len, &len_min, 1, MPI_OFFSET, MPI_MIN, comm);
+    MPI_Allreduce(&time_len, &len_max, 1, MPI_OFFSET, MPI_MAX, comm);
+    if (len_min != len_max) {
+        printf("Error: Files of %04d-%02d have different numbers of time steps\n", year, month);
+        MPI_Abort(MPI_COMM_WORLD, -1);
+        return 1;
+    }
+
+    ret = ncmpi_create(comm, path, NC_64BIT_DATA, info, &ncid);
+    CHECK_ERR(ret);
+    ret = def_output_grid(ncid, g, chunked, &dimids[1], grid_varids);
+    if (ret != 0) return ret;
+    ret = ncmpi_def_dim(ncid, g->dim_names[0], time_len, &dimids[0]);
+    CHECK_ERR(ret);
+    for (v = 0; v < num_vars; v++) {
+        ret = ncmpi_def_var(ncid, var_types[v], out_types[v], ndims, dimids, &varids[v]);
+        CHECK_ERR(ret);
+        sprintf(attr_text, "Anomaly of %s for %04d-%02d relative to the monthly climatology", var_types[v], year, month);
+        ret = ncmpi_put_att_text(ncid, varids[v], "long_name", strlen(attr_text), attr_text);
+        CHECK_ERR(ret);
+    }
+    ret = ncmpi_enddef(ncid);
+    CHECK_ERR(ret);
+
+    /* 每个时间步每个变量一次集合写，没有数据的进程 count 为0 */
+    MPI_Allreduce(&time_count, &max_steps, 1, MPI_OFFSET, MPI_MAX, comm);
+    void *anomaly = malloc((plane + 1) * var->acc_size);
+    for (t = 0; t < max_steps; t++) {
+        for (v = 0; v < num_vars; v++) {
+            MPI_Offset start[3] = {0, 0, 0}, count[3] = {0, 0, 0};
+            if (v == my_var && t < time_count) {
+                anomaly_plane(var, (const char *)buffer + t * plane * var->elem_size, clim, plane, anomaly);
+                start[0] = time_start + t;
+                count[0] = 1;
+                count[1] = g->ny;
+                count[2] = g->nx;
+                ret = ncmpi_put_vara_all(ncid, varids[v], start, count, anomaly, plane, var->acc_mpitype);
+            } else {
+                ret = ncmpi_put_vara_all(ncid, varids[v], start, count, NULL, 0, nc2mpitype(out_types[v]));
+            }
+            CHECK_ERR(ret);
+        }
+    }
+    free(anomaly);
+
+    ret = put_output_grid(ncid, g, grid_varids);
+    if (ret != 0) return ret;
+    ret = ncmpi_close(ncid);
+    CHECK_ERR(ret);
+    free(varids);
+    return 0;
+}
+
+/* 时间插值模式的写出：每个子步一次集合写，组内各进程写出自己的行 */
+typedef struct {
+    int ncid, varid;
+    MPI_Offset start[3], count[3];
+} interp_writer_t;
+
+static int put_interp_step(void *arg, MPI_Offset step, const float *plane, MPI_Offset n) {
+    interp_writer_t *w = (interp_writer_t *)arg;
+    int ret;
+    w->start[0] = step;
+    /* 灵活接口核对 n 与 count 的元素数 */
+    ret = ncmpi_put_vara_all(w->ncid, w->varid, w->start, w->count, plane, n, MPI_FLOAT);
+    CHECK_ERR(ret);
+    return 0;
+}
+
+/* 写出一个变量的插值结果 (time, y, x)，time 为 nt * nsub 个子步。g 为本组的网格描述，
+ * 本进程写出 [row_start, row_start + row_count) 行，数据由 interp_stream 逐子步产生 */
+static int write_interp_file(const char *path, MPI_Comm comm, MPI_Info info, int chunked, const output_grid_t *g,
+                             const interp_spec_t *spec, MPI_Offset row_start, MPI_Offset row_count) {
+    int ret, ncid, varid, dimids[3], grid_varids[4];
+    int ndims = g->gridcell_layout ? 2 : 3;
+    const char *method = (spec->method == INTERP_COSZEN) ? "coszen" : "linear";
+    char attr_text[200];
+    interp_writer_t writer;
+
+    ret = ncmpi_create(comm, path, NC_CLOBBER | NC_64BIT_DATA, info, &ncid);
+    CHECK_ERR(ret);
+    ret = def_output_grid(ncid, g, chunked, &dimids[1], grid_varids);
+    if (ret != 0) return ret;
+    ret = ncmpi_def_dim(ncid, g->dim_names[0], spec->nt * spec->nsub, &dimids[0]);
+    CHECK_ERR(ret);
+    ret = ncmpi_def_var(ncid, spec->var_name, NC_FLOAT, ndims, dimids, &varid);
+    CHECK_ERR(ret);
+    sprintf(attr_text, "%s interpolated to %d sub-steps per input step", spec->var_name, spec->nsub);
+    ret = ncmpi_put_att_text(ncid, varid, "long_name", strlen(attr_text), attr_text);
+    CHECK_ERR(ret);
+    ret = ncmpi_put_att_text(ncid, varid, "interp_method", strlen(method), method);
+    CHECK_ERR(ret);
+    ret = ncmpi_put_att_int(ncid, varid, "interp_sub_steps", NC_INT, 1, &spec->nsub);
+    CHECK_ERR(ret);
+    ret = ncmpi_enddef(ncid);
+    CHECK_ERR(ret);
+
+    writer.ncid = ncid;
+    writer.varid = varid;
+    writer.start[0] = 0;
+    writer.start[1] = row_start;
+    writer.start[2] = 0;
+    writer.count[0] = 1;
+    writer.count[1] = row_count;
+    writer.count[2] = g->nx;
+    ret = interp_stream(spec, put_interp_step, &writer);
+    if (ret != 0) return ret;
+
+    ret = put_output_grid(ncid, g, grid_varids);
+    if (ret != 0) return ret;
+    ret = ncmpi_close(ncid);
+    CHECK_ERR(ret);
+    return 0;
+}
+
+/* 按time划分时的逐格点直方图：依次对组内每个进程的写出行统计本进程时间段的直方图，
+ * 再归约到该进程。任一时刻只保存一个进程的行，内存与按y划分时相同 */
+static int reduce_time_split_hist(const forcing_var_t *var, const void *buffer, MPI_Offset nt,
+                                  MPI_Offset rows, MPI_Offset cols, MPI_Comm comm, pixel_hist_t *hist) {
+    int p, rank, size;
+    pixel_hist_t local;
+    MPI_Offset r0, rc, max_rows;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    split_range(rows, size, 0, &r0, &max_rows);     /* 第0份最大 */
+    if (pixel_hist_init(&local, max_rows * cols, hist->nbins, hist->lo, hist->hi) != 0) {
+        return -1;
+    }
+    for (p = 0; p < size; p++) {
+        split_range(rows, size, p, &r0, &rc);
+        memset(local.counts, 0, rc * cols * hist->nbins * sizeof(unsigned short));
+        for (MPI_Offset t = 0; t < nt; t++) {
+            pixel_hist_add(&local, var, (const char *)buffer + (t * rows + r0) * cols * var->elem_size, rc * cols, 0);
+        }
+        MPI_Reduce(local.counts, (p == rank) ? hist->counts : NULL, (int)(rc * cols * hist->nbins),
+                   MPI_UNSIGNED_SHORT, MPI_SUM, p, comm);
+    }
+    pixel_hist_free(&local);
+    return 0;
+}
+
+/* ---------- 压缩的组内归约 ---------- */
+
+/* 消息的编码方式，写在每条消息的第一个字节 */
+#define REDUCE_RAW 0
+#define REDUCE_ZSTD 1   /* 字节重排 (byte_shuffle) + zstd，无损 */
+#define REDUCE_SZ 2     /* SZ 绝对误差界，有损 */
+
+typedef struct {
+    int method;             /* REDUCE_RAW 时直接用 MPI_Allreduce */
+    double error_bound;     /* REDUCE_SZ：输出均值的绝对误差界 */
+    int compare;            /* 另做一次 MPI_Allreduce 计时，并与其结果比较 */
+    double raw_bytes;       /* 不压缩的环形归约要发送的字节数 */
+    double wire_bytes;      /* 实际发送的字节数 */
+    double time, codec_time, plain_time;
+    double max_error;       /* 与 MPI_Allreduce 结果的最大绝对差（均值） */
+} reduce_codec_t;
+
+/* 把 n 个 acc_type 类型的值编码到 out，返回字节数。SZ 不处理非有限值（海洋格点的填充值之和
+ * 可能溢出），这样的块改用无损压缩；压缩后不更小时原样发送 */
+static size_t reduce_encode(int method, nc_type acc_type, const void *src, MPI_Offset n, double eb,
+                            unsigned char *out, void *scratch) {
+    int size = nc_type_size(acc_type);
+    size_t bytes = n * size, len = 0;
+    if (method == REDUCE_SZ) {
+        for (MPI_Offset k = 0; k < n; k++) {
+            double v = (acc_type == NC_FLOAT) ? ((const float *)src)[k] : ((const double *)src)[k];
+            if (!isfinite(v)) {
+                method = REDUCE_ZSTD;
+                break;
+            }
+        }
+    }
+    if (method == REDUCE_SZ && n > 0) {
+        size_t outsize = 0;
+        unsigned char *c = SZ_compress_args(acc_type == NC_FLOAT ? SZ_FLOAT : SZ_DOUBLE, (void *)src, &outsize,
+                                            ABS, eb, 0, 0, 0, 0, 0, 0, (size_t)n);
+        if (c != NULL && outsize < bytes) {
+            memcpy(out + 1, c, outsize);
+            len = outsize;
+        }
+        free(c);
+    } else if (method == REDUCE_ZSTD && n > 0) {
+        byte_shuffle(src, n, size, scratch);
+        size_t r = ZSTD_compress(out + 1, ZSTD_compressBound(bytes), scratch, bytes, 1);
+        if (!ZSTD_isError(r) && r < bytes) {
+            len = r;
+        }
+    }
+    if (len == 0) {
+        method = REDUCE_RAW;
+        memcpy(out + 1, src, bytes);
+        len = bytes;
+    }
+    out[0] = (unsigned char)method;
+    return len + 1;
+}
+
+/* 解码 reduce_encode 的消息，得到 n 个值 */
+static int reduce_decode(nc_type acc_type, const unsigned char *in, size_t len, MPI_Offset n, void *dst,
+                         void *scratch) {
+    int size = nc_type_size(acc_type);
+    size_t bytes = n * size;
+    if (in[0] == REDUCE_ZSTD) {
+        size_t r = ZSTD_decompress(scratch, bytes, in + 1, len - 1);
+        if (ZSTD_isError(r) || r != bytes) return -1;
+        byte_unshuffle(scratch, n, size, dst);
+    } else if (in[0] == REDUCE_SZ) {
+        void *d = SZ_decompress(acc_type == NC_FLOAT ? SZ_FLOAT : SZ_DOUBLE, (unsigned char *)in + 1, len - 1,
+                                0, 0, 0, 0, (size_t)n);
+        if (d == NULL) return -1;
+        memcpy(dst, d, bytes);
+        free(d);
+    } else {
+        if (len - 1 != bytes) return -1;
+        memcpy(dst, in + 1, bytes);
+    }
+    return 0;
+}
+
+/* 与右邻交换一条变长消息：先交换长度，再交换内容 */
+static size_t reduce_exchange(const unsigned char *send, size_t len, unsigned char *recv, int left, int right,
+                              MPI_Comm comm) {
+    long long slen = (long long)len, rlen = 0;
+    MPI_Sendrecv(&slen, 1, MPI_LONG_LONG, right, 0, &rlen, 1, MPI_LONG_LONG, left, 0, comm, MPI_STATUS_IGNORE);
+    MPI_Sendrecv(send, (int)slen, MPI_BYTE, right, 1, recv, (int)rlen, MPI_BYTE, left, 1, comm, MPI_STATUS_IGNORE);
+    return (size_t)rlen;
+}
+
+/* 压缩的 allreduce (MPI_SUM)：数组按 split_range 分成进程数个块，环形 reduce-scatter 中
+ * 每一步压缩自己的部分和发给右邻，收到左邻的块后解压并累加；然后每个进程把完成的块
+ * 压缩一次，在环形 allgather 中原样转发。各进程解码同一条消息，结果逐位相同。
+ * sum_bound 为和的绝对误差界，每条消息分得 1/size（size-1 次累加加1次分发） */
+static int compressed_allreduce(reduce_codec_t *rc, const void *sendbuf, void *recvbuf, MPI_Offset n,
+                                nc_type acc_type, double sum_bound, MPI_Comm comm) {
+    int rank, size, s, ret = 0;
+    int elem = nc_type_size(acc_type);
+    MPI_Offset b0, max_block, s0, c0;
+    double t0 = MPI_Wtime(), tc;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    split_range(n, size, 0, &b0, &max_block);
+    size_t cap = 1 + ZSTD_compressBound(max_block * elem);
+    if (cap < 1 + (size_t)max_block * elem) cap = 1 + max_block * elem;
+    if (size == 1 || cap > INT_MAX) {
+        /* 单进程无需交换；块超过 int 计数时退回 MPI_Allreduce */
+        MPI_Allreduce(sendbuf, recvbuf, n, nc2mpitype(acc_type), MPI_SUM, comm);
+        rc->time += MPI_Wtime() - t0;
+        return 0;
+    }
+    unsigned char *send = (unsigned char *)malloc(cap);
+    unsigned char *recv = (unsigned char *)malloc(cap);
+    void *scratch = malloc(max_block * elem + 1);
+    void *block = malloc(max_block * elem + 1);
+    if (send == NULL || recv == NULL || scratch == NULL || block == NULL) {
+        printf("Error: Memory allocation failed for the compressed reduction buffers\n");
+        MPI_Abort(MPI_COMM_WORLD, -1);
+        return -1;
+    }
+    int left = (rank + size - 1) % size, right = (rank + 1) % size;
+    double eb = sum_bound / size;
+    memcpy(recvbuf, sendbuf, n * elem);
+
+    /* reduce-scatter：第 s 步发出块 rank - s，收到并累加块 rank - s - 1 */
+    for (s = 0; s < size - 1 && ret == 0; s++) {
+        int sb = (rank - s + size) % size, rb = (rank - s - 1 + 2 * size) % size;
+        split_range(n, size, sb, &s0, &c0);
+        tc = MPI_Wtime();
+        size_t len = reduce_encode(rc->method, acc_type, (char *)recvbuf + s0 * elem, c0, eb, send, scratch);
+        rc->codec_time += MPI_Wtime() - tc;
+        rc->raw_bytes += c0 * elem;
+        rc->wire_bytes += len;
+        size_t rlen = reduce_exchange(send, len, recv, left, right, comm);
+        split_range(n, size, rb, &s0, &c0);
+        tc = MPI_Wtime();
+        ret = reduce_decode(acc_type, recv, rlen, c0, block, scratch);
+        if (acc_type == NC_FLOAT) {
+            for (MPI_Offset k = 0; k < c0; k++) ((float *)recvbuf)[s0 + k] += ((float *)block)[k];
+        } else {
+            for (MPI_Offset k = 0; k < c0; k++) ((double *)recvbuf)[s0 + k] += ((double *)block)[k];
+        }
+        rc->codec_time += MPI_Wtime() - tc;
+    }
+
+    /* allgather：完成的块 rank + 1 编码一次，本进程也用解码后的值，之后收到的消息原样转发 */
+    split_range(n, size, right, &s0, &c0);
+    tc = MPI_Wtime();
+    size_t len = reduce_encode(rc->method, acc_type, (char *)recvbuf + s0 * elem, c0, eb, send, scratch);
+    if (ret == 0) ret = reduce_decode(acc_type, send, len, c0, (char *)recvbuf + s0 * elem, scratch);
+    rc->codec_time += MPI_Wtime() - tc;
+    for (s = 0; s < size - 1 && ret == 0; s++) {
+        unsigned char *tmp;
+        split_range(n, size, (rank - s + size) % size, &s0, &c0);
+        rc->raw_bytes += c0 * elem;
+        rc->wire_bytes += len;
+        size_t rlen = reduce_exchange(send, len, recv, left, right, comm);
+        tc = MPI_Wtime();
+        ret = reduce_decode(acc_type, recv, rlen, c0, (char *)recvbuf + s0 * elem, scratch);
+        rc->codec_time += MPI_Wtime() - tc;
+        tmp = send;
+        send = recv;
+        recv = tmp;
+        len = rlen;
+    }
+    free(send);
+    free(recv);
+    free(scratch);
+    free(block);
+    rc->time += MPI_Wtime() - t0;
+    return ret;
+}
+
+/* 组内归约：按 rc 压缩或直接 MPI_Allreduce。steps 为均值的时间步数，用于换算误差界 */
+static int group_allreduce(reduce_codec_t *rc, const void *sendbuf, void *recvbuf, MPI_Offset n,
+                           nc_type acc_type, MPI_Offset steps, MPI_Comm comm) {
+    int elem = nc_type_size(acc_type);
+    double t0;
+    if (rc->method == REDUCE_RAW) {
+        MPI_Allreduce(sendbuf, recvbuf, n, nc2mpitype(acc_type), MPI_SUM, comm);
+        return 0;
+    }
+    if (compressed_allreduce(rc, sendbuf, recvbuf, n, acc_type, rc->error_bound * steps, comm) != 0) {
+        printf("Error: Failed to decode a compressed reduction message\n");
+        return -1;
+    }
+    if (rc->compare) {
+        void *plain = malloc(n * elem + 1);
+        if (plain == NULL) return 0;
+        MPI_Barrier(comm);
+        t0 = MPI_Wtime();
+        MPI_Allreduce(sendbuf, plain, n, nc2mpitype(acc_type), MPI_SUM, comm);
+        rc->plain_time += MPI_Wtime() - t0;
+        for (MPI_Offset k = 0; k < n; k++) {
+            double a = (acc_type == NC_FLOAT) ? ((float *)plain)[k] : ((double *)plain)[k];
+            double b = (acc_type == NC_FLOAT) ? ((float *)recvbuf)[k] : ((double *)recvbuf)[k];
+            if (isfinite(a) && fabs(a - b) / steps > rc->max_error) rc->max_error = fabs(a - b) / steps;
+        }
+        free(plain);
+    }
+    return 0;
+}
+
+/* 在0号进程打印压缩归约的线路压缩比和时间，与 MPI_Allreduce 对照 */
+static void reduce_codec_report(const reduce_codec_t *rc, MPI_Comm comm) {
+    double bytes[2] = {rc->raw_bytes, rc->wire_bytes}, sums[2];
+    double times[4] = {rc->time, rc->codec_time, rc->plain_time, rc->max_error}, maxs[4];
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Reduce(bytes, sums, 2, MPI_DOUBLE, MPI_SUM, 0, comm);
+    MPI_Reduce(times, maxs, 4, MPI_DOUBLE, MPI_MAX, 0, comm);
+    if (rank != 0) return;
+    printf("===== 压缩归约 (%s) =====\n", rc->method == REDUCE_SZ ? "SZ" : "zstd");
+    printf("发送字节: 不压缩 %.1f MB, 实际 %.1f MB, 压缩比 %.2f\n", sums[0] / 1048576.0, sums[1] / 1048576.0,
+           sums[1] > 0 ? sums[0] / sums[1] : 0.0);
+    printf("归约时间: %.4f 秒 (其中压缩/解压 %.4f 秒)\n", maxs[0], maxs[1]);
+    if (rc->compare) {
+        printf("MPI_Allreduce: %.4f 秒, 加速 %.2f 倍, 均值最大误差 %g", maxs[2], maxs[0] > 0 ? maxs[2] / maxs[0] : 0.0,
+               maxs[3]);
+        if (rc->method == REDUCE_SZ) printf(" (误差界 %g)", rc->error_bound);
+        printf("\n");
+    }
+}
+
+/* --count 的时间和：每步都是填充值的格点求和后溢出或偏离填充值，改回 fill。
+ * 与 regrid_apply 相同，按相对 1e-3 的误差识别填充值；fill 为 NaN 时和已是 NaN */
+static void restore_sum_fill(nc_type acc_type, void *values, MPI_Offset n, MPI_Offset steps, double fill) {
+    if (fill != fill || steps <= 0) return;
+    for (MPI_Offset k = 0; k < n; k++) {
+        double v = (acc_type == NC_DOUBLE) ? ((double *)values)[k] : ((float *)values)[k];
+        if (isfinite(v) && fabs(v / steps - fill) > 1e-3 * fabs(fill)) continue;
+        if (acc_type == NC_DOUBLE) {
+            ((double *)values)[k] = fill;
+        } else {
+            ((float *)values)[k] = (float)fill;
+        }
+    }
+}
+
+/* 派生变量：逐时间步从各输入文件读取同一 hyperslab，第一个输入即 var 所在的文件，
+ * 其余输入在同一目录下按文件名规则打开，一遍算出派生值写入 out。任一输入为 NaN 或
+ * 其填充值的格点输出 var->fill。组内各进程的时间步数最多相差1，max_count 为其中最大者，
+ * 多出的一步以空读取参与集合操作 */
+static int read_derived(const derived_var_t *derived, const forcing_var_t *var, const char *first_file,
+                        int year, int month, MPI_Comm comm, MPI_Info info, const MPI_Offset *start,
+                        const MPI_Offset *count, MPI_Offset max_count, float *out) {
+    int ret, k, d;
+    int ncids[DERIVED_MAX_INPUTS], varids[DERIVED_MAX_INPUTS];
+    float *planes[DERIVED_MAX_INPUTS], fills[DERIVED_MAX_INPUTS];
+    char path[MAX_PATH_LEN], name[NC_MAX_NAME+1];
+    MPI_Offset plane = count[1] * count[2];
+    int dir_len = (int)(strrchr(first_file, '/') - first_file);
+
+    ncids[0] = var->ncid;
+    varids[0] = var->varid;
+    fills[0] = (float)var->fill;
+    for (k = 1; k < derived->ninputs; k++) {
+        forcing_var_t in;
+        sprintf(name, FORCING_FILE_FORMAT, derived->inputs[k], year, month);
+        sprintf(path, "%.*s/%s", dir_len, first_file, name);
+        ret = ncmpi_open(comm, path, NC_NOWRITE, info, &ncids[k]);
+        CHECK_ERR(ret);
+        ret = ncmpi_inq_varid(ncids[k], derived->inputs[k], &varids[k]);
+        CHECK_ERR(ret);
+        ret = forcing_var_inq(ncids[k], varids[k], &in);
+        CHECK_ERR(ret);
+        fills[k] = (float)in.fill;
+        for (d = 0; d < var->ndims; d++) {
+            if (in.ndims != var->ndims || in.dim_sizes[d] != var->dim_sizes[d]) {
+                printf("Error: %s in %s does not have the same shape as %s\n", derived->inputs[k], path,
+                       derived->inputs[0]);
+                return 1;
+            }
+        }
+    }
+    for (k = 0; k < derived->ninputs; k++) {
+        planes[k] = (float *)malloc((plane + 1) * sizeof(float));
+        if (planes[k] == NULL) {
+            printf("Error: Memory allocation failed for %s\n", derived->inputs[k]);
+            return 1;
+        }
+    }
+
+    for (MPI_Offset t = 0; t < max_count; t++) {
+        MPI_Offset s[3] = {start[0] + (t < count[0] ? t : count[0]), start[1], start[2]};
+        MPI_Offset c[3] = {t < count[0] ? 1 : 0, count[1], count[2]};
+        for (k = 0; k < derived->ninputs; k++) {
+            ret = ncmpi_get_vara_float_all(ncids[k], varids[k], s, c, planes[k]);
+            CHECK_ERR(ret);
+        }
+        if (t < count[0]) {
+            float *o = out + t * plane;
+            derived->eval(derived->ctx, (const float *const *)planes, plane, o);
+            /* 公式在填充值上会溢出或混入有效值，这些格点改写为填充值 */
+            for (k = 0; k < derived->ninputs; k++) {
+                const float *in = planes[k];
+                for (MPI_Offset i = 0; i < plane; i++) {
+                    if (in[i] != in[i] || in[i] == fills[k]) o[i] = fills[0];
+                }
+            }
+        }
+    }
+
+    for (k = 0; k < derived->ninputs; k++) {
+        free(planes[k]);
+        if (k > 0) {
+            ret = ncmpi_close(ncids[k]);
+            CHECK_ERR(ret);
+        }
+    }
+    return 0;
+}
+
+/* 合并模式：只读取逐月统计量文件，合并 (count, sum, M2) 后写出季节、年或多年的平均值和方差。
+ * 年份为 [year0, year1]；months 中月份值变小之前的月份取上一年，例如 12,1,2 中的12月 */
+static int combine_stats(const char *input_dir, const char *output_path, int chunked,
+                         char **var_types, int num_vars, const char *var_string,
+                         int year0, int year1, const int *months, int nmonths, MPI_Info hints) {
+    int ret, i, k, v, y, rank, nprocs, ncid, varid, ndims, dimids[2], grid_varids[4];
+    char path[MAX_PATH_LEN], name[NC_MAX_NAME+1], label[64], output_file[MAX_PATH_LEN];
+    int *year_offset = (int *)malloc(nmonths * sizeof(int));
+    output_grid_t grid;
+    MPI_Info info;
+    double start_time = MPI_Wtime();
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+    memset(&grid, 0, sizeof(grid));
+
+    for (k = nmonths - 1, i = 0; k >= 0; k--) {
+        year_offset[k] = -i;
+        if (k > 0 && months[k - 1] > months[k]) {
+            i++;
+        }
+    }
+
+    /* 网格描述取自第一个统计量文件 */
+    sprintf(path, STATS_FILE_FORMAT, input_dir, year0 + year_offset[0], months[0]);
+    ret = ncmpi_open(MPI_COMM_WORLD, path, NC_NOWRITE, hints, &ncid);
+    CHECK_ERR(ret);
+    sprintf(name, "%s_sum", var_types[0]);
+    ret = ncmpi_inq_varid(ncid, name, &varid);
+    CHECK_ERR(ret);
+    ret = ncmpi_inq_varndims(ncid, varid, &ndims);
+    CHECK_ERR(ret);
+    ret = ncmpi_inq_vardimid(ncid, varid, dimids);
+    CHECK_ERR(ret);
+    grid.gridcell_layout = (ndims == 1);
+    grid.nx = 1;
+    for (i = 0; i < ndims; i++) {
+        ret = ncmpi_inq_dimname(ncid, dimids[i], grid.dim_names[i + 1]);
+        CHECK_ERR(ret);
+        ret = ncmpi_inq_dimlen(ncid, dimids[i], i == 0 ? &grid.ny : &grid.nx);
+        CHECK_ERR(ret);
+    }
+    if (grid.gridcell_layout) {
+        ret = ncmpi_get_att_int(ncid, NC_GLOBAL, "gridcell_ny", &grid.raster_shape[0]);
+        CHECK_ERR(ret);
+        ret = ncmpi_get_att_int(ncid, NC_GLOBAL, "gridcell_nx", &grid.raster_shape[1]);
+        CHECK_ERR(ret);
+    }
+    int roi_offset[2];
+    if (ncmpi_get_att_int(ncid, NC_GLOBAL, "roi_y_offset", &roi_offset[0]) == NC_NOERR) {
+        ret = ncmpi_get_att_int(ncid, NC_GLOBAL, "roi_x_offset", &roi_offset[1]);
+        CHECK_ERR(ret);
+        grid.use_roi = 1;
+        grid.roi[0] = roi_offset[0];
+        grid.roi[1] = grid.ny;
+        grid.roi[2] = roi_offset[1];
+        grid.roi[3] = grid.nx;
+        grid.use_bbox = (ncmpi_get_att_double(ncid, NC_GLOBAL, "roi_bbox", grid.bbox) == NC_NOERR);
+    }
+
+    /* 每个进程负责一段连续的行，格点索引和经纬度也读取同样的行 */
+    MPI_Offset row_start, row_count;
+    split_range(grid.ny, nprocs, rank, &row_start, &row_count);
+    MPI_Offset nelems = row_count * grid.nx;
+    MPI_Offset start[2] = {row_start, 0}, count[2] = {row_count, grid.nx};
+    if (grid.gridcell_layout) {
+        int varid_y, varid_x;
+        grid.index_start = row_start;
+        grid.index_count = row_count;
+        grid.gridcell_y = (int *)malloc((row_count + 1) * sizeof(int));
+        grid.gridcell_x = (int *)malloc((row_count + 1) * sizeof(int));
+        ret = ncmpi_inq_varid(ncid, GRIDCELL_Y_NAME, &varid_y);
+        CHECK_ERR(ret);
+        ret = ncmpi_inq_varid(ncid, GRIDCELL_X_NAME, &varid_x);
+        CHECK_ERR(ret);
+        ret = ncmpi_get_vara_int_all(ncid, varid_y, &row_start, &row_count, grid.gridcell_y);
+        CHECK_ERR(ret);
+        ret = ncmpi_get_vara_int_all(ncid, varid_x, &row_start, &row_count, grid.gridcell_x);
+        CHECK_ERR(ret);
+    }
+    int varid_lat, varid_lon;
+    if (ncmpi_inq_varid(ncid, "LATIXY", &varid_lat) == NC_NOERR &&
+        ncmpi_inq_varid(ncid, "LONGXY", &varid_lon) == NC_NOERR) {
+        grid.has_coords = 1;
+        ret = ncmpi_inq_vartype(ncid, varid_lat, &grid.coord_types[0]);
+        CHECK_ERR(ret);
+        ret = ncmpi_inq_vartype(ncid, varid_lon, &grid.coord_types[1]);
+        CHECK_ERR(ret);
+        memcpy(grid.coord_start, start, sizeof(start));
+        memcpy(grid.coord_count, count, sizeof(count));
+        grid.coord_lat = (double *)malloc((nelems + 1) * sizeof(double));
+        grid.coord_lon = (double *)malloc((nelems + 1) * sizeof(double));
+        ret = ncmpi_get_vara_double_all(ncid, varid_lat, start, count, grid.coord_lat);
+        CHECK_ERR(ret);
+        ret = ncmpi_get_vara_double_all(ncid, varid_lon, start, count, grid.coord_lon);
+        CHECK_ERR(ret);
+    }
+    ret = ncmpi_close(ncid);
+    CHECK_ERR(ret);
+
+    /* 逐个文件合并所有变量，每个文件只打开一次 */
+    long long *total = (long long *)calloc(num_vars, sizeof(long long));
+    int *out_types = (int *)malloc(num_vars * sizeof(int));
+    double **sum = (double **)malloc(num_vars * sizeof(double *));
+    double **m2 = (double **)malloc(num_vars * sizeof(double *));
+    double *sum_b = (double *)malloc((nelems + 1) * sizeof(double));
+    double *m2_b = (double *)malloc((nelems + 1) * sizeof(double));
+    for (v = 0; v < num_vars; v++) {
+        sum[v] = (double *)calloc(nelems + 1, sizeof(double));
+        m2[v] = (double *)calloc(nelems + 1, sizeof(double));
+    }
+    for (y = year0; y <= year1; y++) {
+        for (k = 0; k < nmonths; k++) {
+            sprintf(path, STATS_FILE_FORMAT, input_dir, y + year_offset[k], months[k]);
+            if (rank == 0) {
+                printf("合并统计量文件: %s\n", path);
+            }
+            ret = ncmpi_open(MPI_COMM_WORLD, path, NC_NOWRITE, hints, &ncid);
+            CHECK_ERR(ret);
+            for (v = 0; v < num_vars; v++) {
+                long long nb;
+                MPI_Offset len;
+                sprintf(name, "%s_sum", var_types[v]);
+                ret = ncmpi_inq_varid(ncid, name, &varid);
+                CHECK_ERR(ret);
+                ret = ncmpi_inq_vardimid(ncid, varid, dimids);
+                CHECK_ERR(ret);
+                ret = ncmpi_inq_dimlen(ncid, dimids[0], &len);
+                CHECK_ERR(ret);
+                if (len != grid.ny) {
+                    printf("Error: %s in %s does not match the grid of the first file\n", name, path);
+                    MPI_Abort(MPI_COMM_WORLD, -1);
+                    return 1;
+                }
+                ret = ncmpi_get_att_longlong(ncid, varid, "count", &nb);
+                CHECK_ERR(ret);
+                ret = ncmpi_get_att_int(ncid, varid, "average_type", &out_types[v]);
+                CHECK_ERR(ret);
+                ret = ncmpi_get_vara_double_all(ncid, varid, start, count, sum_b);
+                CHECK_ERR(ret);
+                sprintf(name, "%s_m2", var_types[v]);
+                ret = ncmpi_inq_varid(ncid, name, &varid);
+                CHECK_ERR(ret);
+                ret = ncmpi_get_vara_double_all(ncid, varid, start, count, m2_b);
+                CHECK_ERR(ret);
+                merge_moments(total[v], sum[v], m2[v], nb, sum_b, m2_b, nelems);
+                total[v] += nb;
+            }
+            ret = ncmpi_close(ncid);
+            CHECK_ERR(ret);
+        }
+    }
+
+    /* 由合并结果计算平均值和方差（除以总时间步数） */
+    for (v = 0; v < num_vars; v++) {
+        for (i = 0; i < nelems; i++) {
+            sum[v][i] /= total[v];
+            m2[v][i] /= total[v];
+        }
+    }
+
+    /* 输出文件名：forcing2d_average_<年份>_<月份>.nc，12个月全选时月份写作 annual */
+    if (year0 == year1) {
+        sprintf(label, "%04d", year0);
+    } else {
+        sprintf(label, "%04d-%04d", year0, year1);
+    }
+    if (nmonths == 12) {
+        strcat(label, "_annual");
+    } else {
+        for (k = 0; k < nmonths; k++) {
+            sprintf(label + strlen(label), "%s%02d", k == 0 ? "_" : "-", months[k]);
+        }
+    }
+    if (output_path[strlen(output_path) - 1] != '/') {
+        sprintf(output_file, "%s/forcing2d_average_%s.nc", output_path, label);
+    } else {
+        sprintf(output_file, "%sforcing2d_average_%s.nc", output_path, label);
+    }
+
+    MPI_Info_create(&info);
+    if (chunked) {
+        MPI_Info_set(info, "nc_chunk_default_filter", "sz");
+        MPI_Info_set(info, "nc_chunking", "enable");
+    }
+    hints_apply(info, hints);
+    ret = ncmpi_create(MPI_COMM_WORLD, output_file, NC_64BIT_DATA, info, &ncid);
+    CHECK_ERR(ret);
+    ret = def_output_grid(ncid, &grid, chunked, dimids, grid_varids);
+    if (ret != 0) return ret;
+    int *varid_mean = (int *)malloc(num_vars * sizeof(int));
+    int *varid_var = (int *)malloc(num_vars * sizeof(int));
+    for (v = 0; v < num_vars; v++) {
+        char attr_text[200];
+        ret = ncmpi_def_var(ncid, var_types[v], out_types[v], grid.gridcell_layout ? 1 : 2, dimids, &varid_mean[v]);
+        CHECK_ERR(ret);
+        sprintf(attr_text, "Time average of %s for %s", var_types[v], label);
+        ret = ncmpi_put_att_text(ncid, varid_mean[v], "long_name", strlen(attr_text), attr_text);
+        CHECK_ERR(ret);
+        ret = ncmpi_put_att_longlong(ncid, varid_mean[v], "count", NC_INT64, 1, &total[v]);
+        CHECK_ERR(ret);
+        sprintf(name, "%s_var", var_types[v]);
+        ret = ncmpi_def_var(ncid, name, out_types[v], grid.gridcell_layout ? 1 : 2, dimids, &varid_var[v]);
+        CHECK_ERR(ret);
+        sprintf(attr_text, "Time variance of %s for %s", var_types[v], label);
+        ret = ncmpi_put_att_text(ncid, varid_var[v], "long_name", strlen(attr_text), attr_text);
+        CHECK_ERR(ret);
+    }
+    char global_attr_text[MAX_PATH_LEN + 100];
+    sprintf(global_attr_text, "Time average of %s for %s", var_string, label);
+    ret = ncmpi_put_att_text(ncid, NC_GLOBAL, "long_name", strlen(global_attr_text), global_attr_text);
+    CHECK_ERR(ret);
+    ret = ncmpi_enddef(ncid);
+    CHECK_ERR(ret);
+    for (v = 0; v < num_vars; v++) {
+        ret = ncmpi_put_vara_double_all(ncid, varid_mean[v], start, count, sum[v]);
+        CHECK_ERR(ret);
+        ret = ncmpi_put_vara_double_all(ncid, varid_var[v], start, count, m2[v]);
+        CHECK_ERR(ret);
+    }
+    ret = put_output_grid(ncid, &grid, grid_varids);
+    if (ret != 0) return ret;
+    ret = ncmpi_close(ncid);
+    CHECK_ERR(ret);
+
+    double total_time = max_time(MPI_Wtime() - start_time, MPI_COMM_WORLD);
+    if (rank == 0) {
+        printf("合并了 %d 个统计量文件，输出文件: %s\n", (year1 - year0 + 1) * nmonths, output_file);
+        printf("总执行时间: %.4f 秒\n", total_time);
+    }
+
+    for (v = 0; v < num_vars; v++) {
+        free(sum[v]);
+        free(m2[v]);
+    }
+    free(sum);
+    free(m2);
+    free(sum_b);
+    free(m2_b);
+    free(total);
+    free(out_types);
+    free(varid_mean);
+    free(varid_var);
+    free(year_offset);
+    free_output_grid(&grid);
+    MPI_Info_free(&info);
+    return 0;
+}
+
+int forcing2d_average_main(int argc, char **argv, int chunked) {
+    int ret, i, j;
+    int ncid_in, ncid_out, varid_in, *varid_out;
+    int ndims;
+    MPI_Offset *dim_sizes_in;
+    int global_rank, global_size;
+    int file_group, proc_in_group, num_groups, procs_per_group;
+    char **input_files;
+    char output_path[MAX_PATH_LEN] = "";
+    char output_file[MAX_PATH_LEN];
+    void *buffer = NULL;            // 输入缓冲区，类型为变量自身的类型
+    void *local_sum = NULL;         // 局部时间和，类型为累加类型
+    void *global_avg = NULL;        // 全局平均值
+    forcing_var_t var;              // 当前组的输入变量
+    MPI_Comm file_comm;
+    MPI_Info info;
+    char **var_types;               // 变量类型数组
+
+    /* 添加计时变量 */
+    double start_time, process_time;
+    double read_start, read_time;
+    double compute_start, compute_time;
+    double write_start_time, write_time;
+    double total_read_time, total_compute_time, total_write_time, total_time;
+    double phase_start;             // 分阶段计时的开始时间
+    char profile_file[MAX_PATH_LEN] = "";
+    char trace_file[MAX_PATH_LEN] = "";
+    int counters = 0;               // 硬件计数器
+    char hints_file[MAX_PATH_LEN] = "";
+    MPI_Info hints = MPI_INFO_NULL; // --hints 读入的提示，覆盖默认值
+    int align = 0;                  // 按 chunk/条带边界对齐组内划分
+    split_layout_t time_layout, band_layout;
+    split_plan_t time_plan, band_plan;
+    reduce_codec_t reduce_codec;    // --reduce-compress
+    codec_params_t codec_params;    // forcing2d_raw2chunk -z/-e 写出的主变量
+    codec_stats_t codec_stats;
+    int coded = 0, any_coded = 0;
+    pack_params_t pack_params;      // forcing2d_raw2chunk -Q 打包的主变量
+    int packed = 0;
+    hwc_mark_t hwc_mark;
+
+    /* 参数相关变量 */
+    char input_dir[MAX_PATH_LEN] = "";
+    int num_var_types = 0;
+    int year = -1;
+    int year_end = -1;
+    int month = -1;
+    int months[12];
+    int num_months = 0;
+    double month_list[12];
+    int num_files = 0;
+    char var_string[MAX_PATH_LEN] = "";
+    int opt;
+    int bad_arg = 0;
+
+    /* 感兴趣区域：roi = {y起点, y个数, x起点, x个数}，个数<0表示整个维度 */
+    double bbox[4];
+    double range[2];
+    int use_bbox = 0;
+    int use_roi = 0;
+    MPI_Offset roi[4] = {0, -1, 0, -1};
+    char roi_cache_file[MAX_PATH_LEN];
+
+    /* 节点聚合读取，0表示每个进程各自读取 */
+    int node_aggregators = 0;
+    node_reader_t node_reader;
+
+    /* 多线程解压 */
+    int num_threads = 1;
+    int thread_level;
+    double thread_time[MAX_THREADS] = {0.0};
+    int thread_items[MAX_THREADS] = {0};
+
+    /* 读取划分方式与节点内 chunk 缓存 */
+    int split_y = 0;
+    double chunk_cache_mb = 0.0;
+    chunk_cache_t chunk_cache;
+
+    /* 逐月统计量文件与合并模式 */
+    int sidecar = 0;
+    int combine = 0;
+    int climatology = 0;
+
+    /* 逐格点分位数 */
+    int num_quantiles = 0;
+    double quantiles[MAX_QUANTILES];
+    int hist_bins = 100;
+    double hist_range[2];
+    int use_hist_range = 0;
+    pixel_hist_t hist;
+    void *quantile_out = NULL;
+
+    /* 重网格化 */
+    char regrid_file[MAX_PATH_LEN] = "";
+    regrid_weights_t weights;
+    double *regrid_out = NULL;      // 本进程负责的目标网格行
+
+    /* 分区统计：(time, region) 数组，只在组内0号进程上是完整结果 */
+    char region_file[MAX_PATH_LEN] = "";
+    char region_var[NC_MAX_NAME+1] = "region";
+    int *region_mask = NULL;
+    int nregions = 0;
+    double *region_sum = NULL, *region_min = NULL, *region_max = NULL;
+    long long *region_count = NULL;
+
+    /* 时间插值：每个输入时间步的子步数，0 表示求平均 */
+    int interp_steps = 0;
+    int interp_method = INTERP_LINEAR;
+
+    /* 用户表达式，编译后的 def 指向数组元素自身，不能复制 */
+    expr_t exprs[MAX_EXPRS];
+    int num_exprs = 0;
+    char stats_file[MAX_PATH_LEN];
+    double *stat_sum = NULL;        // 组内时间和（double），只在 --sidecar 时使用
+    double *stat_m2 = NULL;         // 组内离差平方和
+    static struct option long_options[] = {
+        {"bbox", required_argument, NULL, OPT_BBOX},
+        {"ybox", required_argument, NULL, OPT_YBOX},
+        {"xbox", required_argument, NULL, OPT_XBOX},
+        {"aggregators", required_argument, NULL, OPT_AGGREGATORS},
+        {"threads", required_argument, NULL, OPT_THREADS},
+        {"split", required_argument, NULL, OPT_SPLIT},
+        {"chunk-cache", required_argument, NULL, OPT_CHUNK_CACHE},
+        {"sidecar", no_argument, NULL, OPT_SIDECAR},
+        {"combine", no_argument, NULL, OPT_COMBINE},
+        {"climatology", no_argument, NULL, OPT_CLIMATOLOGY},
+        {"quantiles", required_argument, NULL, OPT_QUANTILES},
+        {"hist-bins", required_argument, NULL, OPT_HIST_BINS},
+        {"hist-range", required_argument, NULL, OPT_HIST_RANGE},
+        {"regrid", required_argument, NULL, OPT_REGRID},
+        {"regions", required_argument, NULL, OPT_REGIONS},
+        {"expr", required_argument, NULL, OPT_EXPR},
+        {"count", required_argument, NULL, OPT_COUNT},
+        {"interp", required_argument, NULL, OPT_INTERP},
+        {"interp-method", required_argument, NULL, OPT_INTERP_METHOD},
+        {"profile", required_argument, NULL, OPT_PROFILE},
+        {"trace", required_argument, NULL, OPT_TRACE},
+        {"counters", no_argument, NULL, OPT_COUNTERS},
+        {"hints", required_argument, NULL, OPT_HINTS},
+        {"align", no_argument, NULL, OPT_ALIGN},
+        {"reduce-compress", required_argument, NULL, OPT_REDUCE_COMPRESS},
+        {"reduce-compare", no_argument, NULL, OPT_REDUCE_COMPARE},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    /* 初始化MPI，解压线程各自调用PnetCDF，需要MPI_THREAD_MULTIPLE */
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &thread_level);
+    MPI_Comm_rank(MPI_COMM_WORLD, &global_rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &global_size);
+
+    /* 开始计时 - 整个程序开始 */
+    start_time = MPI_Wtime();
+
+    /* 解析命令行参数 */
+    memset(&reduce_codec, 0, sizeof(reduce_codec));
+    memset(&codec_stats, 0, sizeof(codec_stats));
+    while ((opt = getopt_long(argc, argv, "i:o:y:m:v:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'i':
+                strcpy(input_dir, optarg);
+                break;
+            case 'o':
+                strcpy(output_path, optarg);
+                break;
+            case 'y':
+                if (sscanf(optarg, "%d-%d", &year, &year_end) < 2) {
+                    year_end = year;
+                }
+                break;
+            case 'm':
+                num_months = parse_number_list(optarg, month_list, 12);
+                for (i = 0; i < num_months; i++) {
+                    months[i] = (int)month_list[i];
+                    if (months[i] < 1 || months[i] > 12) {
+                        num_months = -1;
+                        break;
+                    }
+                }
+                month = (num_months > 0) ? months[0] : 0;
+                break;
+            case 'v':
+                strcpy(var_string, optarg);
+                break;
+            case OPT_BBOX:
+                if (parse_number_list(optarg, bbox, 4) != 4 || bbox[0] > bbox[1]) {
+                    if (global_rank == 0) {
+                        fprintf(stderr, "Error: Invalid --bbox %s, expected lat0,lat1,lon0,lon1\n", optarg);
+                    }
+                    bad_arg = 1;
+                }
+                use_bbox = 1;
+                use_roi = 1;
+                break;
+            case OPT_YBOX:
+            case OPT_XBOX:
+                if (parse_number_list(optarg, range, 2) != 2 || range[0] < 0 || range[1] < range[0]) {
+                    if (global_rank == 0) {
+                        fprintf(stderr, "Error: Invalid index range %s, expected start,end\n", optarg);
+                    }
+                    bad_arg = 1;
+                    break;
+                }
+                j = (opt == OPT_YBOX) ? 0 : 2;
+                roi[j] = (MPI_Offset)range[0];
+                roi[j + 1] = (MPI_Offset)range[1] - roi[j] + 1;
+                use_roi = 1;
+                break;
+            case OPT_THREADS:
+                num_threads = atoi(optarg);
+                if (num_threads < 1 || num_threads > MAX_THREADS) {
+                    if (global_rank == 0) {
+                        fprintf(stderr, "Error: Invalid --threads %s, expected 1 to %d\n", optarg, MAX_THREADS);
+                    }
+                    bad_arg = 1;
+                }
+                break;
+            case OPT_AGGREGATORS:
+                node_aggregators = atoi(optarg);
+                if (node_aggregators < 1) {
+                    if (global_rank == 0) {
+                        fprintf(stderr, "Error: Invalid --aggregators %s\n", optarg);
+                    }
+                    bad_arg = 1;
+                }
+                break;
+            case OPT_SPLIT:
+                if (strcmp(optarg, "y") == 0) {
+                    split_y = 1;
+                } else if (strcmp(optarg, "time") != 0) {
+                    if (global_rank == 0) {
+                        fprintf(stderr, "Error: Invalid --split %s, expected time or y\n", optarg);
+                    }
+                    bad_arg = 1;
+                }
+                break;
+            case OPT_CHUNK_CACHE:
+                chunk_cache_mb = atof(optarg);
+                if (chunk_cache_mb <= 0.0) {
+                    if (global_rank == 0) {
+                        fprintf(stderr, "Error: Invalid --chunk-cache %s\n", optarg);
+                    }
+                    bad_arg = 1;
+                }
+                /* 按time划分时各进程的 chunk 互不重叠，缓存只对按y划分有意义 */
+                split_y = 1;
+                break;
+            case OPT_SIDECAR:
+                sidecar = 1;
+                break;
+            case OPT_COMBINE:
+                combine = 1;
+                break;
+            case OPT_CLIMATOLOGY:
+                climatology = 1;
+                break;
+            case OPT_QUANTILES:
+                num_quantiles = parse_number_list(optarg, quantiles, MAX_QUANTILES);
+                for (i = 0; i < num_quantiles; i++) {
+                    if (quantiles[i] <= 0.0 || quantiles[i] >= 100.0) {
+                        num_quantiles = -1;
+                        break;
+                    }
+                }
+                if (num_quantiles <= 0) {
+                    if (global_rank == 0) {
+                        fprintf(stderr, "Error: Invalid --quantiles %s, expected up to %d percentiles in (0, 100)\n",
+                                optarg, MAX_QUANTILES);
+                    }
+                    bad_arg = 1;
+                }
+                break;
+            case OPT_REGRID:
+                strcpy(regrid_file, optarg);
+                break;
+            case OPT_REGIONS:
+                strcpy(region_file, optarg);
+                if (strrchr(region_file, ':') != NULL) {
+                    char *colon = strrchr(region_file, ':');
+                    strncpy(region_var, colon + 1, NC_MAX_NAME);
+                    *colon = '\0';
+                }
+                break;
+            case OPT_EXPR:
+            case OPT_COUNT:
+                if (num_exprs == MAX_EXPRS || expr_compile(optarg, opt == OPT_COUNT, &exprs[num_exprs]) != 0) {
+                    if (global_rank == 0) {
+                        fprintf(stderr, "Error: Invalid or too many (max %d) --expr/--count %s\n", MAX_EXPRS, optarg);
+                    }
+                    bad_arg = 1;
+                    break;
+                }
+                num_exprs++;
+                break;
+            case OPT_INTERP:
+                interp_steps = atoi(optarg);
+                if (interp_steps < 1) {
+                    if (global_rank == 0) {
+                        fprintf(stderr, "Error: Invalid --interp %s\n", optarg);
+                    }
+                    bad_arg = 1;
+                }
+                break;
+            case OPT_INTERP_METHOD:
+                if (strcmp(optarg, "linear") == 0) {
+                    interp_method = INTERP_LINEAR;
+                } else if (strcmp(optarg, "coszen") == 0) {
+                    interp_method = INTERP_COSZEN;
+                } else {
+                    if (global_rank == 0) {
+                        fprintf(stderr, "Error: Invalid --interp-method %s, expected linear or coszen\n", optarg);
+                    }
+                    bad_arg = 1;
+                }
+                break;
+            case OPT_PROFILE:
+                strcpy(profile_file, optarg);
+                break;
+            case OPT_TRACE:
+                strcpy(trace_file, optarg);
+                break;
+            case OPT_COUNTERS:
+                counters = 1;
+                break;
+            case OPT_HINTS:
+                strcpy(hints_file, optarg);
+                break;
+            case OPT_ALIGN:
+                align = 1;
+                break;
+            case OPT_REDUCE_COMPRESS:
+                if (strcmp(optarg, "zstd") == 0) {
+                    reduce_codec.method = REDUCE_ZSTD;
+                } else if (strncmp(optarg, "sz:", 3) == 0 && atof(optarg + 3) > 0.0) {
+                    reduce_codec.method = REDUCE_SZ;
+                    reduce_codec.error_bound = atof(optarg + 3);
+                } else {
+                    if (global_rank == 0) {
+                        fprintf(stderr, "Error: Invalid --reduce-compress %s, expected zstd or sz:E with E > 0\n", optarg);
+                    }
+                    bad_arg = 1;
+                }
+                break;
+            case OPT_REDUCE_COMPARE:
+                reduce_codec.compare = 1;
+                break;
+            case OPT_HIST_BINS:
+                hist_bins = atoi(optarg);
+                if (hist_bins < 2) {
+                    if (global_rank == 0) {
+                        fprintf(stderr, "Error: Invalid --hist-bins %s\n", optarg);
+                    }
+                    bad_arg = 1;
+                }
+                break;
+            case OPT_HIST_RANGE:
+                if (parse_number_list(optarg, hist_range, 2) != 2 || hist_range[0] >= hist_range[1]) {
+                    if (global_rank == 0) {
+                        fprintf(stderr, "Error: Invalid --hist-range %s, expected lo,hi\n", optarg);
+                    }
+                    bad_arg = 1;
+                }
+                use_hist_range = 1;
+                break;
+            case 'h':
+                if (global_rank == 0) {
+                    show_usage(argv[0]);
+                }
+                MPI_Finalize();
+                return 0;
+            default:
+                if (global_rank == 0) {
+                    fprintf(stderr, "Unknown option: %c\n", opt);
+                    show_usage(argv[0]);
+                }
+                MPI_Finalize();
+                return 1;
+        }
+    }
+
+    /* 节点聚合读取只用于按time划分 */
+    if (node_aggregators > 0 && split_y) {
+        if (global_rank == 0) {
+            fprintf(stderr, "Error: --aggregators cannot be combined with --split y/--chunk-cache\n");
+        }
+        bad_arg = 1;
+    }
+
+    /* --bbox 与 --ybox/--xbox 不能同时使用 */
+    if (use_bbox && (roi[1] >= 0 || roi[3] >= 0)) {
+        if (global_rank == 0) {
+            fprintf(stderr, "Error: --bbox cannot be combined with --ybox/--xbox\n");
+        }
+        bad_arg = 1;
+    }
+
+    /* 按y划分时没有组内归约 */
+    if (reduce_codec.method != REDUCE_RAW && split_y) {
+        if (global_rank == 0) {
+            fprintf(stderr, "Error: --reduce-compress cannot be combined with --split y/--chunk-cache\n");
+        }
+        bad_arg = 1;
+    }
+
+    /* 离差平方和需要再遍历一次本进程读取的数据，只支持按time划分 */
+    if (sidecar && split_y) {
+        if (global_rank == 0) {
+            fprintf(stderr, "Error: --sidecar cannot be combined with --split y/--chunk-cache\n");
+        }
+        bad_arg = 1;
+    }
+
+    /* 重网格化只作用于月时间平均，输出在目标网格上；多年平均和距平、合并、统计量旁文件
+     * 和分位数都按源网格写出，没有对应的重网格化 */
+    if (regrid_file[0] != '\0' && (climatology || combine || sidecar || num_quantiles > 0)) {
+        if (global_rank == 0) {
+            fprintf(stderr, "Error: --regrid cannot be combined with --climatology/--combine/--sidecar/--quantiles\n");
+        }
+        bad_arg = 1;
+    }
+    /* 分区统计逐时间步处理本进程读取的平面，只支持按time划分 */
+    if (region_file[0] != '\0' && (split_y || climatology || combine)) {
+        if (global_rank == 0) {
+            fprintf(stderr, "Error: --regions cannot be combined with --split y/--chunk-cache/--climatology/--combine\n");
+        }
+        bad_arg = 1;
+    }
+    /* 时间插值不求平均，不能与其他统计模式同时使用 */
+    if (interp_steps > 0 && (climatology || combine || sidecar || num_quantiles > 0 ||
+                             regrid_file[0] != '\0' || region_file[0] != '\0')) {
+        if (global_rank == 0) {
+            fprintf(stderr, "Error: --interp cannot be combined with --climatology/--combine/--sidecar/--quantiles/--regrid/--regions\n");
+        }
+        bad_arg = 1;
+    }
+    if ((climatology || combine) && num_quantiles > 0) {
+        if (global_rank == 0) {
+            fprintf(stderr, "Error: --quantiles cannot be combined with --climatology/--combine\n");
+        }
+        bad_arg = 1;
+    }
+    /* 多年平均和距平需要每个进程保留自己读取的数据，只支持按time划分 */
+    if (climatology && (split_y || sidecar || combine)) {
+        if (global_rank == 0) {
+            fprintf(stderr, "Error: --climatology cannot be combined with --split y/--chunk-cache/--sidecar/--combine\n");
+        }
+        bad_arg = 1;
+    }
+
+    /* 合并模式默认合并全年12个月；否则只能指定一个月份，年份范围只用于合并和多年平均 */
+    if (combine && num_months == 0) {
+        for (i = 0; i < 12; i++) {
+            months[i] = i + 1;
+        }
+        num_months = 12;
+        month = 1;
+    }
+    if (num_months < 0 || (!combine && num_months > 1) || (!combine && !climatology && year_end != year) ||
+        year_end < year) {
+        if (global_rank == 0) {
+            fprintf(stderr, "Error: Invalid -y/-m, a year range needs --combine/--climatology and a month list --combine\n");
+        }
+        bad_arg = 1;
+    }
+
+    if (num_threads > 1 && !FORCING_PNETCDF_THREAD_SAFE) {
+        if (global_rank == 0) {
+            fprintf(stderr, "Error: --threads needs a PnetCDF built with --enable-thread-safe\n");
+        }
+        bad_arg = 1;
+    } else if (num_threads > 1 && thread_level < MPI_THREAD_MULTIPLE) {
+        if (global_rank == 0) {
+            printf("Warning: MPI does not provide MPI_THREAD_MULTIPLE, --threads ignored\n");
+        }
+        num_threads = 1;
+    }
+
+    /* 检查必要参数 */
+    if (bad_arg || input_dir[0] == '\0' || output_path[0] == '\0' ||
+        year < 0 || month < 1 || month > 12 || var_string[0] == '\0') {
+        if (global_rank == 0) {
+            fprintf(stderr, "Error: Missing required parameters\n");
+            show_usage(argv[0]);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    if (reduce_codec.method == REDUCE_SZ) {
+        SZ_Init(NULL);
+    }
+
+    /* 构建输出文件名 */
+    /* 检查输出路径是否以斜杠结尾 */
+    if (output_path[strlen(output_path) - 1] != '/') {
+        sprintf(output_file, "%s/forcing2d_average_%04d_%02d.nc", output_path, year, month);
+        sprintf(roi_cache_file, "%s/%s", output_path, ROI_CACHE_NAME);
+    } else {
+        sprintf(output_file, "%sforcing2d_average_%04d_%02d.nc", output_path, year, month);
+        sprintf(roi_cache_file, "%s%s", output_path, ROI_CACHE_NAME);
+    }
+    sprintf(stats_file, STATS_FILE_FORMAT, output_path, year, month);
+    if (climatology) {
+        sprintf(output_file, "%s/forcing2d_climatology_%04d-%04d_%02d.nc", output_path, year, year_end, month);
+    }
+
+    /* 解析变量列表 */
+    var_types = (char **)malloc(MAX_VAR_TYPES * sizeof(char *));
+    parse_variable_list(var_string, var_types, &num_var_types);
+
+    if (num_var_types == 0) {
+        if (global_rank == 0) {
+            fprintf(stderr, "Error: No valid variables specified\n");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    /* 派生变量按第一个输入变量查找文件，组内逐时间步读取所有输入并计算 */
+    const char *file_vars[MAX_VAR_TYPES];
+    int num_derived = 0;
+    for (i = 0; i < num_var_types; i++) {
+        const derived_var_t *derived = derived_var_lookup(var_types[i], exprs, num_exprs);
+        file_vars[i] = derived ? derived->inputs[0] : var_types[i];
+        num_derived += (derived != NULL);
+    }
+    if (num_derived > 0 && !combine &&
+        (split_y || node_aggregators > 0 || num_threads > 1 || interp_steps > 0 ||
+         (num_quantiles > 0 && !use_hist_range))) {
+        if (global_rank == 0) {
+            fprintf(stderr, "Error: Derived variables need the time split without --aggregators/--threads/--interp, "
+                            "and --quantiles needs an explicit --hist-range\n");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    if (global_rank == 0) {
+        printf("输入目录: %s\n", input_dir);
+        printf("输出文件: %s\n", output_file);
+        printf("年份: %d\n", year);
+        printf("月份: %d\n", month);
+        printf("变量列表 (%d个): ", num_var_types);
+        for (i = 0; i < num_var_types; i++) {
+            printf("%s%s", var_types[i], (i < num_var_types - 1) ? ", " : "\n");
+        }
+    }
+
+    /* 提示文件由所有进程一起读取，出错时所有进程一起退出 */
+    if (hints_file[0] != '\0' && hints_load(hints_file, &hints, MPI_COMM_WORLD) < 0) {
+        MPI_Finalize();
+        return 1;
+    }
+
+    /* 合并模式只读取统计量文件 */
+    if (combine) {
+        ret = combine_stats(input_dir, output_path, chunked, var_types, num_var_types, var_string,
+                            year, year_end, months, num_months, hints);
+        for (i = 0; i < num_var_types; i++) {
+            free(var_types[i]);
+        }
+        free(var_types);
+        MPI_Finalize();
+        return ret;
+    }
+
+    /* 分配文件列表内存 */
+    input_files = (char **)malloc(MAX_FILES * sizeof(char *));
+    for (i = 0; i < MAX_FILES; i++) {
+        input_files[i] = (char *)malloc(MAX_PATH_LEN * sizeof(char));
+    }
+
+    /* 查找匹配的文件，多年平均时按年份依次排列，每年的文件顺序与变量列表相同 */
+    int num_years = year_end - year + 1;
+    if (global_rank == 0) {
+        printf("开始查找匹配的文件...\n");
+        for (j = 0; j < num_years; j++) {
+            int found = 0;
+            ret = find_matching_files(input_dir, file_vars, num_var_types, year + j, month,
+                                      input_files + num_files, &found);
+            if (ret != 0 || found == 0 || (climatology && found != num_var_types)) {
+                printf("Error: No matching files found for %04d-%02d\n", year + j, month);
+                MPI_Abort(MPI_COMM_WORLD, -1);
+                return 1;
+            }
+            num_files += found;
+        }
+        printf("找到 %d 个匹配的文件\n", num_files);
+        for (i = 0; i < num_files; i++) {
+            printf("文件 %d: %s\n", i, input_files[i]);
+        }
+    }
+
+    /* 将文件数广播给所有进程 */
+    MPI_Bcast(&num_files, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    /* 将文件名广播给所有进程 */
+    for (i = 0; i < num_files; i++) {
+        MPI_Bcast(input_files[i], MAX_PATH_LEN, MPI_CHAR, 0, MPI_COMM_WORLD);
+    }
+
+    /* 经纬度范围只换算一次（所有文件共用同一网格），并缓存到输出目录 */
+    if (use_bbox) {
+        int cached = 0;
+        if (global_rank == 0) {
+            cached = (roi_cache_lookup(roi_cache_file, input_dir, bbox, roi) == 0);
+        }
+        MPI_Bcast(&cached, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        if (cached) {
+            MPI_Bcast(roi, 4, MPI_OFFSET, 0, MPI_COMM_WORLD);
+        } else {
+            if (resolve_bbox(input_files[0], bbox, roi, MPI_COMM_WORLD) != 0) {
+                if (global_rank == 0) {
+                    printf("Error: No grid cell falls inside the bbox\n");
+                }
+                MPI_Finalize();
+                return 1;
+            }
+            if (global_rank == 0) {
+                roi_cache_store(roi_cache_file, input_dir, bbox, roi);
+            }
+        }
+        if (global_rank == 0) {
+            printf("bbox 对应的下标范围%s: y [%lld, %lld], x [%lld, %lld]\n", cached ? "(缓存)" : "",
+                   roi[0], roi[0] + roi[1] - 1, roi[2], roi[2] + roi[3] - 1);
+        }
+    }
+
+    /* 检查进程数是否是文件数的倍数 */
+    if (global_size % num_files != 0) {
+        if (global_rank == 0) {
+            printf("Warning: Number of processes (%d) is not a multiple of the number of files (%d)\n", global_size, num_files);
+            printf("Some processes may remain idle\n");
+        }
+    }
+    /* 检查进程数是否大于文件数 */
+    if (global_size / num_files == 0) {
+        if (global_rank == 0) {
+            printf("Error: Number of processes (%d) is less than the number of files (%d)\n", global_size, num_files);
+            MPI_Finalize();
+            return 0;
+        }
+    }
+
+    /* 设置组数为文件数 */
+    num_groups = num_files;
+
+    /* 计算每组的进程数 */
+    procs_per_group = global_size / num_groups;
+
+    /* 确定当前进程属于哪个文件组和组内的序号 */
+    file_group = global_rank / procs_per_group;
+    proc_in_group = global_rank % procs_per_group;
+
+    /* 如果进程所属组超出了文件数，则该进程不参与计算 */
+    if (file_group >= num_files) {
+        MPI_Finalize();
+        return 0;
+    }
+
+    /* 创建当前进程组的通信域 */
+    MPI_Comm_split(MPI_COMM_WORLD, file_group, proc_in_group, &file_comm);
+
+    /* 创建MPI信息对象，v1 按 chunk 分块并用 SZ 压缩读写，--hints 中的提示优先 */
+    MPI_Info_create(&info);
+    if (chunked) {
+        MPI_Info_set(info, "nc_chunk_default_filter", "sz");
+        MPI_Info_set(info, "nc_chunking", "enable");
+    }
+    hints_apply(info, hints);
+
+    /* 第一阶段：读取输入文件 */
+    if (global_rank == 0) {
+        printf("开始读取输入文件...\n");
+    }
+
+    /* 开始读取计时 */
+    prof_init(trace_file[0] != '\0', counters, MPI_COMM_WORLD);
+    read_start = MPI_Wtime();
+
+    /* 打开当前组对应的输入文件 */
+    phase_start = prof_begin();
+    ret = ncmpi_open(file_comm, input_files[file_group], NC_NOWRITE, info, &ncid_in);
+    CHECK_ERR(ret);
+    prof_end(PHASE_OPEN, phase_start, 0);
+    phase_start = prof_begin();
+
+    /* 获取变量ID - 使用文件名中的变量类型名作为变量名，派生变量为其第一个输入 */
+    char var_name[NC_MAX_NAME+1];
+    const derived_var_t *derived = derived_var_lookup(var_types[file_group % num_var_types], exprs, num_exprs);
+    strcpy(var_name, file_vars[file_group % num_var_types]);
+    ret = ncmpi_inq_varid(ncid_in, var_name, &varid_in);
+    CHECK_ERR(ret);
+
+    /* 获取变量的类型和维度 */
+    ret = forcing_var_inq(ncid_in, varid_in, &var);
+    CHECK_ERR(ret);
+    /* 派生变量以 float 计算和累加，之后的归约与普通 float 变量相同 */
+    if (derived != NULL) {
+        var.type = var.acc_type = NC_FLOAT;
+        var.mpitype = var.acc_mpitype = MPI_FLOAT;
+        var.elem_size = var.acc_size = sizeof(float);
+    }
+    ndims = var.ndims;
+    dim_sizes_in = var.dim_sizes;
+    /* forcing2d_raw2chunk -z/-e 按步压缩的主变量只能按time划分整段读取后逐步解码（时间差分从关键帧开始） */
+    coded = codec_inq(&var, &codec_params);
+    if (coded && (split_y || num_threads > 1 || node_aggregators > 0 || derived != NULL || interp_steps > 0)) {
+        printf("Error: %s is stored by forcing2d_raw2chunk -z/-e, which needs the time split "
+               "without --threads/--aggregators/--interp or derived variables\n", input_files[file_group]);
+        MPI_Abort(MPI_COMM_WORLD, -1);
+        return 1;
+    }
+    /* 打包的主变量按打包类型读取，累加时才解包；其他统计直接使用读入的数据，不支持打包 */
+    packed = pack_inq(&var, &pack_params);
+    if (packed) {
+        var.acc_type = NC_FLOAT;
+        var.acc_mpitype = MPI_FLOAT;
+        var.acc_size = sizeof(float);
+    }
+    if (packed && (split_y || derived != NULL || interp_steps > 0 || num_quantiles > 0 || region_file[0] != '\0' ||
+                   sidecar || climatology)) {
+        printf("Error: %s is packed by forcing2d_raw2chunk -Q, which supports only the plain time mean "
+               "(no --split y, --interp, --quantiles, --regions, --sidecar, --climatology, --expr or --count)\n",
+               input_files[file_group]);
+        MPI_Abort(MPI_COMM_WORLD, -1);
+        return 1;
+    }
+    /* 直方图的取值范围：命令行优先，否则取变量的有效范围属性 */
+    if (num_quantiles > 0 && !use_hist_range) {
+        if (ncmpi_get_att_double(ncid_in, varid_in, "valid_range", hist_range) != NC_NOERR &&
+            (ncmpi_get_att_double(ncid_in, varid_in, "valid_min", &hist_range[0]) != NC_NOERR ||
+             ncmpi_get_att_double(ncid_in, varid_in, "valid_max", &hist_range[1]) != NC_NOERR)) {
+            printf("Error: %s has no valid_range/valid_min/valid_max, use --hist-range\n", var_name);
+            MPI_Abort(MPI_COMM_WORLD, -1);
+            return 1;
+        }
+    }
+    if (num_quantiles > 0 && var.dim_sizes[0] > 65535) {
+        printf("Error: --quantiles counts at most 65535 time steps per cell\n");
+        MPI_Abort(MPI_COMM_WORLD, -1);
+        return 1;
+    }
+    if (sum_kernel(var.type) == NULL) {
+        printf("Error: Variable %s has non-numeric type %d\n", var_name, var.type);
+        MPI_Abort(MPI_COMM_WORLD, -1);
+        return 1;
+    }
+
+    /* 二维变量且带有格点索引变量时，按陆地格点压缩格式 (time, gridcell) 读取 */
+    int gridcell_layout = 0;
+    int varid_gridcell_y, varid_gridcell_x;
+    if (ndims == 2 &&
+        ncmpi_inq_varid(ncid_in, GRIDCELL_Y_NAME, &varid_gridcell_y) == NC_NOERR &&
+        ncmpi_inq_varid(ncid_in, GRIDCELL_X_NAME, &varid_gridcell_x) == NC_NOERR) {
+        gridcell_layout = 1;
+    } else if (ndims != 3) {
+        printf("Error: Expected 3 dimensions (time, y, x) or 2 dimensions (time, gridcell) but found %d dimensions\n", ndims);
+        MPI_Abort(MPI_COMM_WORLD, -1);
+        return 1;
+    }
+
+    /* 输出维度名：v0 沿用输入文件的维度名，v1 使用固定的名字 */
+    char dim_names[3][NC_MAX_NAME+1];
+    if (chunked) {
+        strcpy(dim_names[0], "time");
+        strcpy(dim_names[1], gridcell_layout ? GRIDCELL_DIM_NAME : "y");
+        strcpy(dim_names[2], "x");
+    } else {
+        for (i = 0; i < ndims; i++) {
+            ret = ncmpi_inq_dimname(ncid_in, var.dimids[i], dim_names[i]);
+            CHECK_ERR(ret);
+        }
+    }
+
+    /* 重网格化：组内各进程读取一段权重，源网格必须是完整的输入网格 */
+    if (regrid_file[0] != '\0') {
+        if (gridcell_layout) {
+            printf("Error: --regrid requires (time, y, x) input\n");
+            MPI_Abort(MPI_COMM_WORLD, -1);
+            return 1;
+        }
+        ret = regrid_weights_read(regrid_file, file_comm, &weights);
+        if (ret != 0) return ret;
+        if (weights.src_dims[0] != dim_sizes_in[2] || weights.src_dims[1] != dim_sizes_in[1] ||
+            weights.n_b != (MPI_Offset)weights.dst_dims[0] * weights.dst_dims[1]) {
+            printf("Error: Weights in %s are for a %d x %d source grid, input is %lld x %lld\n", regrid_file,
+                   weights.src_dims[1], weights.src_dims[0], dim_sizes_in[1], dim_sizes_in[2]);
+            MPI_Abort(MPI_COMM_WORLD, -1);
+            return 1;
+        }
+    }
+
+    /* 确定读取的 y/x 范围，默认整个平面 */
+    if (use_roi && gridcell_layout) {
+        printf("Error: --bbox/--ybox/--xbox require (time, y, x) input\n");
+        MPI_Abort(MPI_COMM_WORLD, -1);
+        return 1;
+    }
+    if (!gridcell_layout) {
+        if (roi[1] < 0) {
+            roi[0] = 0;
+            roi[1] = dim_sizes_in[1];
+        }
+        if (roi[3] < 0) {
+            roi[2] = 0;
+            roi[3] = dim_sizes_in[2];
+        }
+        if (roi[0] + roi[1] > dim_sizes_in[1] || roi[2] + roi[3] > dim_sizes_in[2]) {
+            printf("Error: Region y [%lld, %lld], x [%lld, %lld] exceeds the %lld x %lld grid\n",
+                   roi[0], roi[0] + roi[1] - 1, roi[2], roi[2] + roi[3] - 1, dim_sizes_in[1], dim_sizes_in[2]);
+            MPI_Abort(MPI_COMM_WORLD, -1);
+            return 1;
+        }
+    }
+
+    /* 分区变量与输入在同一网格上，每个进程读取整个感兴趣区域 */
+    if (region_file[0] != '\0') {
+        if (gridcell_layout) {
+            printf("Error: --regions requires (time, y, x) input\n");
+            MPI_Abort(MPI_COMM_WORLD, -1);
+            return 1;
+        }
+        region_mask = (int *)malloc((roi[1] * roi[3] + 1) * sizeof(int));
+        if (region_mask == NULL) {
+            printf("Error: Memory allocation failed for region_mask\n");
+            MPI_Abort(MPI_COMM_WORLD, -1);
+            return 1;
+        }
+        ret = region_mask_read(region_file, region_var, file_comm, roi, region_mask, &nregions);
+        if (ret != 0) return ret;
+        if (nregions == 0) {
+            printf("Error: Region mask %s in %s has no non-negative region id\n", region_var, region_file);
+            MPI_Abort(MPI_COMM_WORLD, -1);
+            return 1;
+        }
+    }
+
+    /* 计算空间维度大小（y * x，压缩格式下为陆地格点数）*/
+    MPI_Offset spatial_size = gridcell_layout ? dim_sizes_in[1] : roi[1] * roi[3];
+    MPI_Offset time_steps = dim_sizes_in[0]; // time dimension size
+    MPI_Offset avg_steps = time_steps;       // 平均所用的总时间步数
+
+    /* 设置读取起始位置和计数 - 在time维度上分割，--align 时边界对齐 chunk 和条带 */
+    MPI_Offset my_time_start, my_time_count;
+    if (align) {
+        split_layout_inq(&var, 0, hints, &time_layout);
+        split_layout_inq(&var, 1, hints, &band_layout);
+    }
+    if (split_plan(time_steps, procs_per_group, align ? &time_layout : NULL, &time_plan) != 0) {
+        printf("Error: Memory allocation failed for time_plan\n");
+        MPI_Abort(MPI_COMM_WORLD, -1);
+        return 1;
+    }
+    split_plan_part(&time_plan, proc_in_group, &my_time_start, &my_time_count);
+
+    /* 分配读取起始位置和计数数组，压缩格式下 x 视为1 */
+    MPI_Offset start[3] = {my_time_start, 0, 0};
+    MPI_Offset count[3] = {my_time_count, dim_sizes_in[1], 1};
+    /* 只读取感兴趣区域的y和x范围（压缩格式下为全部格点）*/
+    if (!gridcell_layout) {
+        start[1] = roi[0];
+        count[1] = roi[1];
+        start[2] = roi[2];
+        count[2] = roi[3];
+    }
+
+    /* 按y划分：本进程负责的行与写出阶段的划分相同。只有按y读取（--split y、--interp）时才按布局对齐；
+     * 按time划分时直方图归约和写出都按 split_range 取行，行的划分必须与之一致 */
+    MPI_Offset band_rows = gridcell_layout ? dim_sizes_in[1] : roi[1];
+    MPI_Offset band_cols = gridcell_layout ? 1 : roi[3];
+    MPI_Offset my_band_start, my_band_count;
+    int align_band = align && (split_y || interp_steps > 0);
+    if (split_plan(band_rows, procs_per_group, align_band ? &band_layout : NULL, &band_plan) != 0) {
+        printf("Error: Memory allocation failed for band_plan\n");
+        MPI_Abort(MPI_COMM_WORLD, -1);
+        return 1;
+    }
+    split_plan_part(&band_plan, proc_in_group, &my_band_start, &my_band_count);
+    if (align && global_rank == 0) {
+        if (split_y || interp_steps > 0) {
+            split_plan_report(&band_plan, &band_layout, "y");
+        } else {
+            split_plan_report(&time_plan, &time_layout, "time");
+        }
+    }
+    void *band_avg = NULL;
+    prof_end(PHASE_HEADER, phase_start, 0);
+
+    /* 时间插值：组内按y划分，每个进程只保留自己行的两个时间平面，逐子步写出后结束 */
+    if (interp_steps > 0) {
+        static const int month_days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+        output_grid_t igrid;
+        interp_spec_t spec;
+        char interp_file[MAX_PATH_LEN];
+        int varid_lat, varid_lon;
+        double *lat = NULL, *lon = NULL;
+        int has_latlon = !gridcell_layout &&
+                         ncmpi_inq_varid(ncid_in, "LATIXY", &varid_lat) == NC_NOERR &&
+                         ncmpi_inq_varid(ncid_in, "LONGXY", &varid_lon) == NC_NOERR;
+
+        if (interp_method == INTERP_COSZEN && !has_latlon) {
+            printf("Error: --interp-method coszen needs LATIXY/LONGXY on a (time, y, x) grid in %s\n",
+                   input_files[file_group]);
+            MPI_Abort(MPI_COMM_WORLD, -1);
+            return 1;
+        }
+
+        memset(&igrid, 0, sizeof(igrid));
+        igrid.gridcell_layout = gridcell_layout;
+        memcpy(igrid.dim_names, dim_names, sizeof(dim_names));
+        igrid.ny = band_rows;
+        igrid.nx = band_cols;
+        igrid.use_roi = use_roi;
+        igrid.use_bbox = use_bbox;
+        memcpy(igrid.roi, roi, sizeof(roi));
+        memcpy(igrid.bbox, bbox, sizeof(bbox));
+        if (gridcell_layout) {
+            ret = ncmpi_get_att_int(ncid_in, NC_GLOBAL, "gridcell_ny", &igrid.raster_shape[0]);
+            CHECK_ERR(ret);
+            ret = ncmpi_get_att_int(ncid_in, NC_GLOBAL, "gridcell_nx", &igrid.raster_shape[1]);
+            CHECK_ERR(ret);
+            igrid.index_start = my_band_start;
+            igrid.index_count = my_band_count;
+            igrid.gridcell_y = (int *)malloc((my_band_count + 1) * sizeof(int));
+            igrid.gridcell_x = (int *)malloc((my_band_count + 1) * sizeof(int));
+            ret = ncmpi_get_vara_int_all(ncid_in, varid_gridcell_y, &igrid.index_start, &igrid.index_count,
+                                         igrid.gridcell_y);
+            CHECK_ERR(ret);
+            ret = ncmpi_get_vara_int_all(ncid_in, varid_gridcell_x, &igrid.index_start, &igrid.index_count,
+                                         igrid.gridcell_x);
+            CHECK_ERR(ret);
+        }
+        /* 天顶角需要本进程各格点的经纬度；子区域的输出同样带上经纬度 */
+        if (has_latlon && (interp_method == INTERP_COSZEN || use_roi)) {
+            MPI_Offset ll_start[2] = {roi[0] + my_band_start, roi[2]};
+            MPI_Offset ll_count[2] = {my_band_count, roi[3]};
+            lat = (double *)malloc((my_band_count * roi[3] + 1) * sizeof(double));
+            lon = (double *)malloc((my_band_count * roi[3] + 1) * sizeof(double));
+            ret = ncmpi_get_vara_double_all(ncid_in, varid_lat, ll_start, ll_count, lat);
+            CHECK_ERR(ret);
+            ret = ncmpi_get_vara_double_all(ncid_in, varid_lon, ll_start, ll_count, lon);
+            CHECK_ERR(ret);
+            if (use_roi) {
+                igrid.has_coords = 1;
+                igrid.coord_types[0] = igrid.coord_types[1] = NC_DOUBLE;
+                igrid.coord_start[0] = my_band_start;
+                igrid.coord_count[0] = my_band_count;
+                igrid.coord_count[1] = roi[3];
+                igrid.coord_lat = lat;
+                igrid.coord_lon = lon;
+            }
+        }
+
+        /* 时间轴按 Daymet 的365天历，输入均匀覆盖整个月 */
+        memset(&spec, 0, sizeof(spec));
+        spec.file = input_files[file_group];
+        spec.var_name = var_name;
+        spec.info = info;
+        spec.nt = time_steps;
+        spec.ndims = ndims;
+        spec.start[1] = (gridcell_layout ? 0 : roi[0]) + my_band_start;
+        spec.start[2] = gridcell_layout ? 0 : roi[2];
+        spec.count[1] = my_band_count;
+        spec.count[2] = band_cols;
+        spec.nsub = interp_steps;
+        spec.method = interp_method;
+        spec.lat = lat;
+        spec.lon = lon;
+        for (i = 0; i < month - 1; i++) {
+            spec.day0 += month_days[i];
+        }
+        spec.step_days = (double)month_days[month - 1] / time_steps;
+        /* 预读线程与回调中的集合写同时调用 PnetCDF */
+        spec.prefetch = (thread_level >= MPI_THREAD_MULTIPLE && var_thread_safe(&var));
+
+        ret = ncmpi_close(ncid_in);
+        CHECK_ERR(ret);
+        sprintf(interp_file, "%s/forcing2d_interp_%s_%04d_%02d.nc", output_path, var_name, year, month);
+        read_start = MPI_Wtime();
+        phase_start = prof_begin();
+        ret = write_interp_file(interp_file, file_comm, info, chunked, &igrid, &spec, my_band_start, my_band_count);
+        if (ret != 0) return ret;
+        /* 读取、插值与写出交织在一起，整体计入写出 */
+        prof_end(PHASE_WRITE, phase_start, time_steps * interp_steps * my_band_count * band_cols * sizeof(float));
+        total_time = max_time(MPI_Wtime() - read_start, MPI_COMM_WORLD);
+        if (global_rank == 0) {
+            printf("插值文件: %s/forcing2d_interp_VAR_%04d_%02d.nc (每步 %d 个子步, %s%s)\n", output_path, year, month,
+                   interp_steps, interp_method == INTERP_COSZEN ? "coszen" : "linear",
+                   spec.prefetch ? ", 预读" : "");
+            printf("总插值时间: %.4f 秒\n", total_time);
+        }
+        prof_report(chunked ? "forcing2d_average_v1" : "forcing2d_average_v0",
+                    profile_file[0] != '\0' ? profile_file : NULL, trace_file[0] != '\0' ? trace_file : NULL,
+                    MPI_COMM_WORLD);
+        if (lat != igrid.coord_lat) {
+            free(lat);
+            free(lon);
+        }
+        free_output_grid(&igrid);
+        split_plan_free(&time_plan);
+        split_plan_free(&band_plan);
+        MPI_Info_free(&info);
+        MPI_Comm_free(&file_comm);
+        MPI_Finalize();
+        return 0;
+    }
+
+    /* 直方图覆盖本进程写出的行，按y划分时边读边统计 */
+    if (num_quantiles > 0 &&
+        pixel_hist_init(&hist, my_band_count * band_cols, hist_bins, hist_range[0], hist_range[1]) != 0) {
+        printf("Error: Memory allocation failed for the %d-bin histograms\n", hist_bins);
+        MPI_Abort(MPI_COMM_WORLD, -1);
+        return 1;
+    }
+
+    if (split_y) {
+        band_avg = calloc(my_band_count * band_cols + 1, var.acc_size);
+        if (band_avg == NULL) {
+            printf("Error: Memory allocation failed for band_avg\n");
+            MPI_Abort(MPI_COMM_WORLD, -1);
+            return 1;
+        }
+        if (chunk_cache_mb > 0.0) {
+            /* 所有文件共用一个节点缓存，槽大小取最大的 chunk */
+            MPI_Offset chunk_shape[3], slot_bytes;
+            inq_chunk_shape(&var, chunk_shape);
+            slot_bytes = chunk_shape[0] * chunk_shape[1] * chunk_shape[2] * var.elem_size;
+            MPI_Allreduce(MPI_IN_PLACE, &slot_bytes, 1, MPI_OFFSET, MPI_MAX, MPI_COMM_WORLD);
+            if (chunk_cache_init(&chunk_cache, slot_bytes, chunk_cache_mb) != 0) {
+                if (global_rank == 0) {
+                    printf("Warning: --chunk-cache %.1f MB cannot hold one %.1f MB chunk, cache disabled\n",
+                           chunk_cache_mb, slot_bytes / 1048576.0);
+                }
+                chunk_cache_mb = 0.0;
+            }
+        }
+        phase_start = prof_begin();
+        hwc_begin(&hwc_mark);
+        read_band_sum(&var, file_group, (gridcell_layout ? 0 : roi[0]) + my_band_start, my_band_count,
+                      gridcell_layout ? 0 : roi[2], band_cols,
+                      proc_in_group, procs_per_group, chunk_cache_mb > 0.0 ? &chunk_cache : NULL, band_avg,
+                      num_quantiles > 0 ? &hist : NULL);
+        /* 读取与累加融合，整体计入读取 */
+        hwc_end(HWC_DECOMPRESS, &hwc_mark, time_steps * my_band_count * band_cols * var.elem_size,
+                time_steps * my_band_count * band_cols);
+        prof_end(PHASE_READ, phase_start, time_steps * my_band_count * band_cols * var.elem_size);
+    } else {
+        /* 分配内存用于读取数据 */
+        MPI_Offset local_elements = my_time_count * spatial_size;
+        phase_start = prof_begin();
+        hwc_begin(&hwc_mark);
+        if (node_aggregators > 0) {
+            /* 由节点聚合进程读取（解压）到共享内存 */
+            buffer = node_aggregated_read(&node_reader, node_aggregators, input_files, file_vars, num_var_types,
+                                          info, file_group, &var, start, count, local_elements);
+        } else {
+            buffer = alloc_typed(var.type, local_elements);
+            if (buffer == NULL) {
+                printf("Error: Memory allocation failed for buffer\n");
+                MPI_Abort(MPI_COMM_WORLD, -1);
+                return 1;
+            }
+            /* 读取数据 */
+            if (derived != NULL) {
+                MPI_Offset max_count = split_plan_max(&time_plan);
+                ret = read_derived(derived, &var, input_files[file_group], year + file_group / num_var_types, month,
+                                   file_comm, info, start, count, max_count, (float *)buffer);
+                if (ret != 0) {
+                    MPI_Abort(MPI_COMM_WORLD, -1);
+                    return 1;
+                }
+            } else if (num_threads > 1) {
+                if (threaded_read(input_files[file_group], var_name, info, num_threads, &var,
+                                  start, count, buffer, thread_time, thread_items) != 0) {
+                    MPI_Abort(MPI_COMM_WORLD, -1);
+                    return 1;
+                }
+            } else if (coded) {
+                ret = codec_var_get(&var, &codec_params, start, count, buffer, &codec_stats);
+                CHECK_ERR(ret);
+            } else {
+                ret = forcing_var_get(&var, start, count, buffer);
+                CHECK_ERR(ret);
+            }
+        }
+        hwc_end(HWC_DECOMPRESS, &hwc_mark, local_elements * var.elem_size, 0);
+        /* 多线程读取时解压在各线程中完成，整体计入解压 */
+        prof_end(num_threads > 1 && node_aggregators == 0 && derived == NULL ? PHASE_DECOMPRESS : PHASE_READ,
+                 phase_start, local_elements * var.elem_size);
+    }
+
+    /* 输出变量数与本组负责写出的变量：多年平均时每个变量只由第一年的组写出 */
+    int num_out_vars = climatology ? num_var_types : num_files;
+    int out_var = (file_group < num_out_vars) ? file_group : -1;
+    int year_index = file_group / num_out_vars;
+
+    /* 输出网格描述，由第0组（多年平均时为每年的第一个变量的组）填写 */
+    output_grid_t grid;
+    memset(&grid, 0, sizeof(grid));
+    grid.coord_types[0] = grid.coord_types[1] = NC_DOUBLE;
+    phase_start = prof_begin();
+
+    /* 压缩格式：第0组读取栅格形状和本进程写出范围内的格点索引，随结果一并写出 */
+    if (gridcell_layout && file_group % num_out_vars == 0) {
+        ret = ncmpi_get_att_int(ncid_in, NC_GLOBAL, "gridcell_ny", &grid.raster_shape[0]);
+        CHECK_ERR(ret);
+        ret = ncmpi_get_att_int(ncid_in, NC_GLOBAL, "gridcell_nx", &grid.raster_shape[1]);
+        CHECK_ERR(ret);
+
+        /* 与写出阶段相同的划分方式 */
+        split_range(spatial_size, procs_per_group, proc_in_group, &grid.index_start, &grid.index_count);
+
+        grid.gridcell_y = (int *)malloc((grid.index_count + 1) * sizeof(int));
+        grid.gridcell_x = (int *)malloc((grid.index_count + 1) * sizeof(int));
+        ret = ncmpi_get_vara_int_all(ncid_in, varid_gridcell_y, &grid.index_start, &grid.index_count, grid.gridcell_y);
+        CHECK_ERR(ret);
+        ret = ncmpi_get_vara_int_all(ncid_in, varid_gridcell_x, &grid.index_start, &grid.index_count, grid.gridcell_x);
+        CHECK_ERR(ret);
+    }
+
+    /* 子区域：第0组读取本进程写出行对应的 LATIXY/LONGXY，使输出带有地理坐标 */
+    if (use_roi && file_group % num_out_vars == 0) {
+        int varid_lat, varid_lon;
+        if (ncmpi_inq_varid(ncid_in, "LATIXY", &varid_lat) == NC_NOERR &&
+            ncmpi_inq_varid(ncid_in, "LONGXY", &varid_lon) == NC_NOERR) {
+            grid.has_coords = 1;
+            ret = ncmpi_inq_vartype(ncid_in, varid_lat, &grid.coord_types[0]);
+            CHECK_ERR(ret);
+            ret = ncmpi_inq_vartype(ncid_in, varid_lon, &grid.coord_types[1]);
+            CHECK_ERR(ret);
+
+            /* 与写出阶段相同的按y划分方式 */
+            split_range(roi[1], procs_per_group, proc_in_group, &grid.coord_start[0], &grid.coord_count[0]);
+            grid.coord_count[1] = roi[3];
+
+            MPI_Offset in_start[2] = {roi[0] + grid.coord_start[0], roi[2]};
+            grid.coord_lat = (double *)malloc((grid.coord_count[0] * grid.coord_count[1] + 1) * sizeof(double));
+            grid.coord_lon = (double *)malloc((grid.coord_count[0] * grid.coord_count[1] + 1) * sizeof(double));
+            ret = ncmpi_get_vara_double_all(ncid_in, varid_lat, in_start, grid.coord_count, grid.coord_lat);
+            CHECK_ERR(ret);
+            ret = ncmpi_get_vara_double_all(ncid_in, varid_lon, in_start, grid.coord_count, grid.coord_lon);
+            CHECK_ERR(ret);
+        }
+    }
+
+    prof_end(PHASE_HEADER, phase_start, 0);
+
+    /* 关闭输入文件 */
+    phase_start = prof_begin();
+    ret = ncmpi_close(ncid_in);
+    CHECK_ERR(ret);
+    prof_end(PHASE_CLOSE, phase_start, 0);
+
+    /* 结束读取计时，收集所有进程的读取时间，取最大值 */
+    read_time = MPI_Wtime() - read_start;
+    total_read_time = max_time(read_time, MPI_COMM_WORLD);
+
+    /* 开始计算计时 */
+    compute_start = MPI_Wtime();
+
+    if (split_y) {
+        /* 按y划分时各进程的行互不重叠，累加结果即为完整的时间和 */
+        phase_start = prof_begin();
+        hwc_begin(&hwc_mark);
+        scale_values(var.acc_type, band_avg, my_band_count * band_cols, 1.0 / time_steps);
+        hwc_end(HWC_NORMALIZE, &hwc_mark, 2 * my_band_count * band_cols * var.acc_size, my_band_count * band_cols);
+        prof_end(PHASE_ACCUMULATE, phase_start, 0);
+    } else {
+        /* 按输入类型的内核计算本地时间和 */
+        local_sum = calloc(spatial_size + 1, var.acc_size);
+        if (local_sum == NULL) {
+            printf("Error: Memory allocation failed for local_sum\n");
+            MPI_Abort(MPI_COMM_WORLD, -1);
+            return 1;
+        }
+        phase_start = prof_begin();
+        hwc_begin(&hwc_mark);
+        if (packed) {
+            unpack_sum_planes(&pack_params, buffer, my_time_count, spatial_size, (float *)local_sum);
+        } else {
+            sum_planes(&var, buffer, my_time_count, spatial_size, local_sum);
+        }
+        hwc_end(HWC_ACCUMULATE, &hwc_mark, my_time_count * spatial_size * var.elem_size, my_time_count * spatial_size);
+        prof_end(PHASE_ACCUMULATE, phase_start, 0);
+
+        /* 按time划分时各进程的直方图需要归约到写出该行的进程 */
+        if (num_quantiles > 0 &&
+            reduce_time_split_hist(&var, buffer, my_time_count, band_rows, band_cols, file_comm, &hist) != 0) {
+            printf("Error: Memory allocation failed for the %d-bin histograms\n", hist_bins);
+            MPI_Abort(MPI_COMM_WORLD, -1);
+            return 1;
+        }
+
+        /* 分区统计：每个平面按分区编号一遍归约，各进程只填写自己的时间步，
+         * 其余时间步保持 count = 0，组内归约后在0号进程上得到完整的 (time, region) 数组 */
+        if (region_file[0] != '\0') {
+            MPI_Offset nr = time_steps * nregions;
+            region_sum = (double *)calloc(nr + 1, sizeof(double));
+            region_min = (double *)calloc(nr + 1, sizeof(double));
+            region_max = (double *)calloc(nr + 1, sizeof(double));
+            region_count = (long long *)calloc(nr + 1, sizeof(long long));
+            if (region_sum == NULL || region_min == NULL || region_max == NULL || region_count == NULL) {
+                printf("Error: Memory allocation failed for region statistics\n");
+                MPI_Abort(MPI_COMM_WORLD, -1);
+                return 1;
+            }
+            for (MPI_Offset t = 0; t < my_time_count; t++) {
+                MPI_Offset k = (my_time_start + t) * nregions;
+                region_reduce_plane(&var, (const char *)buffer + t * spatial_size * var.elem_size, region_mask,
+                                    spatial_size, nregions, region_sum + k, region_min + k, region_max + k,
+                                    region_count + k);
+            }
+            free(region_mask);
+            region_mask = NULL;
+
+            /* 时间步互不重叠，min/max 也可以按求和归约 */
+            int root = (proc_in_group == 0);
+            phase_start = prof_begin();
+            MPI_Reduce(root ? MPI_IN_PLACE : region_sum, region_sum, nr, MPI_DOUBLE, MPI_SUM, 0, file_comm);
+            MPI_Reduce(root ? MPI_IN_PLACE : region_min, region_min, nr, MPI_DOUBLE, MPI_SUM, 0, file_comm);
+            MPI_Reduce(root ? MPI_IN_PLACE : region_max, region_max, nr, MPI_DOUBLE, MPI_SUM, 0, file_comm);
+            MPI_Reduce(root ? MPI_IN_PLACE : region_count, region_count, nr, MPI_LONG_LONG, MPI_SUM, 0, file_comm);
+            prof_end(PHASE_REDUCE, phase_start, nr * (3 * sizeof(double) + sizeof(long long)));
+            if (root) {
+                for (MPI_Offset k = 0; k < nr; k++) {
+                    if (region_count[k] > 0) {
+                        region_sum[k] /= region_count[k];
+                    } else {
+                        region_sum[k] = region_min[k] = region_max[k] = NC_FILL_DOUBLE;
+                    }
+                }
+            }
+        }
+
+        /* 分配全局平均值缓冲区 */
+        global_avg = malloc((spatial_size + 1) * var.acc_size);
+        if (global_avg == NULL) {
+            printf("Error: Memory allocation failed for global_avg\n");
+            MPI_Abort(MPI_COMM_WORLD, -1);
+            return 1;
+        }
+
+        /* 组内求和后除以总时间步数；多年平均时对同一变量所有年份的组求和 */
+        MPI_Comm reduce_comm = file_comm;
+        phase_start = prof_begin();
+        if (climatology) {
+            MPI_Offset my_steps = (proc_in_group == 0) ? time_steps : 0;
+            MPI_Comm_split(MPI_COMM_WORLD, file_group % num_out_vars, global_rank, &reduce_comm);
+            MPI_Allreduce(&my_steps, &avg_steps, 1, MPI_OFFSET, MPI_SUM, reduce_comm);
+        }
+        if (group_allreduce(&reduce_codec, local_sum, global_avg, spatial_size, var.acc_type, avg_steps,
+                            reduce_comm) != 0) {
+            MPI_Abort(MPI_COMM_WORLD, -1);
+            return 1;
+        }
+        if (climatology) {
+            MPI_Comm_free(&reduce_comm);
+        }
+        prof_end(PHASE_REDUCE, phase_start, spatial_size * var.acc_size);
+
+        /* 逐月统计量：先由组内时间和得到均值，再遍历本进程的数据求离差平方和（二遍法） */
+        if (sidecar) {
+            stat_sum = (double *)malloc((spatial_size + 1) * sizeof(double));
+            stat_m2 = (double *)malloc((spatial_size + 1) * sizeof(double));
+            double *stat_mean = (double *)malloc((spatial_size + 1) * sizeof(double));
+            double *local_m2 = (double *)calloc(spatial_size + 1, sizeof(double));
+            if (stat_sum == NULL || stat_m2 == NULL || stat_mean == NULL || local_m2 == NULL) {
+                printf("Error: Memory allocation failed for sidecar statistics\n");
+                MPI_Abort(MPI_COMM_WORLD, -1);
+                return 1;
+            }
+            to_double(var.acc_type, global_avg, spatial_size, stat_sum);
+            for (MPI_Offset k = 0; k < spatial_size; k++) {
+                stat_mean[k] = stat_sum[k] / time_steps;
+            }
+            phase_start = prof_begin();
+            sum_sq_dev_planes(&var, buffer, my_time_count, spatial_size, stat_mean, local_m2);
+            prof_end(PHASE_ACCUMULATE, phase_start, 0);
+            phase_start = prof_begin();
+            MPI_Allreduce(local_m2, stat_m2, spatial_size, MPI_DOUBLE, MPI_SUM, file_comm);
+            prof_end(PHASE_REDUCE, phase_start, spatial_size * sizeof(double));
+            free(stat_mean);
+            free(local_m2);
+        }
+
+        /* 释放原始数据缓冲区，不再需要；多年平均时留到写出距平之后 */
+        if (!climatology) {
+            if (node_aggregators > 0) {
+                node_reader_finalize(&node_reader);
+            } else {
+                free(buffer);
+            }
+        }
+
+        /* --count 的表达式输出时间和 */
+        if (derived == NULL || !derived->total) {
+            hwc_begin(&hwc_mark);
+            scale_values(var.acc_type, global_avg, spatial_size, 1.0 / avg_steps);
+            hwc_end(HWC_NORMALIZE, &hwc_mark, 2 * spatial_size * var.acc_size, spatial_size);
+        } else {
+            restore_sum_fill(var.acc_type, global_avg, spatial_size, avg_steps, var.fill);
+        }
+    }
+
+    /* 重网格化：组内每个进程都需要完整的源网格平均值，按y划分时先在组内收集 */
+    if (regrid_file[0] != '\0') {
+        void *full_avg = global_avg;
+        if (split_y) {
+            int *recvcounts = (int *)malloc(procs_per_group * sizeof(int));
+            int *displs = (int *)malloc(procs_per_group * sizeof(int));
+            for (i = 0; i < procs_per_group; i++) {
+                MPI_Offset s0, c0;
+                split_plan_part(&band_plan, i, &s0, &c0);
+                recvcounts[i] = (int)(c0 * band_cols);
+                displs[i] = (int)(s0 * band_cols);
+            }
+            full_avg = malloc((spatial_size + 1) * var.acc_size);
+            MPI_Allgatherv(band_avg, recvcounts[proc_in_group], var.acc_mpitype,
+                           full_avg, recvcounts, displs, var.acc_mpitype, file_comm);
+            free(recvcounts);
+            free(displs);
+            free(band_avg);
+            band_avg = NULL;
+        }
+        double *src = (double *)malloc((spatial_size + 1) * sizeof(double));
+        MPI_Offset dst_start, dst_count;
+        to_double(var.acc_type, full_avg, spatial_size, src);
+        if (full_avg != global_avg) {
+            free(full_avg);
+        }
+        split_range(weights.dst_dims[1], procs_per_group, proc_in_group, &dst_start, &dst_count);
+        regrid_out = (double *)malloc((dst_count * weights.dst_dims[0] + 1) * sizeof(double));
+        regrid_apply(&weights, src, roi, var.fill, file_comm, regrid_out);
+        free(src);
+    }
+
+    /* 由直方图得到本进程写出行的各分位数 */
+    if (num_quantiles > 0) {
+        MPI_Offset ncells = my_band_count * band_cols;
+        quantile_out = malloc((num_quantiles * ncells + 1) * var.acc_size);
+        for (i = 0; i < num_quantiles; i++) {
+            pixel_hist_quantile(&hist, quantiles[i] / 100.0, var.acc_type,
+                                (char *)quantile_out + i * ncells * var.acc_size);
+        }
+        pixel_hist_free(&hist);
+    }
+
+    /* 结束计算计时，收集所有进程的计算时间，取最大值 */
+    compute_time = MPI_Wtime() - compute_start;
+    total_compute_time = max_time(compute_time, MPI_COMM_WORLD);
+
+    /* 同步所有进程，确保所有输入文件都已读取和处理 */
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    if (global_rank == 0) {
+        printf("所有输入文件读取和处理完成，开始创建输出文件...\n");
+    }
+
+    /* 所有输入文件必须采用相同的存储格式 */
+    int layout_min, layout_max;
+    MPI_Allreduce(&gridcell_layout, &layout_min, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    MPI_Allreduce(&gridcell_layout, &layout_max, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    if (layout_min != layout_max) {
+        if (global_rank == 0) {
+            printf("Error: Input files mix (time, y, x) and (time, gridcell) layouts\n");
+        }
+        MPI_Abort(MPI_COMM_WORLD, -1);
+        return 1;
+    }
+    MPI_Bcast(grid.raster_shape, 2, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&grid.has_coords, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(grid.coord_types, 2, MPI_INT, 0, MPI_COMM_WORLD);
+    grid.gridcell_layout = gridcell_layout;
+    memcpy(grid.dim_names, dim_names, sizeof(dim_names));
+    grid.ny = band_rows;
+    grid.nx = band_cols;
+    grid.use_roi = use_roi;
+    grid.use_bbox = use_bbox;
+    memcpy(grid.roi, roi, sizeof(roi));
+    memcpy(grid.bbox, bbox, sizeof(bbox));
+
+    /* 重网格化后输出目标网格：维度为 (lat, lon)，经纬度取自权重文件，由第0组写出 */
+    if (regrid_file[0] != '\0') {
+        free_output_grid(&grid);
+        grid.gridcell_y = grid.gridcell_x = NULL;
+        grid.use_roi = grid.use_bbox = 0;
+        strcpy(grid.dim_names[1], "lat");
+        strcpy(grid.dim_names[2], "lon");
+        grid.ny = weights.dst_dims[1];
+        grid.nx = weights.dst_dims[0];
+        grid.has_coords = 1;
+        grid.coord_types[0] = grid.coord_types[1] = NC_DOUBLE;
+        grid.coord_start[1] = 0;
+        grid.coord_count[1] = grid.nx;
+        split_range(grid.ny, procs_per_group, proc_in_group, &grid.coord_start[0], &grid.coord_count[0]);
+        if (file_group != 0) {
+            grid.coord_count[0] = 0;
+        }
+        grid.coord_lat = (double *)malloc((grid.coord_count[0] * grid.nx + 1) * sizeof(double));
+        grid.coord_lon = (double *)malloc((grid.coord_count[0] * grid.nx + 1) * sizeof(double));
+        ret = regrid_read_dst_coords(regrid_file, MPI_COMM_WORLD, grid.coord_start[0] * grid.nx,
+                                     grid.coord_count[0] * grid.nx, grid.coord_lat, grid.coord_lon);
+        if (ret != 0) return ret;
+        regrid_weights_free(&weights);
+    }
+
+    /* 每个输出变量的类型为对应输入的累加类型，由各组的0号进程提供 */
+    int *rank_types = (int *)malloc(global_size * sizeof(int));
+    int *out_types = (int *)malloc(num_files * sizeof(int));
+    int acc_type = var.acc_type;
+    MPI_Allgather(&acc_type, 1, MPI_INT, rank_types, 1, MPI_INT, MPI_COMM_WORLD);
+    for (i = 0; i < num_files; i++) {
+        out_types[i] = rank_types[i * procs_per_group];
+    }
+    free(rank_types);
+
+    /* 各文件的时间步数，统计量文件中记为 count */
+    long long *rank_counts = (long long *)malloc(global_size * sizeof(long long));
+    long long *time_counts = (long long *)malloc(num_files * sizeof(long long));
+    long long my_count = time_steps;
+    MPI_Allgather(&my_count, 1, MPI_LONG_LONG, rank_counts, 1, MPI_LONG_LONG, MPI_COMM_WORLD);
+    for (i = 0; i < num_files; i++) {
+        time_counts[i] = rank_counts[i * procs_per_group];
+    }
+    free(rank_counts);
+
+    /* 开始写入计时 */
+    write_start_time = MPI_Wtime();
+
+    /* 第二阶段：创建输出文件 */
+    phase_start = prof_begin();
+    ret = ncmpi_create(MPI_COMM_WORLD, output_file, NC_64BIT_DATA, info, &ncid_out);
+    CHECK_ERR(ret);
+
+    /* 多年平均输出只由第一年的组写出格点索引和经纬度，其他年份的副本用于各自的距平文件 */
+    output_grid_t out_grid = grid;
+    if (year_index > 0) {
+        out_grid.index_count = 0;
+        out_grid.coord_count[0] = out_grid.coord_count[1] = 0;
+    }
+
+    /* 创建输出网格：维度、格点索引、子区域属性和经纬度 */
+    int dimids_out[2], grid_varids[4];
+    int out_ndims = gridcell_layout ? 1 : 2;
+    ret = def_output_grid(ncid_out, &out_grid, chunked, dimids_out, grid_varids);
+    if (ret != 0) return ret;
+
+    /* 创建输出变量 - 使用文件名中的变量类型名作为变量名 */
+    varid_out = (int *)malloc(num_out_vars * sizeof(int));
+    /* 使用循环定义每个变量 */
+    for (i = 0; i < num_out_vars; i++) {
+        ret = ncmpi_def_var(ncid_out, var_types[i], out_types[i], out_ndims, dimids_out, &varid_out[i]);
+        CHECK_ERR(ret);
+        /* 添加变量属性，说明这是时间平均值 */
+        char attr_text[100];
+        if (climatology) {
+            sprintf(attr_text, "Climatology of %s for month %02d of %04d-%04d", var_types[i], month, year, year_end);
+        } else {
+            sprintf(attr_text, "Time average of %s for %04d-%02d", var_types[i], year, month);
+        }
+        ret = ncmpi_put_att_text(ncid_out, varid_out[i], "long_name", strlen(attr_text), attr_text);
+        CHECK_ERR(ret);
+        /* 派生变量记录单位和计算所用的输入变量，表达式变量记录表达式本身 */
+        const derived_var_t *dv = derived_var_lookup(var_types[i], exprs, num_exprs);
+        if (dv != NULL) {
+            char inputs_text[DERIVED_MAX_INPUTS * (NC_MAX_NAME + 1)] = "";
+            for (j = 0; j < dv->ninputs; j++) {
+                sprintf(inputs_text + strlen(inputs_text), "%s%s", j > 0 ? "," : "", dv->inputs[j]);
+            }
+            if (dv->total) {
+                sprintf(attr_text, "Time sum of %s for %04d-%02d", var_types[i], year, month);
+                ret = ncmpi_put_att_text(ncid_out, varid_out[i], "long_name", strlen(attr_text), attr_text);
+                CHECK_ERR(ret);
+            }
+            if (dv->ctx != NULL) {
+                ret = ncmpi_put_att_text(ncid_out, varid_out[i], "expression", strlen(dv->long_name), dv->long_name);
+                CHECK_ERR(ret);
+            } else {
+                ret = ncmpi_put_att_text(ncid_out, varid_out[i], "units", strlen(dv->units), dv->units);
+                CHECK_ERR(ret);
+            }
+            ret = ncmpi_put_att_text(ncid_out, varid_out[i], "derived_from", strlen(inputs_text), inputs_text);
+            CHECK_ERR(ret);
+        }
+    }
+
+    /* 分位数变量 <VAR>_p<q>，与平均值同类型 */
+    int *varid_quantile = (int *)malloc((num_out_vars * num_quantiles + 1) * sizeof(int));
+    for (i = 0; i < num_out_vars; i++) {
+        for (j = 0; j < num_quantiles; j++) {
+            char qname[NC_MAX_NAME+1], attr_text[200];
+            int k = i * num_quantiles + j;
+            sprintf(qname, "%s_p%g", var_types[i], quantiles[j]);
+            ret = ncmpi_def_var(ncid_out, qname, out_types[i], out_ndims, dimids_out, &varid_quantile[k]);
+            CHECK_ERR(ret);
+            sprintf(attr_text, "Approximate %g-th percentile of %s for %04d-%02d", quantiles[j], var_types[i], year, month);
+            ret = ncmpi_put_att_text(ncid_out, varid_quantile[k], "long_name", strlen(attr_text), attr_text);
+            CHECK_ERR(ret);
+            ret = ncmpi_put_att_int(ncid_out, varid_quantile[k], "histogram_bins", NC_INT, 1, &hist_bins);
+            CHECK_ERR(ret);
+            ret = ncmpi_put_att_double(ncid_out, varid_quantile[k], "histogram_range", NC_DOUBLE, 2, hist_range);
+            CHECK_ERR(ret);
+        }
+    }
+
+    /* 分区统计变量 <VAR>_region_mean/min/max，维度为 (time, region)；
+     * 各文件的时间步数可能不同，time 取最大值，较短的变量其余部分为填充值 */
+    int *varid_region = (int *)malloc((num_out_vars * 3 + 1) * sizeof(int));
+    if (region_file[0] != '\0') {
+        static const char *region_stat[3] = {"mean", "min", "max"};
+        long long max_steps = 0;
+        int region_dimids[2];
+        for (i = 0; i < num_files; i++) {
+            if (time_counts[i] > max_steps) max_steps = time_counts[i];
+        }
+        ret = ncmpi_def_dim(ncid_out, dim_names[0], max_steps, &region_dimids[0]);
+        CHECK_ERR(ret);
+        ret = ncmpi_def_dim(ncid_out, "region", nregions, &region_dimids[1]);
+        CHECK_ERR(ret);
+        for (i = 0; i < num_out_vars; i++) {
+            for (j = 0; j < 3; j++) {
+                char rname[NC_MAX_NAME+1], attr_text[200];
+                double fill = NC_FILL_DOUBLE;
+                sprintf(rname, "%s_region_%s", var_types[i], region_stat[j]);
+                ret = ncmpi_def_var(ncid_out, rname, NC_DOUBLE, 2, region_dimids, &varid_region[i * 3 + j]);
+                CHECK_ERR(ret);
+                sprintf(attr_text, "Per-region %s of %s by %s:%s for %04d-%02d", region_stat[j], var_types[i],
+                        region_file, region_var, year, month);
+                ret = ncmpi_put_att_text(ncid_out, varid_region[i * 3 + j], "long_name", strlen(attr_text), attr_text);
+                CHECK_ERR(ret);
+                ret = ncmpi_put_att_double(ncid_out, varid_region[i * 3 + j], "_FillValue", NC_DOUBLE, 1, &fill);
+                CHECK_ERR(ret);
+            }
+        }
+    }
+
+    /* 添加全局属性，说明这是时间平均值 */
+    char global_attr_text[MAX_PATH_LEN + 100];
+    sprintf(global_attr_text, "Time average of %s for %04d-%02d", var_string, year, month);
+    ret = ncmpi_put_att_text(ncid_out, NC_GLOBAL, "long_name", strlen(global_attr_text), global_attr_text);
+    CHECK_ERR(ret);
+    if (regrid_file[0] != '\0') {
+        ret = ncmpi_put_att_text(ncid_out, NC_GLOBAL, "regrid_weights", strlen(regrid_file), regrid_file);
+        CHECK_ERR(ret);
+    }
+
+    /* 结束定义模式 */
+    ret = ncmpi_enddef(ncid_out);
+    CHECK_ERR(ret);
+    prof_end(PHASE_CREATE, phase_start, 0);
+
+    /* 第三阶段：写入输出文件 */
+    if (global_rank == 0) {
+        printf("开始写入输出文件...\n");
+    }
+
+    /* 设置写入时按y维度分割的起始位置和计数 */
+    MPI_Offset x_size = grid.nx;
+    MPI_Offset my_y_start, my_y_count;
+    if (split_y && regrid_file[0] == '\0') {
+        /* 按y划分时写出本进程读取的行 */
+        my_y_start = my_band_start;
+        my_y_count = my_band_count;
+    } else {
+        split_range(grid.ny, procs_per_group, proc_in_group, &my_y_start, &my_y_count);
+    }
+
+    /* 设置写入的起始位置和计数 */
+    MPI_Offset write_start[2], write_count[2];
+
+    /* 计算该进程处理的数据大小 */
+    MPI_Offset proc_data_size = my_y_count * x_size;
+
+    /* 按y划分时本进程的结果正好是要写出的行，否则从组内平均中取出这些行；
+     * 重网格化时为本进程负责的目标网格行 (double) */
+    void *proc_buffer = band_avg;
+    MPI_Datatype proc_mpitype = var.acc_mpitype;
+    if (regrid_file[0] != '\0') {
+        proc_buffer = regrid_out;
+        proc_mpitype = MPI_DOUBLE;
+    } else if (!split_y) {
+        proc_buffer = malloc((proc_data_size + 1) * var.acc_size);
+        if (proc_buffer == NULL) {
+            printf("Error: Memory allocation failed for proc_buffer\n");
+            MPI_Abort(MPI_COMM_WORLD, -1);
+            return 1;
+        }
+        hwc_begin(&hwc_mark);
+        memcpy(proc_buffer, (char *)global_avg + my_y_start * x_size * var.acc_size, proc_data_size * var.acc_size);
+        hwc_end(HWC_COPY, &hwc_mark, 2 * proc_data_size * var.acc_size, 0);
+    }
+
+    /* 为所有变量写入数据，每个组的进程只实际写入其对应的变量数据 */
+    phase_start = prof_begin();
+    hwc_begin(&hwc_mark);
+    for (i = 0; i < num_out_vars; i++) {
+        if (i == out_var) {
+            /* 当前组负责的变量：实际写入数据 */
+            write_start[0] = my_y_start;
+            write_count[0] = my_y_count;
+            write_start[1] = 0;
+            write_count[1] = x_size;
+            ret = ncmpi_put_vara_all(ncid_out, varid_out[i], write_start, write_count,
+                                     proc_buffer, proc_data_size, proc_mpitype);
+            CHECK_ERR(ret);
+            for (j = 0; j < num_quantiles; j++) {
+                ret = ncmpi_put_vara_all(ncid_out, varid_quantile[i * num_quantiles + j], write_start, write_count,
+                                         (char *)quantile_out + j * proc_data_size * var.acc_size,
+                                         proc_data_size, var.acc_mpitype);
+                CHECK_ERR(ret);
+            }
+        } else {
+            /* 其他组负责的变量：count设为0，不实际写入数据 */
+            write_start[0] = 0;
+            write_count[0] = 0;
+            write_start[1] = 0;
+            write_count[1] = 0;
+            ret = ncmpi_put_vara_all(ncid_out, varid_out[i], write_start, write_count,
+                                     NULL, 0, nc2mpitype(out_types[i]));
+            CHECK_ERR(ret);
+            for (j = 0; j < num_quantiles; j++) {
+                ret = ncmpi_put_vara_all(ncid_out, varid_quantile[i * num_quantiles + j], write_start, write_count,
+                                         NULL, 0, nc2mpitype(out_types[i]));
+                CHECK_ERR(ret);
+            }
+        }
+    }
+
+    /* 分区统计由各组的0号进程写出完整数组 */
+    if (region_file[0] != '\0') {
+        for (i = 0; i < num_out_vars; i++) {
+            double *region_out[3] = {region_sum, region_min, region_max};
+            int mine = (i == out_var && proc_in_group == 0);
+            MPI_Offset region_start[2] = {0, 0};
+            MPI_Offset region_count_out[2] = {mine ? time_steps : 0, mine ? nregions : 0};
+            for (j = 0; j < 3; j++) {
+                ret = ncmpi_put_vara_double_all(ncid_out, varid_region[i * 3 + j], region_start, region_count_out,
+                                                mine ? region_out[j] : NULL);
+                CHECK_ERR(ret);
+            }
+        }
+    }
+
+    /* 格点索引和子区域的经纬度由第0组写出 */
+    ret = put_output_grid(ncid_out, &out_grid, grid_varids);
+    if (ret != 0) return ret;
+    hwc_end(HWC_COMPRESS, &hwc_mark, out_var >= 0 ? (1 + num_quantiles) * proc_data_size * var.acc_size : 0, 0);
+    prof_end(PHASE_WRITE, phase_start,
+             out_var >= 0 ? (1 + num_quantiles) * proc_data_size * var.acc_size : 0);
+
+    /* 关闭输出文件 */
+    phase_start = prof_begin();
+    ret = ncmpi_close(ncid_out);
+    CHECK_ERR(ret);
+    prof_end(PHASE_CLOSE, phase_start, 0);
+
+    /* 距平：每年一个文件，由处理该年的进程写出，多年平均仍保存在各进程的内存中 */
+    if (climatology) {
+        char anomaly_file[MAX_PATH_LEN];
+        MPI_Comm year_comm;
+        phase_start = prof_begin();
+        MPI_Comm_split(MPI_COMM_WORLD, year_index, global_rank, &year_comm);
+        sprintf(anomaly_file, "%s/forcing2d_anomaly_%04d_%02d.nc", output_path, year + year_index, month);
+        ret = write_anomaly_file(anomaly_file, year_comm, info, chunked, &grid, var_types, num_out_vars, out_types,
+                                 file_group % num_out_vars, &var, buffer, my_time_start, my_time_count,
+                                 time_steps, global_avg, year + year_index, month);
+        if (ret != 0) return ret;
+        prof_end(PHASE_WRITE, phase_start, my_time_count * spatial_size * var.acc_size);
+        MPI_Comm_free(&year_comm);
+        if (node_aggregators > 0) {
+            node_reader_finalize(&node_reader);
+        } else {
+            free(buffer);
+        }
+        if (global_rank == 0) {
+            printf("距平文件: %s/forcing2d_anomaly_YYYY_%02d.nc (%d 年)\n", output_path, month, num_years);
+        }
+    }
+
+    /* 逐月统计量文件，与平均结果的写出方式相同 */
+    if (sidecar) {
+        phase_start = prof_begin();
+        ret = write_stats_file(stats_file, &grid, var_types, num_files, out_types, time_counts, file_group,
+                               year, month, my_y_start, my_y_count,
+                               stat_sum + my_y_start * x_size, stat_m2 + my_y_start * x_size, hints);
+        if (ret != 0) return ret;
+        prof_end(PHASE_WRITE, phase_start, 2 * my_y_count * x_size * sizeof(double));
+        if (global_rank == 0) {
+            printf("统计量文件: %s\n", stats_file);
+        }
+    }
+
+    /* 结束写入计时，收集所有进程的写入时间，取最大值 */
+    write_time = MPI_Wtime() - write_start_time;
+    total_write_time = max_time(write_time, MPI_COMM_WORLD);
+
+    /* 释放资源 */
+    free_output_grid(&grid);
+    free(stat_sum);
+    free(stat_m2);
+    free(time_counts);
+    free(local_sum);
+    free(global_avg);
+    free(proc_buffer);
+    free(quantile_out);
+    free(varid_quantile);
+    free(region_sum);
+    free(region_min);
+    free(region_max);
+    free(region_count);
+    free(varid_region);
+    free(out_types);
+    for (i = 0; i < MAX_FILES; i++) {
+        free(input_files[i]);
+    }
+    free(input_files);
+
+    for (i = 0; i < num_var_types; i++) {
+        free(var_types[i]);
+    }
+    free(var_types);
+    free(varid_out);
+
+    split_plan_free(&time_plan);
+    split_plan_free(&band_plan);
+    MPI_Info_free(&info);
+    if (hints != MPI_INFO_NULL) {
+        MPI_Info_free(&hints);
+    }
+    MPI_Comm_free(&file_comm);
+
+    if (global_rank == 0) {
+        printf("成功完成！输出文件: %s\n", output_file);
+    }
+    /* 结束计时 - 整个程序 */
+    process_time = MPI_Wtime() - start_time;
+    total_time = max_time(process_time, MPI_COMM_WORLD);
+    if (global_rank == 0) {
+        printf("===== 性能统计 =====\n");
+        printf("总读取时间: %.4f 秒\n", total_read_time);
+        printf("总计算时间: %.4f 秒\n", total_compute_time);
+        printf("总写入时间: %.4f 秒\n", total_write_time);
+        printf("总执行时间: %.4f 秒\n", total_time);
+    }
+    prof_report(chunked ? "forcing2d_average_v1" : "forcing2d_average_v0",
+                profile_file[0] != '\0' ? profile_file : NULL, trace_file[0] != '\0' ? trace_file : NULL,
+                MPI_COMM_WORLD);
+    if (reduce_codec.method != REDUCE_RAW) {
+        reduce_codec_report(&reduce_codec, MPI_COMM_WORLD);
+    }
+    MPI_Allreduce(&coded, &any_coded, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    if (any_coded) {
+        codec_report(&codec_stats, "zstd 解码", MPI_COMM_WORLD);
+    }
+    if (chunk_cache_mb > 0.0) {
+        chunk_cache_finalize(&chunk_cache);
+    }
+    if (num_threads > 1) {
+        /* 各线程编号上所有进程的最长解压时间和工作项总数 */
+        double max_thread_time[MAX_THREADS];
+        int total_thread_items[MAX_THREADS];
+        MPI_Reduce(thread_time, max_thread_time, num_threads, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        MPI_Reduce(thread_items, total_thread_items, num_threads, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (global_rank == 0) {
+            printf("===== 多线程解压 =====\n");
+            for (i = 0; i < num_threads; i++) {
+                printf("线程 %d: 工作项 %d 个, 最长解压时间 %.4f 秒\n", i, total_thread_items[i], max_thread_time[i]);
+            }
+        }
+    }
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,199 @@
+#!/bin/bash
+#
+# forcing2d 端到端基准测试：用 forcing2d_synth 生成合成数据，然后在不同进程数和压缩方式下
+# 依次运行 forcing2d_raw2chunk、forcing2d_average_v0 和 forcing2d_average_v1，
+# 把耗时、吞吐率和压缩比写入 CSV 和 JSON。只需要本机的 MPI，不依赖生产数据。
+#
+# PnetCDF 的压缩方式（sz、zlib）通过 PNETCDF_HINTS 环境变量传入（覆盖程序中的 nc_chunk_default_filter）；
+# zstd 使用 forcing2d_raw2chunk -z 的应用层压缩，可加后缀 +byte/+bit/+none 选择重排方式，+kN 保留 N 位尾数，+eE 使用误差为 E 的时间差分编码。
+# int16、float16 使用 forcing2d_raw2chunk -Q 打包主变量。
+#
+
+set -e
+
+usage() {
+    cat <<EOF
+Usage: $0 [options]
+  -b <bin_dir>     可执行文件目录(默认 ./exec)
+  -w <work_dir>    数据和输出目录(默认 ./bench_work)
+  -r <result>      结果文件前缀，写出 <result>.csv 和 <result>.json(默认 ./bench_result)
+  -n <ranks>       进程数列表，以逗号分隔(默认 1,2,4)
+  -c <codecs>      raw2chunk/average_v1 的压缩方式列表(默认 sz,zlib,zstd)
+                   zstd 可加后缀，如 zstd+bit、zstd+k12、zstd+bit+k12、zstd+e0.01；int16、float16 为打包
+  -v <variables>   变量列表(默认 FSDS,PRECTmms,TBOT)
+  -Y <ny> -X <nx> -T <nt>  合成数据的大小(默认 512 x 512，该月每3小时一步)
+  -y <year> -m <month>     年份和月份(默认 2014-01)
+  -R <repeat>      每个配置重复的次数，取最短时间(默认 1)
+环境变量 MPIEXEC(默认 mpiexec) 和 MPIEXEC_FLAGS(如 --oversubscribe) 用于启动 MPI 程序。
+EOF
+}
+
+BIN_DIR=./exec
+WORK_DIR=./bench_work
+RESULT=./bench_result
+RANKS=1,2,4
+CODECS=sz,zlib,zstd
+VARS=FSDS,PRECTmms,TBOT
+NY=512
+NX=512
+NT=
+YEAR=2014
+MONTH=1
+REPEAT=1
+MPIEXEC=${MPIEXEC:-mpiexec}
+
+while getopts "b:w:r:n:c:v:Y:X:T:y:m:R:h" opt; do
+    case $opt in
+        b) BIN_DIR=$OPTARG ;;
+        w) WORK_DIR=$OPTARG ;;
+        r) RESULT=$OPTARG ;;
+        n) RANKS=$OPTARG ;;
+        c) CODECS=$OPTARG ;;
+        v) VARS=$OPTARG ;;
+        Y) NY=$OPTARG ;;
+        X) NX=$OPTARG ;;
+        T) NT=$OPTARG ;;
+        y) YEAR=$OPTARG ;;
+        m) MONTH=$OPTARG ;;
+        R) REPEAT=$OPTARG ;;
+        h) usage; exit 0 ;;
+        *) usage; exit 1 ;;
+    esac
+done
+
+MM=$(printf "%02d" "$MONTH")
+RAW_DIR=$WORK_DIR/raw
+OUT_DIR=$WORK_DIR/out
+LOG=$WORK_DIR/bench.log
+mkdir -p "$RAW_DIR" "$OUT_DIR"
+: > "$LOG"
+
+IFS=, read -r -a RANK_LIST <<< "$RANKS"
+IFS=, read -r -a CODEC_LIST <<< "$CODECS"
+IFS=, read -r -a VAR_LIST <<< "$VARS"
+NVARS=${#VAR_LIST[@]}
+MAX_RANKS=$(printf "%s\n" "${RANK_LIST[@]}" | sort -n | tail -1)
+
+# 运行一个 MPI 程序 REPEAT 次，输出最短的墙钟时间（秒）
+run_timed() {
+    local ranks=$1 hints=$2 best= t0 t1 dt i
+    shift 2
+    for ((i = 0; i < REPEAT; i++)); do
+        echo "PNETCDF_HINTS=$hints $MPIEXEC $MPIEXEC_FLAGS -n $ranks $*" >> "$LOG"
+        t0=$(date +%s.%N)
+        PNETCDF_HINTS=$hints $MPIEXEC $MPIEXEC_FLAGS -n "$ranks" "$@" >> "$LOG" 2>&1
+        t1=$(date +%s.%N)
+        dt=$(awk "BEGIN { print $t1 - $t0 }")
+        if [ -z "$best" ] || awk "BEGIN { exit !($dt < $best) }"; then
+            best=$dt
+        fi
+    done
+    echo "$best"
+}
+
+# 一组文件的总字节数
+total_bytes() {
+    local sum=0 f
+    for f in "$@"; do
+        sum=$((sum + $(stat -c %s "$f")))
+    done
+    echo "$sum"
+}
+
+CSV=$RESULT.csv
+echo "tool,ranks,codec,variables,ny,nx,nt,input_bytes,output_bytes,ratio,seconds,mb_per_s" > "$CSV"
+
+# 追加一行结果：tool ranks codec in_bytes out_bytes seconds，吞吐率按输入字节计算
+record() {
+    local tool=$1 ranks=$2 codec=$3 in_bytes=$4 out_bytes=$5 seconds=$6
+    local ratio mbps
+    ratio=$(awk "BEGIN { print $in_bytes / $out_bytes }")
+    mbps=$(awk "BEGIN { print $in_bytes / 1048576 / $seconds }")
+    printf "%s,%s,%s,%s,%s,%s,%s,%s,%s,%.4f,%.4f,%.2f\n" "$tool" "$ranks" "$codec" "${VARS//,/;}" \
+        "$NY" "$NX" "$NT_USED" "$in_bytes" "$out_bytes" "$ratio" "$seconds" "$mbps" >> "$CSV"
+    printf "%-22s ranks=%-4s codec=%-6s %8.3f s %10.2f MB/s ratio %.2f\n" "$tool" "$ranks" "$codec" \
+        "$seconds" "$mbps" "$ratio"
+}
+
+# 第一步：生成合成数据（只生成一次，用最大的进程数）
+echo "生成合成数据: ${NY} x ${NX}, 变量 $VARS"
+SYNTH_ARGS=(-o "$RAW_DIR" -y "$YEAR" -m "$MONTH" -v "$VARS" -Y "$NY" -X "$NX")
+if [ -n "$NT" ]; then
+    SYNTH_ARGS+=(-T "$NT")
+fi
+t=$(run_timed "$MAX_RANKS" "" "$BIN_DIR/forcing2d_synth" "${SYNTH_ARGS[@]}")
+RAW_FILES=()
+for v in "${VAR_LIST[@]}"; do
+    RAW_FILES+=("$RAW_DIR/clmforc.Daymet4.1km.$v.$YEAR-$MM.nc")
+done
+RAW_BYTES=$(total_bytes "${RAW_FILES[@]}")
+# 与 forcing2d_synth 相同的365天历
+MONTH_DAYS=(31 28 31 30 31 30 31 31 30 31 30 31)
+NT_USED=${NT:-$(( MONTH_DAYS[MONTH - 1] * 8 ))}
+record forcing2d_synth "$MAX_RANKS" none "$RAW_BYTES" "$RAW_BYTES" "$t"
+
+for ranks in "${RANK_LIST[@]}"; do
+    # 第二步：每种压缩方式把原始文件转换为分块压缩文件，再用 v1 求平均
+    for codec in "${CODEC_LIST[@]}"; do
+        CHUNK_DIR=$WORK_DIR/chunk_$codec
+        mkdir -p "$CHUNK_DIR"
+        hints="nc_chunk_default_filter=$codec"
+        CODEC_ARGS=()
+        if [ "$codec" = int16 ] || [ "$codec" = float16 ]; then
+            # 打包：主变量的过滤器由 forcing2d_raw2chunk 设为 deflate
+            hints=
+            CODEC_ARGS=(-Q "$codec")
+        elif [ "${codec%%+*}" = zstd ]; then
+            # 应用层压缩：主变量不经过 PnetCDF 过滤器
+            hints=
+            CODEC_ARGS=(-z 3)
+            IFS=+ read -r -a suffixes <<< "${codec#zstd}"
+            for sfx in "${suffixes[@]}"; do
+                case $sfx in
+                    "") ;;
+                    byte|bit|none) CODEC_ARGS+=(-s "$sfx") ;;
+                    k[0-9]*) CODEC_ARGS+=(-k "${sfx#k}") ;;
+                    e[0-9]*) CODEC_ARGS+=(-e "${sfx#e}") ;;
+                    *) echo "未知的压缩方式: $codec"; exit 1 ;;
+                esac
+            done
+        fi
+        elapsed=0
+        for f in "${RAW_FILES[@]}"; do
+            t=$(run_timed "$ranks" "$hints" "$BIN_DIR/forcing2d_raw2chunk" "${CODEC_ARGS[@]}" "$f" \
+                "$CHUNK_DIR/$(basename "$f")")
+            elapsed=$(awk "BEGIN { print $elapsed + $t }")
+        done
+        CHUNK_BYTES=$(total_bytes "$CHUNK_DIR"/clmforc.Daymet4.1km.*.$YEAR-$MM.nc)
+        record forcing2d_raw2chunk "$ranks" "$codec" "$RAW_BYTES" "$CHUNK_BYTES" "$elapsed"
+
+        if [ "$ranks" -ge "$NVARS" ]; then
+            t=$(run_timed "$ranks" "$hints" "$BIN_DIR/forcing2d_average_v1" -i "$CHUNK_DIR" -o "$OUT_DIR" \
+                -y "$YEAR" -m "$MONTH" -v "$VARS")
+            OUT_BYTES=$(total_bytes "$OUT_DIR/forcing2d_average_${YEAR}_$MM.nc")
+            record forcing2d_average_v1 "$ranks" "$codec" "$CHUNK_BYTES" "$OUT_BYTES" "$t"
+        fi
+    done
+
+    # 第三步：v0 直接读取原始文件，每个变量至少需要一个进程
+    if [ "$ranks" -ge "$NVARS" ]; then
+        t=$(run_timed "$ranks" "" "$BIN_DIR/forcing2d_average_v0" -i "$RAW_DIR" -o "$OUT_DIR" \
+            -y "$YEAR" -m "$MONTH" -v "$VARS")
+        OUT_BYTES=$(total_bytes "$OUT_DIR/forcing2d_average_${YEAR}_$MM.nc")
+        record forcing2d_average_v0 "$ranks" none "$RAW_BYTES" "$OUT_BYTES" "$t"
+    else
+        echo "跳过 average: 进程数 $ranks 小于变量数 $NVARS"
+    fi
+done
+
+# CSV 转为 JSON 数组
+awk -F, 'NR == 1 { for (i = 1; i <= NF; i++) key[i] = $i; print "["; next }
+         { printf "%s  {", (NR > 2 ? ",\n" : "")
+           for (i = 1; i <= NF; i++) {
+               q = (i == 1 || i == 3 || i == 4) ? "\"" : ""
+               printf "\"%s\": %s%s%s%s", key[i], q, $i, q, (i < NF ? ", " : "")
+           }
+           printf "}" }
+         END { print "\n]" }' "$CSV" > "$RESULT.json"
+
+echo "结果: $CSV, $RESULT.json (运行日志 $LOG)"
@@ -0,0 +1,803 @@
+/*
+ * forcing2d 应用层压缩的实现，接口说明见 forcing2d_codec.h
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <zstd.h>
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+#include "forcing2d_codec.h"
+
+/* ---------- 预处理 ---------- */
+
+/* 整数运算的写法让编译器可以向量化：先对所有值舍入，再按指数是否全1或等于填充值选回原值。
+ * 没有填充值时 fill 为 NaN，其位模式的指数全1，不会多选回任何值。位模式用 memcpy 读写，
+ * 不通过整数指针访问浮点数组（违反严格别名规则，-O2 内联后舍入会被优化掉） */
+void bitround(nc_type xtype, void *values, MPI_Offset n, int keep_bits, double fill) {
+    if (xtype == NC_FLOAT && keep_bits > 0 && keep_bits < 23) {
+        float *x = (float *)values, f = (float)fill;
+        int drop = 23 - keep_bits;
+        uint32_t half = (1u << (drop - 1)) - 1, mask = ~((1u << drop) - 1), fill_bits;
+        memcpy(&fill_bits, &f, sizeof(f));
+        for (MPI_Offset k = 0; k < n; k++) {
+            uint32_t v, r;
+            memcpy(&v, x + k, sizeof(v));
+            r = (v + half + ((v >> drop) & 1)) & mask;
+            r = ((v & 0x7f800000u) == 0x7f800000u || v == fill_bits) ? v : r;
+            memcpy(x + k, &r, sizeof(r));
+        }
+    } else if (xtype == NC_DOUBLE && keep_bits > 0 && keep_bits < 52) {
+        double *x = (double *)values;
+        int drop = 52 - keep_bits;
+        uint64_t half = (1ull << (drop - 1)) - 1, mask = ~((1ull << drop) - 1), fill_bits;
+        memcpy(&fill_bits, &fill, sizeof(fill));
+        for (MPI_Offset k = 0; k < n; k++) {
+            uint64_t v, r;
+            memcpy(&v, x + k, sizeof(v));
+            r = (v + half + ((v >> drop) & 1)) & mask;
+            r = ((v & 0x7ff0000000000000ull) == 0x7ff0000000000000ull || v == fill_bits) ? v : r;
+            memcpy(x + k, &r, sizeof(r));
+        }
+    }
+}
+
+#ifdef __SSSE3__
+/* 4个 float 的 16 字节内按字节位置分组，4x4 字节转置，自身即其逆 */
+#define SHUFFLE4_MASK _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15)
+#endif
+
+void byte_shuffle(const void *src, MPI_Offset n, int size, void *dst) {
+    const unsigned char *s = (const unsigned char *)src;
+    unsigned char *d = (unsigned char *)dst;
+    MPI_Offset i = 0;
+#ifdef __SSSE3__
+    /* 每次16个元素：组内字节分组后做 32 位字的 4x4 转置，得到4个字节平面各16字节 */
+    if (size == 4) {
+        const __m128i mask = SHUFFLE4_MASK;
+        for (; i + 16 <= n; i += 16) {
+            __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(s + 4 * i)), mask);
+            __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(s + 4 * i + 16)), mask);
+            __m128i c = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(s + 4 * i + 32)), mask);
+            __m128i e = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(s + 4 * i + 48)), mask);
+            __m128i t0 = _mm_unpacklo_epi32(a, b), t1 = _mm_unpackhi_epi32(a, b);
+            __m128i t2 = _mm_unpacklo_epi32(c, e), t3 = _mm_unpackhi_epi32(c, e);
+            _mm_storeu_si128((__m128i *)(d + i), _mm_unpacklo_epi64(t0, t2));
+            _mm_storeu_si128((__m128i *)(d + n + i), _mm_unpackhi_epi64(t0, t2));
+            _mm_storeu_si128((__m128i *)(d + 2 * n + i), _mm_unpacklo_epi64(t1, t3));
+            _mm_storeu_si128((__m128i *)(d + 3 * n + i), _mm_unpackhi_epi64(t1, t3));
+        }
+    }
+#endif
+    for (int b = 0; b < size; b++) {
+        for (MPI_Offset k = i; k < n; k++) {
+            d[b * n + k] = s[k * size + b];
+        }
+    }
+}
+
+void byte_unshuffle(const void *src, MPI_Offset n, int size, void *dst) {
+    const unsigned char *s = (const unsigned char *)src;
+    unsigned char *d = (unsigned char *)dst;
+    MPI_Offset i = 0;
+#ifdef __SSSE3__
+    if (size == 4) {
+        const __m128i mask = SHUFFLE4_MASK;
+        for (; i + 16 <= n; i += 16) {
+            __m128i r0 = _mm_loadu_si128((const __m128i *)(s + i));
+            __m128i r1 = _mm_loadu_si128((const __m128i *)(s + n + i));
+            __m128i r2 = _mm_loadu_si128((const __m128i *)(s + 2 * n + i));
+            __m128i r3 = _mm_loadu_si128((const __m128i *)(s + 3 * n + i));
+            __m128i t0 = _mm_unpacklo_epi32(r0, r1), t1 = _mm_unpackhi_epi32(r0, r1);
+            __m128i t2 = _mm_unpacklo_epi32(r2, r3), t3 = _mm_unpackhi_epi32(r2, r3);
+            _mm_storeu_si128((__m128i *)(d + 4 * i), _mm_shuffle_epi8(_mm_unpacklo_epi64(t0, t2), mask));
+            _mm_storeu_si128((__m128i *)(d + 4 * i + 16), _mm_shuffle_epi8(_mm_unpackhi_epi64(t0, t2), mask));
+            _mm_storeu_si128((__m128i *)(d + 4 * i + 32), _mm_shuffle_epi8(_mm_unpacklo_epi64(t1, t3), mask));
+            _mm_storeu_si128((__m128i *)(d + 4 * i + 48), _mm_shuffle_epi8(_mm_unpackhi_epi64(t1, t3), mask));
+        }
+    }
+#endif
+    for (int b = 0; b < size; b++) {
+        for (MPI_Offset k = i; k < n; k++) {
+            d[k * size + b] = s[b * n + k];
+        }
+    }
+}
+
+/* 8x8 位矩阵转置（每个字节一行），自身即其逆 */
+static uint64_t transpose8(uint64_t x) {
+    uint64_t t;
+    t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAull;
+    x = x ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCull;
+    x = x ^ t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ull;
+    x = x ^ t ^ (t << 28);
+    return x;
+}
+
+/* 一个 n 字节的字节平面：每8字节转置后，第 k 个字节写到第 k 个位平面（各 n/8 字节），尾部原样 */
+void bit_shuffle(const void *src, MPI_Offset n, int size, void *dst, void *scratch) {
+    MPI_Offset groups = n / 8;
+    byte_shuffle(src, n, size, scratch);
+    for (int b = 0; b < size; b++) {
+        const unsigned char *s = (const unsigned char *)scratch + b * n;
+        unsigned char *d = (unsigned char *)dst + b * n;
+        for (MPI_Offset g = 0; g < groups; g++) {
+            uint64_t x;
+            memcpy(&x, s + 8 * g, 8);
+            x = transpose8(x);
+            for (int k = 0; k < 8; k++) {
+                d[k * groups + g] = (unsigned char)(x >> (8 * k));
+            }
+        }
+        memcpy(d + 8 * groups, s + 8 * groups, n - 8 * groups);
+    }
+}
+
+void bit_unshuffle(const void *src, MPI_Offset n, int size, void *dst, void *scratch) {
+    MPI_Offset groups = n / 8;
+    for (int b = 0; b < size; b++) {
+        const unsigned char *s = (const unsigned char *)src + b * n;
+        unsigned char *d = (unsigned char *)scratch + b * n;
+        for (MPI_Offset g = 0; g < groups; g++) {
+            uint64_t x = 0;
+            for (int k = 0; k < 8; k++) {
+                x |= (uint64_t)s[k * groups + g] << (8 * k);
+            }
+            x = transpose8(x);
+            memcpy(d + 8 * g, &x, 8);
+        }
+        memcpy(d + 8 * groups, s + 8 * groups, n - 8 * groups);
+    }
+    byte_unshuffle(scratch, n, size, dst);
+}
+
+/* ---------- 编码 ---------- */
+
+size_t codec_bound(const codec_params_t *p, nc_type xtype, MPI_Offset n) {
+    size_t bytes = (size_t)n * nc_type_size(xtype);
+    /* 时间差分模式：每个值一个量化码，无法量化的值另外原样存放 */
+    if (p->error > 0) bytes += (size_t)n * sizeof(int32_t);
+    return ZSTD_compressBound(bytes);
+}
+
+size_t codec_encode(const codec_params_t *p, nc_type xtype, void *plane, MPI_Offset n, void *out, void *scratch) {
+    int size = nc_type_size(xtype);
+    size_t bytes = (size_t)n * size, r;
+    const void *src = plane;
+
+    bitround(xtype, plane, n, p->keep_bits, p->fill);
+    if (p->shuffle == CODEC_SHUFFLE_BYTE) {
+        byte_shuffle(plane, n, size, scratch);
+        src = scratch;
+    } else if (p->shuffle == CODEC_SHUFFLE_BIT) {
+        bit_shuffle(plane, n, size, scratch, (char *)scratch + bytes);
+        src = scratch;
+    }
+    r = ZSTD_compress(out, ZSTD_compressBound(bytes), src, bytes, p->level);
+    return ZSTD_isError(r) ? 0 : r;
+}
+
+int codec_decode(const codec_params_t *p, nc_type xtype, const void *in, size_t len, MPI_Offset n, void *out,
+                 void *scratch) {
+    int size = nc_type_size(xtype);
+    size_t bytes = (size_t)n * size;
+    void *dst = (p->shuffle == CODEC_SHUFFLE_NONE) ? out : scratch;
+    size_t r = ZSTD_decompress(dst, bytes, in, len);
+    if (ZSTD_isError(r) || r != bytes) return -1;
+    if (p->shuffle == CODEC_SHUFFLE_BYTE) {
+        byte_unshuffle(scratch, n, size, out);
+    } else if (p->shuffle == CODEC_SHUFFLE_BIT) {
+        bit_unshuffle(scratch, n, size, out, (char *)scratch + bytes);
+    }
+    return 0;
+}
+
+/* ---------- 时间差分 ---------- */
+
+#define DELTA_ESCAPE INT32_MIN          /* 无法量化的值，原样存放 */
+#define DELTA_LIMIT 1073741824.0        /* |q| < 2^30，两步之差不会等于 DELTA_ESCAPE */
+
+/* 工作区：重排后的量化码 (4n 字节) 和原样存放的值 (至多 n 个)，其后是未重排的量化码和位重排的中间结果 */
+static size_t delta_scratch_size(nc_type xtype, MPI_Offset n) {
+    return (size_t)n * (3 * sizeof(int32_t) + nc_type_size(xtype));
+}
+
+/* 量化一个平面，关键帧写出量化码，否则写出与 q 中上一步量化码的差；q 更新为本步的量化码。
+ * 上一步或本步无法量化时写出本步的量化码本身 */
+static size_t delta_encode(const codec_params_t *p, nc_type xtype, const void *plane, MPI_Offset n, int key,
+                           int32_t *q, void *out, void *scratch) {
+    int size = nc_type_size(xtype);
+    unsigned char *packed = (unsigned char *)scratch, *raw = packed + 4 * n;
+    uint32_t *codes = (uint32_t *)(packed + n * (4 + size));
+    double inv = 1.0 / (2.0 * p->error);
+    MPI_Offset nraw = 0;
+    size_t bytes, r;
+
+    for (MPI_Offset i = 0; i < n; i++) {
+        double v = (xtype == NC_FLOAT ? ((const float *)plane)[i] : ((const double *)plane)[i]) * inv;
+        int32_t cur, d;
+        /* NaN 和无穷也不满足该条件 */
+        if (v > -DELTA_LIMIT && v < DELTA_LIMIT) {
+            cur = (int32_t)lrint(v);
+        } else {
+            cur = DELTA_ESCAPE;
+            memcpy(raw + nraw * size, (const char *)plane + i * size, size);
+            nraw++;
+        }
+        d = (key || q[i] == DELTA_ESCAPE || cur == DELTA_ESCAPE) ? cur : cur - q[i];
+        q[i] = cur;
+        /* zigzag：绝对值小的负数也编码为小的正数 */
+        codes[i] = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+    }
+    if (p->shuffle == CODEC_SHUFFLE_BYTE) {
+        byte_shuffle(codes, n, 4, packed);
+    } else if (p->shuffle == CODEC_SHUFFLE_BIT) {
+        bit_shuffle(codes, n, 4, packed, codes + n);
+    } else {
+        memcpy(packed, codes, 4 * n);
+    }
+    bytes = 4 * n + nraw * size;
+    r = ZSTD_compress(out, ZSTD_compressBound(bytes), packed, bytes, p->level);
+    return ZSTD_isError(r) ? 0 : r;
+}
+
+/* delta_encode 的逆过程，q 为上一步的量化码（关键帧时不使用），返回时更新为本步的量化码 */
+static int delta_decode(const codec_params_t *p, nc_type xtype, const void *in, size_t len, MPI_Offset n, int key,
+                        int32_t *q, void *out, void *scratch) {
+    int size = nc_type_size(xtype);
+    unsigned char *packed = (unsigned char *)scratch;
+    const unsigned char *raw = packed + 4 * n;
+    uint32_t *codes = (uint32_t *)(packed + n * (4 + size));
+    double step = 2.0 * p->error;
+    size_t r = ZSTD_decompress(packed, (size_t)n * (4 + size), in, len);
+    MPI_Offset nraw = 0, max_raw;
+
+    if (ZSTD_isError(r) || r < (size_t)(4 * n)) return -1;
+    max_raw = (r - 4 * n) / size;
+    if (p->shuffle == CODEC_SHUFFLE_BYTE) {
+        byte_unshuffle(packed, n, 4, codes);
+    } else if (p->shuffle == CODEC_SHUFFLE_BIT) {
+        bit_unshuffle(packed, n, 4, codes, codes + n);
+    } else {
+        memcpy(codes, packed, 4 * n);
+    }
+    for (MPI_Offset i = 0; i < n; i++) {
+        int32_t d = (int32_t)((codes[i] >> 1) ^ (0u - (codes[i] & 1)));
+        int32_t cur = (key || q[i] == DELTA_ESCAPE || d == DELTA_ESCAPE) ? d : q[i] + d;
+        q[i] = cur;
+        if (cur == DELTA_ESCAPE) {
+            if (nraw >= max_raw) return -1;
+            memcpy((char *)out + i * size, raw + nraw * size, size);
+            nraw++;
+        } else if (xtype == NC_FLOAT) {
+            ((float *)out)[i] = (float)(cur * step);
+        } else {
+            ((double *)out)[i] = cur * step;
+        }
+    }
+    return 0;
+}
+
+/* ---------- 文件 ---------- */
+
+static const char *shuffle_names[] = {"none", "byte", "bit"};
+
+int codec_def_var(int ncid, int varid, const codec_params_t *p) {
+    int ret;
+    const char *codec = (p->error > 0) ? "delta" : "zstd";
+    ret = ncmpi_var_set_filter(ncid, varid, NC_FILTER_NONE);
+    if (ret != NC_NOERR) return ret;
+    ret = ncmpi_put_att_text(ncid, varid, "forcing2d_codec", strlen(codec), codec);
+    if (ret != NC_NOERR) return ret;
+    if (p->error > 0) {
+        ret = ncmpi_put_att_double(ncid, varid, "forcing2d_error_bound", NC_DOUBLE, 1, &p->error);
+        if (ret != NC_NOERR) return ret;
+        ret = ncmpi_put_att_int(ncid, varid, "forcing2d_keyframe", NC_INT, 1, &p->keyframe);
+        if (ret != NC_NOERR) return ret;
+    }
+    ret = ncmpi_put_att_text(ncid, varid, "forcing2d_shuffle", strlen(shuffle_names[p->shuffle]),
+                             shuffle_names[p->shuffle]);
+    if (ret != NC_NOERR) return ret;
+    ret = ncmpi_put_att_int(ncid, varid, "forcing2d_keepbits", NC_INT, 1, &p->keep_bits);
+    if (ret != NC_NOERR) return ret;
+    return ncmpi_put_att_int(ncid, varid, "forcing2d_zstd_level", NC_INT, 1, &p->level);
+}
+
+int codec_inq(const forcing_var_t *var, codec_params_t *p) {
+    char text[16];
+    MPI_Offset len;
+    memset(p, 0, sizeof(*p));
+    p->fill = var->fill;
+    if (ncmpi_inq_attlen(var->ncid, var->varid, "forcing2d_codec", &len) != NC_NOERR ||
+        len >= (MPI_Offset)sizeof(text)) return 0;
+    ncmpi_get_att_text(var->ncid, var->varid, "forcing2d_codec", text);
+    text[len] = '\0';
+    if (strcmp(text, "delta") == 0) {
+        if (ncmpi_get_att_double(var->ncid, var->varid, "forcing2d_error_bound", &p->error) != NC_NOERR ||
+            p->error <= 0) return 0;
+        ncmpi_get_att_int(var->ncid, var->varid, "forcing2d_keyframe", &p->keyframe);
+    } else if (strcmp(text, "zstd") != 0) {
+        return 0;
+    }
+    if (ncmpi_inq_attlen(var->ncid, var->varid, "forcing2d_shuffle", &len) == NC_NOERR && len < (MPI_Offset)sizeof(text)) {
+        ncmpi_get_att_text(var->ncid, var->varid, "forcing2d_shuffle", text);
+        text[len] = '\0';
+        for (int s = 0; s < 3; s++) {
+            if (strcmp(text, shuffle_names[s]) == 0) p->shuffle = s;
+        }
+    }
+    ncmpi_get_att_int(var->ncid, var->varid, "forcing2d_keepbits", &p->keep_bits);
+    ncmpi_get_att_int(var->ncid, var->varid, "forcing2d_zstd_level", &p->level);
+    return 1;
+}
+
+/* 编码写出和解码读取中途还有集体调用，单个进程出错返回会让其余进程挂起，直接终止 */
+#define CODEC_ERR(err) { \
+    if (err != NC_NOERR) { \
+        printf("Error at line %d: %s\n", __LINE__, ncmpi_strerror(err)); \
+        MPI_Abort(MPI_COMM_WORLD, -1); \
+    } \
+}
+
+/* 主变量名后加后缀 */
+static void codec_name(int ncid, int varid, const char *suffix, char *name) {
+    ncmpi_inq_varname(ncid, varid, name);
+    strcat(name, suffix);
+}
+
+int codec_write_steps(int ncid, int varid, const codec_params_t *p, nc_type xtype, void *planes,
+                      MPI_Offset first_step, MPI_Offset nsteps, MPI_Offset plane_size, MPI_Comm comm,
+                      codec_stats_t *stats) {
+    int ret, size = nc_type_size(xtype);
+    int dimids[FORCING_MAX_DIMS], bytes_dim, data_id, offset_id, size_id, key_id = -1;
+    int delta = (p->error > 0);
+    char name[NC_MAX_NAME + 16];
+    size_t bound = codec_bound(p, xtype, plane_size), used = 0, cap = 0;
+    unsigned char *blob = NULL, *tmp = (unsigned char *)malloc(bound + 1);
+    void *scratch = malloc((delta ? delta_scratch_size(xtype, plane_size) : (size_t)(2 * plane_size * size)) + 1);
+    int32_t *q = delta ? (int32_t *)malloc(plane_size * sizeof(int32_t) + 1) : NULL;
+    long long *offsets = (long long *)malloc((nsteps + 1) * sizeof(long long));
+    long long *sizes = (long long *)malloc((nsteps + 1) * sizeof(long long));
+    long long *keys = (long long *)malloc((nsteps + 1) * sizeof(long long));
+    double t0 = MPI_Wtime();
+
+    if (delta && xtype != NC_FLOAT && xtype != NC_DOUBLE) {
+        printf("Error: the temporal delta codec only supports float and double variables\n");
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    if (tmp == NULL || scratch == NULL || (delta && q == NULL) || offsets == NULL || sizes == NULL ||
+        keys == NULL) {
+        printf("Error: Memory allocation failed for the codec buffers\n");
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+
+    /* 逐步编码，追加到本进程的字节块。时间差分模式下本进程的第一步也是关键帧，
+     * 这样各进程的编码互不依赖 */
+    for (MPI_Offset t = 0; t < nsteps; t++) {
+        void *plane = (char *)planes + t * plane_size * size;
+        size_t len;
+        if (delta) {
+            MPI_Offset step = first_step + t;
+            int key = (t == 0 || p->keyframe <= 1 || step % p->keyframe == 0);
+            keys[t] = key ? step : keys[t - 1];
+            len = delta_encode(p, xtype, plane, plane_size, key, q, tmp, scratch);
+        } else {
+            len = codec_encode(p, xtype, plane, plane_size, tmp, scratch);
+        }
+        if (len == 0) {
+            printf("Error: zstd failed on step %lld\n", first_step + t);
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+        if (used + len > cap) {
+            cap = (used + len) * 2;
+            blob = (unsigned char *)realloc(blob, cap);
+            if (blob == NULL) {
+                printf("Error: Memory allocation failed for the codec output\n");
+                MPI_Abort(MPI_COMM_WORLD, -1);
+            }
+        }
+        memcpy(blob + used, tmp, len);
+        offsets[t] = used;
+        sizes[t] = len;
+        used += len;
+    }
+    free(tmp);
+    free(scratch);
+    free(q);
+    stats->raw_bytes += (double)nsteps * plane_size * size;
+    stats->coded_bytes += used;
+    stats->encode_time += MPI_Wtime() - t0;
+
+    /* 按进程顺序排列，偏移为前面进程字节数之和 */
+    long long my_bytes = used, my_offset = 0, total = 0;
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Exscan(&my_bytes, &my_offset, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    if (rank == 0) my_offset = 0;
+    MPI_Allreduce(&my_bytes, &total, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    for (MPI_Offset t = 0; t < nsteps; t++) {
+        offsets[t] += my_offset;
+    }
+
+    ret = ncmpi_inq_vardimid(ncid, varid, dimids);
+    CODEC_ERR(ret);
+    ret = ncmpi_redef(ncid);
+    CODEC_ERR(ret);
+    codec_name(ncid, varid, CODEC_BYTES_SUFFIX, name);
+    ret = ncmpi_def_dim(ncid, name, total > 0 ? total : 1, &bytes_dim);
+    CODEC_ERR(ret);
+    codec_name(ncid, varid, CODEC_DATA_SUFFIX, name);
+    ret = ncmpi_def_var(ncid, name, NC_UBYTE, 1, &bytes_dim, &data_id);
+    CODEC_ERR(ret);
+    codec_name(ncid, varid, CODEC_OFFSET_SUFFIX, name);
+    ret = ncmpi_def_var(ncid, name, NC_INT64, 1, &dimids[0], &offset_id);
+    CODEC_ERR(ret);
+    codec_name(ncid, varid, CODEC_SIZE_SUFFIX, name);
+    ret = ncmpi_def_var(ncid, name, NC_INT64, 1, &dimids[0], &size_id);
+    CODEC_ERR(ret);
+    if (delta) {
+        codec_name(ncid, varid, CODEC_KEY_SUFFIX, name);
+        ret = ncmpi_def_var(ncid, name, NC_INT64, 1, &dimids[0], &key_id);
+        CODEC_ERR(ret);
+        ncmpi_var_set_filter(ncid, key_id, NC_FILTER_NONE);
+    }
+    /* 字节块已经压缩，索引需要精确，都不再经过过滤器 */
+    ncmpi_var_set_filter(ncid, data_id, NC_FILTER_NONE);
+    ncmpi_var_set_filter(ncid, offset_id, NC_FILTER_NONE);
+    ncmpi_var_set_filter(ncid, size_id, NC_FILTER_NONE);
+    ret = ncmpi_enddef(ncid);
+    CODEC_ERR(ret);
+
+    MPI_Offset start = my_offset, count = my_bytes;
+    ret = ncmpi_put_vara_all(ncid, data_id, &start, &count, blob, count, MPI_UNSIGNED_CHAR);
+    CODEC_ERR(ret);
+    start = first_step;
+    count = nsteps;
+    ret = ncmpi_put_vara_longlong_all(ncid, offset_id, &start, &count, offsets);
+    CODEC_ERR(ret);
+    ret = ncmpi_put_vara_longlong_all(ncid, size_id, &start, &count, sizes);
+    CODEC_ERR(ret);
+    if (delta) {
+        ret = ncmpi_put_vara_longlong_all(ncid, key_id, &start, &count, keys);
+        CODEC_ERR(ret);
+    }
+    free(blob);
+    free(offsets);
+    free(sizes);
+    free(keys);
+    return ret;
+}
+
+int codec_var_get(const forcing_var_t *var, const codec_params_t *p, const MPI_Offset *start,
+                  const MPI_Offset *count, void *buf, codec_stats_t *stats) {
+    int ret, data_id, offset_id, size_id, key_id, delta = (p->error > 0);
+    char name[NC_MAX_NAME + 16];
+    MPI_Offset nt = count[0], plane_size = 1, lo = 0, hi = 0;
+    MPI_Offset first = start[0], nread = nt;    /* 需要解码的步 */
+    long long *keys = NULL;
+    double t0;
+
+    for (int d = 1; d < var->ndims; d++) {
+        plane_size *= var->dim_sizes[d];
+    }
+    codec_name(var->ncid, var->varid, CODEC_DATA_SUFFIX, name);
+    ret = ncmpi_inq_varid(var->ncid, name, &data_id);
+    CODEC_ERR(ret);
+    codec_name(var->ncid, var->varid, CODEC_OFFSET_SUFFIX, name);
+    ret = ncmpi_inq_varid(var->ncid, name, &offset_id);
+    CODEC_ERR(ret);
+    codec_name(var->ncid, var->varid, CODEC_SIZE_SUFFIX, name);
+    ret = ncmpi_inq_varid(var->ncid, name, &size_id);
+    CODEC_ERR(ret);
+
+    /* 时间差分模式：从第一步所依赖的关键帧开始解码 */
+    if (delta) {
+        long long key = start[0];
+        MPI_Offset one = (nt > 0) ? 1 : 0;
+        codec_name(var->ncid, var->varid, CODEC_KEY_SUFFIX, name);
+        ret = ncmpi_inq_varid(var->ncid, name, &key_id);
+        CODEC_ERR(ret);
+        ret = ncmpi_get_vara_longlong_all(var->ncid, key_id, &start[0], &one, &key);
+        CODEC_ERR(ret);
+        first = key;
+        nread = start[0] + nt - first;
+        keys = (long long *)malloc((nread + 1) * sizeof(long long));
+        if (keys == NULL) {
+            printf("Error: Memory allocation failed for the codec buffers\n");
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+        ret = ncmpi_get_vara_longlong_all(var->ncid, key_id, &first, &nread, keys);
+        CODEC_ERR(ret);
+    }
+
+    long long *offsets = (long long *)malloc((nread + 1) * sizeof(long long));
+    long long *sizes = (long long *)malloc((nread + 1) * sizeof(long long));
+    if (offsets == NULL || sizes == NULL) {
+        printf("Error: Memory allocation failed for the codec buffers\n");
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    ret = ncmpi_get_vara_longlong_all(var->ncid, offset_id, &first, &nread, offsets);
+    CODEC_ERR(ret);
+    ret = ncmpi_get_vara_longlong_all(var->ncid, size_id, &first, &nread, sizes);
+    CODEC_ERR(ret);
+
+    /* 各步按时间顺序连续存放，一次读出整段 */
+    if (nread > 0) {
+        lo = offsets[0];
+        hi = offsets[nread - 1] + sizes[nread - 1];
+    }
+    MPI_Offset nbytes = hi - lo;
+    unsigned char *blob = (unsigned char *)malloc(nbytes + 1);
+    void *plane = malloc(plane_size * var->elem_size + 1);
+    void *scratch = malloc((delta ? delta_scratch_size(var->type, plane_size) : (size_t)(2 * plane_size * var->elem_size)) + 1);
+    int32_t *q = delta ? (int32_t *)malloc(plane_size * sizeof(int32_t) + 1) : NULL;
+    if (blob == NULL || plane == NULL || scratch == NULL || (delta && q == NULL)) {
+        printf("Error: Memory allocation failed for the codec buffers\n");
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    ret = ncmpi_get_vara_all(var->ncid, data_id, &lo, &nbytes, blob, nbytes, MPI_UNSIGNED_CHAR);
+    CODEC_ERR(ret);
+
+    /* 逐步解码整个平面，再复制出请求的 (y, x) 或 gridcell 范围 */
+    t0 = MPI_Wtime();
+    MPI_Offset rows = count[1], cols = (var->ndims == 3) ? count[2] : 1;
+    MPI_Offset row_len = (var->ndims == 3) ? var->dim_sizes[2] : 1;
+    MPI_Offset col0 = (var->ndims == 3) ? start[2] : 0;
+    char *out = (char *)buf;
+    for (MPI_Offset t = 0; t < nread; t++) {
+        const unsigned char *in = blob + (offsets[t] - lo);
+        if (delta) {
+            ret = delta_decode(p, var->type, in, sizes[t], plane_size, keys[t] == first + t, q, plane, scratch);
+        } else {
+            ret = codec_decode(p, var->type, in, sizes[t], plane_size, plane, scratch);
+        }
+        if (ret != 0) {
+            printf("Error: zstd failed to decode step %lld\n", first + t);
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+        /* 关键帧与 start[0] 之间的步只用于恢复量化码 */
+        if (first + t < start[0]) continue;
+        if (var->ndims == 2) {
+            memcpy(out, (char *)plane + start[1] * var->elem_size, rows * var->elem_size);
+            out += rows * var->elem_size;
+            continue;
+        }
+        for (MPI_Offset r = 0; r < rows; r++) {
+            memcpy(out, (char *)plane + ((start[1] + r) * row_len + col0) * var->elem_size, cols * var->elem_size);
+            out += cols * var->elem_size;
+        }
+    }
+    stats->decode_time += MPI_Wtime() - t0;
+    stats->raw_bytes += (double)nt * plane_size * var->elem_size;
+    stats->coded_bytes += nbytes;
+    free(blob);
+    free(plane);
+    free(scratch);
+    free(q);
+    free(keys);
+    free(offsets);
+    free(sizes);
+    return NC_NOERR;
+}
+
+void codec_report(const codec_stats_t *stats, const char *what, MPI_Comm comm) {
+    double sums[2] = {stats->raw_bytes, stats->coded_bytes}, total[2];
+    double times[2] = {stats->encode_time, stats->decode_time}, tmax[2];
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Reduce(sums, total, 2, MPI_DOUBLE, MPI_SUM, 0, comm);
+    MPI_Reduce(times, tmax, 2, MPI_DOUBLE, MPI_MAX, 0, comm);
+    if (rank != 0 || total[1] == 0) return;
+    printf("%s: 原始 %.1f MB, 压缩后 %.1f MB, 压缩比 %.2f", what, total[0] / 1048576.0, total[1] / 1048576.0,
+           total[0] / total[1]);
+    if (tmax[0] > 0) printf(", 编码 %.4f 秒 (%.1f MB/s)", tmax[0], total[0] / 1048576.0 / tmax[0]);
+    if (tmax[1] > 0) printf(", 解码 %.4f 秒 (%.1f MB/s)", tmax[1], total[0] / 1048576.0 / tmax[1]);
+    printf("\n");
+}
+
+/* ---------- 打包 ---------- */
+
+nc_type pack_type(int method) {
+    return (method == PACK_FLOAT16) ? NC_USHORT : NC_SHORT;
+}
+
+/* 按原变量的类型取填充值，用于比较；没有填充值时为 NaN，与任何值都不相等 */
+static double pack_fill(const pack_params_t *p, nc_type xtype) {
+    if (!p->has_fill) return NAN;
+    return (xtype == NC_FLOAT) ? (double)(float)p->fill : p->fill;
+}
+
+void pack_choose(pack_params_t *p, nc_type xtype, const void *values, MPI_Offset n, MPI_Comm comm,
+                 double *vmin, double *vmax) {
+    double range[2] = {INFINITY, INFINITY};     /* {-max, min}，一次 MPI_MIN 归约 */
+    double fill = pack_fill(p, xtype);
+    for (MPI_Offset k = 0; k < n; k++) {
+        double x = (xtype == NC_FLOAT) ? ((const float *)values)[k] : ((const double *)values)[k];
+        if (!isfinite(x) || x == fill) continue;
+        if (-x < range[0]) range[0] = -x;
+        if (x < range[1]) range[1] = x;
+    }
+    MPI_Allreduce(MPI_IN_PLACE, range, 2, MPI_DOUBLE, MPI_MIN, comm);
+    *vmin = range[1];
+    *vmax = -range[0];
+    p->scale = 1.0;
+    p->offset = 0.0;
+    if (p->method == PACK_INT16 && *vmin <= *vmax) {
+        /* [min, max] 映射到 [-32767, 32767]，-32768 留给填充值 */
+        p->offset = 0.5 * (*vmin + *vmax);
+        if (*vmax > *vmin) p->scale = (*vmax - *vmin) / 65534.0;
+    }
+}
+
+/* IEEE 半精度转换，就近舍入，平局取偶；溢出为无穷 */
+static uint16_t float_to_half(float f) {
+    uint32_t x, ax, sign;
+    memcpy(&x, &f, 4);
+    sign = (x >> 16) & 0x8000;
+    ax = x & 0x7fffffffu;
+    if (ax >= 0x7f800000u) return (uint16_t)(sign | 0x7c00 | (ax > 0x7f800000u ? 0x200 : 0));
+    if (ax >= 0x477ff000u) return (uint16_t)(sign | 0x7c00);
+    if (ax < 0x38800000u) {
+        /* 半精度的非规格化数：以 2^-24 为单位取整 */
+        float v;
+        memcpy(&v, &ax, 4);
+        return (uint16_t)(sign | (uint32_t)lrintf(v * 16777216.0f));
+    }
+    return (uint16_t)(sign | ((ax + 0xfff + ((ax >> 13) & 1) - 0x38000000u) >> 13));
+}
+
+static float half_to_float(uint16_t h) {
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16, e = (h >> 10) & 0x1f, m = h & 0x3ff, x;
+    float f;
+    if (e == 0x1f) {
+        x = sign | 0x7f800000u | (m << 13);
+    } else if (e == 0) {
+        f = m * (1.0f / 16777216.0f);
+        memcpy(&x, &f, 4);
+        x |= sign;
+    } else {
+        x = sign | ((e + 112) << 23) | (m << 13);
+    }
+    memcpy(&f, &x, 4);
+    return f;
+}
+
+void pack_values(const pack_params_t *p, nc_type xtype, const void *values, MPI_Offset n, void *out) {
+    double fill = pack_fill(p, xtype);
+    if (p->method == PACK_INT16) {
+        int16_t *q = (int16_t *)out;
+        double inv = 1.0 / p->scale;
+        for (MPI_Offset k = 0; k < n; k++) {
+            double x = (xtype == NC_FLOAT) ? ((const float *)values)[k] : ((const double *)values)[k];
+            double v = (x - p->offset) * inv;
+            if (isnan(x) || x == fill) {
+                q[k] = PACK_FILL_INT16;
+            } else {
+                q[k] = (int16_t)(v > 32767.0 ? 32767 : v < -32767.0 ? -32767 : lrint(v));
+            }
+        }
+        return;
+    }
+    uint16_t *h = (uint16_t *)out;
+    MPI_Offset k = 0;
+#ifdef __F16C__
+    /* 每次8个：F16C 转换，填充值和 NaN 的位置按16位掩码置为全1 */
+    if (xtype == NC_FLOAT) {
+        const float *x = (const float *)values;
+        const __m256 fv = _mm256_set1_ps((float)fill);
+        for (; k + 8 <= n; k += 8) {
+            __m256 v = _mm256_loadu_ps(x + k);
+            __m256 m = _mm256_or_ps(_mm256_cmp_ps(v, v, _CMP_UNORD_Q), _mm256_cmp_ps(v, fv, _CMP_EQ_OQ));
+            __m128i mi = _mm_packs_epi32(_mm256_castsi256_si128(_mm256_castps_si256(m)),
+                                         _mm256_extractf128_si256(_mm256_castps_si256(m), 1));
+            __m128i hv = _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT);
+            _mm_storeu_si128((__m128i *)(h + k), _mm_or_si128(hv, mi));
+        }
+    }
+#endif
+    for (; k < n; k++) {
+        double x = (xtype == NC_FLOAT) ? ((const float *)values)[k] : ((const double *)values)[k];
+        h[k] = (isnan(x) || x == fill) ? PACK_FILL_FLOAT16 : float_to_half((float)x);
+    }
+}
+
+/* 打包属性：forcing2d_packing 说明方式，_FillValue 为打包后的填充值，forcing2d_unpacked_fill 为原填充值 */
+int pack_def_var(int ncid, int varid, nc_type xtype, const pack_params_t *p) {
+    int ret;
+    const char *method = (p->method == PACK_FLOAT16) ? "float16" : "int16";
+    /* 打包已经是有损的一步，打包后的整数再用无损的 deflate，不经过默认的 SZ */
+    ret = ncmpi_var_set_filter(ncid, varid, NC_FILTER_DEFLATE);
+    if (ret != NC_NOERR) return ret;
+    ret = ncmpi_put_att_text(ncid, varid, "forcing2d_packing", strlen(method), method);
+    if (ret != NC_NOERR) return ret;
+    if (p->method == PACK_INT16) {
+        short fill = PACK_FILL_INT16;
+        ret = ncmpi_put_att_short(ncid, varid, "_FillValue", NC_SHORT, 1, &fill);
+        if (ret != NC_NOERR) return ret;
+        ret = ncmpi_put_att_double(ncid, varid, "scale_factor", xtype, 1, &p->scale);
+        if (ret != NC_NOERR) return ret;
+        ret = ncmpi_put_att_double(ncid, varid, "add_offset", xtype, 1, &p->offset);
+        if (ret != NC_NOERR) return ret;
+    } else {
+        unsigned short fill = PACK_FILL_FLOAT16;
+        ret = ncmpi_put_att_ushort(ncid, varid, "_FillValue", NC_USHORT, 1, &fill);
+        if (ret != NC_NOERR) return ret;
+    }
+    if (p->has_fill) {
+        ret = ncmpi_put_att_double(ncid, varid, "forcing2d_unpacked_fill", xtype, 1, &p->fill);
+    }
+    return ret;
+}
+
+int pack_put_params(int ncid, int varid, nc_type xtype, const pack_params_t *p) {
+    int ret;
+    if (p->method != PACK_INT16) return NC_NOERR;
+    ret = ncmpi_redef(ncid);
+    if (ret != NC_NOERR) return ret;
+    ret = ncmpi_put_att_double(ncid, varid, "scale_factor", xtype, 1, &p->scale);
+    if (ret != NC_NOERR) return ret;
+    ret = ncmpi_put_att_double(ncid, varid, "add_offset", xtype, 1, &p->offset);
+    if (ret != NC_NOERR) return ret;
+    return ncmpi_enddef(ncid);
+}
+
+int pack_inq(const forcing_var_t *var, pack_params_t *p) {
+    char text[16];
+    MPI_Offset len;
+    memset(p, 0, sizeof(*p));
+    if (ncmpi_inq_attlen(var->ncid, var->varid, "forcing2d_packing", &len) != NC_NOERR ||
+        len >= (MPI_Offset)sizeof(text)) return 0;
+    ncmpi_get_att_text(var->ncid, var->varid, "forcing2d_packing", text);
+    text[len] = '\0';
+    if (strcmp(text, "int16") == 0 && var->type == NC_SHORT) {
+        p->method = PACK_INT16;
+        if (ncmpi_get_att_double(var->ncid, var->varid, "scale_factor", &p->scale) != NC_NOERR ||
+            ncmpi_get_att_double(var->ncid, var->varid, "add_offset", &p->offset) != NC_NOERR) return 0;
+    } else if (strcmp(text, "float16") == 0 && var->type == NC_USHORT) {
+        p->method = PACK_FLOAT16;
+    } else {
+        return 0;
+    }
+    p->has_fill = (ncmpi_get_att_double(var->ncid, var->varid, "forcing2d_unpacked_fill", &p->fill) == NC_NOERR);
+    return 1;
+}
+
+void unpack_sum_planes(const pack_params_t *p, const void *planes, MPI_Offset nplanes, MPI_Offset plane_size,
+                       float *sum) {
+    const float fill = p->has_fill ? (float)p->fill : NAN;
+    if (p->method == PACK_INT16) {
+        /* 先解包再按填充值选回，写法与 bitround 相同，编译器可以向量化 */
+        const float scale = (float)p->scale, offset = (float)p->offset;
+        for (MPI_Offset t = 0; t < nplanes; t++) {
+            const int16_t *q = (const int16_t *)planes + t * plane_size;
+            for (MPI_Offset k = 0; k < plane_size; k++) {
+                float v = q[k] * scale + offset;
+                sum[k] += (q[k] == PACK_FILL_INT16) ? fill : v;
+            }
+        }
+        return;
+    }
+    for (MPI_Offset t = 0; t < nplanes; t++) {
+        const uint16_t *h = (const uint16_t *)planes + t * plane_size;
+        MPI_Offset k = 0;
+#ifdef __F16C__
+        /* 每次8个：F16C 转换后把 NaN（即填充值）换成原填充值，直接加到 sum */
+        const __m256 fv = _mm256_set1_ps(fill);
+        for (; k + 8 <= plane_size; k += 8) {
+            __m256 v = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(h + k)));
+            v = _mm256_blendv_ps(v, fv, _mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+            _mm256_storeu_ps(sum + k, _mm256_add_ps(_mm256_loadu_ps(sum + k), v));
+        }
+#endif
+        for (; k < plane_size; k++) {
+            float v = half_to_float(h[k]);
+            sum[k] += isnan(v) ? fill : v;
+        }
+    }
+}
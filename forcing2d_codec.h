@@ -0,0 +1,147 @@
+/*
+ * forcing2d 应用层压缩：forcing2d_raw2chunk 和 forcing2d_average_v0/v1 共用
+ *
+ * 主变量的每个时间步平面依次经过：尾数舍入 (BitRound，保留 keep_bits 位) -> 字节或位重排 -> zstd，
+ * 压缩成一个字节块。各步的字节块按时间顺序连续存放在 VAR_zdata (VAR_zbytes) 中，
+ * VAR_zoffset(time) 和 VAR_zsize(time) 给出每一步的位置。主变量 VAR 本身不写数据，
+ * 只保留维度和属性，属性 forcing2d_codec 及其参数说明编码方式。
+ *
+ * 时间差分模式 (error > 0) 用于相邻时间步变化很小的变量：每个值按绝对误差 error 量化为整数
+ * q = round(x / (2 * error))，关键帧存放 q 本身，其余各步存放与上一步 q 的差，再经过重排和 zstd。
+ * 重建值只取决于本步的 q，误差不随步数累积。关键帧每 keyframe 步一个（另外每个写出进程的第一步
+ * 也是关键帧），VAR_zkey(time) 给出每一步所依赖的关键帧，随机读取最多多解码 keyframe - 1 步。
+ * 无法量化的值（填充值、NaN、超出范围）原样存放在该步的量化码之后。
+ *
+ * 只依赖 zstd，不经过 PnetCDF 的 chunk 过滤器，因此也不需要 PnetCDF 支持该过滤器。
+ *
+ * 另一种更轻的方式是打包：主变量按 CF 约定存为 short (scale_factor/add_offset)，或存为 IEEE 半精度
+ * （按位存为 unsigned short），字节数减半，读取时解包与时间累加融合在一个内核中完成。
+ */
+
+#ifndef FORCING2D_CODEC_H
+#define FORCING2D_CODEC_H
+
+#include "forcing2d_lib.h"
+
+/* 重排方式 */
+#define CODEC_SHUFFLE_NONE 0
+#define CODEC_SHUFFLE_BYTE 1    /* 第 b 个字节排在一起 */
+#define CODEC_SHUFFLE_BIT 2     /* 第 k 位排在一起 */
+
+/* 压缩后的数据变量、维度和索引变量的名字后缀 */
+#define CODEC_DATA_SUFFIX "_zdata"
+#define CODEC_BYTES_SUFFIX "_zbytes"
+#define CODEC_OFFSET_SUFFIX "_zoffset"
+#define CODEC_SIZE_SUFFIX "_zsize"
+#define CODEC_KEY_SUFFIX "_zkey"        /* 时间差分模式 */
+
+typedef struct {
+    int keep_bits;          /* BitRound 保留的尾数位数，0 表示不舍入（无损） */
+    int shuffle;            /* CODEC_SHUFFLE_* */
+    int level;              /* zstd 级别 */
+    double error;           /* 时间差分模式的绝对误差上限，0 表示按步独立压缩 */
+    int keyframe;           /* 时间差分模式的关键帧间隔（步） */
+    double fill;            /* 主变量的填充值，原样保留；没有时为 NaN */
+} codec_params_t;
+
+/* 编码统计，各进程本地累计 */
+typedef struct {
+    double raw_bytes, coded_bytes;
+    double encode_time, decode_time;
+} codec_stats_t;
+
+/* ---------- 预处理 ---------- */
+
+/* 按 BitRound 把 float/double 的尾数舍入到 keep_bits 位（就近舍入，平局取偶），
+ * 相对误差不超过 2^-(keep_bits+1)。NaN、无穷和等于 fill 的值不变（与 netCDF 的 quantize 相同），
+ * 其他类型不处理 */
+void bitround(nc_type xtype, void *values, MPI_Offset n, int keep_bits, double fill);
+
+/* 字节重排：n 个 size 字节的元素，dst[b * n + i] = src[i * size + b]。size 为4时用 SSSE3 */
+void byte_shuffle(const void *src, MPI_Offset n, int size, void *dst);
+void byte_unshuffle(const void *src, MPI_Offset n, int size, void *dst);
+
+/* 位重排：在字节重排的基础上每8个元素做一次 8x8 位转置，第 k 位排在一起。
+ * 不足8个的尾部元素按字节重排存放 */
+void bit_shuffle(const void *src, MPI_Offset n, int size, void *dst, void *scratch);
+void bit_unshuffle(const void *src, MPI_Offset n, int size, void *dst, void *scratch);
+
+/* ---------- 编码 ---------- */
+
+/* n 个元素编码后的最大字节数 */
+size_t codec_bound(const codec_params_t *p, nc_type xtype, MPI_Offset n);
+
+/* 编码一个平面到 out（容量 codec_bound），返回字节数，出错返回0。BitRound 直接作用于 plane，
+ * scratch 至少 2 * n * 元素大小 字节 */
+size_t codec_encode(const codec_params_t *p, nc_type xtype, void *plane, MPI_Offset n, void *out, void *scratch);
+
+/* 解码一个平面，scratch 同上 */
+int codec_decode(const codec_params_t *p, nc_type xtype, const void *in, size_t len, MPI_Offset n, void *out,
+                 void *scratch);
+
+/* ---------- 文件 ---------- */
+
+/* 在定义模式下把编码参数写成主变量的属性，并关闭该变量的 PnetCDF 过滤器 */
+int codec_def_var(int ncid, int varid, const codec_params_t *p);
+
+/* 主变量是否按本编码存放，是则返回1并填写参数 */
+int codec_inq(const forcing_var_t *var, codec_params_t *p);
+
+/* 集合写出：每个进程编码自己的 nsteps 个平面（从 first_step 开始，按时间顺序划分，时间差分模式下
+ * 只支持 float/double），
+ * 然后重新进入定义模式定义压缩数据变量和索引变量，再按各进程的字节偏移写出。
+ * 调用时文件处于数据模式，返回时仍处于数据模式 */
+int codec_write_steps(int ncid, int varid, const codec_params_t *p, nc_type xtype, void *planes,
+                      MPI_Offset first_step, MPI_Offset nsteps, MPI_Offset plane_size, MPI_Comm comm,
+                      codec_stats_t *stats);
+
+/* 集合读取 start/count 范围到 buf（与 forcing_var_get 相同），读取涉及的各步字节块后逐步解码，
+ * 只复制出请求的空间范围。时间差分模式下从 start[0] 所依赖的关键帧开始顺序解码 */
+int codec_var_get(const forcing_var_t *var, const codec_params_t *p, const MPI_Offset *start,
+                  const MPI_Offset *count, void *buf, codec_stats_t *stats);
+
+/* 在0号进程打印压缩比和编解码吞吐率 */
+void codec_report(const codec_stats_t *stats, const char *what, MPI_Comm comm);
+
+/* ---------- 打包 ---------- */
+
+#define PACK_NONE 0
+#define PACK_INT16 1            /* CF 约定：short，x = q * scale_factor + add_offset */
+#define PACK_FLOAT16 2          /* IEEE 半精度，按位存为 unsigned short */
+
+/* 打包后的填充值，原变量的填充值和 NaN 都打包为它 */
+#define PACK_FILL_INT16 (-32768)
+#define PACK_FILL_FLOAT16 0xFFFF    /* 半精度的一个 NaN */
+
+typedef struct {
+    int method;             /* PACK_* */
+    double scale, offset;   /* PACK_INT16 */
+    int has_fill;
+    double fill;            /* 原变量的填充值，解包时还原；没有时解包为 NaN */
+} pack_params_t;
+
+/* 打包后的变量类型 */
+nc_type pack_type(int method);
+
+/* 并行求 n 个 float/double 的最小值和最大值（跳过填充值和非有限值），PACK_INT16 时据此确定
+ * scale 和 offset，量化误差不超过 scale / 2。所有进程得到相同的结果 */
+void pack_choose(pack_params_t *p, nc_type xtype, const void *values, MPI_Offset n, MPI_Comm comm,
+                 double *vmin, double *vmax);
+
+/* 把 n 个 float/double 打包到 out（short 或 unsigned short） */
+void pack_values(const pack_params_t *p, nc_type xtype, const void *values, MPI_Offset n, void *out);
+
+/* 在定义模式下写打包属性并改用 deflate 过滤器，scale_factor/add_offset 先写占位值，xtype 为原变量类型 */
+int pack_def_var(int ncid, int varid, nc_type xtype, const pack_params_t *p);
+
+/* 在数据模式下重新进入定义模式，写入 pack_choose 得到的 scale_factor/add_offset。属性大小不变，文件头不需要移动 */
+int pack_put_params(int ncid, int varid, nc_type xtype, const pack_params_t *p);
+
+/* 主变量是否为打包存放，是则返回1并填写参数 */
+int pack_inq(const forcing_var_t *var, pack_params_t *p);
+
+/* 融合的解包累加：把 nplanes 个连续的打包平面解包后逐元素累加到 float 类型的 sum，不生成解包后的平面 */
+void unpack_sum_planes(const pack_params_t *p, const void *planes, MPI_Offset nplanes, MPI_Offset plane_size,
+                       float *sum);
+
+#endif
@@ -0,0 +1,221 @@
+#!/bin/bash
+#
+# forcing2d MPI-IO/PnetCDF 提示扫描：对每组提示文件（每行 key = value）、每个进程数，
+# 运行 forcing2d_raw2chunk（-H）、forcing2d_average_v0 和 forcing2d_average_v1（--hints），
+# 把耗时写入 sweep.csv，并把每个程序、每个进程数下最快的一组提示复制为 <profile>/<tool>_<ranks>.hints，
+# 生产运行时直接用 -H / --hints 传入即可。
+#
+# 没有给出 -i 时用 forcing2d_synth 生成合成数据；没有给出 -H 时使用下面内置的几组提示。
+#
+
+set -e
+
+usage() {
+    cat <<EOF
+Usage: $0 [options]
+  -b <bin_dir>     可执行文件目录(默认 ./exec)
+  -w <work_dir>    数据和输出目录(默认 ./hint_sweep)
+  -i <raw_dir>     原始数据目录(默认用 forcing2d_synth 在 <work_dir>/raw 下生成)
+  -H <hints_dir>   提示文件目录，扫描其中所有 *.hints(默认使用内置的几组提示)
+  -p <profile_dir> 最快提示的输出目录(默认 <work_dir>/profile)
+  -n <ranks>       进程数列表，以逗号分隔(默认 1,2,4)
+  -t <tools>       要扫描的程序，raw2chunk,v0,v1 的子集(默认全部)
+  -v <variables>   变量列表(默认 FSDS,PRECTmms,TBOT)
+  -Y <ny> -X <nx>  合成数据的大小(默认 512 x 512)
+  -y <year> -m <month>     年份和月份(默认 2014-01)
+  -R <repeat>      每个配置重复的次数，取最短时间(默认 1)
+环境变量 MPIEXEC(默认 mpiexec) 和 MPIEXEC_FLAGS(如 --oversubscribe) 用于启动 MPI 程序。
+EOF
+}
+
+BIN_DIR=./exec
+WORK_DIR=./hint_sweep
+RAW_DIR=
+HINTS_DIR=
+PROFILE_DIR=
+RANKS=1,2,4
+TOOLS=raw2chunk,v0,v1
+VARS=FSDS,PRECTmms,TBOT
+NY=512
+NX=512
+YEAR=2014
+MONTH=1
+REPEAT=1
+MPIEXEC=${MPIEXEC:-mpiexec}
+
+while getopts "b:w:i:H:p:n:t:v:Y:X:y:m:R:h" opt; do
+    case $opt in
+        b) BIN_DIR=$OPTARG ;;
+        w) WORK_DIR=$OPTARG ;;
+        i) RAW_DIR=$OPTARG ;;
+        H) HINTS_DIR=$OPTARG ;;
+        p) PROFILE_DIR=$OPTARG ;;
+        n) RANKS=$OPTARG ;;
+        t) TOOLS=$OPTARG ;;
+        v) VARS=$OPTARG ;;
+        Y) NY=$OPTARG ;;
+        X) NX=$OPTARG ;;
+        y) YEAR=$OPTARG ;;
+        m) MONTH=$OPTARG ;;
+        R) REPEAT=$OPTARG ;;
+        h) usage; exit 0 ;;
+        *) usage; exit 1 ;;
+    esac
+done
+
+MM=$(printf "%02d" "$MONTH")
+OUT_DIR=$WORK_DIR/out
+PROFILE_DIR=${PROFILE_DIR:-$WORK_DIR/profile}
+LOG=$WORK_DIR/sweep.log
+mkdir -p "$OUT_DIR" "$PROFILE_DIR"
+: > "$LOG"
+
+IFS=, read -r -a RANK_LIST <<< "$RANKS"
+IFS=, read -r -a TOOL_LIST <<< "$TOOLS"
+IFS=, read -r -a VAR_LIST <<< "$VARS"
+NVARS=${#VAR_LIST[@]}
+MAX_RANKS=$(printf "%s\n" "${RANK_LIST[@]}" | sort -n | tail -1)
+
+# 运行一个 MPI 程序 REPEAT 次，输出最短的墙钟时间（秒）；失败时输出 fail
+run_timed() {
+    local ranks=$1 best= t0 t1 dt i
+    shift
+    for ((i = 0; i < REPEAT; i++)); do
+        echo "$MPIEXEC $MPIEXEC_FLAGS -n $ranks $*" >> "$LOG"
+        t0=$(date +%s.%N)
+        if ! $MPIEXEC $MPIEXEC_FLAGS -n "$ranks" "$@" >> "$LOG" 2>&1; then
+            echo fail
+            return
+        fi
+        t1=$(date +%s.%N)
+        dt=$(awk "BEGIN { print $t1 - $t0 }")
+        if [ -z "$best" ] || awk "BEGIN { exit !($dt < $best) }"; then
+            best=$dt
+        fi
+    done
+    echo "$best"
+}
+
+# 内置的提示：默认值、集合缓冲区大小、集合读写开关、PnetCDF 头部/变量对齐和 Lustre 条带
+write_builtin_hints() {
+    local dir=$1
+    mkdir -p "$dir"
+    echo "# 不设置任何提示，作为对照" > "$dir/default.hints"
+    printf "cb_buffer_size = 16777216\n" > "$dir/cb16m.hints"
+    printf "cb_buffer_size = 67108864\n" > "$dir/cb64m.hints"
+    printf "romio_cb_read = enable\nromio_cb_write = enable\n" > "$dir/cb_enable.hints"
+    printf "romio_cb_read = disable\nromio_cb_write = disable\n" > "$dir/cb_disable.hints"
+    printf "nc_header_align_size = 1048576\nnc_var_align_size = 1048576\n" > "$dir/align1m.hints"
+    printf "striping_factor = 8\nstriping_unit = 4194304\n" > "$dir/stripe8x4m.hints"
+}
+
+if [ -z "$HINTS_DIR" ]; then
+    HINTS_DIR=$WORK_DIR/hints
+    write_builtin_hints "$HINTS_DIR"
+fi
+HINT_FILES=("$HINTS_DIR"/*.hints)
+if [ ! -e "${HINT_FILES[0]}" ]; then
+    echo "$HINTS_DIR 中没有 *.hints 文件"
+    exit 1
+fi
+
+# 第一步：准备原始数据，没有给出时生成合成数据
+if [ -z "$RAW_DIR" ]; then
+    RAW_DIR=$WORK_DIR/raw
+    mkdir -p "$RAW_DIR"
+    echo "生成合成数据: ${NY} x ${NX}, 变量 $VARS"
+    t=$(run_timed "$MAX_RANKS" "$BIN_DIR/forcing2d_synth" -o "$RAW_DIR" -y "$YEAR" -m "$MONTH" -v "$VARS" \
+        -Y "$NY" -X "$NX")
+    if [ "$t" = fail ]; then
+        echo "forcing2d_synth 失败，见 $LOG"
+        exit 1
+    fi
+fi
+RAW_FILES=()
+for v in "${VAR_LIST[@]}"; do
+    RAW_FILES+=("$RAW_DIR/clmforc.Daymet4.1km.$v.$YEAR-$MM.nc")
+done
+
+# v1 读取的分块文件用默认提示转换一次，各组提示只影响 v1 本身的读写
+has_tool() {
+    local t
+    for t in "${TOOL_LIST[@]}"; do
+        [ "$t" = "$1" ] && return 0
+    done
+    return 1
+}
+CHUNK_DIR=$WORK_DIR/chunk
+if has_tool v1; then
+    mkdir -p "$CHUNK_DIR"
+    for f in "${RAW_FILES[@]}"; do
+        t=$(run_timed "$MAX_RANKS" "$BIN_DIR/forcing2d_raw2chunk" "$f" "$CHUNK_DIR/$(basename "$f")")
+        if [ "$t" = fail ]; then
+            echo "forcing2d_raw2chunk 失败，见 $LOG"
+            exit 1
+        fi
+    done
+fi
+
+CSV=$WORK_DIR/sweep.csv
+echo "tool,ranks,hints,seconds" > "$CSV"
+
+# 第二步：每个进程数、每组提示运行一遍所选的程序
+for ranks in "${RANK_LIST[@]}"; do
+    for hf in "${HINT_FILES[@]}"; do
+        name=$(basename "$hf" .hints)
+        for tool in "${TOOL_LIST[@]}"; do
+            case $tool in
+                raw2chunk)
+                    mkdir -p "$WORK_DIR/chunk_$name"
+                    elapsed=0
+                    for f in "${RAW_FILES[@]}"; do
+                        t=$(run_timed "$ranks" "$BIN_DIR/forcing2d_raw2chunk" -H "$hf" "$f" \
+                            "$WORK_DIR/chunk_$name/$(basename "$f")")
+                        if [ "$t" = fail ]; then
+                            elapsed=fail
+                            break
+                        fi
+                        elapsed=$(awk "BEGIN { print $elapsed + $t }")
+                    done
+                    t=$elapsed
+                    ;;
+                v0|v1)
+                    if [ "$ranks" -lt "$NVARS" ]; then
+                        continue
+                    fi
+                    in_dir=$RAW_DIR
+                    [ "$tool" = v1 ] && in_dir=$CHUNK_DIR
+                    t=$(run_timed "$ranks" "$BIN_DIR/forcing2d_average_$tool" -i "$in_dir" -o "$OUT_DIR" \
+                        -y "$YEAR" -m "$MONTH" -v "$VARS" --hints "$hf")
+                    ;;
+                *)
+                    echo "未知的程序: $tool"
+                    exit 1
+                    ;;
+            esac
+            echo "$tool,$ranks,$name,$t" >> "$CSV"
+            printf "%-10s ranks=%-4s hints=%-12s %s s\n" "$tool" "$ranks" "$name" "$t"
+        done
+    done
+done
+
+# 第三步：每个程序、每个进程数取最快的一组提示，与默认值比较
+awk -F, 'NR > 1 && $4 != "fail" {
+             k = $1 "," $2
+             if (!(k in best) || $4 < best[k]) { best[k] = $4; name[k] = $3 }
+             if ($3 == "default") base[k] = $4
+         }
+         END {
+             print "tool,ranks,hints,seconds,default_seconds,speedup"
+             for (k in best) {
+                 d = (k in base) ? base[k] : ""
+                 printf "%s,%s,%s,%s,%s\n", k, name[k], best[k], d, (d != "" ? sprintf("%.3f", d / best[k]) : "")
+             }
+         }' "$CSV" > "$PROFILE_DIR/profile.csv"
+
+tail -n +2 "$PROFILE_DIR/profile.csv" | while IFS=, read -r tool ranks name seconds base speedup; do
+    cp "$HINTS_DIR/$name.hints" "$PROFILE_DIR/${tool}_$ranks.hints"
+    echo "最快: $tool ranks=$ranks 使用 $name (${seconds} 秒, 相对默认 ${speedup:-?} 倍)"
+done
+
+echo "结果: $CSV, $PROFILE_DIR/profile.csv (运行日志 $LOG)"
@@ -0,0 +1,542 @@
+/*
+ * PnetCDF/MPI-IO 调用跟踪：forcing2d_iotrace
+ * 功能：包装各程序使用的 ncmpi_* 打开/创建/关闭与数据读写调用，以及 PnetCDF 内部使用的 MPI_File_* 调用，
+ * 统计每种调用的次数、数据量、时间、请求大小和是否连续，在 MPI_Finalize 时汇总所有进程并打印。
+ * 设置环境变量 FORCING2D_IOTRACE=<前缀> 时，每个进程另外把逐次调用的记录写到 <前缀>.<rank>.csv。
+ *
+ * 使用方式（程序代码无需修改）：
+ *   1. 与程序一起编译链接（PnetCDF 需为共享库）；
+ *   2. 编译为共享库后通过 LD_PRELOAD 加载。
+ * ncmpi_* 通过 dlsym(RTLD_NEXT) 找到 PnetCDF 中的实现，MPI_File_* 和 MPI_Finalize 通过 MPI 的 PMPI 接口包装。
+ * 数据调用中嵌套的 MPI-IO 时间单独累计，其余时间为 PnetCDF 自身的开销（打包、chunk 压缩/解压、元数据通信）
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <mpi.h>
+#include <pnetcdf.h>
+
+/* 跟踪的调用 */
+enum {
+    OP_NC_OPEN, OP_NC_CREATE, OP_NC_ENDDEF, OP_NC_CLOSE,
+    OP_NC_GET_VARA_ALL, OP_NC_PUT_VARA_ALL, OP_NC_GET_VARA, OP_NC_PUT_VARA,
+    OP_NC_GET_VAR_ALL, OP_NC_PUT_VAR_ALL,
+    OP_NC_GET_VARA_FLOAT_ALL, OP_NC_PUT_VARA_FLOAT_ALL, OP_NC_GET_VARA_DOUBLE_ALL, OP_NC_PUT_VARA_DOUBLE_ALL,
+    OP_NC_GET_VARA_INT_ALL, OP_NC_PUT_VARA_INT_ALL, OP_NC_GET_VAR_INT_ALL,
+    OP_FILE_OPEN, OP_FILE_CLOSE, OP_FILE_SET_VIEW,
+    OP_FILE_READ_AT, OP_FILE_READ_AT_ALL, OP_FILE_WRITE_AT, OP_FILE_WRITE_AT_ALL,
+    OP_FILE_READ, OP_FILE_READ_ALL, OP_FILE_WRITE, OP_FILE_WRITE_ALL,
+    NUM_OPS
+};
+
+static const char *op_names[NUM_OPS] = {
+    "ncmpi_open", "ncmpi_create", "ncmpi_enddef", "ncmpi_close",
+    "ncmpi_get_vara_all", "ncmpi_put_vara_all", "ncmpi_get_vara", "ncmpi_put_vara",
+    "ncmpi_get_var_all", "ncmpi_put_var_all",
+    "ncmpi_get_vara_float_all", "ncmpi_put_vara_float_all", "ncmpi_get_vara_double_all", "ncmpi_put_vara_double_all",
+    "ncmpi_get_vara_int_all", "ncmpi_put_vara_int_all", "ncmpi_get_var_int_all",
+    "MPI_File_open", "MPI_File_close", "MPI_File_set_view",
+    "MPI_File_read_at", "MPI_File_read_at_all", "MPI_File_write_at", "MPI_File_write_at_all",
+    "MPI_File_read", "MPI_File_read_all", "MPI_File_write", "MPI_File_write_all",
+};
+
+/* 请求大小分布的分界：4KB, 64KB, 1MB, 16MB */
+#define NUM_SIZE_BINS 5
+static const double size_bins[NUM_SIZE_BINS - 1] = {4096.0, 65536.0, 1048576.0, 16777216.0};
+static const char *size_bin_names[NUM_SIZE_BINS] = {"<4KB", "4KB-64KB", "64KB-1MB", "1MB-16MB", ">=16MB"};
+
+/* 记录 ncid 所用通信子的表，ncid 超出范围时记为未知 */
+#define MAX_TRACED_NCIDS 4096
+/* 日志中 start/count 最多记录的维数 */
+#define TRACE_MAX_DIMS 8
+
+/* 每种调用的累计值，汇总时按求和、最小、最大分别归约 */
+typedef struct {
+    double calls, bytes, time, io_time, contiguous;
+    double size_hist[NUM_SIZE_BINS];
+} op_sum_t;
+
+static op_sum_t op_sum[NUM_OPS];
+static double op_min_req[NUM_OPS];
+static double op_max_req[NUM_OPS];
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *trace_log = NULL;
+static int trace_log_opened = 0;
+static int ncid_comm_size[MAX_TRACED_NCIDS];
+static char ncid_comm_label[MAX_TRACED_NCIDS][8];
+
+/* 当前线程的 ncmpi 调用嵌套深度，以及最外层调用中累计的 MPI-IO 时间 */
+static __thread int nc_depth = 0;
+static __thread double nc_io_time = 0.0;
+
+/* 一次 ncmpi 或 MPI-IO 调用的记录 */
+typedef struct {
+    int op;
+    int active;             /* 嵌套在其他 ncmpi 调用中时不单独记录 */
+    int ncid, varid;
+    int ndims;
+    MPI_Offset start[TRACE_MAX_DIMS], count[TRACE_MAX_DIMS];
+    int contiguous;
+    int comm_size;
+    const char *comm_label;
+    double t0;
+} trace_call_t;
+
+/* 在 PnetCDF 库中查找被包装的函数 */
+static void *real_symbol(const char *name) {
+    void *p = dlsym(RTLD_NEXT, name);
+    if (p == NULL) {
+        fprintf(stderr, "forcing2d_iotrace: cannot find %s, PnetCDF must be a shared library\n", name);
+        PMPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    return p;
+}
+
+#define LOOKUP_REAL(real, name) \
+    if (real == NULL) real = (__typeof__(real))real_symbol(#name)
+
+/* 通信子的标签：world、self 或其他大小的子通信子 */
+static const char *comm_label(MPI_Comm comm, int *size) {
+    int cmp;
+    PMPI_Comm_size(comm, size);
+    PMPI_Comm_compare(comm, MPI_COMM_WORLD, &cmp);
+    if (cmp == MPI_IDENT || cmp == MPI_CONGRUENT) return "world";
+    return (*size == 1) ? "self" : "sub";
+}
+
+/* 第一次记录时打开本进程的日志文件 */
+static void open_trace_log(void) {
+    const char *prefix = getenv("FORCING2D_IOTRACE");
+    char path[1024];
+    int rank;
+    trace_log_opened = 1;
+    if (prefix == NULL || prefix[0] == '\0') return;
+    PMPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    snprintf(path, sizeof(path), "%s.%d.csv", prefix, rank);
+    trace_log = fopen(path, "w");
+    if (trace_log == NULL) {
+        fprintf(stderr, "forcing2d_iotrace: cannot create %s\n", path);
+        return;
+    }
+    fprintf(trace_log, "call,ncid,varid,comm,comm_size,start,count,bytes,begin,seconds,mpiio_seconds,contiguous\n");
+}
+
+/* 累计一次调用并写日志 */
+static void trace_record(const trace_call_t *c, double bytes, double t1, double io_time) {
+    op_sum_t *s = &op_sum[c->op];
+    double dt = t1 - c->t0;
+    int b = 0, i;
+
+    while (b < NUM_SIZE_BINS - 1 && bytes >= size_bins[b]) b++;
+    pthread_mutex_lock(&trace_lock);
+    if (s->calls == 0.0 || bytes < op_min_req[c->op]) op_min_req[c->op] = bytes;
+    if (bytes > op_max_req[c->op]) op_max_req[c->op] = bytes;
+    s->calls += 1.0;
+    s->bytes += bytes;
+    s->time += dt;
+    s->io_time += io_time;
+    s->contiguous += c->contiguous;
+    s->size_hist[b] += 1.0;
+
+    if (!trace_log_opened) open_trace_log();
+    if (trace_log != NULL) {
+        fprintf(trace_log, "%s,%d,%d,%s,%d,", op_names[c->op], c->ncid, c->varid, c->comm_label, c->comm_size);
+        for (i = 0; i < c->ndims; i++) fprintf(trace_log, "%s%lld", i ? ":" : "", (long long)c->start[i]);
+        fprintf(trace_log, ",");
+        for (i = 0; i < c->ndims; i++) fprintf(trace_log, "%s%lld", i ? ":" : "", (long long)c->count[i]);
+        fprintf(trace_log, ",%.0f,%.6f,%.6f,%.6f,%d\n", bytes, c->t0, dt, io_time, c->contiguous);
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/* ---------- ncmpi 调用 ---------- */
+
+/* 开始一次 ncmpi 调用。start 为 NULL 时表示整个变量；
+ * 连续是指请求在变量的行优先顺序中是一段连续区域：第一个长度不为1的维度之后的维度都取满 */
+static void nc_begin(trace_call_t *c, int op, int ncid, int varid, const MPI_Offset *start, const MPI_Offset *count) {
+    int dimids[NC_MAX_VAR_DIMS];
+    MPI_Offset len[NC_MAX_VAR_DIMS];
+    int i, ndims = 0, first;
+
+    memset(c, 0, sizeof(*c));
+    c->active = (nc_depth++ == 0);
+    if (!c->active) return;
+    nc_io_time = 0.0;
+    c->op = op;
+    c->ncid = ncid;
+    c->varid = varid;
+    c->contiguous = 1;
+    if (ncid >= 0 && ncid < MAX_TRACED_NCIDS && ncid_comm_size[ncid] > 0) {
+        c->comm_size = ncid_comm_size[ncid];
+        c->comm_label = ncid_comm_label[ncid];
+    } else {
+        c->comm_label = "?";
+    }
+
+    if (varid >= 0 && ncmpi_inq_varndims(ncid, varid, &ndims) == NC_NOERR && ndims <= NC_MAX_VAR_DIMS &&
+        ncmpi_inq_vardimid(ncid, varid, dimids) == NC_NOERR) {
+        for (i = 0; i < ndims; i++) {
+            if (ncmpi_inq_dimlen(ncid, dimids[i], &len[i]) != NC_NOERR) len[i] = -1;
+        }
+        c->ndims = (ndims < TRACE_MAX_DIMS) ? ndims : TRACE_MAX_DIMS;
+        for (i = 0; i < c->ndims; i++) {
+            c->start[i] = start ? start[i] : 0;
+            c->count[i] = start ? count[i] : len[i];
+        }
+        if (start != NULL) {
+            for (first = 0; first < ndims && count[first] == 1; first++);
+            for (i = first + 1; i < ndims; i++) {
+                if (count[i] != len[i]) c->contiguous = 0;
+            }
+        }
+    }
+    c->t0 = MPI_Wtime();
+}
+
+/* 结束一次 ncmpi 调用，bytes 为内存中的数据量 */
+static void nc_end(trace_call_t *c, double bytes) {
+    double t1 = MPI_Wtime();
+    nc_depth--;
+    if (c->active) trace_record(c, bytes, t1, nc_io_time);
+}
+
+/* 请求的元素个数 */
+static double nc_elems(const trace_call_t *c) {
+    double n = 1.0;
+    int i;
+    for (i = 0; i < c->ndims; i++) n *= (double)c->count[i];
+    return n;
+}
+
+/* 灵活接口的数据量：bufcount 为 -1 时 buftype 为元素类型 */
+static double flex_bytes(const trace_call_t *c, MPI_Offset bufcount, MPI_Datatype buftype) {
+    int size = 0;
+    if (buftype == MPI_DATATYPE_NULL) return 0.0;
+    PMPI_Type_size(buftype, &size);
+    return (bufcount < 0) ? nc_elems(c) * size : (double)bufcount * size;
+}
+
+/* 记录 ncid 所用的通信子 */
+static void nc_remember_comm(int ncid, MPI_Comm comm) {
+    int size;
+    const char *label;
+    if (ncid < 0 || ncid >= MAX_TRACED_NCIDS) return;
+    label = comm_label(comm, &size);
+    ncid_comm_size[ncid] = size;
+    strcpy(ncid_comm_label[ncid], label);
+}
+
+int ncmpi_open(MPI_Comm comm, const char *path, int omode, MPI_Info info, int *ncidp) {
+    static __typeof__(&ncmpi_open) real = NULL;
+    trace_call_t c;
+    int ret, size;
+    LOOKUP_REAL(real, ncmpi_open);
+    nc_begin(&c, OP_NC_OPEN, -1, -1, NULL, NULL);
+    c.comm_label = comm_label(comm, &size);
+    c.comm_size = size;
+    ret = real(comm, path, omode, info, ncidp);
+    if (ret == NC_NOERR) {
+        c.ncid = *ncidp;
+        nc_remember_comm(*ncidp, comm);
+    }
+    nc_end(&c, 0.0);
+    return ret;
+}
+
+int ncmpi_create(MPI_Comm comm, const char *path, int cmode, MPI_Info info, int *ncidp) {
+    static __typeof__(&ncmpi_create) real = NULL;
+    trace_call_t c;
+    int ret, size;
+    LOOKUP_REAL(real, ncmpi_create);
+    nc_begin(&c, OP_NC_CREATE, -1, -1, NULL, NULL);
+    c.comm_label = comm_label(comm, &size);
+    c.comm_size = size;
+    ret = real(comm, path, cmode, info, ncidp);
+    if (ret == NC_NOERR) {
+        c.ncid = *ncidp;
+        nc_remember_comm(*ncidp, comm);
+    }
+    nc_end(&c, 0.0);
+    return ret;
+}
+
+int ncmpi_enddef(int ncid) {
+    static __typeof__(&ncmpi_enddef) real = NULL;
+    trace_call_t c;
+    int ret;
+    LOOKUP_REAL(real, ncmpi_enddef);
+    nc_begin(&c, OP_NC_ENDDEF, ncid, -1, NULL, NULL);
+    ret = real(ncid);
+    nc_end(&c, 0.0);
+    return ret;
+}
+
+int ncmpi_close(int ncid) {
+    static __typeof__(&ncmpi_close) real = NULL;
+    trace_call_t c;
+    int ret;
+    LOOKUP_REAL(real, ncmpi_close);
+    nc_begin(&c, OP_NC_CLOSE, ncid, -1, NULL, NULL);
+    ret = real(ncid);
+    nc_end(&c, 0.0);
+    if (ncid >= 0 && ncid < MAX_TRACED_NCIDS) ncid_comm_size[ncid] = 0;
+    return ret;
+}
+
+/* 灵活接口的子数组读写 */
+#define TRACE_FLEX_VARA(OP, NAME, CONST) \
+int NAME(int ncid, int varid, const MPI_Offset *start, const MPI_Offset *count, \
+         CONST void *buf, MPI_Offset bufcount, MPI_Datatype buftype) { \
+    static __typeof__(&NAME) real = NULL; \
+    trace_call_t c; \
+    int ret; \
+    LOOKUP_REAL(real, NAME); \
+    nc_begin(&c, OP, ncid, varid, start, count); \
+    ret = real(ncid, varid, start, count, buf, bufcount, buftype); \
+    nc_end(&c, c.active ? flex_bytes(&c, bufcount, buftype) : 0.0); \
+    return ret; \
+}
+
+TRACE_FLEX_VARA(OP_NC_GET_VARA_ALL, ncmpi_get_vara_all, )
+TRACE_FLEX_VARA(OP_NC_PUT_VARA_ALL, ncmpi_put_vara_all, const)
+TRACE_FLEX_VARA(OP_NC_GET_VARA, ncmpi_get_vara, )
+TRACE_FLEX_VARA(OP_NC_PUT_VARA, ncmpi_put_vara, const)
+
+/* 灵活接口的整个变量读写 */
+#define TRACE_FLEX_VAR(OP, NAME, CONST) \
+int NAME(int ncid, int varid, CONST void *buf, MPI_Offset bufcount, MPI_Datatype buftype) { \
+    static __typeof__(&NAME) real = NULL; \
+    trace_call_t c; \
+    int ret; \
+    LOOKUP_REAL(real, NAME); \
+    nc_begin(&c, OP, ncid, varid, NULL, NULL); \
+    ret = real(ncid, varid, buf, bufcount, buftype); \
+    nc_end(&c, c.active ? flex_bytes(&c, bufcount, buftype) : 0.0); \
+    return ret; \
+}
+
+TRACE_FLEX_VAR(OP_NC_GET_VAR_ALL, ncmpi_get_var_all, )
+TRACE_FLEX_VAR(OP_NC_PUT_VAR_ALL, ncmpi_put_var_all, const)
+
+/* 按类型的子数组读写 */
+#define TRACE_TYPED_VARA(OP, NAME, CONST, T) \
+int NAME(int ncid, int varid, const MPI_Offset *start, const MPI_Offset *count, CONST T *buf) { \
+    static __typeof__(&NAME) real = NULL; \
+    trace_call_t c; \
+    int ret; \
+    LOOKUP_REAL(real, NAME); \
+    nc_begin(&c, OP, ncid, varid, start, count); \
+    ret = real(ncid, varid, start, count, buf); \
+    nc_end(&c, nc_elems(&c) * sizeof(T)); \
+    return ret; \
+}
+
+TRACE_TYPED_VARA(OP_NC_GET_VARA_FLOAT_ALL, ncmpi_get_vara_float_all, , float)
+TRACE_TYPED_VARA(OP_NC_PUT_VARA_FLOAT_ALL, ncmpi_put_vara_float_all, const, float)
+TRACE_TYPED_VARA(OP_NC_GET_VARA_DOUBLE_ALL, ncmpi_get_vara_double_all, , double)
+TRACE_TYPED_VARA(OP_NC_PUT_VARA_DOUBLE_ALL, ncmpi_put_vara_double_all, const, double)
+TRACE_TYPED_VARA(OP_NC_GET_VARA_INT_ALL, ncmpi_get_vara_int_all, , int)
+TRACE_TYPED_VARA(OP_NC_PUT_VARA_INT_ALL, ncmpi_put_vara_int_all, const, int)
+
+int ncmpi_get_var_int_all(int ncid, int varid, int *buf) {
+    static __typeof__(&ncmpi_get_var_int_all) real = NULL;
+    trace_call_t c;
+    int ret;
+    LOOKUP_REAL(real, ncmpi_get_var_int_all);
+    nc_begin(&c, OP_NC_GET_VAR_INT_ALL, ncid, varid, NULL, NULL);
+    ret = real(ncid, varid, buf);
+    nc_end(&c, nc_elems(&c) * sizeof(int));
+    return ret;
+}
+
+/* ---------- MPI-IO 调用 ---------- */
+
+/* 开始一次 MPI-IO 调用。offset 为视图中的偏移，个别文件指针的调用传入 -1；
+ * 连续是指文件视图的 filetype 没有空洞 */
+static void io_begin(trace_call_t *c, int op, MPI_File fh, MPI_Offset offset) {
+    MPI_Offset disp;
+    MPI_Datatype etype, filetype;
+    MPI_Aint lb, extent;
+    MPI_Group group;
+    char datarep[MPI_MAX_DATAREP_STRING];
+    int size, nints, naddrs, ntypes, combiner;
+
+    memset(c, 0, sizeof(*c));
+    c->active = 1;
+    c->op = op;
+    c->ncid = c->varid = -1;
+    c->comm_label = "file";
+    c->contiguous = 1;
+    if (fh != MPI_FILE_NULL) {
+        PMPI_File_get_group(fh, &group);
+        PMPI_Group_size(group, &c->comm_size);
+        PMPI_Group_free(&group);
+
+        if (offset < 0) PMPI_File_get_position(fh, &offset);
+        if (PMPI_File_get_byte_offset(fh, offset, &disp) == MPI_SUCCESS) {
+            c->ndims = 1;
+            c->start[0] = disp;
+        }
+        PMPI_File_get_view(fh, &disp, &etype, &filetype, datarep);
+        PMPI_Type_size(filetype, &size);
+        PMPI_Type_get_extent(filetype, &lb, &extent);
+        c->contiguous = ((MPI_Aint)size == extent);
+        /* get_view 返回的派生类型需要释放 */
+        PMPI_Type_get_envelope(filetype, &nints, &naddrs, &ntypes, &combiner);
+        if (combiner != MPI_COMBINER_NAMED) PMPI_Type_free(&filetype);
+        PMPI_Type_get_envelope(etype, &nints, &naddrs, &ntypes, &combiner);
+        if (combiner != MPI_COMBINER_NAMED) PMPI_Type_free(&etype);
+    }
+    c->t0 = MPI_Wtime();
+}
+
+/* 结束一次 MPI-IO 调用；在 ncmpi 调用中时把时间计入该调用的 MPI-IO 时间 */
+static void io_end(trace_call_t *c, int count, MPI_Datatype datatype) {
+    double t1 = MPI_Wtime();
+    int size = 0;
+    if (datatype != MPI_DATATYPE_NULL) PMPI_Type_size(datatype, &size);
+    if (nc_depth > 0) nc_io_time += t1 - c->t0;
+    if (c->ndims == 1) c->count[0] = (MPI_Offset)count * size;
+    trace_record(c, (double)count * size, t1, t1 - c->t0);
+}
+
+int MPI_File_open(MPI_Comm comm, const char *filename, int amode, MPI_Info info, MPI_File *fh) {
+    trace_call_t c;
+    int ret;
+    io_begin(&c, OP_FILE_OPEN, MPI_FILE_NULL, 0);
+    c.comm_label = comm_label(comm, &c.comm_size);
+    ret = PMPI_File_open(comm, filename, amode, info, fh);
+    io_end(&c, 0, MPI_DATATYPE_NULL);
+    return ret;
+}
+
+int MPI_File_close(MPI_File *fh) {
+    trace_call_t c;
+    int ret;
+    io_begin(&c, OP_FILE_CLOSE, MPI_FILE_NULL, 0);
+    ret = PMPI_File_close(fh);
+    io_end(&c, 0, MPI_DATATYPE_NULL);
+    return ret;
+}
+
+int MPI_File_set_view(MPI_File fh, MPI_Offset disp, MPI_Datatype etype, MPI_Datatype filetype,
+                      const char *datarep, MPI_Info info) {
+    trace_call_t c;
+    int ret;
+    io_begin(&c, OP_FILE_SET_VIEW, MPI_FILE_NULL, 0);
+    ret = PMPI_File_set_view(fh, disp, etype, filetype, datarep, info);
+    io_end(&c, 0, MPI_DATATYPE_NULL);
+    return ret;
+}
+
+/* 显式偏移的读写 */
+#define TRACE_FILE_AT(OP, NAME, CONST) \
+int NAME(MPI_File fh, MPI_Offset offset, CONST void *buf, int count, MPI_Datatype datatype, MPI_Status *status) { \
+    trace_call_t c; \
+    int ret; \
+    io_begin(&c, OP, fh, offset); \
+    ret = P##NAME(fh, offset, buf, count, datatype, status); \
+    io_end(&c, count, datatype); \
+    return ret; \
+}
+
+TRACE_FILE_AT(OP_FILE_READ_AT, MPI_File_read_at, )
+TRACE_FILE_AT(OP_FILE_READ_AT_ALL, MPI_File_read_at_all, )
+TRACE_FILE_AT(OP_FILE_WRITE_AT, MPI_File_write_at, const)
+TRACE_FILE_AT(OP_FILE_WRITE_AT_ALL, MPI_File_write_at_all, const)
+
+/* 个别文件指针的读写 */
+#define TRACE_FILE_PTR(OP, NAME, CONST) \
+int NAME(MPI_File fh, CONST void *buf, int count, MPI_Datatype datatype, MPI_Status *status) { \
+    trace_call_t c; \
+    int ret; \
+    io_begin(&c, OP, fh, -1); \
+    ret = P##NAME(fh, buf, count, datatype, status); \
+    io_end(&c, count, datatype); \
+    return ret; \
+}
+
+TRACE_FILE_PTR(OP_FILE_READ, MPI_File_read, )
+TRACE_FILE_PTR(OP_FILE_READ_ALL, MPI_File_read_all, )
+TRACE_FILE_PTR(OP_FILE_WRITE, MPI_File_write, const)
+TRACE_FILE_PTR(OP_FILE_WRITE_ALL, MPI_File_write_all, const)
+
+/* ---------- 汇总 ---------- */
+
+/* 汇总所有进程的统计并由0号进程打印 */
+static void trace_report(void) {
+    const int nsum = sizeof(op_sum_t) / sizeof(double);
+    op_sum_t total[NUM_OPS];
+    double local_time[NUM_OPS], max_time[NUM_OPS];
+    double min_req[NUM_OPS], max_req[NUM_OPS];
+    double nc_time = 0.0, nc_io = 0.0, coll_io = 0.0, indep_io = 0.0;
+    double hist[NUM_SIZE_BINS] = {0.0};
+    int rank, nprocs, i, b;
+
+    PMPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    PMPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+    for (i = 0; i < NUM_OPS; i++) {
+        local_time[i] = op_sum[i].time;
+        /* 没有调用的进程不参与最小请求大小 */
+        min_req[i] = (op_sum[i].calls > 0.0) ? op_min_req[i] : 1e300;
+    }
+    PMPI_Reduce(op_sum, total, NUM_OPS * nsum, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    PMPI_Reduce(local_time, max_time, NUM_OPS, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    PMPI_Reduce(rank == 0 ? MPI_IN_PLACE : min_req, min_req, NUM_OPS, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD);
+    PMPI_Reduce(op_max_req, max_req, NUM_OPS, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    if (rank != 0) return;
+
+    printf("===== PnetCDF/MPI-IO 调用统计 (%d 个进程) =====\n", nprocs);
+    printf("%-26s %8s %12s %10s %10s %10s %24s %6s\n", "call", "calls", "MB", "sum(s)", "max(s)",
+           "MB/s", "req min/mean/max (KB)", "contig");
+    for (i = 0; i < NUM_OPS; i++) {
+        op_sum_t *t = &total[i];
+        char req[64];
+        if (t->calls == 0.0) continue;
+        snprintf(req, sizeof(req), "%.1f/%.1f/%.1f", min_req[i] / 1024.0, t->bytes / t->calls / 1024.0,
+                 max_req[i] / 1024.0);
+        printf("%-26s %8.0f %12.2f %10.4f %10.4f ", op_names[i], t->calls, t->bytes / 1048576.0, t->time,
+               max_time[i]);
+        if (t->bytes > 0.0 && max_time[i] > 0.0) {
+            printf("%10.2f %24s %5.0f%%\n", t->bytes / 1048576.0 / max_time[i], req, 100.0 * t->contiguous / t->calls);
+        } else {
+            printf("%10s %24s %6s\n", "-", "-", "-");
+        }
+        if (i >= OP_NC_GET_VARA_ALL && i <= OP_NC_GET_VAR_INT_ALL) {
+            nc_time += t->time;
+            nc_io += t->io_time;
+            for (b = 0; b < NUM_SIZE_BINS; b++) hist[b] += t->size_hist[b];
+        }
+        if (i == OP_FILE_READ_AT_ALL || i == OP_FILE_WRITE_AT_ALL || i == OP_FILE_READ_ALL || i == OP_FILE_WRITE_ALL) {
+            coll_io += t->time;
+        } else if (i >= OP_FILE_READ_AT) {
+            indep_io += t->time;
+        }
+    }
+    if (nc_time > 0.0) {
+        /* 两阶段集合 I/O 的数据交换发生在 MPI_File_*_all 内部，计入 MPI-IO 时间 */
+        printf("PnetCDF 数据调用共 %.4f 秒 (所有进程之和)，其中 MPI-IO %.4f 秒 (%.1f%%)，"
+               "其余 %.4f 秒为 PnetCDF 自身的打包、chunk 压缩/解压和元数据通信\n",
+               nc_time, nc_io, 100.0 * nc_io / nc_time, nc_time - nc_io);
+        printf("MPI-IO 集合调用 %.4f 秒 (含两阶段集合缓冲的数据交换)，独立调用 %.4f 秒\n", coll_io, indep_io);
+        printf("PnetCDF 数据请求大小分布:");
+        for (b = 0; b < NUM_SIZE_BINS; b++) {
+            printf(" %s %.0f%s", size_bin_names[b], hist[b], b < NUM_SIZE_BINS - 1 ? "," : "\n");
+        }
+    }
+}
+
+int MPI_Finalize(void) {
+    trace_report();
+    pthread_mutex_lock(&trace_lock);
+    if (trace_log != NULL) {
+        fclose(trace_log);
+        trace_log = NULL;
+    }
+    pthread_mutex_unlock(&trace_lock);
+    return PMPI_Finalize();
+}
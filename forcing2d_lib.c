@@ -0,0 +1,2512 @@
+/*
+ * forcing2d 公共库的实现，接口说明见 forcing2d_lib.h
+ */
+
+#include <ctype.h>
+#include <dirent.h>
+#include <math.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+#include "forcing2d_lib.h"
+
+/* ---------- 类型 ---------- */
+
+MPI_Datatype nc2mpitype(nc_type xtype) {
+    switch (xtype) {
+        case NC_CHAR:   return MPI_CHAR;
+        case NC_BYTE:   return MPI_SIGNED_CHAR;
+        case NC_SHORT:  return MPI_SHORT;
+        case NC_INT:    return MPI_INT;
+        case NC_FLOAT:  return MPI_FLOAT;
+        case NC_DOUBLE: return MPI_DOUBLE;
+        case NC_UBYTE:  return MPI_UNSIGNED_CHAR;
+        case NC_USHORT: return MPI_UNSIGNED_SHORT;
+        case NC_UINT:   return MPI_UNSIGNED;
+        case NC_INT64:  return MPI_LONG_LONG_INT;
+        case NC_UINT64: return MPI_UNSIGNED_LONG_LONG;
+        default:        return MPI_DATATYPE_NULL;
+    }
+}
+
+int nc_type_size(nc_type xtype) {
+    switch (xtype) {
+        case NC_BYTE:
+        case NC_CHAR:
+        case NC_UBYTE:  return 1;
+        case NC_SHORT:
+        case NC_USHORT: return 2;
+        case NC_INT:
+        case NC_UINT:
+        case NC_FLOAT:  return 4;
+        case NC_DOUBLE:
+        case NC_INT64:
+        case NC_UINT64: return 8;
+        default:        return 0;
+    }
+}
+
+nc_type accum_type(nc_type xtype) {
+    switch (xtype) {
+        case NC_INT:
+        case NC_UINT:
+        case NC_INT64:
+        case NC_UINT64:
+        case NC_DOUBLE: return NC_DOUBLE;
+        default:        return NC_FLOAT;
+    }
+}
+
+void *alloc_typed(nc_type xtype, MPI_Offset nelems) {
+    int size = nc_type_size(xtype);
+    if (size == 0) {
+        return NULL;
+    }
+    return malloc((nelems + 1) * size);
+}
+
+/* ---------- 变量读取 ---------- */
+
+int forcing_var_inq(int ncid, int varid, forcing_var_t *var) {
+    int ret;
+
+    memset(var, 0, sizeof(*var));
+    var->ncid = ncid;
+    var->varid = varid;
+    ret = ncmpi_inq_vartype(ncid, varid, &var->type);
+    CHECK_ERR(ret);
+    ret = ncmpi_inq_varndims(ncid, varid, &var->ndims);
+    CHECK_ERR(ret);
+    if (var->ndims > FORCING_MAX_DIMS) {
+        printf("Error: Variable has %d dimensions, at most %d supported\n", var->ndims, FORCING_MAX_DIMS);
+        return NC_EMAXDIMS;
+    }
+    ret = ncmpi_inq_vardimid(ncid, varid, var->dimids);
+    CHECK_ERR(ret);
+    for (int i = 0; i < var->ndims; i++) {
+        ret = ncmpi_inq_dimlen(ncid, var->dimids[i], &var->dim_sizes[i]);
+        CHECK_ERR(ret);
+    }
+
+    var->mpitype = nc2mpitype(var->type);
+    var->elem_size = nc_type_size(var->type);
+    var->acc_type = accum_type(var->type);
+    var->acc_mpitype = nc2mpitype(var->acc_type);
+    var->acc_size = nc_type_size(var->acc_type);
+    if (ncmpi_get_att_double(ncid, varid, "_FillValue", &var->fill) != NC_NOERR &&
+        ncmpi_get_att_double(ncid, varid, "missing_value", &var->fill) != NC_NOERR) {
+        var->fill = NAN;
+    }
+    if (var->mpitype == MPI_DATATYPE_NULL || var->elem_size == 0) {
+        printf("Error: Unsupported variable type %d\n", var->type);
+        return NC_EBADTYPE;
+    }
+    return NC_NOERR;
+}
+
+int forcing_var_get(const forcing_var_t *var, const MPI_Offset *start, const MPI_Offset *count, void *buf) {
+    MPI_Offset nelems = 1;
+    for (int i = 0; i < var->ndims; i++) {
+        nelems *= count[i];
+    }
+    return ncmpi_get_vara_all(var->ncid, var->varid, start, count, buf, nelems, var->mpitype);
+}
+
+void inq_chunk_shape(const forcing_var_t *var, MPI_Offset *chunk_shape) {
+    int chunk_dim[FORCING_MAX_DIMS];
+    chunk_shape[0] = var->dim_sizes[0];
+    chunk_shape[1] = var->dim_sizes[1];
+    chunk_shape[2] = (var->ndims == 3) ? var->dim_sizes[2] : 1;
+    if (ncmpi_var_get_chunk(var->ncid, var->varid, chunk_dim) == NC_NOERR) {
+        for (int d = 0; d < var->ndims && d < 3; d++) {
+            if (chunk_dim[d] > 0) {
+                chunk_shape[d] = chunk_dim[d];
+            }
+        }
+    }
+}
+
+/* ---------- 划分 ---------- */
+
+void split_range(MPI_Offset n, int nparts, int part, MPI_Offset *start, MPI_Offset *count) {
+    MPI_Offset chunk = n / nparts;
+    MPI_Offset remainder = n % nparts;
+    *count = (part < remainder) ? chunk + 1 : chunk;
+    *start = (part < remainder) ? part * (chunk + 1) : part * chunk + remainder;
+}
+
+/* info 中的整数值，没有该键时返回0 */
+static MPI_Offset info_get_offset(MPI_Info info, const char *key) {
+    char value[MPI_MAX_INFO_VAL + 1];
+    int flag = 0;
+    if (info == MPI_INFO_NULL) return 0;
+    MPI_Info_get(info, key, MPI_MAX_INFO_VAL, value, &flag);
+    return flag ? atoll(value) : 0;
+}
+
+void split_layout_inq(const forcing_var_t *var, int dim, MPI_Info hints, split_layout_t *layout) {
+    int chunk_dim[FORCING_MAX_DIMS];
+    int unlimdim = -1;
+    MPI_Info file_info;
+
+    memset(layout, 0, sizeof(*layout));
+    if (ncmpi_var_get_chunk(var->ncid, var->varid, chunk_dim) == NC_NOERR && chunk_dim[dim] > 0) {
+        layout->chunk = chunk_dim[dim];
+        return;
+    }
+    if (ncmpi_inq_varoffset(var->ncid, var->varid, &layout->base) != NC_NOERR) return;
+    ncmpi_inq_unlimdim(var->ncid, &unlimdim);
+    if (dim == 0 && var->dimids[0] == unlimdim) {
+        ncmpi_inq_recsize(var->ncid, &layout->stride);
+    } else {
+        layout->stride = var->elem_size;
+        for (int d = dim + 1; d < var->ndims; d++) {
+            layout->stride *= var->dim_sizes[d];
+        }
+    }
+    layout->stripe = info_get_offset(hints, "striping_unit");
+    if (layout->stripe == 0 && ncmpi_inq_file_info(var->ncid, &file_info) == NC_NOERR) {
+        layout->stripe = info_get_offset(file_info, "striping_unit");
+        MPI_Info_free(&file_info);
+    }
+}
+
+/* 边界 i 的代价：切开 chunk 记2，共用条带记1 */
+static int split_cost(const split_layout_t *layout, MPI_Offset n, MPI_Offset i) {
+    int cost = 0;
+    if (i == 0 || i == n) return 0;
+    if (layout->chunk > 1 && i % layout->chunk != 0) cost += 2;
+    if (layout->stripe > 0 && (layout->base + i * layout->stride) % layout->stripe != 0) cost += 1;
+    return cost;
+}
+
+static void split_plan_stats(split_plan_t *plan, const split_layout_t *layout) {
+    MPI_Offset max_count = split_plan_max(plan);
+    plan->split_chunks = plan->shared_stripes = 0;
+    for (int p = 1; layout != NULL && p < plan->nparts; p++) {
+        int cost = split_cost(layout, plan->n, plan->bounds[p]);
+        if (cost >= 2) plan->split_chunks++;
+        if (cost % 2 == 1) plan->shared_stripes++;
+    }
+    plan->imbalance = (plan->n > 0) ? max_count * (double)plan->nparts / plan->n : 1.0;
+}
+
+int split_plan(MPI_Offset n, int nparts, const split_layout_t *layout, split_plan_t *plan) {
+    MPI_Offset s, c;
+    plan->n = n;
+    plan->nparts = nparts;
+    plan->bounds = (MPI_Offset *)malloc((nparts + 1) * sizeof(MPI_Offset));
+    if (plan->bounds == NULL) return -1;
+    for (int p = 0; p < nparts; p++) {
+        split_range(n, nparts, p, &s, &c);
+        plan->bounds[p] = s;
+    }
+    plan->bounds[nparts] = n;
+
+    /* 每个边界在均匀位置 ±slack 内取代价最小、离均匀位置最近的点，且不早于前一个边界 */
+    if (layout != NULL && (layout->chunk > 1 || layout->stripe > 0)) {
+        MPI_Offset slack = (MPI_Offset)(SPLIT_PLAN_SLACK * n / nparts / 2);
+        for (int p = 1; p < nparts; p++) {
+            MPI_Offset ideal = plan->bounds[p], best = ideal;
+            int best_cost;
+            if (best < plan->bounds[p - 1]) best = plan->bounds[p - 1];
+            best_cost = split_cost(layout, n, best);
+            /* 由近及远，先下后上，找到代价为0的位置即停止 */
+            for (MPI_Offset d = 1; d <= slack && best_cost > 0; d++) {
+                MPI_Offset cand[2] = {ideal - d, ideal + d};
+                for (int k = 0; k < 2; k++) {
+                    int cost;
+                    if (cand[k] < plan->bounds[p - 1] || cand[k] > n) continue;
+                    cost = split_cost(layout, n, cand[k]);
+                    if (cost < best_cost) {
+                        best = cand[k];
+                        best_cost = cost;
+                    }
+                }
+            }
+            plan->bounds[p] = best;
+        }
+    }
+    split_plan_stats(plan, layout);
+    return 0;
+}
+
+void split_plan_part(const split_plan_t *plan, int part, MPI_Offset *start, MPI_Offset *count) {
+    *start = plan->bounds[part];
+    *count = plan->bounds[part + 1] - plan->bounds[part];
+}
+
+MPI_Offset split_plan_max(const split_plan_t *plan) {
+    MPI_Offset max_count = 0;
+    for (int p = 0; p < plan->nparts; p++) {
+        if (plan->bounds[p + 1] - plan->bounds[p] > max_count) {
+            max_count = plan->bounds[p + 1] - plan->bounds[p];
+        }
+    }
+    return max_count;
+}
+
+void split_plan_report(const split_plan_t *plan, const split_layout_t *layout, const char *what) {
+    split_plan_t uniform;
+    if (split_plan(plan->n, plan->nparts, NULL, &uniform) != 0) return;
+    split_plan_stats(&uniform, layout);
+    printf("划分 %s: %lld 分成 %d 份, chunk %lld, 条带 %lld 字节 (偏移 %lld, 步长 %lld)\n", what, plan->n,
+           plan->nparts, layout->chunk, layout->stripe, layout->base, layout->stride);
+    printf("  均匀划分: 最大/平均 %.3f, 切开 chunk 的边界 %d, 共用条带的边界 %d\n", uniform.imbalance,
+           uniform.split_chunks, uniform.shared_stripes);
+    printf("  对齐划分: 最大/平均 %.3f, 切开 chunk 的边界 %d, 共用条带的边界 %d\n", plan->imbalance,
+           plan->split_chunks, plan->shared_stripes);
+    split_plan_free(&uniform);
+}
+
+void split_plan_free(split_plan_t *plan) {
+    free(plan->bounds);
+    plan->bounds = NULL;
+}
+
+/* ---------- 归约 ---------- */
+
+/* 每种输入类型一个内核，直接从原始类型累加到累加类型 */
+#define DEFINE_SUM_KERNEL(NAME, IN_T, ACC_T) \
+    static void NAME(const void *src, MPI_Offset n, void *sum) { \
+        const IN_T *s = (const IN_T *)src; \
+        ACC_T *d = (ACC_T *)sum; \
+        for (MPI_Offset k = 0; k < n; k++) { \
+            d[k] += (ACC_T)s[k]; \
+        } \
+    }
+
+DEFINE_SUM_KERNEL(sum_byte, signed char, float)
+DEFINE_SUM_KERNEL(sum_ubyte, unsigned char, float)
+DEFINE_SUM_KERNEL(sum_short, short, float)
+DEFINE_SUM_KERNEL(sum_ushort, unsigned short, float)
+DEFINE_SUM_KERNEL(sum_float, float, float)
+DEFINE_SUM_KERNEL(sum_int, int, double)
+DEFINE_SUM_KERNEL(sum_uint, unsigned int, double)
+DEFINE_SUM_KERNEL(sum_int64, long long, double)
+DEFINE_SUM_KERNEL(sum_uint64, unsigned long long, double)
+DEFINE_SUM_KERNEL(sum_double, double, double)
+
+sum_kernel_t sum_kernel(nc_type xtype) {
+    switch (xtype) {
+        case NC_BYTE:   return sum_byte;
+        case NC_UBYTE:  return sum_ubyte;
+        case NC_SHORT:  return sum_short;
+        case NC_USHORT: return sum_ushort;
+        case NC_FLOAT:  return sum_float;
+        case NC_INT:    return sum_int;
+        case NC_UINT:   return sum_uint;
+        case NC_INT64:  return sum_int64;
+        case NC_UINT64: return sum_uint64;
+        case NC_DOUBLE: return sum_double;
+        default:        return NULL;
+    }
+}
+
+void sum_planes(const forcing_var_t *var, const void *planes, MPI_Offset nplanes, MPI_Offset plane_size, void *sum) {
+    sum_kernel_t kernel = sum_kernel(var->type);
+    const char *src = (const char *)planes;
+    for (MPI_Offset t = 0; t < nplanes; t++) {
+        kernel(src + t * plane_size * var->elem_size, plane_size, sum);
+    }
+}
+
+void scale_values(nc_type acc_type, void *values, MPI_Offset n, double factor) {
+    if (acc_type == NC_DOUBLE) {
+        double *v = (double *)values;
+        for (MPI_Offset k = 0; k < n; k++) {
+            v[k] *= factor;
+        }
+    } else {
+        float *v = (float *)values;
+        float f = (float)factor;
+        for (MPI_Offset k = 0; k < n; k++) {
+            v[k] *= f;
+        }
+    }
+}
+
+/* 每种输入类型一个内核，m2[k] += (src[k] - mean[k])^2，始终在 double 中计算 */
+#define DEFINE_SQ_DEV_KERNEL(NAME, IN_T) \
+    static void NAME(const void *src, MPI_Offset n, const double *mean, double *m2) { \
+        const IN_T *s = (const IN_T *)src; \
+        for (MPI_Offset k = 0; k < n; k++) { \
+            double d = (double)s[k] - mean[k]; \
+            m2[k] += d * d; \
+        } \
+    }
+
+DEFINE_SQ_DEV_KERNEL(sq_dev_byte, signed char)
+DEFINE_SQ_DEV_KERNEL(sq_dev_ubyte, unsigned char)
+DEFINE_SQ_DEV_KERNEL(sq_dev_short, short)
+DEFINE_SQ_DEV_KERNEL(sq_dev_ushort, unsigned short)
+DEFINE_SQ_DEV_KERNEL(sq_dev_float, float)
+DEFINE_SQ_DEV_KERNEL(sq_dev_int, int)
+DEFINE_SQ_DEV_KERNEL(sq_dev_uint, unsigned int)
+DEFINE_SQ_DEV_KERNEL(sq_dev_int64, long long)
+DEFINE_SQ_DEV_KERNEL(sq_dev_uint64, unsigned long long)
+DEFINE_SQ_DEV_KERNEL(sq_dev_double, double)
+
+void sum_sq_dev_planes(const forcing_var_t *var, const void *planes, MPI_Offset nplanes, MPI_Offset plane_size,
+                       const double *mean, double *m2) {
+    void (*kernel)(const void *, MPI_Offset, const double *, double *);
+    const char *src = (const char *)planes;
+    switch (var->type) {
+        case NC_BYTE:   kernel = sq_dev_byte; break;
+        case NC_UBYTE:  kernel = sq_dev_ubyte; break;
+        case NC_SHORT:  kernel = sq_dev_short; break;
+        case NC_USHORT: kernel = sq_dev_ushort; break;
+        case NC_FLOAT:  kernel = sq_dev_float; break;
+        case NC_INT:    kernel = sq_dev_int; break;
+        case NC_UINT:   kernel = sq_dev_uint; break;
+        case NC_INT64:  kernel = sq_dev_int64; break;
+        case NC_UINT64: kernel = sq_dev_uint64; break;
+        case NC_DOUBLE: kernel = sq_dev_double; break;
+        default:        return;
+    }
+    for (MPI_Offset t = 0; t < nplanes; t++) {
+        kernel(src + t * plane_size * var->elem_size, plane_size, mean, m2);
+    }
+}
+
+/* 每种输入类型一个内核，在累加类型中计算 src - mean */
+#define DEFINE_ANOMALY_KERNEL(NAME, IN_T, ACC_T) \
+    static void NAME(const void *src, const void *mean, MPI_Offset n, void *out) { \
+        const IN_T *s = (const IN_T *)src; \
+        const ACC_T *m = (const ACC_T *)mean; \
+        ACC_T *d = (ACC_T *)out; \
+        for (MPI_Offset k = 0; k < n; k++) { \
+            d[k] = (ACC_T)s[k] - m[k]; \
+        } \
+    }
+
+DEFINE_ANOMALY_KERNEL(anomaly_byte, signed char, float)
+DEFINE_ANOMALY_KERNEL(anomaly_ubyte, unsigned char, float)
+DEFINE_ANOMALY_KERNEL(anomaly_short, short, float)
+DEFINE_ANOMALY_KERNEL(anomaly_ushort, unsigned short, float)
+DEFINE_ANOMALY_KERNEL(anomaly_float, float, float)
+DEFINE_ANOMALY_KERNEL(anomaly_int, int, double)
+DEFINE_ANOMALY_KERNEL(anomaly_uint, unsigned int, double)
+DEFINE_ANOMALY_KERNEL(anomaly_int64, long long, double)
+DEFINE_ANOMALY_KERNEL(anomaly_uint64, unsigned long long, double)
+DEFINE_ANOMALY_KERNEL(anomaly_double, double, double)
+
+void anomaly_plane(const forcing_var_t *var, const void *src, const void *mean, MPI_Offset n, void *out) {
+    switch (var->type) {
+        case NC_BYTE:   anomaly_byte(src, mean, n, out); break;
+        case NC_UBYTE:  anomaly_ubyte(src, mean, n, out); break;
+        case NC_SHORT:  anomaly_short(src, mean, n, out); break;
+        case NC_USHORT: anomaly_ushort(src, mean, n, out); break;
+        case NC_FLOAT:  anomaly_float(src, mean, n, out); break;
+        case NC_INT:    anomaly_int(src, mean, n, out); break;
+        case NC_UINT:   anomaly_uint(src, mean, n, out); break;
+        case NC_INT64:  anomaly_int64(src, mean, n, out); break;
+        case NC_UINT64: anomaly_uint64(src, mean, n, out); break;
+        case NC_DOUBLE: anomaly_double(src, mean, n, out); break;
+        default:        break;
+    }
+}
+
+void to_double(nc_type acc_type, const void *values, MPI_Offset n, double *out) {
+    if (acc_type == NC_DOUBLE) {
+        memcpy(out, values, n * sizeof(double));
+    } else {
+        const float *v = (const float *)values;
+        for (MPI_Offset k = 0; k < n; k++) {
+            out[k] = v[k];
+        }
+    }
+}
+
+void merge_moments(long long na, double *sum_a, double *m2_a,
+                   long long nb, const double *sum_b, const double *m2_b, MPI_Offset n) {
+    if (nb == 0) {
+        return;
+    }
+    if (na == 0) {
+        memcpy(sum_a, sum_b, n * sizeof(double));
+        memcpy(m2_a, m2_b, n * sizeof(double));
+        return;
+    }
+    double scale = (double)na * nb / (na + nb);
+    for (MPI_Offset k = 0; k < n; k++) {
+        double delta = sum_b[k] / nb - sum_a[k] / na;
+        m2_a[k] += m2_b[k] + delta * delta * scale;
+        sum_a[k] += sum_b[k];
+    }
+}
+
+/* ---------- 逐格点直方图 ---------- */
+
+int pixel_hist_init(pixel_hist_t *h, MPI_Offset ncells, int nbins, double lo, double hi) {
+    h->nbins = nbins;
+    h->lo = lo;
+    h->hi = hi;
+    h->ncells = ncells;
+    h->counts = (unsigned short *)calloc(ncells * nbins + 1, sizeof(unsigned short));
+    return (h->counts == NULL) ? -1 : 0;
+}
+
+/* 每种输入类型一个内核，把值换算为箱号后计数。箱号先在 double 中截断到 [0, nbins - 1] 再转换，
+ * 远超范围的值（如 1e36）转换为 int 会溢出 */
+#define DEFINE_HIST_KERNEL(NAME, IN_T) \
+    static void NAME(pixel_hist_t *h, const void *src, MPI_Offset n, MPI_Offset offset, double fill) { \
+        const IN_T *s = (const IN_T *)src; \
+        double scale = h->nbins / (h->hi - h->lo), top = h->nbins - 1; \
+        unsigned short *c = h->counts + offset * h->nbins; \
+        for (MPI_Offset k = 0; k < n; k++, c += h->nbins) { \
+            double v = (double)s[k]; \
+            if (v != v || v == fill) continue; \
+            double x = (v - h->lo) * scale; \
+            if (x < 0.0) x = 0.0; \
+            if (x > top) x = top; \
+            c[(int)x]++; \
+        } \
+    }
+
+DEFINE_HIST_KERNEL(hist_byte, signed char)
+DEFINE_HIST_KERNEL(hist_ubyte, unsigned char)
+DEFINE_HIST_KERNEL(hist_short, short)
+DEFINE_HIST_KERNEL(hist_ushort, unsigned short)
+DEFINE_HIST_KERNEL(hist_float, float)
+DEFINE_HIST_KERNEL(hist_int, int)
+DEFINE_HIST_KERNEL(hist_uint, unsigned int)
+DEFINE_HIST_KERNEL(hist_int64, long long)
+DEFINE_HIST_KERNEL(hist_uint64, unsigned long long)
+DEFINE_HIST_KERNEL(hist_double, double)
+
+void pixel_hist_add(pixel_hist_t *h, const forcing_var_t *var, const void *src, MPI_Offset n, MPI_Offset offset) {
+    switch (var->type) {
+        case NC_BYTE:   hist_byte(h, src, n, offset, var->fill); break;
+        case NC_UBYTE:  hist_ubyte(h, src, n, offset, var->fill); break;
+        case NC_SHORT:  hist_short(h, src, n, offset, var->fill); break;
+        case NC_USHORT: hist_ushort(h, src, n, offset, var->fill); break;
+        case NC_FLOAT:  hist_float(h, src, n, offset, var->fill); break;
+        case NC_INT:    hist_int(h, src, n, offset, var->fill); break;
+        case NC_UINT:   hist_uint(h, src, n, offset, var->fill); break;
+        case NC_INT64:  hist_int64(h, src, n, offset, var->fill); break;
+        case NC_UINT64: hist_uint64(h, src, n, offset, var->fill); break;
+        case NC_DOUBLE: hist_double(h, src, n, offset, var->fill); break;
+        default:        break;
+    }
+}
+
+void pixel_hist_quantile(const pixel_hist_t *h, double q, nc_type acc_type, void *out) {
+    double width = (h->hi - h->lo) / h->nbins;
+    for (MPI_Offset cell = 0; cell < h->ncells; cell++) {
+        const unsigned short *c = h->counts + cell * h->nbins;
+        long long total = 0, below = 0;
+        double value = NC_FILL_DOUBLE;
+        int b;
+        for (b = 0; b < h->nbins; b++) {
+            total += c[b];
+        }
+        if (total > 0) {
+            /* 找到累计计数首次达到 q * total 的箱，在箱内按计数线性插值 */
+            double target = q * total;
+            for (b = 0; b < h->nbins - 1 && below + c[b] < target; b++) {
+                below += c[b];
+            }
+            value = h->lo + (b + (c[b] > 0 ? (target - below) / c[b] : 0.0)) * width;
+        }
+        if (acc_type == NC_DOUBLE) {
+            ((double *)out)[cell] = value;
+        } else {
+            ((float *)out)[cell] = (total > 0) ? (float)value : NC_FILL_FLOAT;
+        }
+    }
+}
+
+void pixel_hist_free(pixel_hist_t *h) {
+    free(h->counts);
+    h->counts = NULL;
+}
+
+/* ---------- 重网格化 ---------- */
+
+/* 依次尝试几个变量名，返回第一个存在的变量 */
+static int inq_varid_any(int ncid, const char *name1, const char *name2, int *varid) {
+    if (ncmpi_inq_varid(ncid, name1, varid) == NC_NOERR) {
+        return NC_NOERR;
+    }
+    return ncmpi_inq_varid(ncid, name2, varid);
+}
+
+static int inq_dimlen_any(int ncid, const char *name1, const char *name2, MPI_Offset *len) {
+    int ret, dimid;
+    if (ncmpi_inq_dimid(ncid, name1, &dimid) != NC_NOERR) {
+        ret = ncmpi_inq_dimid(ncid, name2, &dimid);
+        if (ret != NC_NOERR) return ret;
+    }
+    return ncmpi_inq_dimlen(ncid, dimid, len);
+}
+
+int regrid_weights_read(const char *file, MPI_Comm comm, regrid_weights_t *w) {
+    int ret, ncid, rank, size, varid_row, varid_col, varid_S, varid;
+    MPI_Offset n_s, start[2] = {0, 0}, count[2] = {0, 1};
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    memset(w, 0, sizeof(*w));
+
+    ret = ncmpi_open(comm, file, NC_NOWRITE, MPI_INFO_NULL, &ncid);
+    CHECK_ERR(ret);
+    ret = inq_dimlen_any(ncid, "n_s", "num_links", &n_s);
+    CHECK_ERR(ret);
+    ret = inq_dimlen_any(ncid, "n_a", "src_grid_size", &w->n_a);
+    CHECK_ERR(ret);
+    ret = inq_dimlen_any(ncid, "n_b", "dst_grid_size", &w->n_b);
+    CHECK_ERR(ret);
+
+    /* 一维网格的 *_grid_dims 只有一个元素，视为 ny = 1 */
+    w->src_dims[1] = w->dst_dims[1] = 1;
+    ret = ncmpi_inq_varid(ncid, "src_grid_dims", &varid);
+    CHECK_ERR(ret);
+    ret = ncmpi_get_var_int_all(ncid, varid, w->src_dims);
+    CHECK_ERR(ret);
+    ret = ncmpi_inq_varid(ncid, "dst_grid_dims", &varid);
+    CHECK_ERR(ret);
+    ret = ncmpi_get_var_int_all(ncid, varid, w->dst_dims);
+    CHECK_ERR(ret);
+
+    ret = inq_varid_any(ncid, "row", "dst_address", &varid_row);
+    CHECK_ERR(ret);
+    ret = inq_varid_any(ncid, "col", "src_address", &varid_col);
+    CHECK_ERR(ret);
+    ret = inq_varid_any(ncid, "S", "remap_matrix", &varid_S);
+    CHECK_ERR(ret);
+
+    /* 每个进程读取均匀的一段，SCRIP 的 remap_matrix 只取第一列（一阶守恒权重） */
+    split_range(n_s, size, rank, &start[0], &count[0]);
+    w->nnz = count[0];
+    w->row = (int *)malloc((w->nnz + 1) * sizeof(int));
+    w->col = (int *)malloc((w->nnz + 1) * sizeof(int));
+    w->S = (double *)malloc((w->nnz + 1) * sizeof(double));
+    ret = ncmpi_get_vara_int_all(ncid, varid_row, start, count, w->row);
+    CHECK_ERR(ret);
+    ret = ncmpi_get_vara_int_all(ncid, varid_col, start, count, w->col);
+    CHECK_ERR(ret);
+    ret = ncmpi_get_vara_double_all(ncid, varid_S, start, count, w->S);
+    CHECK_ERR(ret);
+    ret = ncmpi_close(ncid);
+    CHECK_ERR(ret);
+
+    /* 文件中的下标从1开始 */
+    for (MPI_Offset k = 0; k < w->nnz; k++) {
+        w->row[k]--;
+        w->col[k]--;
+    }
+    return 0;
+}
+
+int regrid_read_dst_coords(const char *file, MPI_Comm comm, MPI_Offset start, MPI_Offset count,
+                           double *lat, double *lon) {
+    int ret, ncid, varid_lat, varid_lon;
+    char units[NC_MAX_NAME+1] = "";
+    MPI_Offset len;
+
+    ret = ncmpi_open(comm, file, NC_NOWRITE, MPI_INFO_NULL, &ncid);
+    CHECK_ERR(ret);
+    ret = inq_varid_any(ncid, "yc_b", "dst_grid_center_lat", &varid_lat);
+    CHECK_ERR(ret);
+    ret = inq_varid_any(ncid, "xc_b", "dst_grid_center_lon", &varid_lon);
+    CHECK_ERR(ret);
+    ret = ncmpi_get_vara_double_all(ncid, varid_lat, &start, &count, lat);
+    CHECK_ERR(ret);
+    ret = ncmpi_get_vara_double_all(ncid, varid_lon, &start, &count, lon);
+    CHECK_ERR(ret);
+
+    /* SCRIP 文件的坐标可能以弧度存储 */
+    if (ncmpi_inq_attlen(ncid, varid_lat, "units", &len) == NC_NOERR && len <= NC_MAX_NAME) {
+        ret = ncmpi_get_att_text(ncid, varid_lat, "units", units);
+        CHECK_ERR(ret);
+        units[len] = '\0';
+    }
+    if (strncmp(units, "radian", 6) == 0) {
+        for (MPI_Offset k = 0; k < count; k++) {
+            lat[k] *= 180.0 / 3.14159265358979323846;
+            lon[k] *= 180.0 / 3.14159265358979323846;
+        }
+    }
+    ret = ncmpi_close(ncid);
+    CHECK_ERR(ret);
+    return 0;
+}
+
+void regrid_apply(const regrid_weights_t *w, const double *src, const MPI_Offset *roi, double fill, MPI_Comm comm,
+                  double *out) {
+    int rank, size, p;
+    MPI_Offset src_nx = w->src_dims[0];
+    MPI_Offset dst_nx = w->dst_dims[0];
+    MPI_Offset dst_ny = w->n_b / dst_nx;
+    MPI_Offset row_start, row_count;
+    double *num = (double *)calloc(w->n_b + 1, sizeof(double));
+    double *den = (double *)calloc(w->n_b + 1, sizeof(double));
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    for (MPI_Offset k = 0; k < w->nnz; k++) {
+        MPI_Offset y = w->col[k] / src_nx - roi[0];
+        MPI_Offset x = w->col[k] % src_nx - roi[2];
+        if (y < 0 || y >= roi[1] || x < 0 || x >= roi[3]) {
+            continue;
+        }
+        double v = src[y * roi[3] + x];
+        if (v != v || fabs(v - fill) <= 1e-3 * fabs(fill)) {
+            continue;
+        }
+        num[w->row[k]] += w->S[k] * v;
+        den[w->row[k]] += w->S[k];
+    }
+
+    /* 目标行按 split_range 划分，各进程得到自己那些行的和 */
+    int *recvcounts = (int *)malloc(size * sizeof(int));
+    for (p = 0; p < size; p++) {
+        MPI_Offset s0, c0;
+        split_range(dst_ny, size, p, &s0, &c0);
+        recvcounts[p] = (int)(c0 * dst_nx);
+    }
+    split_range(dst_ny, size, rank, &row_start, &row_count);
+    double *my_den = (double *)malloc((row_count * dst_nx + 1) * sizeof(double));
+    MPI_Reduce_scatter(num, out, recvcounts, MPI_DOUBLE, MPI_SUM, comm);
+    MPI_Reduce_scatter(den, my_den, recvcounts, MPI_DOUBLE, MPI_SUM, comm);
+    for (MPI_Offset k = 0; k < row_count * dst_nx; k++) {
+        out[k] = (my_den[k] > 0.0) ? out[k] / my_den[k] : NC_FILL_DOUBLE;
+    }
+    free(recvcounts);
+    free(my_den);
+    free(num);
+    free(den);
+}
+
+void regrid_weights_free(regrid_weights_t *w) {
+    free(w->row);
+    free(w->col);
+    free(w->S);
+}
+
+/* ---------- 分区统计 ---------- */
+
+/* 每种输入类型一个内核，跳过 NaN 和填充值 */
+#define DEFINE_REGION_KERNEL(NAME, IN_T) \
+    static void NAME(const void *src, const int *mask, MPI_Offset n, int nregions, \
+                     double fill, double *sum, double *min, double *max, long long *count) { \
+        const IN_T *s = (const IN_T *)src; \
+        for (MPI_Offset k = 0; k < n; k++) { \
+            int r = mask[k]; \
+            double v = (double)s[k]; \
+            if (r < 0 || r >= nregions || v != v || v == fill) continue; \
+            if (count[r] == 0 || v < min[r]) min[r] = v; \
+            if (count[r] == 0 || v > max[r]) max[r] = v; \
+            sum[r] += v; \
+            count[r]++; \
+        } \
+    }
+
+DEFINE_REGION_KERNEL(region_byte, signed char)
+DEFINE_REGION_KERNEL(region_ubyte, unsigned char)
+DEFINE_REGION_KERNEL(region_short, short)
+DEFINE_REGION_KERNEL(region_ushort, unsigned short)
+DEFINE_REGION_KERNEL(region_float, float)
+DEFINE_REGION_KERNEL(region_int, int)
+DEFINE_REGION_KERNEL(region_uint, unsigned int)
+DEFINE_REGION_KERNEL(region_int64, long long)
+DEFINE_REGION_KERNEL(region_uint64, unsigned long long)
+DEFINE_REGION_KERNEL(region_double, double)
+
+void region_reduce_plane(const forcing_var_t *var, const void *src, const int *mask, MPI_Offset n, int nregions,
+                         double *sum, double *min, double *max, long long *count) {
+    void (*kernel)(const void *, const int *, MPI_Offset, int, double, double *, double *, double *, long long *);
+    switch (var->type) {
+        case NC_BYTE:   kernel = region_byte; break;
+        case NC_UBYTE:  kernel = region_ubyte; break;
+        case NC_SHORT:  kernel = region_short; break;
+        case NC_USHORT: kernel = region_ushort; break;
+        case NC_FLOAT:  kernel = region_float; break;
+        case NC_INT:    kernel = region_int; break;
+        case NC_UINT:   kernel = region_uint; break;
+        case NC_INT64:  kernel = region_int64; break;
+        case NC_UINT64: kernel = region_uint64; break;
+        case NC_DOUBLE: kernel = region_double; break;
+        default:        return;
+    }
+    kernel(src, mask, n, nregions, var->fill, sum, min, max, count);
+}
+
+int region_mask_read(const char *file, const char *name, MPI_Comm comm, const MPI_Offset *roi,
+                     int *mask, int *nregions) {
+    int ret, ncid, varid, ndims;
+    int local_max = -1;
+    MPI_Offset start[2] = {roi[0], roi[2]};
+    MPI_Offset count[2] = {roi[1], roi[3]};
+
+    ret = ncmpi_open(comm, file, NC_NOWRITE, MPI_INFO_NULL, &ncid);
+    CHECK_ERR(ret);
+    ret = ncmpi_inq_varid(ncid, name, &varid);
+    CHECK_ERR(ret);
+    ret = ncmpi_inq_varndims(ncid, varid, &ndims);
+    CHECK_ERR(ret);
+    if (ndims != 2) {
+        printf("Error: Region mask %s in %s must be 2-D (y, x)\n", name, file);
+        ncmpi_close(ncid);
+        return 1;
+    }
+    ret = ncmpi_get_vara_int_all(ncid, varid, start, count, mask);
+    CHECK_ERR(ret);
+    ret = ncmpi_close(ncid);
+    CHECK_ERR(ret);
+
+    for (MPI_Offset k = 0; k < roi[1] * roi[3]; k++) {
+        if (mask[k] > local_max) local_max = mask[k];
+    }
+    MPI_Allreduce(&local_max, nregions, 1, MPI_INT, MPI_MAX, comm);
+    (*nregions)++;
+    return 0;
+}
+
+/* ---------- 派生变量 ---------- */
+
+/* 水汽压 e = q p / (0.622 + 0.378 q)，q 为比湿 (kg/kg)，p 为气压 (Pa) */
+static inline float vapor_pressure(float q, float p) {
+    return q * p / (0.622f + 0.378f * q);
+}
+
+/* 饱和水汽压（液面，Bolton 1980），T 为气温 (K)，结果为 Pa */
+static inline float saturation_vapor_pressure(float t) {
+    return 611.2f * expf(17.67f * (t - 273.15f) / (t - 29.65f));
+}
+
+/* 输入 QBOT, TBOT, PSRF */
+static void derived_rh(const void *ctx, const float *const *in, MPI_Offset n, float *out) {
+    const float *q = in[0], *t = in[1], *p = in[2];
+    (void)ctx;
+    for (MPI_Offset k = 0; k < n; k++) {
+        out[k] = 100.0f * vapor_pressure(q[k], p[k]) / saturation_vapor_pressure(t[k]);
+    }
+}
+
+/* 输入 QBOT, PSRF */
+static void derived_ea(const void *ctx, const float *const *in, MPI_Offset n, float *out) {
+    const float *q = in[0], *p = in[1];
+    (void)ctx;
+    for (MPI_Offset k = 0; k < n; k++) {
+        out[k] = vapor_pressure(q[k], p[k]);
+    }
+}
+
+/* 输入 TBOT */
+static void derived_esat(const void *ctx, const float *const *in, MPI_Offset n, float *out) {
+    const float *t = in[0];
+    (void)ctx;
+    for (MPI_Offset k = 0; k < n; k++) {
+        out[k] = saturation_vapor_pressure(t[k]);
+    }
+}
+
+/* 输入 QBOT, TBOT, PSRF */
+static void derived_vpd(const void *ctx, const float *const *in, MPI_Offset n, float *out) {
+    const float *q = in[0], *t = in[1], *p = in[2];
+    (void)ctx;
+    for (MPI_Offset k = 0; k < n; k++) {
+        out[k] = saturation_vapor_pressure(t[k]) - vapor_pressure(q[k], p[k]);
+    }
+}
+
+static const derived_var_t derived_vars[] = {
+    {"RH", "Relative humidity", "%", 3, {"QBOT", "TBOT", "PSRF"}, derived_rh, NULL, 0},
+    {"EA", "Vapor pressure", "Pa", 2, {"QBOT", "PSRF"}, derived_ea, NULL, 0},
+    {"ESAT", "Saturation vapor pressure", "Pa", 1, {"TBOT"}, derived_esat, NULL, 0},
+    {"VPD", "Vapor pressure deficit", "Pa", 3, {"QBOT", "TBOT", "PSRF"}, derived_vpd, NULL, 0},
+};
+
+const derived_var_t *derived_var_lookup(const char *name, const expr_t *exprs, int num_exprs) {
+    for (int i = 0; i < num_exprs; i++) {
+        if (strcmp(exprs[i].name, name) == 0) {
+            return &exprs[i].def;
+        }
+    }
+    for (size_t i = 0; i < sizeof(derived_vars) / sizeof(derived_vars[0]); i++) {
+        if (strcmp(derived_vars[i].name, name) == 0) {
+            return &derived_vars[i];
+        }
+    }
+    return NULL;
+}
+
+/* ---------- 表达式 ---------- */
+
+enum {
+    EXPR_CONST, EXPR_INPUT, EXPR_NEG,
+    EXPR_ADD, EXPR_SUB, EXPR_MUL, EXPR_DIV,
+    EXPR_GT, EXPR_GE, EXPR_LT, EXPR_LE, EXPR_EQ, EXPR_NE,
+    EXPR_MIN, EXPR_MAX,
+    EXPR_EXP, EXPR_LOG, EXPR_SQRT, EXPR_ABS
+};
+
+/* 递归下降的编译状态：p 为当前位置，depth 为执行到此处时的栈深度 */
+typedef struct {
+    const char *p;
+    expr_t *e;
+    int depth, max_depth;
+    const char *error;
+} expr_parser_t;
+
+static int expr_parse_cmp(expr_parser_t *ps);
+
+static void expr_skip_space(expr_parser_t *ps) {
+    while (isspace((unsigned char)*ps->p)) ps->p++;
+}
+
+static int expr_emit(expr_parser_t *ps, int op, int arg, float value) {
+    expr_t *e = ps->e;
+    if (e->ncode >= EXPR_MAX_CODE) {
+        ps->error = "expression too long";
+        return 1;
+    }
+    e->code[e->ncode].op = op;
+    e->code[e->ncode].arg = arg;
+    e->code[e->ncode].value = value;
+    e->ncode++;
+    /* 常数和输入压栈，单目运算不变，双目运算出栈一个 */
+    if (op == EXPR_CONST || op == EXPR_INPUT) {
+        ps->depth++;
+    } else if (op >= EXPR_ADD && op <= EXPR_MAX) {
+        ps->depth--;
+    }
+    if (ps->depth > ps->max_depth) ps->max_depth = ps->depth;
+    if (ps->depth > EXPR_MAX_STACK) {
+        ps->error = "expression nested too deeply";
+        return 1;
+    }
+    return 0;
+}
+
+static int expr_expect(expr_parser_t *ps, char c) {
+    expr_skip_space(ps);
+    if (*ps->p != c) {
+        ps->error = (c == ')') ? "missing ')'" : "missing ','";
+        return 1;
+    }
+    ps->p++;
+    return 0;
+}
+
+static int expr_parse_primary(expr_parser_t *ps) {
+    static const struct { const char *name; int op; int nargs; } funcs[] = {
+        {"exp", EXPR_EXP, 1}, {"log", EXPR_LOG, 1}, {"sqrt", EXPR_SQRT, 1}, {"abs", EXPR_ABS, 1},
+        {"min", EXPR_MIN, 2}, {"max", EXPR_MAX, 2},
+    };
+    expr_t *e = ps->e;
+    char ident[NC_MAX_NAME+1];
+    int len = 0, i;
+
+    expr_skip_space(ps);
+    if (*ps->p == '-') {
+        ps->p++;
+        return expr_parse_primary(ps) || expr_emit(ps, EXPR_NEG, 0, 0.0f);
+    }
+    if (*ps->p == '(') {
+        ps->p++;
+        return expr_parse_cmp(ps) || expr_expect(ps, ')');
+    }
+    if (isdigit((unsigned char)*ps->p) || *ps->p == '.') {
+        char *end;
+        double v = strtod(ps->p, &end);
+        ps->p = end;
+        return expr_emit(ps, EXPR_CONST, 0, (float)v);
+    }
+    while ((isalnum((unsigned char)ps->p[len]) || ps->p[len] == '_') && len < NC_MAX_NAME) {
+        ident[len] = ps->p[len];
+        len++;
+    }
+    ident[len] = '\0';
+    if (len == 0) {
+        ps->error = "expected a number, a variable or '('";
+        return 1;
+    }
+    ps->p += len;
+
+    /* 函数调用 */
+    expr_skip_space(ps);
+    if (*ps->p == '(') {
+        for (i = 0; i < (int)(sizeof(funcs) / sizeof(funcs[0])); i++) {
+            if (strcmp(funcs[i].name, ident) == 0) break;
+        }
+        if (i == (int)(sizeof(funcs) / sizeof(funcs[0]))) {
+            ps->error = "unknown function";
+            return 1;
+        }
+        ps->p++;
+        if (expr_parse_cmp(ps)) return 1;
+        if (funcs[i].nargs == 2 && (expr_expect(ps, ',') || expr_parse_cmp(ps))) return 1;
+        return expr_expect(ps, ')') || expr_emit(ps, funcs[i].op, 0, 0.0f);
+    }
+
+    /* 输入变量，按第一次出现的顺序编号 */
+    for (i = 0; i < e->def.ninputs; i++) {
+        if (strcmp(e->inputs[i], ident) == 0) break;
+    }
+    if (i == e->def.ninputs) {
+        if (i == DERIVED_MAX_INPUTS) {
+            ps->error = "too many input variables";
+            return 1;
+        }
+        strcpy(e->inputs[i], ident);
+        e->def.inputs[i] = e->inputs[i];
+        e->def.ninputs++;
+    }
+    return expr_emit(ps, EXPR_INPUT, i, 0.0f);
+}
+
+static int expr_parse_mul(expr_parser_t *ps) {
+    if (expr_parse_primary(ps)) return 1;
+    for (;;) {
+        expr_skip_space(ps);
+        char c = *ps->p;
+        if (c != '*' && c != '/') return 0;
+        ps->p++;
+        if (expr_parse_primary(ps) || expr_emit(ps, c == '*' ? EXPR_MUL : EXPR_DIV, 0, 0.0f)) return 1;
+    }
+}
+
+static int expr_parse_add(expr_parser_t *ps) {
+    if (expr_parse_mul(ps)) return 1;
+    for (;;) {
+        expr_skip_space(ps);
+        char c = *ps->p;
+        if (c != '+' && c != '-') return 0;
+        ps->p++;
+        if (expr_parse_mul(ps) || expr_emit(ps, c == '+' ? EXPR_ADD : EXPR_SUB, 0, 0.0f)) return 1;
+    }
+}
+
+static int expr_parse_cmp(expr_parser_t *ps) {
+    static const struct { const char *text; int op; } cmps[] = {
+        {">=", EXPR_GE}, {"<=", EXPR_LE}, {"==", EXPR_EQ}, {"!=", EXPR_NE}, {">", EXPR_GT}, {"<", EXPR_LT},
+    };
+    if (expr_parse_add(ps)) return 1;
+    expr_skip_space(ps);
+    for (int i = 0; i < (int)(sizeof(cmps) / sizeof(cmps[0])); i++) {
+        size_t len = strlen(cmps[i].text);
+        if (strncmp(ps->p, cmps[i].text, len) == 0) {
+            ps->p += len;
+            return expr_parse_add(ps) || expr_emit(ps, cmps[i].op, 0, 0.0f);
+        }
+    }
+    return 0;
+}
+
+/* 按批解释执行：每条指令对一批格点做同一运算，栈上每个元素是一批值 */
+static void expr_kernel(const void *ctx, const float *const *in, MPI_Offset n, float *out) {
+    const expr_t *e = (const expr_t *)ctx;
+    float stack[EXPR_MAX_STACK][EXPR_BATCH];
+
+    for (MPI_Offset k0 = 0; k0 < n; k0 += EXPR_BATCH) {
+        int m = (n - k0 < EXPR_BATCH) ? (int)(n - k0) : EXPR_BATCH;
+        int sp = 0;
+        for (int pc = 0; pc < e->ncode; pc++) {
+            float *a = stack[sp > 1 ? sp - 2 : 0], *b = stack[sp > 0 ? sp - 1 : 0];
+            int i;
+            switch (e->code[pc].op) {
+                case EXPR_CONST:
+                    for (i = 0; i < m; i++) stack[sp][i] = e->code[pc].value;
+                    sp++;
+                    break;
+                case EXPR_INPUT:
+                    memcpy(stack[sp], in[e->code[pc].arg] + k0, m * sizeof(float));
+                    sp++;
+                    break;
+                case EXPR_NEG:  for (i = 0; i < m; i++) b[i] = -b[i]; break;
+                case EXPR_EXP:  for (i = 0; i < m; i++) b[i] = expf(b[i]); break;
+                case EXPR_LOG:  for (i = 0; i < m; i++) b[i] = logf(b[i]); break;
+                case EXPR_SQRT: for (i = 0; i < m; i++) b[i] = sqrtf(b[i]); break;
+                case EXPR_ABS:  for (i = 0; i < m; i++) b[i] = fabsf(b[i]); break;
+                case EXPR_ADD:  for (i = 0; i < m; i++) a[i] += b[i]; sp--; break;
+                case EXPR_SUB:  for (i = 0; i < m; i++) a[i] -= b[i]; sp--; break;
+                case EXPR_MUL:  for (i = 0; i < m; i++) a[i] *= b[i]; sp--; break;
+                case EXPR_DIV:  for (i = 0; i < m; i++) a[i] /= b[i]; sp--; break;
+                case EXPR_GT:   for (i = 0; i < m; i++) a[i] = (float)(a[i] > b[i]); sp--; break;
+                case EXPR_GE:   for (i = 0; i < m; i++) a[i] = (float)(a[i] >= b[i]); sp--; break;
+                case EXPR_LT:   for (i = 0; i < m; i++) a[i] = (float)(a[i] < b[i]); sp--; break;
+                case EXPR_LE:   for (i = 0; i < m; i++) a[i] = (float)(a[i] <= b[i]); sp--; break;
+                case EXPR_EQ:   for (i = 0; i < m; i++) a[i] = (float)(a[i] == b[i]); sp--; break;
+                case EXPR_NE:   for (i = 0; i < m; i++) a[i] = (float)(a[i] != b[i]); sp--; break;
+                case EXPR_MIN:  for (i = 0; i < m; i++) a[i] = (b[i] < a[i]) ? b[i] : a[i]; sp--; break;
+                case EXPR_MAX:  for (i = 0; i < m; i++) a[i] = (b[i] > a[i]) ? b[i] : a[i]; sp--; break;
+            }
+        }
+        memcpy(out + k0, stack[0], m * sizeof(float));
+    }
+}
+
+int expr_compile(const char *text, int total, expr_t *e) {
+    const char *eq = strchr(text, '=');
+    expr_parser_t ps;
+
+    memset(e, 0, sizeof(*e));
+    if (eq == NULL || eq == text || eq - text > NC_MAX_NAME || strlen(eq + 1) >= MAX_PATH_LEN) {
+        printf("Error: Expression %s is not of the form NAME=EXPR\n", text);
+        return 1;
+    }
+    memcpy(e->name, text, eq - text);
+    strcpy(e->text, eq + 1);
+
+    memset(&ps, 0, sizeof(ps));
+    ps.p = e->text;
+    ps.e = e;
+    if (expr_parse_cmp(&ps) == 0) {
+        expr_skip_space(&ps);
+        if (*ps.p != '\0') {
+            ps.error = "unexpected trailing characters";
+        } else if (e->def.ninputs == 0) {
+            ps.error = "no input variable";
+        }
+    }
+    if (ps.error != NULL) {
+        printf("Error: %s in expression %s at \"%s\"\n", ps.error, text, ps.p);
+        return 1;
+    }
+
+    e->def.name = e->name;
+    e->def.long_name = e->text;
+    e->def.units = "";
+    e->def.eval = expr_kernel;
+    e->def.ctx = e;
+    e->def.total = total;
+    return 0;
+}
+
+/* ---------- 时间插值 ---------- */
+
+/* out = a + w (b - a) */
+static void interp_linear_plane(const float *a, const float *b, MPI_Offset n, float w, float *out) {
+    for (MPI_Offset k = 0; k < n; k++) {
+        out[k] = a[k] + w * (b[k] - a[k]);
+    }
+}
+
+/* 各格点的太阳天顶角余弦。时角 h = h0 + lon，cos h 按和角公式展开，内层循环没有三角函数 */
+typedef struct {
+    float *sin_lat, *cos_lat, *cos_lon, *sin_lon;
+} coszen_geom_t;
+
+static void coszen_plane(const coszen_geom_t *g, MPI_Offset n, double day, float *cosz) {
+    double decl = 0.409 * sin(2.0 * 3.14159265358979323846 * (day + 284.0) / 365.0);
+    double h0 = 2.0 * 3.14159265358979323846 * (day - floor(day)) - 3.14159265358979323846;
+    float sd = (float)sin(decl), cd = (float)cos(decl);
+    float ch = (float)cos(h0), sh = (float)sin(h0);
+    for (MPI_Offset k = 0; k < n; k++) {
+        float c = g->sin_lat[k] * sd + g->cos_lat[k] * cd * (ch * g->cos_lon[k] - sh * g->sin_lon[k]);
+        cosz[k] = c > 0.0f ? c : 0.0f;
+    }
+}
+
+/* 时段平均按子步的天顶角余弦分配：out = avg * nsub * cosz / sum(cosz)，夜间为0 */
+static void interp_coszen_plane(const float *avg, const float *cosz, const float *cosz_sum, MPI_Offset n,
+                                int nsub, float *out) {
+    for (MPI_Offset k = 0; k < n; k++) {
+        out[k] = (cosz_sum[k] > 1e-6f) ? avg[k] * nsub * cosz[k] / cosz_sum[k] : avg[k];
+    }
+}
+
+/* 预读线程：把第 t 步读入 buf */
+typedef struct {
+    int ncid, varid, ndims;
+    MPI_Offset start[3], count[3];
+    float *buf;
+    int ret;
+} interp_read_t;
+
+static void *interp_read_plane(void *p) {
+    interp_read_t *r = (interp_read_t *)p;
+    r->ret = ncmpi_get_vara_float_all(r->ncid, r->varid, r->start, r->count, r->buf);
+    return NULL;
+}
+
+int interp_stream(const interp_spec_t *spec, interp_callback_t callback, void *arg) {
+    int ret, i, ncid, varid;
+    int lookahead = (spec->method == INTERP_LINEAR) ? 1 : 0;   /* 一个区间需要的后续平面数 */
+    int nbuf = lookahead + 2;
+    MPI_Offset n = spec->count[1] * (spec->ndims == 3 ? spec->count[2] : 1);
+    MPI_Offset t, j;
+    float *planes[3], *out, *cosz = NULL, *cosz_sum = NULL;
+    coszen_geom_t geom;
+    interp_read_t reader;
+    pthread_t thread;
+
+    ret = ncmpi_open(MPI_COMM_SELF, spec->file, NC_NOWRITE, spec->info, &ncid);
+    CHECK_ERR(ret);
+    ret = ncmpi_inq_varid(ncid, spec->var_name, &varid);
+    CHECK_ERR(ret);
+
+    for (i = 0; i < nbuf; i++) {
+        planes[i] = (float *)malloc((n + 1) * sizeof(float));
+    }
+    out = (float *)malloc((n + 1) * sizeof(float));
+    memset(&geom, 0, sizeof(geom));
+    if (spec->method == INTERP_COSZEN) {
+        cosz = (float *)malloc((n + 1) * sizeof(float));
+        cosz_sum = (float *)malloc((n + 1) * sizeof(float));
+        geom.sin_lat = (float *)malloc((n + 1) * sizeof(float));
+        geom.cos_lat = (float *)malloc((n + 1) * sizeof(float));
+        geom.cos_lon = (float *)malloc((n + 1) * sizeof(float));
+        geom.sin_lon = (float *)malloc((n + 1) * sizeof(float));
+        for (MPI_Offset k = 0; k < n; k++) {
+            double lat = spec->lat[k] * 3.14159265358979323846 / 180.0;
+            double lon = spec->lon[k] * 3.14159265358979323846 / 180.0;
+            geom.sin_lat[k] = (float)sin(lat);
+            geom.cos_lat[k] = (float)cos(lat);
+            geom.cos_lon[k] = (float)cos(lon);
+            geom.sin_lon[k] = (float)sin(lon);
+        }
+    }
+
+    memset(&reader, 0, sizeof(reader));
+    reader.ncid = ncid;
+    reader.varid = varid;
+    reader.ndims = spec->ndims;
+    memcpy(reader.start, spec->start, sizeof(reader.start));
+    memcpy(reader.count, spec->count, sizeof(reader.count));
+    reader.count[0] = 1;
+
+    /* 先同步读取第一个区间需要的平面 */
+    for (t = 0; t <= lookahead && t < spec->nt; t++) {
+        reader.start[0] = t;
+        reader.buf = planes[t % nbuf];
+        interp_read_plane(&reader);
+        CHECK_ERR(reader.ret);
+    }
+
+    for (t = 0; t < spec->nt; t++) {
+        /* 预读区间之后的下一个平面，与本区间的插值和回调重叠 */
+        MPI_Offset next = t + lookahead + 1;
+        int started = 0;
+        if (next < spec->nt) {
+            reader.start[0] = next;
+            reader.buf = planes[next % nbuf];
+            started = spec->prefetch && pthread_create(&thread, NULL, interp_read_plane, &reader) == 0;
+        }
+
+        const float *a = planes[t % nbuf];
+        const float *b = (lookahead && t + 1 < spec->nt) ? planes[(t + 1) % nbuf] : a;
+        if (spec->method == INTERP_COSZEN) {
+            memset(cosz_sum, 0, n * sizeof(float));
+            for (j = 0; j < spec->nsub; j++) {
+                coszen_plane(&geom, n, spec->day0 + (t + (j + 0.5) / spec->nsub) * spec->step_days, cosz);
+                for (MPI_Offset k = 0; k < n; k++) {
+                    cosz_sum[k] += cosz[k];
+                }
+            }
+        }
+        for (j = 0; j < spec->nsub && ret == 0; j++) {
+            if (spec->method == INTERP_COSZEN) {
+                coszen_plane(&geom, n, spec->day0 + (t + (j + 0.5) / spec->nsub) * spec->step_days, cosz);
+                interp_coszen_plane(a, cosz, cosz_sum, n, spec->nsub, out);
+            } else {
+                interp_linear_plane(a, b, n, (float)j / spec->nsub, out);
+            }
+            ret = callback(arg, t * spec->nsub + j, out, n);
+        }
+
+        if (started) {
+            pthread_join(thread, NULL);
+        } else if (next < spec->nt) {
+            interp_read_plane(&reader);
+        }
+        if (ret != 0) break;
+        CHECK_ERR(reader.ret);
+    }
+
+    for (i = 0; i < nbuf; i++) {
+        free(planes[i]);
+    }
+    free(out);
+    free(cosz);
+    free(cosz_sum);
+    free(geom.sin_lat);
+    free(geom.cos_lat);
+    free(geom.cos_lon);
+    free(geom.sin_lon);
+    ncmpi_close(ncid);
+    return ret;
+}
+
+/* ---------- 计时 ---------- */
+
+double max_time(double local_time, MPI_Comm comm) {
+    double result = 0.0;
+    MPI_Reduce(&local_time, &result, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+    return result;
+}
+
+prof_t forcing_prof;
+
+static const char *phase_names[NUM_PHASES] = {
+    "open", "header", "read", "decompress", "accumulate", "reduce", "create", "write", "close"
+};
+
+static const char *hwc_region_names[NUM_HWC_REGIONS] = {
+    "accumulate", "normalize", "copy", "read/decompress", "compress/write"
+};
+
+/* 估计内存流量时每次末级缓存缺失的字节数 */
+#define HWC_LINE_BYTES 64.0
+
+/* 打开本进程的用户态计数器。inherit 使之后创建的线程（多线程解压、预读）在退出时计入；
+ * inherit 不能与事件组同时使用，所以每个事件单独打开，读数按复用时间比例换算 */
+static void hwc_open(prof_t *p) {
+#ifdef __linux__
+    static const unsigned long long configs[HWC_NUM_EVENTS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES
+    };
+    struct perf_event_attr attr;
+    int i;
+    for (i = 0; i < HWC_NUM_EVENTS; i++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.inherit = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        p->hwc_fd[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        /* 周期和指令是必需的，缓存事件在某些虚拟机上不存在，缺少时对应指标不输出 */
+        if (p->hwc_fd[i] < 0 && i < 2) {
+            snprintf(p->hwc_error, sizeof(p->hwc_error), "perf_event_open: %s", strerror(errno));
+            while (--i >= 0) close(p->hwc_fd[i]);
+            p->hwc = -1;
+            return;
+        }
+    }
+    p->hwc = 1;
+#else
+    strcpy(p->hwc_error, "perf_event_open requires Linux");
+    p->hwc = -1;
+#endif
+}
+
+/* 读取所有计数器，没有打开的事件读作0 */
+static void hwc_read(const prof_t *p, double *count) {
+    int i;
+    for (i = 0; i < HWC_NUM_EVENTS; i++) {
+        unsigned long long v[3] = {0, 0, 0};
+        count[i] = 0.0;
+        if (p->hwc == 1 && p->hwc_fd[i] >= 0 && read(p->hwc_fd[i], v, sizeof(v)) == sizeof(v) && v[2] > 0) {
+            count[i] = (double)v[0] * ((double)v[1] / v[2]);
+        }
+    }
+}
+
+void hwc_begin(hwc_mark_t *m) {
+    if (forcing_prof.hwc == 0) return;
+    hwc_read(&forcing_prof, m->count);
+    m->t0 = MPI_Wtime();
+}
+
+void hwc_end(int region, const hwc_mark_t *m, MPI_Offset bytes, MPI_Offset ops) {
+    prof_t *p = &forcing_prof;
+    double count[HWC_NUM_EVENTS];
+    int i;
+    if (p->hwc == 0) return;
+    p->hwc_time[region] += MPI_Wtime() - m->t0;
+    hwc_read(p, count);
+    for (i = 0; i < HWC_NUM_EVENTS; i++) {
+        p->hwc_count[region][i] += count[i] - m->count[i];
+    }
+    p->hwc_bytes[region] += (double)bytes;
+    p->hwc_ops[region] += (double)ops;
+}
+
+void prof_init(int trace, int counters, MPI_Comm comm) {
+    int i;
+    free(forcing_prof.events);
+    if (forcing_prof.hwc == 1) {
+        for (i = 0; i < HWC_NUM_EVENTS; i++) {
+            if (forcing_prof.hwc_fd[i] >= 0) close(forcing_prof.hwc_fd[i]);
+        }
+    }
+    memset(&forcing_prof, 0, sizeof(forcing_prof));
+    if (trace) {
+        forcing_prof.events = (double *)malloc(PROF_MAX_EVENTS * 3 * sizeof(double));
+    }
+    if (counters) {
+        hwc_open(&forcing_prof);
+    }
+    /* 各进程大致同时开始，时间线的零点才可比（MPI_Wtime 不一定是全局时钟） */
+    MPI_Barrier(comm);
+    forcing_prof.origin = MPI_Wtime();
+}
+
+double prof_begin(void) {
+    return MPI_Wtime();
+}
+
+void prof_end(int phase, double t0, MPI_Offset bytes) {
+    prof_t *p = &forcing_prof;
+    double t1 = MPI_Wtime();
+    p->time[phase] += t1 - t0;
+    p->bytes[phase] += (double)bytes;
+    p->calls[phase]++;
+    if (p->events != NULL) {
+        if (p->nevents < PROF_MAX_EVENTS) {
+            double *e = p->events + 3 * p->nevents++;
+            e[0] = phase;
+            e[1] = t0 - p->origin;
+            e[2] = t1 - p->origin;
+        } else {
+            p->dropped++;
+        }
+    }
+}
+
+void prof_add(int phase, double seconds, MPI_Offset bytes) {
+    forcing_prof.time[phase] += seconds;
+    forcing_prof.bytes[phase] += (double)bytes;
+    forcing_prof.calls[phase]++;
+}
+
+/* 每个进程上报的记录：各阶段时间、字节数、调用次数，内存峰值 (MB)，
+ * 然后是硬件计数器的状态和每个区域的时间、字节数、运算数与各事件计数 */
+#define PROF_HWC (3 * NUM_PHASES + 1)
+#define HWC_REGION_RECORD (3 + HWC_NUM_EVENTS)
+#define PROF_RECORD (PROF_HWC + 1 + NUM_HWC_REGIONS * HWC_REGION_RECORD)
+
+/* 由计数得到的指标，分母为0时为-1 */
+static double hwc_ratio(double a, double b) {
+    return (b > 0.0) ? a / b : -1.0;
+}
+
+/* 打印一列指标，v < 0 表示没有该指标 */
+static void print_metric(int width, const char *fmt, double v) {
+    if (v < 0.0) {
+        printf(" %*s", width, "-");
+    } else {
+        printf(" ");
+        printf(fmt, width, v);
+    }
+}
+
+/* 打印一个区域的指标：IPC、末级缓存缺失率、估计内存带宽、字节/周期、运算强度和有效带宽。
+ * c 为各事件计数，seconds 为计算带宽所用的时间 */
+static void print_hwc_metrics(const char *name, double seconds, double bytes, double ops, const double *c) {
+    double dram = c[3] * HWC_LINE_BYTES;
+    int has_cache = (c[0] > 0.0 && c[2] > 0.0);
+    printf("%-16s %9.4f", name, seconds);
+    print_metric(6, "%*.2f", hwc_ratio(c[1], c[0]));
+    print_metric(9, "%*.1f", has_cache ? 100.0 * c[3] / c[2] : -1.0);
+    print_metric(10, "%*.2f", has_cache ? hwc_ratio(dram, seconds) / 1e9 : -1.0);
+    print_metric(9, "%*.3f", hwc_ratio(bytes, c[0]));
+    print_metric(10, "%*.3f", has_cache ? hwc_ratio(ops, dram) : -1.0);
+    print_metric(10, "%*.2f", hwc_ratio(bytes, seconds) / 1048576.0);
+    printf(" MB/s\n");
+}
+
+/* 0号进程打印硬件计数器的汇总。各区域合计所有进程的计数，带宽按最慢进程的时间计算；
+ * 设置 FORCING2D_PEAK_GBS 和 FORCING2D_PEAK_GOPS（每个进程的峰值带宽和运算速度）时，
+ * 按屋顶线模型给出各区域达到的比例和受限类型 */
+static void print_hwc_report(const double *all, int nprocs) {
+    const char *peak_gbs_env = getenv("FORCING2D_PEAK_GBS");
+    const char *peak_gops_env = getenv("FORCING2D_PEAK_GOPS");
+    double peak_gbs = peak_gbs_env ? atof(peak_gbs_env) : 0.0;
+    double peak_gops = peak_gops_env ? atof(peak_gops_env) : 0.0;
+    int g, r, k, unavailable = 0;
+
+    for (r = 0; r < nprocs; r++) {
+        if (all[(MPI_Offset)r * PROF_RECORD + PROF_HWC] < 0) unavailable++;
+    }
+    printf("===== 硬件计数器 (perf_event_open, 用户态) =====\n");
+    if (unavailable > 0) {
+        printf("%d 个进程的硬件计数器不可用 (0号进程: %s)，这些进程只计入时间和有效带宽\n", unavailable,
+               forcing_prof.hwc_error[0] ? forcing_prof.hwc_error : "可用");
+    }
+    /* 中文表头按显示宽度手工对齐，缺失率为百分比 */
+    printf("区域              时间(秒)    IPC LLC缺失率 内存(GB/s) 字节/周期 强度(op/B)    有效带宽\n");
+    for (g = 0; g < NUM_HWC_REGIONS; g++) {
+        double c[HWC_NUM_EVENTS] = {0.0}, tmax = 0.0, tsum = 0.0, bytes = 0.0, ops = 0.0;
+        for (r = 0; r < nprocs; r++) {
+            const double *x = all + (MPI_Offset)r * PROF_RECORD + PROF_HWC + 1 + g * HWC_REGION_RECORD;
+            if (x[0] > tmax) tmax = x[0];
+            tsum += x[0];
+            bytes += x[1];
+            ops += x[2];
+            for (k = 0; k < HWC_NUM_EVENTS; k++) c[k] += x[3 + k];
+        }
+        if (tsum == 0.0) continue;
+        print_hwc_metrics(hwc_region_names[g], tmax, bytes, ops, c);
+        if (peak_gbs > 0.0 && peak_gops > 0.0 && c[3] > 0.0 && ops > 0.0) {
+            /* 每个进程的平均运算速度与其可达性能比较 */
+            double intensity = ops / (c[3] * HWC_LINE_BYTES);
+            double attainable = (intensity * peak_gbs < peak_gops) ? intensity * peak_gbs : peak_gops;
+            double achieved = ops / tsum / 1e9;
+            printf("%-16s 屋顶线: 强度 %.3f op/B, 可达 %.2f Gop/s, 实际 %.2f Gop/s (%.0f%%), %s\n", "",
+                   intensity, attainable, achieved, 100.0 * achieved / attainable,
+                   intensity < peak_gops / peak_gbs ? "内存受限" : "计算受限");
+        }
+    }
+    /* 进程不多时逐进程列出，否则见 --profile 的 JSON */
+    if (nprocs <= 8) {
+        for (r = 0; r < nprocs; r++) {
+            for (g = 0; g < NUM_HWC_REGIONS; g++) {
+                const double *x = all + (MPI_Offset)r * PROF_RECORD + PROF_HWC + 1 + g * HWC_REGION_RECORD;
+                char name[64];
+                if (x[0] == 0.0) continue;
+                snprintf(name, sizeof(name), "  %d:%s", r, hwc_region_names[g]);
+                print_hwc_metrics(name, x[0], x[1], x[2], x + 3);
+            }
+        }
+    }
+}
+
+/* 写出每个阶段的汇总和每个进程的明细 */
+static int write_prof_json(const char *path, const char *tool, const double *all, int nprocs) {
+    FILE *fp = fopen(path, "w");
+    int p, r;
+    if (fp == NULL) {
+        printf("Error: Cannot create %s\n", path);
+        return -1;
+    }
+    fprintf(fp, "{\n  \"tool\": \"%s\",\n  \"nprocs\": %d,\n  \"phases\": [", tool, nprocs);
+    for (p = 0; p < NUM_PHASES; p++) {
+        double tmin = all[p], tmax = all[p], tsum = 0.0, bytes = 0.0;
+        long long calls = 0;
+        for (r = 0; r < nprocs; r++) {
+            const double *rec = all + (MPI_Offset)r * PROF_RECORD;
+            if (rec[p] < tmin) tmin = rec[p];
+            if (rec[p] > tmax) tmax = rec[p];
+            tsum += rec[p];
+            bytes += rec[NUM_PHASES + p];
+            calls += (long long)rec[2 * NUM_PHASES + p];
+        }
+        fprintf(fp, "%s\n    {\"name\": \"%s\", \"calls\": %lld, \"min\": %.6f, \"mean\": %.6f, \"max\": %.6f, "
+                "\"imbalance\": %.4f, \"bytes\": %.0f, \"mb_per_s\": %.2f}",
+                p ? "," : "", phase_names[p], calls, tmin, tsum / nprocs, tmax,
+                tsum > 0.0 ? tmax * nprocs / tsum : 1.0, bytes, tmax > 0.0 ? bytes / 1048576.0 / tmax : 0.0);
+    }
+    fprintf(fp, "\n  ],\n  \"ranks\": [");
+    for (r = 0; r < nprocs; r++) {
+        const double *rec = all + (MPI_Offset)r * PROF_RECORD;
+        fprintf(fp, "%s\n    {\"rank\": %d, \"maxrss_mb\": %.1f, \"time\": {", r ? "," : "", r, rec[3 * NUM_PHASES]);
+        for (p = 0; p < NUM_PHASES; p++) {
+            fprintf(fp, "%s\"%s\": %.6f", p ? ", " : "", phase_names[p], rec[p]);
+        }
+        fprintf(fp, "}, \"bytes\": {");
+        for (p = 0; p < NUM_PHASES; p++) {
+            fprintf(fp, "%s\"%s\": %.0f", p ? ", " : "", phase_names[p], rec[NUM_PHASES + p]);
+        }
+        fprintf(fp, "}");
+        if (rec[PROF_HWC] != 0) {
+            fprintf(fp, ", \"counters_available\": %s, \"counters\": {", rec[PROF_HWC] > 0 ? "true" : "false");
+            for (p = 0; p < NUM_HWC_REGIONS; p++) {
+                const double *x = rec + PROF_HWC + 1 + p * HWC_REGION_RECORD;
+                fprintf(fp, "%s\"%s\": {\"seconds\": %.6f, \"bytes\": %.0f, \"ops\": %.0f, \"cycles\": %.0f, "
+                        "\"instructions\": %.0f, \"llc_references\": %.0f, \"llc_misses\": %.0f}",
+                        p ? ", " : "", hwc_region_names[p], x[0], x[1], x[2], x[3], x[4], x[5], x[6]);
+            }
+            fprintf(fp, "}");
+        }
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "\n  ]\n}\n");
+    fclose(fp);
+    return 0;
+}
+
+/* 收集各进程的时间线，写出 Chrome trace（chrome://tracing 或 Perfetto 可直接打开），
+ * 每个进程是一行 (tid)，时间单位为微秒 */
+static int write_prof_trace(const char *path, const char *tool, MPI_Comm comm) {
+    prof_t *p = &forcing_prof;
+    int rank, nprocs, r, i, ret = 0;
+    int n = 3 * p->nevents;
+    int *counts = NULL, *displs = NULL;
+    double *events = NULL;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nprocs);
+
+    if (rank == 0) {
+        counts = (int *)malloc(nprocs * sizeof(int));
+        displs = (int *)malloc(nprocs * sizeof(int));
+    }
+    MPI_Gather(&n, 1, MPI_INT, counts, 1, MPI_INT, 0, comm);
+    if (rank == 0) {
+        int total = 0;
+        for (r = 0; r < nprocs; r++) {
+            displs[r] = total;
+            total += counts[r];
+        }
+        events = (double *)malloc((total + 1) * sizeof(double));
+    }
+    MPI_Gatherv(p->events, n, MPI_DOUBLE, events, counts, displs, MPI_DOUBLE, 0, comm);
+
+    if (rank == 0) {
+        FILE *fp = fopen(path, "w");
+        if (fp == NULL) {
+            printf("Error: Cannot create %s\n", path);
+            ret = -1;
+        } else {
+            fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+            fprintf(fp, "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 0, \"args\": {\"name\": \"%s\"}}", tool);
+            for (r = 0; r < nprocs; r++) {
+                fprintf(fp, ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %d, "
+                        "\"args\": {\"name\": \"rank %d\"}}", r, r);
+                for (i = 0; i < counts[r]; i += 3) {
+                    const double *e = events + displs[r] + i;
+                    fprintf(fp, ",\n  {\"name\": \"%s\", \"cat\": \"forcing2d\", \"ph\": \"X\", \"pid\": 0, "
+                            "\"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                            phase_names[(int)e[0]], r, e[1] * 1e6, (e[2] - e[1]) * 1e6);
+                }
+            }
+            fprintf(fp, "\n]}\n");
+            fclose(fp);
+        }
+    }
+    free(counts);
+    free(displs);
+    free(events);
+    return ret;
+}
+
+int prof_report(const char *tool, const char *json_path, const char *trace_path, MPI_Comm comm) {
+    prof_t *p = &forcing_prof;
+    double rec[PROF_RECORD];
+    double *all = NULL;
+    struct rusage usage;
+    int rank, nprocs, i, r, ret = 0;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nprocs);
+
+    for (i = 0; i < NUM_PHASES; i++) {
+        rec[i] = p->time[i];
+        rec[NUM_PHASES + i] = p->bytes[i];
+        rec[2 * NUM_PHASES + i] = p->calls[i];
+    }
+    /* Linux 上 ru_maxrss 的单位是 KB */
+    getrusage(RUSAGE_SELF, &usage);
+    rec[3 * NUM_PHASES] = usage.ru_maxrss / 1024.0;
+    rec[PROF_HWC] = p->hwc;
+    for (i = 0; i < NUM_HWC_REGIONS; i++) {
+        double *x = rec + PROF_HWC + 1 + i * HWC_REGION_RECORD;
+        x[0] = p->hwc_time[i];
+        x[1] = p->hwc_bytes[i];
+        x[2] = p->hwc_ops[i];
+        memcpy(x + 3, p->hwc_count[i], HWC_NUM_EVENTS * sizeof(double));
+    }
+
+    if (rank == 0) {
+        all = (double *)malloc((MPI_Offset)nprocs * PROF_RECORD * sizeof(double));
+    }
+    MPI_Gather(rec, PROF_RECORD, MPI_DOUBLE, all, PROF_RECORD, MPI_DOUBLE, 0, comm);
+
+    if (rank == 0) {
+        double rss_min = all[3 * NUM_PHASES], rss_max = rss_min, rss_sum = 0.0;
+        double slowest_total = -1.0, total_sum = 0.0;
+        int rss_rank = 0, slowest = 0;
+
+        printf("===== 分阶段统计 (%d 个进程) =====\n", nprocs);
+        /* 中文表头按显示宽度手工对齐 */
+        printf("阶段           最短(秒)   平均(秒)   最长(秒)   不均衡   数据量(MB)   带宽(MB/s)\n");
+        for (i = 0; i < NUM_PHASES; i++) {
+            double tmin = all[i], tmax = all[i], tsum = 0.0, bytes = 0.0, calls = 0.0;
+            int tmax_rank = 0;
+            for (r = 0; r < nprocs; r++) {
+                const double *x = all + (MPI_Offset)r * PROF_RECORD;
+                if (x[i] < tmin) tmin = x[i];
+                if (x[i] > tmax) {
+                    tmax = x[i];
+                    tmax_rank = r;
+                }
+                tsum += x[i];
+                bytes += x[NUM_PHASES + i];
+                calls += x[2 * NUM_PHASES + i];
+            }
+            if (calls == 0.0) continue;
+            printf("%-12s %10.4f %10.4f %10.4f %8.2f", phase_names[i], tmin, tsum / nprocs, tmax,
+                   tsum > 0.0 ? tmax * nprocs / tsum : 1.0);
+            if (bytes > 0.0 && tmax > 0.0) {
+                printf(" %12.2f %12.2f", bytes / 1048576.0, bytes / 1048576.0 / tmax);
+            }
+            printf("  (最慢: 进程 %d)\n", tmax_rank);
+        }
+        for (r = 0; r < nprocs; r++) {
+            const double *x = all + (MPI_Offset)r * PROF_RECORD;
+            double total = 0.0;
+            for (i = 0; i < NUM_PHASES; i++) total += x[i];
+            total_sum += total;
+            if (total > slowest_total) {
+                slowest_total = total;
+                slowest = r;
+            }
+            rss_sum += x[3 * NUM_PHASES];
+            if (x[3 * NUM_PHASES] < rss_min) rss_min = x[3 * NUM_PHASES];
+            if (x[3 * NUM_PHASES] > rss_max) {
+                rss_max = x[3 * NUM_PHASES];
+                rss_rank = r;
+            }
+        }
+        printf("内存峰值: 最小 %.1f MB, 平均 %.1f MB, 最大 %.1f MB (进程 %d)\n",
+               rss_min, rss_sum / nprocs, rss_max, rss_rank);
+        printf("最慢进程: %d, 各阶段合计 %.4f 秒 (平均 %.4f 秒)\n", slowest, slowest_total, total_sum / nprocs);
+        if (p->hwc != 0) {
+            print_hwc_report(all, nprocs);
+        }
+        if (json_path != NULL && write_prof_json(json_path, tool, all, nprocs) != 0) {
+            ret = -1;
+        }
+        free(all);
+    }
+
+    if (trace_path != NULL) {
+        int dropped = 0;
+        MPI_Reduce(&p->dropped, &dropped, 1, MPI_INT, MPI_SUM, 0, comm);
+        if (write_prof_trace(trace_path, tool, comm) != 0) {
+            ret = -1;
+        }
+        if (rank == 0 && dropped > 0) {
+            printf("Warning: %d trace events beyond %d per process were not recorded\n", dropped, PROF_MAX_EVENTS);
+        }
+    }
+    MPI_Bcast(&ret, 1, MPI_INT, 0, comm);
+    return ret;
+}
+
+/* ---------- 参数与文件 ---------- */
+
+int find_matching_files(const char *input_dir, const char **var_types, int num_var_types,
+                        int year, int month, char **file_list, int *num_files) {
+    DIR *dir;
+    struct dirent *entry;
+    char pattern[256];
+    int found = 0;
+
+    dir = opendir(input_dir);
+    if (dir == NULL) {
+        printf("Error: Could not open directory %s\n", input_dir);
+        return -1;
+    }
+
+    *num_files = 0;
+
+    /* 对每个变量类型进行匹配 */
+    for (int i = 0; i < num_var_types; i++) {
+        /* 构建匹配模式: clmforc.Daymet4.1km.VARTYPE.YYYY-MM.nc */
+        sprintf(pattern, FORCING_FILE_FORMAT, var_types[i], year, month);
+
+        /* 重置目录读取位置 */
+        rewinddir(dir);
+
+        /* 遍历目录寻找匹配文件 */
+        while ((entry = readdir(dir)) != NULL) {
+            if (strcmp(entry->d_name, pattern) == 0) {
+                /* 构建完整文件路径 */
+                sprintf(file_list[*num_files], "%s/%s", input_dir, entry->d_name);
+                (*num_files)++;
+                found = 1;
+                break; /* 找到一个就跳出，避免重复添加 */
+            }
+        }
+    }
+
+    closedir(dir);
+    return found ? 0 : -1;
+}
+
+int parse_variable_list(const char *var_string, char **var_types, int *num_var_types) {
+    char *token;
+    char *string_copy = strdup(var_string);
+    char *save_ptr = NULL;
+    int count = 0;
+
+    token = strtok_r(string_copy, ",", &save_ptr);
+    while (token != NULL && count < MAX_VAR_TYPES) {
+        /* 去除前后空格 */
+        char *start = token;
+        while (*start == ' ') start++;
+
+        char *end = start + strlen(start) - 1;
+        while (end > start && *end == ' ') end--;
+        *(end + 1) = '\0';
+
+        var_types[count] = strdup(start);
+        count++;
+
+        token = strtok_r(NULL, ",", &save_ptr);
+    }
+
+    *num_var_types = count;
+    free(string_copy);
+    return 0;
+}
+
+double normalize_lon(double lon) {
+    while (lon > 180.0) lon -= 360.0;
+    while (lon <= -180.0) lon += 360.0;
+    return lon;
+}
+
+int parse_number_list(const char *str, double *values, int max_values) {
+    const char *p = str;
+    char *end = NULL;
+    int count = 0;
+
+    while (count < max_values) {
+        values[count] = strtod(p, &end);
+        if (end == p) {
+            return -1;
+        }
+        count++;
+        if (*end != ',') {
+            break;
+        }
+        p = end + 1;
+    }
+    return (end != NULL && *end == '\0') ? count : -1;
+}
+
+/* 去掉首尾空白，返回新的开头 */
+static char *trim(char *s) {
+    char *end;
+    while (isspace((unsigned char)*s)) s++;
+    end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) *--end = '\0';
+    return s;
+}
+
+int hints_load(const char *path, MPI_Info *hints, MPI_Comm comm) {
+    char *text = (char *)calloc(MAX_HINTS_BYTES + 1, 1);
+    char *line, *next, *key, *value, *sep;
+    int rank, len = 0, count = 0, line_no = 0;
+    MPI_Comm_rank(comm, &rank);
+
+    if (rank == 0) {
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL) {
+            printf("Error: Cannot open hints file %s\n", path);
+            len = -1;
+        } else {
+            len = (int)fread(text, 1, MAX_HINTS_BYTES, fp);
+            if (!feof(fp)) {
+                printf("Error: Hints file %s is larger than %d bytes\n", path, MAX_HINTS_BYTES);
+                len = -1;
+            }
+            fclose(fp);
+        }
+    }
+    MPI_Bcast(&len, 1, MPI_INT, 0, comm);
+    if (len < 0) {
+        free(text);
+        return -1;
+    }
+    MPI_Bcast(text, len, MPI_CHAR, 0, comm);
+    text[len] = '\0';
+
+    MPI_Info_create(hints);
+    for (line = text; line != NULL; line = next) {
+        next = strchr(line, '\n');
+        if (next != NULL) *next++ = '\0';
+        line_no++;
+        if ((sep = strchr(line, '#')) != NULL) *sep = '\0';
+        line = trim(line);
+        if (*line == '\0') continue;
+        /* key = value 或 key value */
+        sep = strchr(line, '=');
+        if (sep == NULL) sep = line + strcspn(line, " \t");
+        if (*sep == '\0') {
+            if (rank == 0) {
+                printf("Error: %s:%d: expected 'key = value'\n", path, line_no);
+            }
+            MPI_Info_free(hints);
+            free(text);
+            return -1;
+        }
+        *sep = '\0';
+        key = trim(line);
+        value = trim(sep + 1);
+        if (*key == '\0' || *value == '\0' || strlen(key) >= MPI_MAX_INFO_KEY) {
+            if (rank == 0) {
+                printf("Error: %s:%d: expected 'key = value'\n", path, line_no);
+            }
+            MPI_Info_free(hints);
+            free(text);
+            return -1;
+        }
+        MPI_Info_set(*hints, key, value);
+        if (rank == 0) {
+            printf("提示 (%s): %s = %s\n", path, key, value);
+        }
+        count++;
+    }
+    free(text);
+    return count;
+}
+
+void hints_apply(MPI_Info info, MPI_Info hints) {
+    char key[MPI_MAX_INFO_KEY + 1], value[MPI_MAX_INFO_VAL + 1];
+    int nkeys, i, flag;
+    if (hints == MPI_INFO_NULL) return;
+    MPI_Info_get_nkeys(hints, &nkeys);
+    for (i = 0; i < nkeys; i++) {
+        MPI_Info_get_nthkey(hints, i, key);
+        MPI_Info_get(hints, key, MPI_MAX_INFO_VAL, value, &flag);
+        if (flag) MPI_Info_set(info, key, value);
+    }
+}
+
+/* ---------- 感兴趣区域 ---------- */
+
+int roi_cache_lookup(const char *cache_file, const char *input_dir, const double *bbox, MPI_Offset *roi) {
+    FILE *fp = fopen(cache_file, "r");
+    char line[MAX_PATH_LEN + 256];
+    char dir[MAX_PATH_LEN];
+    double b[4];
+    long long r[4];
+    int found = -1;
+
+    if (fp == NULL) {
+        return -1;
+    }
+    while (found != 0 && fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "%lf %lf %lf %lf %lld %lld %lld %lld %1023s",
+                   &b[0], &b[1], &b[2], &b[3], &r[0], &r[1], &r[2], &r[3], dir) != 9) {
+            continue;
+        }
+        if (b[0] == bbox[0] && b[1] == bbox[1] && b[2] == bbox[2] && b[3] == bbox[3] &&
+            strcmp(dir, input_dir) == 0) {
+            for (int k = 0; k < 4; k++) {
+                roi[k] = r[k];
+            }
+            found = 0;
+        }
+    }
+    fclose(fp);
+    return found;
+}
+
+void roi_cache_store(const char *cache_file, const char *input_dir, const double *bbox, const MPI_Offset *roi) {
+    FILE *fp = fopen(cache_file, "a");
+    if (fp == NULL) {
+        printf("Warning: Could not write ROI cache %s\n", cache_file);
+        return;
+    }
+    fprintf(fp, "%.17g %.17g %.17g %.17g %lld %lld %lld %lld %s\n",
+            bbox[0], bbox[1], bbox[2], bbox[3],
+            (long long)roi[0], (long long)roi[1], (long long)roi[2], (long long)roi[3], input_dir);
+    fclose(fp);
+}
+
+/* 用 LATIXY/LONGXY 把经纬度范围 bbox = {lat0, lat1, lon0, lon1} 换算成下标范围
+ * roi = {y起点, y个数, x起点, x个数}，即落在范围内所有格点的外接矩形。
+ * comm 内的进程按行分割读取坐标。返回0成功，-1表示没有格点落在范围内 */
+int resolve_bbox(const char *file, const double *bbox, MPI_Offset *roi, MPI_Comm comm) {
+    int ret, rank, size;
+    int ncid, varid_lat, varid_lon;
+    int dimids[2];
+    MPI_Offset ny, nx;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    ret = ncmpi_open(comm, file, NC_NOWRITE, MPI_INFO_NULL, &ncid);
+    CHECK_ERR(ret);
+    ret = ncmpi_inq_varid(ncid, "LATIXY", &varid_lat);
+    CHECK_ERR(ret);
+    ret = ncmpi_inq_varid(ncid, "LONGXY", &varid_lon);
+    CHECK_ERR(ret);
+    ret = ncmpi_inq_vardimid(ncid, varid_lat, dimids);
+    CHECK_ERR(ret);
+    ret = ncmpi_inq_dimlen(ncid, dimids[0], &ny);
+    CHECK_ERR(ret);
+    ret = ncmpi_inq_dimlen(ncid, dimids[1], &nx);
+    CHECK_ERR(ret);
+
+    /* 按行分割 */
+    MPI_Offset my_row_start, my_row_count;
+    split_range(ny, size, rank, &my_row_start, &my_row_count);
+    MPI_Offset start[2] = {my_row_start, 0};
+    MPI_Offset count[2] = {my_row_count, nx};
+
+    double *lat = (double *)malloc((my_row_count * nx + 1) * sizeof(double));
+    double *lon = (double *)malloc((my_row_count * nx + 1) * sizeof(double));
+    if (lat == NULL || lon == NULL) {
+        printf("Error: Memory allocation failed for LATIXY/LONGXY\n");
+        MPI_Abort(MPI_COMM_WORLD, -1);
+        return 1;
+    }
+    ret = ncmpi_get_vara_double_all(ncid, varid_lat, start, count, lat);
+    CHECK_ERR(ret);
+    ret = ncmpi_get_vara_double_all(ncid, varid_lon, start, count, lon);
+    CHECK_ERR(ret);
+    ret = ncmpi_close(ncid);
+    CHECK_ERR(ret);
+
+    /* lo = {最小y, 最小x}，hi = {最大y, 最大x} */
+    MPI_Offset lo[2] = {ny, nx}, hi[2] = {-1, -1};
+    MPI_Offset global_lo[2], global_hi[2];
+    double lon0 = normalize_lon(bbox[2]);
+    double lon1 = normalize_lon(bbox[3]);
+    for (MPI_Offset r = 0; r < my_row_count; r++) {
+        for (MPI_Offset c = 0; c < nx; c++) {
+            double la = lat[r * nx + c];
+            double lo_deg = normalize_lon(lon[r * nx + c]);
+            if (la >= bbox[0] && la <= bbox[1] && lo_deg >= lon0 && lo_deg <= lon1) {
+                MPI_Offset y = my_row_start + r;
+                if (y < lo[0]) lo[0] = y;
+                if (y > hi[0]) hi[0] = y;
+                if (c < lo[1]) lo[1] = c;
+                if (c > hi[1]) hi[1] = c;
+            }
+        }
+    }
+    free(lat);
+    free(lon);
+
+    MPI_Allreduce(lo, global_lo, 2, MPI_OFFSET, MPI_MIN, comm);
+    MPI_Allreduce(hi, global_hi, 2, MPI_OFFSET, MPI_MAX, comm);
+    if (global_hi[0] < 0) {
+        return -1;
+    }
+    roi[0] = global_lo[0];
+    roi[1] = global_hi[0] - global_lo[0] + 1;
+    roi[2] = global_lo[1];
+    roi[3] = global_hi[1] - global_lo[1] + 1;
+    return 0;
+}
+
+/* ---------- 节点聚合读取 ---------- */
+
+/* 节点聚合读取中一个进程的读取请求 */
+typedef struct {
+    int file;
+    nc_type type;
+    MPI_Offset start[3];
+    MPI_Offset count[3];
+} read_request_t;
+
+/* 聚合进程以 MPI_COMM_SELF 打开文件，轮流负责节点内编号 node_rank % naggr 相同的进程 */
+void *node_aggregated_read(node_reader_t *nr, int naggr, char **input_files, const char *const *var_names,
+                           int num_vars, MPI_Info info, int file, const forcing_var_t *var,
+                           const MPI_Offset *start, const MPI_Offset *count, MPI_Offset nelems) {
+    int ret, node_rank, node_size, disp_unit;
+    MPI_Aint seg_size;
+    void *local = NULL;
+    read_request_t request, *requests;
+
+    memset(nr, 0, sizeof(*nr));
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &nr->node_comm);
+    MPI_Comm_rank(nr->node_comm, &node_rank);
+    MPI_Comm_size(nr->node_comm, &node_size);
+    nr->naggr = (naggr < node_size) ? naggr : node_size;
+    nr->is_aggr = (node_rank < nr->naggr);
+
+    /* 收集本节点所有进程的读取请求 */
+    memset(&request, 0, sizeof(request));
+    request.file = file;
+    request.type = var->type;
+    for (int d = 0; d < 3; d++) {
+        request.start[d] = (d < var->ndims) ? start[d] : 0;
+        request.count[d] = (d < var->ndims) ? count[d] : 1;
+    }
+    requests = (read_request_t *)malloc(node_size * sizeof(read_request_t));
+    MPI_Allgather(&request, sizeof(read_request_t), MPI_BYTE, requests, sizeof(read_request_t), MPI_BYTE, nr->node_comm);
+
+    /* 每个进程在共享窗口中分配自己的片段 */
+    MPI_Win_allocate_shared((nelems + 1) * var->elem_size, var->elem_size, MPI_INFO_NULL, nr->node_comm, &local, &nr->win);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, nr->win);
+
+    if (nr->is_aggr) {
+        int ncid = -1, varid = -1, open_file = -1;
+        double t0 = MPI_Wtime();
+        for (int r = node_rank; r < node_size; r += nr->naggr) {
+            void *dst;
+            MPI_Offset n = requests[r].count[0] * requests[r].count[1] * requests[r].count[2];
+            MPI_Win_shared_query(nr->win, r, &seg_size, &disp_unit, &dst);
+            if (requests[r].file != open_file) {
+                if (open_file >= 0) {
+                    ncmpi_close(ncid);
+                }
+                ret = ncmpi_open(MPI_COMM_SELF, input_files[requests[r].file], NC_NOWRITE, info, &ncid);
+                if (ret == NC_NOERR) {
+                    ret = ncmpi_inq_varid(ncid, var_names[requests[r].file % num_vars], &varid);
+                }
+                if (ret != NC_NOERR) {
+                    printf("Error opening %s on aggregator: %s\n", input_files[requests[r].file], ncmpi_strerror(ret));
+                    MPI_Abort(MPI_COMM_WORLD, -1);
+                }
+                open_file = requests[r].file;
+            }
+            ret = ncmpi_get_vara_all(ncid, varid, requests[r].start, requests[r].count, dst, n, nc2mpitype(requests[r].type));
+            if (ret != NC_NOERR) {
+                printf("Error reading for node rank %d: %s\n", r, ncmpi_strerror(ret));
+                MPI_Abort(MPI_COMM_WORLD, -1);
+            }
+            nr->bytes += n * nc_type_size(requests[r].type);
+        }
+        if (open_file >= 0) {
+            ncmpi_close(ncid);
+        }
+        nr->read_time = MPI_Wtime() - t0;
+    }
+
+    /* 聚合进程写完后其他进程才能读取自己的片段 */
+    MPI_Win_sync(nr->win);
+    MPI_Barrier(nr->node_comm);
+    MPI_Win_sync(nr->win);
+
+    free(requests);
+    return local;
+}
+
+void node_reader_finalize(node_reader_t *nr) {
+    int rank, node_rank, nodes, aggregators;
+    MPI_Offset total_bytes;
+    double read_time;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_rank(nr->node_comm, &node_rank);
+    nodes = (node_rank == 0);
+    MPI_Reduce(rank == 0 ? MPI_IN_PLACE : &nodes, &nodes, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&nr->is_aggr, &aggregators, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&nr->bytes, &total_bytes, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+    read_time = max_time(nr->read_time, MPI_COMM_WORLD);
+    if (rank == 0) {
+        printf("===== 节点聚合读取 =====\n");
+        printf("节点数: %d, 聚合进程: 每节点 %d 个, 共 %d 个\n", nodes, nr->naggr, aggregators);
+        printf("读取数据量: %.2f GB, 聚合读取时间: %.4f 秒, 带宽: %.2f GB/s\n",
+               total_bytes / 1073741824.0, read_time,
+               read_time > 0.0 ? total_bytes / 1073741824.0 / read_time : 0.0);
+    }
+
+    MPI_Win_unlock_all(nr->win);
+    MPI_Win_free(&nr->win);
+    MPI_Comm_free(&nr->node_comm);
+}
+
+/* ---------- 多线程解压 ---------- */
+
+/* 多线程解压的一个工作项：一段连续的 (time, 行) 范围，对应读取缓冲区中连续的一段 */
+typedef struct {
+    MPI_Offset start[3];
+    MPI_Offset count[3];
+    MPI_Offset offset;      /* 在读取缓冲区中的元素偏移 */
+} decomp_item_t;
+
+/* 线程共享的工作队列 */
+typedef struct {
+    const char *file;
+    const char *var_name;
+    MPI_Info info;
+    const forcing_var_t *var;
+    decomp_item_t *items;
+    int nitems;
+    int next;               /* 下一个待取的工作项 */
+    pthread_mutex_t lock;
+    char *buffer;
+    double *thread_time;
+    int *thread_items;
+    int error;
+} decomp_pool_t;
+
+typedef struct {
+    decomp_pool_t *pool;
+    int tid;
+} decomp_arg_t;
+
+/* 工作线程：以 MPI_COMM_SELF 单独打开文件，不断从队列取工作项，直接解压到缓冲区中对应位置 */
+static void *decomp_worker(void *p) {
+    decomp_arg_t *arg = (decomp_arg_t *)p;
+    decomp_pool_t *pool = arg->pool;
+    const forcing_var_t *var = pool->var;
+    int ncid, varid, k, ret;
+    double t0;
+
+    ret = ncmpi_open(MPI_COMM_SELF, pool->file, NC_NOWRITE, pool->info, &ncid);
+    if (ret == NC_NOERR) {
+        ret = ncmpi_inq_varid(ncid, pool->var_name, &varid);
+    }
+    t0 = MPI_Wtime();
+    while (ret == NC_NOERR) {
+        pthread_mutex_lock(&pool->lock);
+        k = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        if (k >= pool->nitems) {
+            break;
+        }
+        decomp_item_t *item = &pool->items[k];
+        MPI_Offset n = item->count[0] * item->count[1] * item->count[2];
+        ret = ncmpi_get_vara_all(ncid, varid, item->start, item->count,
+                                 pool->buffer + item->offset * var->elem_size, n, var->mpitype);
+        pool->thread_items[arg->tid]++;
+    }
+    pool->thread_time[arg->tid] = MPI_Wtime() - t0;
+    if (ret != NC_NOERR) {
+        printf("Error in decompression thread %d: %s\n", arg->tid, ncmpi_strerror(ret));
+        pool->error = 1;
+    } else {
+        ncmpi_close(ncid);
+    }
+    return NULL;
+}
+
+int var_thread_safe(const forcing_var_t *var) {
+    int filter = NC_FILTER_NONE;
+    if (!FORCING_PNETCDF_THREAD_SAFE) {
+        return 0;
+    }
+    /* 非 chunk 文件查询失败，没有压缩 */
+    if (ncmpi_var_get_filter(var->ncid, var->varid, &filter) != NC_NOERR) {
+        return 1;
+    }
+    return filter != NC_FILTER_SZ;
+}
+
+/* 按变量的 chunk 边界切分工作项：每个 chunk 只含一个时间步时按 (时间步, chunk 行块) 切分，
+ * 否则按 chunk 的时间块切分。变量不能并发读取时整块集体读取。thread_time/thread_items 返回各线程的解压时间和工作项数 */
+int threaded_read(const char *file, const char *var_name, MPI_Info info, int nthreads,
+                  const forcing_var_t *var, const MPI_Offset *start, const MPI_Offset *count, void *buffer,
+                  double *thread_time, int *thread_items) {
+    MPI_Offset chunk_shape[3];
+    MPI_Offset col_start = (var->ndims == 3) ? start[2] : 0;
+    MPI_Offset col_count = (var->ndims == 3) ? count[2] : 1;
+    MPI_Offset plane = count[1] * col_count;
+    MPI_Offset t, y, end;
+    decomp_pool_t pool;
+    pthread_t threads[MAX_THREADS];
+    decomp_arg_t args[MAX_THREADS];
+    int nitems = 0;
+
+    /* 变量不能并发读取时退回组内的集体读取，各进程读同一文件，走同一分支 */
+    if (!var_thread_safe(var)) {
+        return forcing_var_get(var, start, count, buffer) == NC_NOERR ? 0 : -1;
+    }
+
+    inq_chunk_shape(var, chunk_shape);
+
+    /* 工作项数的上界 */
+    MPI_Offset max_items = (chunk_shape[0] == 1) ? count[0] * ((count[1] + chunk_shape[1] - 1) / chunk_shape[1] + 1)
+                                                 : count[0] / chunk_shape[0] + 2;
+    memset(&pool, 0, sizeof(pool));
+    pool.items = (decomp_item_t *)malloc((max_items + 1) * sizeof(decomp_item_t));
+    if (chunk_shape[0] == 1) {
+        for (t = 0; t < count[0]; t++) {
+            for (y = start[1]; y < start[1] + count[1]; y = end) {
+                end = (y / chunk_shape[1] + 1) * chunk_shape[1];
+                if (end > start[1] + count[1]) {
+                    end = start[1] + count[1];
+                }
+                decomp_item_t *item = &pool.items[nitems++];
+                item->start[0] = start[0] + t;
+                item->start[1] = y;
+                item->start[2] = col_start;
+                item->count[0] = 1;
+                item->count[1] = end - y;
+                item->count[2] = col_count;
+                item->offset = t * plane + (y - start[1]) * col_count;
+            }
+        }
+    } else {
+        for (t = start[0]; t < start[0] + count[0]; t = end) {
+            end = (t / chunk_shape[0] + 1) * chunk_shape[0];
+            if (end > start[0] + count[0]) {
+                end = start[0] + count[0];
+            }
+            decomp_item_t *item = &pool.items[nitems++];
+            item->start[0] = t;
+            item->start[1] = start[1];
+            item->start[2] = col_start;
+            item->count[0] = end - t;
+            item->count[1] = count[1];
+            item->count[2] = col_count;
+            item->offset = (t - start[0]) * plane;
+        }
+    }
+
+    pool.file = file;
+    pool.var_name = var_name;
+    pool.info = info;
+    pool.var = var;
+    pool.nitems = nitems;
+    pool.buffer = (char *)buffer;
+    pool.thread_time = thread_time;
+    pool.thread_items = thread_items;
+    pthread_mutex_init(&pool.lock, NULL);
+
+    if (nthreads > nitems) {
+        nthreads = nitems;
+    }
+    for (int i = 0; i < nthreads; i++) {
+        args[i].pool = &pool;
+        args[i].tid = i;
+        pthread_create(&threads[i], NULL, decomp_worker, &args[i]);
+    }
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool.lock);
+    free(pool.items);
+    return pool.error ? -1 : 0;
+}
+
+/* ---------- 节点内共享 chunk 缓存 ---------- */
+
+int chunk_cache_init(chunk_cache_t *cache, MPI_Offset slot_bytes, double budget_mb) {
+    int node_rank, disp_unit;
+    MPI_Aint win_size = 0, header_bytes;
+    char *base;
+
+    memset(cache, 0, sizeof(*cache));
+    cache->slot_bytes = slot_bytes;
+    cache->nslots = (int)(budget_mb * 1024.0 * 1024.0 / slot_bytes);
+    if (cache->nslots < 1) {
+        return -1;
+    }
+
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &cache->node_comm);
+    MPI_Comm_rank(cache->node_comm, &node_rank);
+
+    /* 数据区按64字节对齐 */
+    header_bytes = (sizeof(long long) + cache->nslots * sizeof(chunk_slot_t) + 63) / 64 * 64;
+    if (node_rank == 0) {
+        win_size = header_bytes + (MPI_Aint)cache->nslots * slot_bytes;
+    }
+    MPI_Win_allocate_shared(win_size, 1, MPI_INFO_NULL, cache->node_comm, &base, &cache->win);
+    MPI_Win_shared_query(cache->win, 0, &win_size, &disp_unit, &base);
+
+    cache->clock = (long long *)base;
+    cache->slots = (chunk_slot_t *)(base + sizeof(long long));
+    cache->data = base + header_bytes;
+
+    if (node_rank == 0) {
+        MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, cache->win);
+        *cache->clock = 0;
+        for (int s = 0; s < cache->nslots; s++) {
+            cache->slots[s].state = CHUNK_SLOT_EMPTY;
+            cache->slots[s].refcount = 0;
+            cache->slots[s].last_use = 0;
+        }
+        MPI_Win_sync(cache->win);
+        MPI_Win_unlock(0, cache->win);
+    }
+    MPI_Barrier(cache->node_comm);
+    return 0;
+}
+
+/* 独立读取一个 chunk，出错时直接终止 */
+static double read_chunk(const forcing_var_t *var, long long chunk_id,
+                         const MPI_Offset *cstart, const MPI_Offset *ccount, void *dst) {
+    double t0 = MPI_Wtime();
+    int ret = ncmpi_get_vara(var->ncid, var->varid, cstart, ccount, dst,
+                             ccount[0] * ccount[1] * ccount[2], var->mpitype);
+    if (ret != NC_NOERR) {
+        printf("Error reading chunk %lld: %s\n", chunk_id, ncmpi_strerror(ret));
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    return MPI_Wtime() - t0;
+}
+
+/* 命中时直接返回共享槽；未命中时占用空槽或最久未用的空闲槽，由本进程独立读取（解压）后标记为就绪 */
+void *chunk_cache_acquire(chunk_cache_t *cache, int file_id, const forcing_var_t *var, long long chunk_id,
+                          const MPI_Offset *cstart, const MPI_Offset *ccount, int *slot) {
+    double acquire_start = MPI_Wtime(), read_time = 0.0;
+    void *chunk = NULL;
+
+    while (chunk == NULL) {
+        int found = -1, victim = -1;
+
+        MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, cache->win);
+        MPI_Win_sync(cache->win);
+        for (int s = 0; s < cache->nslots; s++) {
+            chunk_slot_t *cs = &cache->slots[s];
+            if (cs->state != CHUNK_SLOT_EMPTY && cs->file_id == file_id &&
+                cs->var_id == var->varid && cs->chunk_id == chunk_id) {
+                found = s;
+                break;
+            }
+            /* 候选淘汰槽：优先空槽，其次最久未使用的空闲槽 */
+            if (cs->refcount == 0 && cs->state != CHUNK_SLOT_FILLING &&
+                (victim < 0 || (cache->slots[victim].state != CHUNK_SLOT_EMPTY &&
+                                (cs->state == CHUNK_SLOT_EMPTY || cs->last_use < cache->slots[victim].last_use)))) {
+                victim = s;
+            }
+        }
+
+        if (found >= 0 && cache->slots[found].state == CHUNK_SLOT_READY) {
+            /* 命中 */
+            cache->slots[found].refcount++;
+            cache->slots[found].last_use = ++(*cache->clock);
+            MPI_Win_sync(cache->win);
+            MPI_Win_unlock(0, cache->win);
+            cache->hits++;
+            *slot = found;
+            chunk = cache->data + found * cache->slot_bytes;
+        } else if (found >= 0) {
+            /* 其他进程正在解压这个 chunk，稍后重试 */
+            MPI_Win_unlock(0, cache->win);
+            usleep(100);
+        } else if (victim < 0) {
+            /* 所有槽都被占用：解压到私有缓冲区，不进入缓存 */
+            MPI_Win_unlock(0, cache->win);
+            cache->misses++;
+            cache->bypasses++;
+            if (cache->scratch == NULL) {
+                cache->scratch = malloc(cache->slot_bytes);
+            }
+            read_time = read_chunk(var, chunk_id, cstart, ccount, cache->scratch);
+            *slot = -1;
+            chunk = cache->scratch;
+        } else {
+            /* 未命中：占用该槽并由本进程解压 */
+            chunk_slot_t *cs = &cache->slots[victim];
+            if (cs->state == CHUNK_SLOT_READY) {
+                cache->evictions++;
+            }
+            cs->file_id = file_id;
+            cs->var_id = var->varid;
+            cs->chunk_id = chunk_id;
+            cs->state = CHUNK_SLOT_FILLING;
+            cs->refcount = 1;
+            cs->last_use = ++(*cache->clock);
+            MPI_Win_sync(cache->win);
+            MPI_Win_unlock(0, cache->win);
+            cache->misses++;
+
+            void *dst = cache->data + victim * cache->slot_bytes;
+            read_time = read_chunk(var, chunk_id, cstart, ccount, dst);
+
+            MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, cache->win);
+            MPI_Win_sync(cache->win);
+            cs->state = CHUNK_SLOT_READY;
+            MPI_Win_sync(cache->win);
+            MPI_Win_unlock(0, cache->win);
+            *slot = victim;
+            chunk = dst;
+        }
+    }
+    cache->decompress_time += read_time;
+    cache->wait_time += MPI_Wtime() - acquire_start - read_time;
+    return chunk;
+}
+
+void chunk_cache_release(chunk_cache_t *cache, int slot) {
+    if (slot < 0) {
+        return;
+    }
+    MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, cache->win);
+    MPI_Win_sync(cache->win);
+    cache->slots[slot].refcount--;
+    MPI_Win_sync(cache->win);
+    MPI_Win_unlock(0, cache->win);
+}
+
+void chunk_cache_finalize(chunk_cache_t *cache) {
+    int rank;
+    long long counts[4] = {cache->hits, cache->misses, cache->evictions, cache->bypasses};
+    long long total_counts[4];
+    double times[2] = {cache->decompress_time, cache->wait_time};
+    double sum_times[2], max_times[2];
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Reduce(counts, total_counts, 4, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(times, sum_times, 2, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(times, max_times, 2, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        long long lookups = total_counts[0] + total_counts[1];
+        printf("===== chunk 缓存统计 =====\n");
+        printf("每节点槽数: %d (每槽 %.1f MB)\n", cache->nslots, cache->slot_bytes / 1048576.0);
+        printf("命中: %lld, 未命中: %lld, 命中率: %.1f%%\n", total_counts[0], total_counts[1],
+               lookups > 0 ? 100.0 * total_counts[0] / lookups : 0.0);
+        printf("淘汰: %lld, 绕过缓存: %lld\n", total_counts[2], total_counts[3]);
+        printf("解压时间: 合计 %.4f 秒, 单进程最大 %.4f 秒\n", sum_times[0], max_times[0]);
+        printf("等待时间: 合计 %.4f 秒, 单进程最大 %.4f 秒\n", sum_times[1], max_times[1]);
+    }
+
+    MPI_Win_free(&cache->win);
+    MPI_Comm_free(&cache->node_comm);
+    free(cache->scratch);
+}
+
+/* 经缓存读取时各进程从错开的时间位置开始，使同一节点上的进程并行解压不同的 chunk */
+int read_band_sum(const forcing_var_t *var, int file_id,
+                  MPI_Offset row_start, MPI_Offset row_count, MPI_Offset col_start, MPI_Offset col_count,
+                  int proc_in_group, int procs_per_group, chunk_cache_t *cache, void *sum, pixel_hist_t *hist) {
+    int ret;
+    sum_kernel_t kernel = sum_kernel(var->type);
+    MPI_Offset nt = var->dim_sizes[0];
+    MPI_Offset ny = var->dim_sizes[1];
+    MPI_Offset nx = (var->ndims == 3) ? var->dim_sizes[2] : 1;
+    MPI_Offset band_size = row_count * col_count;
+
+    if (cache == NULL) {
+        MPI_Offset start[3] = {0, row_start, col_start};
+        MPI_Offset count[3] = {1, row_count, col_count};
+        void *plane = alloc_typed(var->type, band_size);
+        for (MPI_Offset t = 0; t < nt; t++) {
+            start[0] = t;
+            ret = forcing_var_get(var, start, count, plane);
+            CHECK_ERR(ret);
+            kernel(plane, band_size, sum);
+            if (hist != NULL) {
+                pixel_hist_add(hist, var, plane, band_size, 0);
+            }
+        }
+        free(plane);
+        return 0;
+    }
+
+    MPI_Offset chunk_shape[3];
+    inq_chunk_shape(var, chunk_shape);
+    MPI_Offset nct = (nt + chunk_shape[0] - 1) / chunk_shape[0];
+    MPI_Offset ncy = (ny + chunk_shape[1] - 1) / chunk_shape[1];
+    MPI_Offset ncx = (nx + chunk_shape[2] - 1) / chunk_shape[2];
+    MPI_Offset cy_first = row_start / chunk_shape[1];
+    MPI_Offset cy_last = (row_start + row_count - 1) / chunk_shape[1];
+    MPI_Offset cx_first = col_start / chunk_shape[2];
+    MPI_Offset cx_last = (col_start + col_count - 1) / chunk_shape[2];
+    MPI_Offset stagger = (MPI_Offset)proc_in_group * nct / procs_per_group;
+
+    ret = ncmpi_begin_indep_data(var->ncid);
+    CHECK_ERR(ret);
+    for (MPI_Offset b = 0; row_count > 0 && col_count > 0 && b < nct; b++) {
+        MPI_Offset ct = (b + stagger) % nct;
+        for (MPI_Offset cy = cy_first; cy <= cy_last; cy++) {
+            for (MPI_Offset cx = cx_first; cx <= cx_last; cx++) {
+                MPI_Offset cstart[3], ccount[3];
+                int slot;
+                cstart[0] = ct * chunk_shape[0];
+                cstart[1] = cy * chunk_shape[1];
+                cstart[2] = cx * chunk_shape[2];
+                ccount[0] = (cstart[0] + chunk_shape[0] > nt) ? nt - cstart[0] : chunk_shape[0];
+                ccount[1] = (cstart[1] + chunk_shape[1] > ny) ? ny - cstart[1] : chunk_shape[1];
+                ccount[2] = (cstart[2] + chunk_shape[2] > nx) ? nx - cstart[2] : chunk_shape[2];
+
+                long long chunk_id = (ct * ncy + cy) * ncx + cx;
+                const char *chunk = (const char *)chunk_cache_acquire(cache, file_id, var, chunk_id, cstart, ccount, &slot);
+
+                /* chunk 与本进程区域的交集 */
+                MPI_Offset r0 = (row_start > cstart[1]) ? row_start : cstart[1];
+                MPI_Offset r1 = (row_start + row_count < cstart[1] + ccount[1]) ? row_start + row_count : cstart[1] + ccount[1];
+                MPI_Offset c0 = (col_start > cstart[2]) ? col_start : cstart[2];
+                MPI_Offset c1 = (col_start + col_count < cstart[2] + ccount[2]) ? col_start + col_count : cstart[2] + ccount[2];
+                for (MPI_Offset t = 0; t < ccount[0]; t++) {
+                    for (MPI_Offset r = r0; r < r1; r++) {
+                        MPI_Offset src = (t * ccount[1] + (r - cstart[1])) * ccount[2] + (c0 - cstart[2]);
+                        MPI_Offset dst = (r - row_start) * col_count + (c0 - col_start);
+                        kernel(chunk + src * var->elem_size, c1 - c0, (char *)sum + dst * var->acc_size);
+                        if (hist != NULL) {
+                            pixel_hist_add(hist, var, chunk + src * var->elem_size, c1 - c0, dst);
+                        }
+                    }
+                }
+                chunk_cache_release(cache, slot);
+            }
+        }
+    }
+    ret = ncmpi_end_indep_data(var->ncid);
+    CHECK_ERR(ret);
+    return 0;
+}
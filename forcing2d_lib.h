@@ -0,0 +1,511 @@
+/*
+ * forcing2d 公共库：forcing2d_average_v0/v1 和 forcing2d_raw2chunk 共用的
+ * 变量读取、划分、归约和计时函数，以及平均程序的各种读取方式
+ * （节点聚合读取、多线程解压、节点内共享 chunk 缓存）
+ */
+
+#ifndef FORCING2D_LIB_H
+#define FORCING2D_LIB_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include <pnetcdf.h>
+#include <pthread.h>
+
+/* 错误处理宏 */
+#define CHECK_ERR(err) { \
+    if (err != NC_NOERR) { \
+        printf("Error at line %d: %s\n", __LINE__, ncmpi_strerror(err)); \
+        MPI_Abort(MPI_COMM_WORLD, -1); \
+        return 1; \
+    } \
+}
+
+/* 最大文件路径长度 */
+#define MAX_PATH_LEN 1024
+/* 最大文件数量 */
+#define MAX_FILES 1000
+/* 最大变量类型数量 */
+#define MAX_VAR_TYPES 100
+/* 输入文件名：clmforc.Daymet4.1km.VAR.YYYY-MM.nc */
+#define FORCING_FILE_FORMAT "clmforc.Daymet4.1km.%s.%04d-%02d.nc"
+/* 变量的最大维度数 */
+#define FORCING_MAX_DIMS 10
+/* 陆地格点压缩格式 (forcing2d_raw2chunk -g) 中的维度和索引变量名 */
+#define GRIDCELL_DIM_NAME "gridcell"
+#define GRIDCELL_Y_NAME "gridcell_y"
+#define GRIDCELL_X_NAME "gridcell_x"
+/* bbox 换算结果的缓存文件名，位于输出目录 */
+#define ROI_CACHE_NAME "forcing2d_roi.cache"
+/* 每个进程的最大解压线程数 */
+#define MAX_THREADS 64
+
+/* ---------- 类型 ---------- */
+
+/* nc_type 对应的 MPI 类型，不支持的类型返回 MPI_DATATYPE_NULL */
+MPI_Datatype nc2mpitype(nc_type xtype);
+
+/* nc_type 的元素字节数，不支持的类型返回0 */
+int nc_type_size(nc_type xtype);
+
+/* 累加使用的类型：double 和32/64位整数用 double，其余用 float */
+nc_type accum_type(nc_type xtype);
+
+/* 按类型分配 nelems 个元素，nelems 为0时也返回有效指针 */
+void *alloc_typed(nc_type xtype, MPI_Offset nelems);
+
+/* ---------- 变量读取 ---------- */
+
+/* 一个变量的读取描述，读取按变量自身的类型进行，不经过 float 转换 */
+typedef struct {
+    int ncid;
+    int varid;
+    nc_type type;
+    MPI_Datatype mpitype;
+    int elem_size;
+    nc_type acc_type;       /* 累加类型，见 accum_type */
+    MPI_Datatype acc_mpitype;
+    int acc_size;
+    int ndims;
+    int dimids[FORCING_MAX_DIMS];
+    MPI_Offset dim_sizes[FORCING_MAX_DIMS];
+    double fill;            /* _FillValue 或 missing_value，都没有时为 NaN（与任何值都不相等） */
+} forcing_var_t;
+
+/* 查询变量的类型、维度和填充值 */
+int forcing_var_inq(int ncid, int varid, forcing_var_t *var);
+
+/* 集合读取 (start, count) 范围到 buf，buf 的类型为变量自身的类型 */
+int forcing_var_get(const forcing_var_t *var, const MPI_Offset *start, const MPI_Offset *count, void *buf);
+
+/* 变量的 chunk 形状，按 (time, y, x) 给出；压缩格式 (time, gridcell) 的 x 为1。
+ * 变量未分块时视为整个变量一个 chunk */
+void inq_chunk_shape(const forcing_var_t *var, MPI_Offset *chunk_shape);
+
+/* ---------- 划分 ---------- */
+
+/* 把 n 个元素尽量均匀地分成 nparts 份，前 n % nparts 份各多一个，返回第 part 份的范围 */
+void split_range(MPI_Offset n, int nparts, int part, MPI_Offset *start, MPI_Offset *count);
+
+/* 划分维度在文件中的布局，用于让进程间的边界落在 chunk 和文件系统条带的边界上 */
+typedef struct {
+    MPI_Offset chunk;       /* 该维度上的 chunk 长度，0 表示不分块 */
+    MPI_Offset base;        /* 索引0的文件偏移（字节） */
+    MPI_Offset stride;      /* 索引每加1文件偏移增加的字节数，记录变量的 time 维为记录大小 */
+    MPI_Offset stripe;      /* 条带大小（字节），0 表示不考虑条带 */
+} split_layout_t;
+
+/* 每份允许偏离均匀划分的比例（相对平均份大小） */
+#define SPLIT_PLAN_SLACK 0.10
+
+/* 划分计划：第 p 份为 [bounds[p], bounds[p + 1]) */
+typedef struct {
+    MPI_Offset n;
+    int nparts;
+    MPI_Offset *bounds;
+    int split_chunks;       /* 落在 chunk 内部的边界数，相邻进程各读一部分同一个 chunk */
+    int shared_stripes;     /* 落在条带内部的边界数，相邻进程写同一个条带时争用锁 */
+    double imbalance;       /* 最大份 / 平均份 */
+} split_plan_t;
+
+/* 查询变量第 dim 维的布局。分块变量只按 chunk 对齐（压缩后的 chunk 偏移不固定）；
+ * 连续存储的变量按条带对齐，条带大小取 hints 中的 striping_unit，没有时取文件打开后
+ * MPI-IO 报告的 striping_unit，都没有时为0。y 维的偏移按第一个记录计算 */
+void split_layout_inq(const forcing_var_t *var, int dim, MPI_Info hints, split_layout_t *layout);
+
+/* 把 n 个元素分成 nparts 份。layout 为 NULL 时与 split_range 相同；否则每个边界在均匀划分的
+ * 位置附近 SPLIT_PLAN_SLACK 范围内，优先选不切开 chunk、其次不共用条带的位置。所有进程得到相同的计划 */
+int split_plan(MPI_Offset n, int nparts, const split_layout_t *layout, split_plan_t *plan);
+
+/* 第 part 份的范围 */
+void split_plan_part(const split_plan_t *plan, int part, MPI_Offset *start, MPI_Offset *count);
+
+/* 最大一份的元素数 */
+MPI_Offset split_plan_max(const split_plan_t *plan);
+
+/* 打印计划与均匀划分的对比：均衡度、切开 chunk 和共用条带的边界数 */
+void split_plan_report(const split_plan_t *plan, const split_layout_t *layout, const char *what);
+
+void split_plan_free(split_plan_t *plan);
+
+/* ---------- 归约 ---------- */
+
+/* 按输入类型专门化的累加内核：sum[k] += src[k]，sum 的类型为 accum_type(输入类型) */
+typedef void (*sum_kernel_t)(const void *src, MPI_Offset n, void *sum);
+
+/* 取输入类型对应的累加内核，不支持的类型返回 NULL */
+sum_kernel_t sum_kernel(nc_type xtype);
+
+/* 把 nplanes 个连续的平面逐元素累加到 sum */
+void sum_planes(const forcing_var_t *var, const void *planes, MPI_Offset nplanes, MPI_Offset plane_size, void *sum);
+
+/* values[k] *= factor，values 的类型为 acc_type */
+void scale_values(nc_type acc_type, void *values, MPI_Offset n, double factor);
+
+/* 把 nplanes 个连续平面与均值之差的平方逐元素累加到 m2（二遍法求方差的第二遍） */
+void sum_sq_dev_planes(const forcing_var_t *var, const void *planes, MPI_Offset nplanes, MPI_Offset plane_size,
+                       const double *mean, double *m2);
+
+/* 距平：out[k] = src[k] - mean[k]，src 为变量自身的类型，mean 和 out 为累加类型 */
+void anomaly_plane(const forcing_var_t *var, const void *src, const void *mean, MPI_Offset n, void *out);
+
+/* 把 acc_type 类型的 values 转换为 double */
+void to_double(nc_type acc_type, const void *values, MPI_Offset n, double *out);
+
+/* 按 Chan 等人的成对公式把 (nb, sum_b, m2_b) 合并到 (na, sum_a, m2_a)，
+ * sum 为逐元素的和，m2 为逐元素的离差平方和，na/nb 为各自的样本数 */
+void merge_moments(long long na, double *sum_a, double *m2_a,
+                   long long nb, const double *sum_b, const double *m2_b, MPI_Offset n);
+
+/* ---------- 逐格点直方图 ---------- */
+
+/* 逐格点的定宽直方图，用于流式估计分位数。[lo, hi] 分成 nbins 个等宽的箱，
+ * 超出范围的值计入首尾两个箱，NaN 不计入。内存为每个格点 nbins 个 unsigned short，
+ * 分位数误差不超过一个箱宽 (hi - lo) / nbins。计数可以直接相加，因此不同进程
+ * （或不同时间段）的直方图可以合并 */
+typedef struct {
+    int nbins;
+    double lo, hi;
+    MPI_Offset ncells;
+    unsigned short *counts;     /* counts[cell * nbins + bin] */
+} pixel_hist_t;
+
+/* 创建 ncells 个格点的直方图，计数清零 */
+int pixel_hist_init(pixel_hist_t *h, MPI_Offset ncells, int nbins, double lo, double hi);
+
+/* 把 src 中的 n 个值（变量自身的类型）计入格点 offset .. offset + n - 1，
+ * NaN 和变量的填充值不计入，全部为填充值的格点的分位数为填充值 */
+void pixel_hist_add(pixel_hist_t *h, const forcing_var_t *var, const void *src, MPI_Offset n, MPI_Offset offset);
+
+/* 每个格点的 q 分位数 (0 < q < 1)，箱内线性插值，out 的类型为 acc_type */
+void pixel_hist_quantile(const pixel_hist_t *h, double q, nc_type acc_type, void *out);
+
+void pixel_hist_free(pixel_hist_t *h);
+
+/* ---------- 重网格化 ---------- */
+
+/* ESMF/SCRIP 格式的稀疏权重矩阵 dst = S * src 中本进程读取的一段。
+ * 格点编号为 0 起的扁平下标，二维网格按 (y, x) 行主序，与 *_grid_dims = (nx, ny) 一致 */
+typedef struct {
+    MPI_Offset n_a, n_b;        /* 源、目标格点数 */
+    int src_dims[2];            /* 源网格 (nx, ny) */
+    int dst_dims[2];            /* 目标网格 (nx, ny) */
+    MPI_Offset nnz;             /* 本进程的权重个数 */
+    int *row, *col;
+    double *S;
+} regrid_weights_t;
+
+/* comm 中的进程各读取权重文件中均匀的一段 (row, col, S)，支持 ESMF (row/col/S)
+ * 和 SCRIP (dst_address/src_address/remap_matrix) 两种变量名 */
+int regrid_weights_read(const char *file, MPI_Comm comm, regrid_weights_t *w);
+
+/* 读取目标网格 [start, start + count) 格点的中心纬度和经度（度） */
+int regrid_read_dst_coords(const char *file, MPI_Comm comm, MPI_Offset start, MPI_Offset count,
+                           double *lat, double *lon);
+
+/* 并行稀疏矩阵-向量乘：src 为源网格中 roi = {y起点, y个数, x起点, x个数} 子区域的值，
+ * 子区域外、NaN 和等于填充值 fill 的源格点（如海洋）不参与，结果按参与权重之和归一化。
+ * src 为时间平均，填充值在累加中有舍入，按相对误差 1e-3 比较；没有填充值时 fill 为 NaN。每个进程先用自己的一段权重
+ * 累加整个目标向量，再用 MPI_Reduce_scatter 把本进程负责的目标行归约到 out 中，
+ * 目标行按 split_range(目标 ny, size, rank) 划分。没有源格点覆盖的目标格点为 NC_FILL_DOUBLE */
+void regrid_apply(const regrid_weights_t *w, const double *src, const MPI_Offset *roi, double fill, MPI_Comm comm,
+                  double *out);
+
+void regrid_weights_free(regrid_weights_t *w);
+
+/* ---------- 分区统计 ---------- */
+
+/* 分段归约：按 mask 把一个平面的 n 个值归入各分区，累加 sum/count 并更新 min/max，
+ * 一遍完成。mask 不在 [0, nregions) 内的格点、NaN 和 var->fill 不计入 */
+void region_reduce_plane(const forcing_var_t *var, const void *src, const int *mask, MPI_Offset n, int nregions,
+                         double *sum, double *min, double *max, long long *count);
+
+/* 读取二维整型分区变量在 roi = {y起点, y个数, x起点, x个数} 内的值，分区编号为 0 起，
+ * 负值（含缺省填充值）表示不属于任何分区；nregions 为 comm 内最大编号加1 */
+int region_mask_read(const char *file, const char *name, MPI_Comm comm, const MPI_Offset *roi,
+                     int *mask, int *nregions);
+
+/* ---------- 派生变量 ---------- */
+
+#define DERIVED_MAX_INPUTS 4
+
+/* 逐格点计算派生变量：out[k] = f(in[0][k], in[1][k], ...)，输入按 inputs 的顺序给出，
+ * ctx 为派生变量自带的参数（表达式的字节码），内置公式为 NULL */
+typedef void (*derived_kernel_t)(const void *ctx, const float *const *in, MPI_Offset n, float *out);
+
+/* 派生变量：由若干个强迫变量（同一网格、同一时间轴）按公式逐格点计算 */
+typedef struct {
+    const char *name;
+    const char *long_name;
+    const char *units;
+    int ninputs;
+    const char *inputs[DERIVED_MAX_INPUTS];
+    derived_kernel_t eval;
+    const void *ctx;
+    int total;              /* 输出时间和（如超过阈值的时间步数），不除以时间步数 */
+} derived_var_t;
+
+/* ---------- 表达式 ---------- */
+
+#define EXPR_MAX_CODE 64
+#define EXPR_MAX_STACK 16
+#define EXPR_BATCH 256      /* 每条指令一次处理的格点数 */
+
+/* 用户定义的逐格点表达式 NAME=EXPR，编译为后缀形式的字节码。
+ * EXPR 支持数字、输入变量名、+ - * /、比较 > >= < <= == !=（结果为1或0）、括号，
+ * 以及 exp/log/sqrt/abs(x)、min/max(x, y)。解释执行时每条指令处理一批 EXPR_BATCH 个格点，
+ * 指令分派的开销被整批分摊，内层循环可以向量化 */
+typedef struct {
+    derived_var_t def;      /* 作为派生变量使用时的描述，def.ctx 指向本结构 */
+    char name[NC_MAX_NAME+1];
+    char text[MAX_PATH_LEN];
+    char inputs[DERIVED_MAX_INPUTS][NC_MAX_NAME+1];
+    int ncode;
+    struct {
+        int op;
+        int arg;            /* 输入变量序号 */
+        float value;        /* 常数 */
+    } code[EXPR_MAX_CODE];
+} expr_t;
+
+/* 编译 "NAME=EXPR"，total 非0时输出时间和。出错时打印原因并返回非0 */
+int expr_compile(const char *text, int total, expr_t *e);
+
+/* 按名字查找派生变量：先查用户表达式，再查内置公式（RH、EA、ESAT、VPD），都不是时返回 NULL */
+const derived_var_t *derived_var_lookup(const char *name, const expr_t *exprs, int num_exprs);
+
+/* ---------- 时间插值 ---------- */
+
+#define INTERP_LINEAR 0     /* 输入为时刻值，在相邻两步之间线性插值 */
+#define INTERP_COSZEN 1     /* 输入为时段平均（如 FSDS），按子步的太阳天顶角余弦分配，时段平均不变 */
+
+/* 本进程一段空间范围的逐步插值：输入的每一步产生 nsub 个子步 */
+typedef struct {
+    const char *file;
+    const char *var_name;
+    MPI_Info info;
+    MPI_Offset nt;                  /* 输入时间步数 */
+    int ndims;
+    MPI_Offset start[3], count[3];  /* 本进程读取的空间范围，time 分量忽略 */
+    int nsub;
+    int method;
+    const double *lat, *lon;        /* INTERP_COSZEN：本进程各格点的纬度、经度（度） */
+    double day0;                    /* 第0步起点的年内日序（0起，UTC，按365天历） */
+    double step_days;               /* 输入步长（天） */
+    int prefetch;                   /* 用后台线程预读下一个平面，需要 MPI_THREAD_MULTIPLE 和 var_thread_safe */
+} interp_spec_t;
+
+/* 每产生一个子步调用一次，step 为子步序号，返回非0时停止 */
+typedef int (*interp_callback_t)(void *arg, MPI_Offset step, const float *plane, MPI_Offset n);
+
+/* 以 MPI_COMM_SELF 打开输入文件，逐步读取平面并插值，把 nt * nsub 个子步依次交给 callback。
+ * 线性插值只保留当前区间两端的两个平面，天顶角方法只保留当前平面，另有一个平面缓冲预读下一步 */
+int interp_stream(const interp_spec_t *spec, interp_callback_t callback, void *arg);
+
+/* ---------- 计时 ---------- */
+
+/* 所有进程中最长的时间，结果只在 comm 的0号进程有效 */
+double max_time(double local_time, MPI_Comm comm);
+
+/* 分阶段计时的阶段 */
+enum {
+    PHASE_OPEN, PHASE_HEADER, PHASE_READ, PHASE_DECOMPRESS, PHASE_ACCUMULATE,
+    PHASE_REDUCE, PHASE_CREATE, PHASE_WRITE, PHASE_CLOSE, NUM_PHASES
+};
+/* 每个进程最多记录的时间线事件数，超出的事件只计入总时间 */
+#define PROF_MAX_EVENTS 4096
+
+/* 硬件计数器的测量区域 */
+enum {
+    HWC_ACCUMULATE, HWC_NORMALIZE, HWC_COPY, HWC_DECOMPRESS, HWC_COMPRESS, NUM_HWC_REGIONS
+};
+/* 计数的事件：周期、指令、末级缓存访问、末级缓存缺失 */
+#define HWC_NUM_EVENTS 4
+
+/* 区域开始时的计数值 */
+typedef struct {
+    double t0;
+    double count[HWC_NUM_EVENTS];
+} hwc_mark_t;
+
+/* 本进程各阶段的累计时间和数据量，以及可选的时间线（用于 Chrome trace）。
+ * 由全局变量 forcing_prof 记录，只在主线程调用 prof_end */
+typedef struct {
+    double origin;              /* prof_init 时的 MPI_Wtime，时间线以此为零点 */
+    double time[NUM_PHASES];
+    double bytes[NUM_PHASES];
+    int calls[NUM_PHASES];
+    double *events;             /* 每个事件三个数：阶段、开始、结束；不记录时间线时为 NULL */
+    int nevents, dropped;
+    int hwc;                    /* 硬件计数器：0 未启用，1 可用，-1 不可用（只记录时间） */
+    int hwc_fd[HWC_NUM_EVENTS];
+    char hwc_error[64];
+    double hwc_time[NUM_HWC_REGIONS];
+    double hwc_bytes[NUM_HWC_REGIONS];
+    double hwc_ops[NUM_HWC_REGIONS];
+    double hwc_count[NUM_HWC_REGIONS][HWC_NUM_EVENTS];
+} prof_t;
+
+extern prof_t forcing_prof;
+
+/* 开始分阶段计时（集合操作），trace 非0时同时记录时间线。
+ * counters 非0时用 perf_event_open 打开本进程（含之后创建的线程）的用户态硬件计数器，
+ * 不可用时（内核不支持、perf_event_paranoid 限制、虚拟机）只记录各区域的时间 */
+void prof_init(int trace, int counters, MPI_Comm comm);
+
+/* 返回阶段开始时间，与 prof_end 配对使用 */
+double prof_begin(void);
+
+/* 结束一个阶段：累计 t0 以来的时间和本次传输的字节数 */
+void prof_end(int phase, double t0, MPI_Offset bytes);
+
+/* 直接累计一段已测得的时间（如其他线程中的时间），不记入时间线 */
+void prof_add(int phase, double seconds, MPI_Offset bytes);
+
+/* 硬件计数器区域的开始和结束，未启用时不做任何事。bytes 为区域处理的数据量，
+ * ops 为其中的算术运算数（累加、缩放每个元素一次，复制为0），用于计算运算强度 */
+void hwc_begin(hwc_mark_t *m);
+void hwc_end(int region, const hwc_mark_t *m, MPI_Offset bytes, MPI_Offset ops);
+
+/* 汇总各进程的阶段时间（集合操作）。0号进程打印每个阶段的最小/平均/最大时间、
+ * 不均衡度（最大/平均）、数据量和带宽，以及内存峰值和最慢的进程；启用硬件计数器时
+ * 另外打印各区域的 IPC、缓存缺失率、估计的内存带宽、字节/周期和运算强度。
+ * json_path 不为 NULL 时写出汇总和每个进程的明细，trace_path 不为 NULL 时写出 Chrome trace */
+int prof_report(const char *tool, const char *json_path, const char *trace_path, MPI_Comm comm);
+
+/* ---------- 参数与文件 ---------- */
+
+/* 查找匹配的文件 */
+int find_matching_files(const char *input_dir, const char **var_types, int num_var_types,
+                        int year, int month, char **file_list, int *num_files);
+
+/* 解析逗号分隔的变量列表 */
+int parse_variable_list(const char *var_string, char **var_types, int *num_var_types);
+
+/* 经度统一到 (-180, 180] */
+double normalize_lon(double lon);
+
+/* 解析逗号分隔的数值列表，返回解析出的个数，格式错误时返回-1 */
+int parse_number_list(const char *str, double *values, int max_values);
+
+/* MPI-IO/PnetCDF 提示文件的最大字节数 */
+#define MAX_HINTS_BYTES 65536
+
+/* 读取提示文件（集合操作，0号进程读取后广播）。每行一个 key = value 或 key value，
+ * # 之后为注释。成功时 *hints 为新建的 MPI_Info 并返回提示个数，失败时返回-1 */
+int hints_load(const char *path, MPI_Info *hints, MPI_Comm comm);
+
+/* 把 hints 中的所有提示复制到 info，覆盖同名的默认值；hints 为 MPI_INFO_NULL 时不做任何事 */
+void hints_apply(MPI_Info info, MPI_Info hints);
+
+/* ---------- 感兴趣区域 ---------- */
+
+/* 在缓存文件中查找 (输入目录, bbox) 对应的下标范围，找到返回0 */
+int roi_cache_lookup(const char *cache_file, const char *input_dir, const double *bbox, MPI_Offset *roi);
+
+/* 把换算结果追加到缓存文件 */
+void roi_cache_store(const char *cache_file, const char *input_dir, const double *bbox, const MPI_Offset *roi);
+
+/* 根据 LATIXY/LONGXY 把经纬度范围换算为包含所有落在范围内格点的最小下标矩形 */
+int resolve_bbox(const char *file, const double *bbox, MPI_Offset *roi, MPI_Comm comm);
+
+/* ---------- 节点聚合读取 ---------- */
+
+/* 节点聚合读取：每个节点只有少数聚合进程访问文件系统，读取（解压）本节点所有进程的
+ * 数据，直接放入各进程在 MPI-3 共享内存窗口中的片段，其他进程就地计算 */
+typedef struct {
+    MPI_Comm node_comm;
+    MPI_Win win;
+    int naggr;              /* 本节点的聚合进程数 */
+    int is_aggr;
+    MPI_Offset bytes;       /* 本进程作为聚合进程读取的字节数 */
+    double read_time;
+} node_reader_t;
+
+/* 由本节点的聚合进程读取所有进程的 (file, start, count) 请求，返回本进程的数据。
+ * 第 file 个文件中的变量名为 var_names[file % num_vars]（多年平均时文件按年重复变量列表） */
+void *node_aggregated_read(node_reader_t *nr, int naggr, char **input_files, const char *const *var_names,
+                           int num_vars, MPI_Info info, int file, const forcing_var_t *var,
+                           const MPI_Offset *start, const MPI_Offset *count, MPI_Offset nelems);
+
+/* 打印聚合进程数和实际读取带宽，然后释放共享窗口 */
+void node_reader_finalize(node_reader_t *nr);
+
+/* ---------- 多线程解压 ---------- */
+
+/* PnetCDF 只有以 --enable-thread-safe 构建时（pnetcdf.h 中 PNETCDF_THREAD_SAFE 为 1）才允许多个线程同时调用 */
+#if defined(PNETCDF_THREAD_SAFE) && PNETCDF_THREAD_SAFE
+#define FORCING_PNETCDF_THREAD_SAFE 1
+#else
+#define FORCING_PNETCDF_THREAD_SAFE 0
+#endif
+
+/* 能否在多个线程中同时读取该变量：需要线程安全的 PnetCDF，且变量不用 SZ 压缩（SZ 有全局状态，不可重入） */
+int var_thread_safe(const forcing_var_t *var);
+
+/* 用 nthreads 个线程读取 (start, count) 到 buffer，每个线程单独打开文件 */
+int threaded_read(const char *file, const char *var_name, MPI_Info info, int nthreads,
+                  const forcing_var_t *var, const MPI_Offset *start, const MPI_Offset *count, void *buffer,
+                  double *thread_time, int *thread_items);
+
+/* ---------- 节点内共享 chunk 缓存 ---------- */
+
+/* chunk 缓存槽的状态 */
+#define CHUNK_SLOT_EMPTY 0
+#define CHUNK_SLOT_FILLING 1
+#define CHUNK_SLOT_READY 2
+
+/* 共享目录中的一个缓存槽，键为 (文件, 变量, chunk 编号) */
+typedef struct {
+    int file_id;
+    int var_id;
+    long long chunk_id;
+    int state;
+    int refcount;
+    long long last_use;     /* LRU 时间戳 */
+} chunk_slot_t;
+
+/* 节点内共享的解压 chunk 缓存。节点内0号进程分配 MPI-3 共享内存窗口，
+ * 开头是 LRU 时钟和槽目录，之后是各槽的数据区；目录只在窗口的排他锁内修改。
+ * 一个进程解压某个 chunk 后，同节点的其他进程直接从共享内存读取 */
+typedef struct {
+    MPI_Comm node_comm;
+    MPI_Win win;
+    long long *clock;
+    chunk_slot_t *slots;
+    char *data;
+    int nslots;
+    MPI_Offset slot_bytes;
+    void *scratch;          /* 所有槽都被占用时使用的私有缓冲区 */
+    long long hits, misses, evictions, bypasses;
+    double decompress_time, wait_time;
+} chunk_cache_t;
+
+/* 创建缓存，budget_mb 为每个节点的内存预算。预算放不下一个 chunk 时返回-1 */
+int chunk_cache_init(chunk_cache_t *cache, MPI_Offset slot_bytes, double budget_mb);
+
+/* 取得一个解压后的 chunk，*slot 返回槽号，用完必须调用 chunk_cache_release */
+void *chunk_cache_acquire(chunk_cache_t *cache, int file_id, const forcing_var_t *var, long long chunk_id,
+                          const MPI_Offset *cstart, const MPI_Offset *ccount, int *slot);
+
+/* 释放 chunk_cache_acquire 取得的槽 */
+void chunk_cache_release(chunk_cache_t *cache, int slot);
+
+/* 汇总并打印缓存统计，然后释放缓存 */
+void chunk_cache_finalize(chunk_cache_t *cache);
+
+/* 按y划分读取：累加本进程负责的行和列在所有时间步上的和，sum 的类型为 var->acc_type。
+ * hist 不为 NULL 时同时把读到的值计入直方图。
+ * cache 为 NULL 时每个时间步做一次集合读取；否则按 chunk 经节点缓存读取 */
+int read_band_sum(const forcing_var_t *var, int file_id,
+                  MPI_Offset row_start, MPI_Offset row_count, MPI_Offset col_start, MPI_Offset col_count,
+                  int proc_in_group, int procs_per_group, chunk_cache_t *cache, void *sum, pixel_hist_t *hist);
+
+/* ---------- 平均程序 ---------- */
+
+/* forcing2d_average_v0/v1 共用的主流程。chunked 非0时按 chunk 分块和压缩读写（v1）*/
+int forcing2d_average_main(int argc, char **argv, int chunked);
+
+#endif
@@ -11,8 +11,14 @@
  #include <stdio.h>
  #include <stdlib.h>
  #include <string.h>
+ #include <stdint.h>
+ #include <math.h>
+ #include <unistd.h>
+ #include <pthread.h>
  #include <pnetcdf.h>
  #include <mpi.h>
+ #include "forcing2d_lib.h"
+ #include "forcing2d_codec.h"
  
  #define ERR(e) {if(e) {fprintf(stderr, "Error at %s:%d: %s\n", __FILE__, __LINE__, ncmpi_strerror(e)); MPI_Abort(MPI_COMM_WORLD, 1);}}
  #define MAX_DIMS 10
@@ -21,28 +27,285 @@
  #define MAX_ATTR_VAL 10240
  #define MAX_VAR_NAME 256
  
- static MPI_Datatype
-nc2mpitype(nc_type xtype)
+// Value that marks a non-land cell: _FillValue, then missing_value,
+// then the netCDF default fill for floats
+static float
+land_fill_value(int ncid, int varid)
 {
-    switch(xtype){
-        case NC_CHAR :   return MPI_CHAR;
-        case NC_BYTE :   return MPI_SIGNED_CHAR;
-        case NC_SHORT :  return MPI_SHORT;
-        case NC_INT :    return MPI_INT;
-        case NC_FLOAT :  return MPI_FLOAT;
-        case NC_DOUBLE : return MPI_DOUBLE;
-        case NC_UBYTE :  return MPI_UNSIGNED_CHAR;
-        case NC_USHORT : return MPI_UNSIGNED_SHORT;
-        case NC_UINT :   return MPI_UNSIGNED;
-        case NC_INT64 :  return MPI_LONG_LONG_INT;
-        case NC_UINT64 : return MPI_UNSIGNED_LONG_LONG;
-        default:         return MPI_DATATYPE_NULL;
+    float fill;
+    if (ncmpi_get_att_float(ncid, varid, "_FillValue", &fill) == NC_NOERR) return fill;
+    if (ncmpi_get_att_float(ncid, varid, "missing_value", &fill) == NC_NOERR) return fill;
+    return NC_FILL_FLOAT;
+}
+
+// Build the [y, x] land mask from the first time step of the main variable.
+// Rows are split across processes and gathered so every process holds the
+// full mask. Returns the number of land cells.
+static MPI_Offset
+build_land_mask(int ncid, int varid, MPI_Offset ny, MPI_Offset nx,
+                unsigned char *mask, int rank, int nprocs)
+{
+    MPI_Offset y_start, y_count;
+    split_range(ny, nprocs, rank, &y_start, &y_count);
+    MPI_Offset start[3] = {0, y_start, 0};
+    MPI_Offset count[3] = {1, y_count, nx};
+    float fill = land_fill_value(ncid, varid);
+    int ret;
+
+    float *rows = (float *)malloc((y_count * nx + 1) * sizeof(float));
+    ret = ncmpi_get_vara_float_all(ncid, varid, start, count, rows);
+    ERR(ret);
+    for (MPI_Offset i = 0; i < y_count * nx; i++) {
+        // NaN never compares equal to itself
+        mask[y_start * nx + i] = (rows[i] == rows[i] && rows[i] != fill);
+    }
+    free(rows);
+
+    int *recvcounts = (int *)malloc(nprocs * sizeof(int));
+    int *displs = (int *)malloc(nprocs * sizeof(int));
+    for (int p = 0; p < nprocs; p++) {
+        MPI_Offset p_start, p_count;
+        split_range(ny, nprocs, p, &p_start, &p_count);
+        recvcounts[p] = (int)(p_count * nx);
+        displs[p] = (int)(p_start * nx);
     }
+    MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL,
+                   mask, recvcounts, displs, MPI_UNSIGNED_CHAR, MPI_COMM_WORLD);
+    free(recvcounts);
+    free(displs);
+
+    MPI_Offset nland = 0;
+    for (MPI_Offset i = 0; i < ny * nx; i++) {
+        nland += mask[i];
+    }
+    return nland;
+}
+
+// Pack nt planes of nyx cells in place down to the land cells listed in
+// land_index (ascending flat y*nx+x indices), giving an [nt, nland] array
+static void
+pack_land_cells(void *buffer, size_t elem_size, MPI_Offset nt, MPI_Offset nyx,
+                const MPI_Offset *land_index, MPI_Offset nland)
+{
+    char *buf = (char *)buffer;
+    // Destination never runs ahead of the source, so a forward pass is safe
+    if (elem_size == sizeof(uint32_t)) {
+        uint32_t *wbuf = (uint32_t *)buffer;
+        for (MPI_Offset t = 0; t < nt; t++) {
+            const uint32_t *src = wbuf + t * nyx;
+            uint32_t *dst = wbuf + t * nland;
+            for (MPI_Offset g = 0; g < nland; g++) {
+                dst[g] = src[land_index[g]];
+            }
+        }
+        return;
+    }
+    for (MPI_Offset t = 0; t < nt; t++) {
+        char *src = buf + t * nyx * elem_size;
+        char *dst = buf + t * nland * elem_size;
+        for (MPI_Offset g = 0; g < nland; g++) {
+            memmove(dst + g * elem_size, src + land_index[g] * elem_size, elem_size);
+        }
+    }
+}
+
+// Bounded queue of time steps between the reader thread and the writer.
+// Steps are consumed in order, so slot k % depth holds step k.
+typedef struct {
+    int ncid, varid;
+    MPI_Datatype mpitype;
+    int time_index;
+    MPI_Offset start[MAX_DIMS], count[MAX_DIMS];  // one time step of this rank
+    MPI_Offset first_step, nsteps;
+    MPI_Offset step_size;                         // elements per step
+    int elem_size;
+    int depth;
+    char *slots;
+    MPI_Offset head, tail;  // next step the writer releases / next step read
+    int error;
+    pthread_mutex_t lock;
+    pthread_cond_t not_full, not_empty;
+    double read_time, read_wait;
+} step_queue_t;
+
+static void *
+step_slot(step_queue_t *q, MPI_Offset k)
+{
+    return q->slots + (k % q->depth) * q->step_size * q->elem_size;
+}
+
+// Read one time step into its slot
+static int
+read_step(step_queue_t *q, MPI_Offset k)
+{
+    MPI_Offset start[MAX_DIMS];
+    memcpy(start, q->start, sizeof(start));
+    start[q->time_index] = q->first_step + k;
+    double t0 = MPI_Wtime();
+    int ret = ncmpi_get_vara_all(q->ncid, q->varid, start, q->count, step_slot(q, k), q->step_size, q->mpitype);
+    q->read_time += MPI_Wtime() - t0;
+    return ret;
+}
+
+// Reader stage: stays up to depth steps ahead of the writer
+static void *
+step_reader(void *arg)
+{
+    step_queue_t *q = (step_queue_t *)arg;
+    for (MPI_Offset k = 0; k < q->nsteps; k++) {
+        double t0 = MPI_Wtime();
+        pthread_mutex_lock(&q->lock);
+        while (q->tail - q->head >= q->depth) pthread_cond_wait(&q->not_full, &q->lock);
+        pthread_mutex_unlock(&q->lock);
+        q->read_wait += MPI_Wtime() - t0;
+
+        int ret = read_step(q, k);
+
+        pthread_mutex_lock(&q->lock);
+        if (ret != NC_NOERR) q->error = ret;
+        q->tail++;
+        pthread_cond_signal(&q->not_empty);
+        pthread_mutex_unlock(&q->lock);
+        if (ret != NC_NOERR) break;
+    }
+    return NULL;
+}
+
+// Copy the main variable one time step at a time with the read of the next
+// depth steps overlapping the compression and write of the current one.
+// The reader thread uses its own MPI_COMM_SELF handle on the input file;
+// without MPI_THREAD_MULTIPLE, a thread-safe PnetCDF build or with an
+// SZ-compressed input the steps are read inline. The chunk driver
+// compresses inside ncmpi_put_vara_all, so compression and write form one
+// stage. Every rank makes max_steps collective puts, the surplus ones empty.
+static int
+pipelined_copy(const char *input_file, int varid, nc_type var_type, int ndims, int time_index,
+               const MPI_Offset *start, const MPI_Offset *count, int ncid_out, int out_varid,
+               MPI_Offset max_steps, int depth, int threaded,
+               const MPI_Offset *land_index, MPI_Offset nland, int rank)
+{
+    step_queue_t q;
+    pthread_t reader;
+    MPI_Offset wstart[MAX_DIMS], wcount[MAX_DIMS];
+    double pack_time = 0.0, write_time = 0.0, write_wait = 0.0;
+    int ret;
+
+    memset(&q, 0, sizeof(q));
+    ret = ncmpi_open(MPI_COMM_SELF, input_file, NC_NOWRITE, MPI_INFO_NULL, &q.ncid);
+    if (ret != NC_NOERR) return ret;
+    q.varid = varid;
+    q.mpitype = nc2mpitype(var_type);
+    MPI_Type_size(q.mpitype, &q.elem_size);
+    q.time_index = time_index;
+    q.step_size = 1;
+    for (int i = 0; i < ndims; i++) {
+        q.start[i] = start[i];
+        q.count[i] = (i == time_index) ? 1 : count[i];
+        q.step_size *= q.count[i];
+    }
+    q.first_step = start[time_index];
+    q.nsteps = count[time_index];
+    q.depth = depth;
+    q.slots = (char *)malloc(depth * q.step_size * q.elem_size + 1);
+    if (q.slots == NULL) {
+        printf("Error: Failed to allocate %d pipeline slots on process %d\n", depth, rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    pthread_mutex_init(&q.lock, NULL);
+    pthread_cond_init(&q.not_full, NULL);
+    pthread_cond_init(&q.not_empty, NULL);
+    if (threaded && q.nsteps > 0) {
+        pthread_create(&reader, NULL, step_reader, &q);
+    }
+
+    // Packed layout writes (time, gridcell); otherwise the step as read
+    memcpy(wstart, q.start, sizeof(wstart));
+    memcpy(wcount, q.count, sizeof(wcount));
+    if (land_index) {
+        wstart[1] = 0;
+        wcount[1] = nland;
+    }
+    MPI_Offset wsize = land_index ? nland : q.step_size;
+
+    for (MPI_Offset k = 0; k < max_steps; k++) {
+        void *step_buf = q.slots;
+        wcount[time_index] = 0;
+        if (k < q.nsteps) {
+            double t0 = MPI_Wtime();
+            if (threaded) {
+                pthread_mutex_lock(&q.lock);
+                while (q.tail <= k && q.error == NC_NOERR) pthread_cond_wait(&q.not_empty, &q.lock);
+                pthread_mutex_unlock(&q.lock);
+                ret = q.error;
+            } else {
+                ret = read_step(&q, k);
+            }
+            write_wait += MPI_Wtime() - t0;
+            ERR(ret);
+
+            step_buf = step_slot(&q, k);
+            if (land_index) {
+                t0 = MPI_Wtime();
+                pack_land_cells(step_buf, q.elem_size, 1, q.step_size, land_index, nland);
+                pack_time += MPI_Wtime() - t0;
+            }
+            wstart[time_index] = q.first_step + k;
+            wcount[time_index] = 1;
+        }
+
+        double t0 = prof_begin();
+        ret = ncmpi_put_vara_all(ncid_out, out_varid, wstart, wcount, step_buf,
+                                 wcount[time_index] ? wsize : 0, q.mpitype);
+        ERR(ret);
+        write_time += MPI_Wtime() - t0;
+        prof_end(PHASE_WRITE, t0, wcount[time_index] ? wsize * q.elem_size : 0);
+
+        if (k < q.nsteps && threaded) {
+            pthread_mutex_lock(&q.lock);
+            q.head++;
+            pthread_cond_signal(&q.not_full);
+            pthread_mutex_unlock(&q.lock);
+        }
+    }
+
+    if (threaded && q.nsteps > 0) {
+        pthread_join(reader, NULL);
+    }
+    // The reader may be another thread, so its busy time is added as a total
+    prof_add(PHASE_READ, q.read_time, q.nsteps * q.step_size * q.elem_size);
+    ncmpi_close(q.ncid);
+    pthread_mutex_destroy(&q.lock);
+    pthread_cond_destroy(&q.not_full);
+    pthread_cond_destroy(&q.not_empty);
+    free(q.slots);
+
+    // Stage report: busy time of each stage, slowest rank. The reader waits
+    // when the queue is full (write-bound), the writer when it is empty
+    // (read-bound).
+    double stage[5] = {q.read_time, pack_time, write_time, q.read_wait, write_wait};
+    double stage_max[5];
+    MPI_Reduce(stage, stage_max, 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        const char *names[3] = {"read", "pack", "compress+write"};
+        int slowest = 0;
+        for (int i = 1; i < 3; i++) {
+            if (stage_max[i] > stage_max[slowest]) slowest = i;
+        }
+        printf("Pipeline depth %d (%s reader)\n", depth, threaded ? "threaded" : "inline");
+        printf("  read:           %.4f s busy, %.4f s blocked on a full queue\n", stage_max[0], stage_max[3]);
+        if (land_index) {
+            printf("  pack:           %.4f s\n", stage_max[1]);
+        }
+        printf("  compress+write: %.4f s busy, %.4f s waiting for data\n", stage_max[2], stage_max[4]);
+        printf("Bottleneck stage: %s\n", names[slowest]);
+    }
+    return NC_NOERR;
 }
 
  int main(int argc, char *argv[]) {
-     int rank, nprocs, ret;
-     MPI_Init(&argc, &argv);
+     int rank, nprocs, ret, thread_level;
+     // The pipeline reader thread calls PnetCDF concurrently with the writer
+     MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &thread_level);
      MPI_Comm_rank(MPI_COMM_WORLD, &rank);
      MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
      
@@ -51,16 +314,118 @@ nc2mpitype(nc_type xtype)
     //     sleep(1); // Wait for all processes to attach
     //     if (getenv("DEBUG_READY")) attached = 1;
     //  }
-     if (argc != 3) {
+     // -g: write the main variable as (time, gridcell) over land cells only
+     int gridcell_mode = 0;
+     // -p depth: pipeline the main variable over depth buffered time steps
+     int pipeline_depth = 0;
+     // -P/-T: per-rank phase summary as JSON / Chrome trace of every phase
+     const char *profile_file = NULL;
+     const char *trace_file = NULL;
+     // -C: hardware counters around the read and the compressing write
+     int counters = 0;
+     hwc_mark_t hwc_mark;
+     // -H file: MPI-IO/PnetCDF hints, one "key = value" per line, for both files
+     const char *hints_file = NULL;
+     MPI_Info hints = MPI_INFO_NULL;
+     // -A: align the time split to stripe boundaries of the input records
+     int align = 0;
+     // -z level: store each step as BitRound -> shuffle -> zstd instead of the PnetCDF filter;
+     // -s picks the shuffle, -k the kept mantissa bits (also applied before the PnetCDF filter);
+     // -e error: quantise to this absolute error and store deltas between steps, keyframe every -K steps
+     codec_params_t codec = {0, CODEC_SHUFFLE_BYTE, 0, 0.0, 8, NAN};
+     codec_stats_t codec_stats;
+     memset(&codec_stats, 0, sizeof(codec_stats));
+     // -Q int16|float16: pack the main variable (CF scale_factor/add_offset, or IEEE half precision)
+     pack_params_t pack;
+     memset(&pack, 0, sizeof(pack));
+     int bad_opt = 0;
+     int opt;
+     while ((opt = getopt(argc, argv, "gp:P:T:CH:Az:s:k:e:K:Q:")) != -1) {
+         switch (opt) {
+             case 'g':
+                 gridcell_mode = 1;
+                 break;
+             case 'p':
+                 pipeline_depth = atoi(optarg);
+                 if (pipeline_depth < 1) bad_opt = 1;
+                 break;
+             case 'P':
+                 profile_file = optarg;
+                 break;
+             case 'T':
+                 trace_file = optarg;
+                 break;
+             case 'C':
+                 counters = 1;
+                 break;
+             case 'H':
+                 hints_file = optarg;
+                 break;
+             case 'A':
+                 align = 1;
+                 break;
+             case 'z':
+                 codec.level = atoi(optarg);
+                 if (codec.level < 1) bad_opt = 1;
+                 break;
+             case 's':
+                 if (strcmp(optarg, "none") == 0) codec.shuffle = CODEC_SHUFFLE_NONE;
+                 else if (strcmp(optarg, "byte") == 0) codec.shuffle = CODEC_SHUFFLE_BYTE;
+                 else if (strcmp(optarg, "bit") == 0) codec.shuffle = CODEC_SHUFFLE_BIT;
+                 else bad_opt = 1;
+                 break;
+             case 'k':
+                 codec.keep_bits = atoi(optarg);
+                 if (codec.keep_bits < 1) bad_opt = 1;
+                 break;
+             case 'e':
+                 codec.error = atof(optarg);
+                 if (codec.error <= 0) bad_opt = 1;
+                 break;
+             case 'K':
+                 codec.keyframe = atoi(optarg);
+                 if (codec.keyframe < 1) bad_opt = 1;
+                 break;
+             case 'Q':
+                 if (strcmp(optarg, "int16") == 0) pack.method = PACK_INT16;
+                 else if (strcmp(optarg, "float16") == 0) pack.method = PACK_FLOAT16;
+                 else bad_opt = 1;
+                 break;
+             default:
+                 bad_opt = 1;
+                 break;
+         }
+     }
+     // The codec and BitRound work on each rank's steps in one go, so they do not combine with -p
+     if ((codec.level > 0 || codec.keep_bits > 0 || codec.error > 0) && pipeline_depth > 0) bad_opt = 1;
+     // The delta codec quantises on its own, so BitRound does not apply; it uses zstd level 3 unless -z says otherwise
+     if (codec.error > 0 && codec.keep_bits > 0) bad_opt = 1;
+     if (codec.error > 0 && codec.level == 0) codec.level = 3;
+     // Packing replaces the value type, so it stands alone; the packed planes go through deflate
+     if (pack.method != PACK_NONE && (codec.level > 0 || codec.keep_bits > 0 || pipeline_depth > 0)) bad_opt = 1;
+     if (bad_opt || argc - optind != 2) {
          if (rank == 0) {
-             printf("Usage: %s <input_file> <output_file>\n", argv[0]);
+             printf("Usage: %s [-g] [-p depth] [-P profile.json] [-T trace.json] [-C] [-H hints] [-A] [-z level [-s none|byte|bit]] [-k bits] [-e error [-K steps]] [-Q int16|float16] <input_file> <output_file>\n", argv[0]);
+             printf("  -g  pack the main variable to (time, gridcell) over land cells only\n");
+             printf("  -p  overlap reading, compression and writing, buffering depth time steps\n");
+             printf("  -P  write per-rank phase times, bytes and memory high-water mark as JSON\n");
+             printf("  -T  write a Chrome trace (chrome://tracing, Perfetto) of every phase on every rank\n");
+             printf("  -C  count cycles, instructions and cache misses with perf_event_open around read and write\n");
+             printf("  -H  MPI-IO/PnetCDF hints file (key = value per line), overriding the defaults below\n");
+             printf("  -z  compress each step with zstd at this level instead of the PnetCDF filter (not with -p)\n");
+             printf("  -s  shuffle before zstd: none, byte (default) or bit\n");
+             printf("  -k  round the mantissa to this many bits (BitRound) before compressing, with -z or the PnetCDF filter (not with -p)\n");
+             printf("  -e  store quantised differences between steps, each value within this absolute error (float/double, not with -k or -p)\n");
+             printf("  -K  keyframe interval of -e in steps (default 8)\n");
+             printf("  -Q  pack the main variable to int16 (scale_factor/add_offset from its global min/max) or float16 (not with -z, -e, -k or -p)\n");
+             printf("  -A  move the time split boundaries onto file system stripe boundaries (striping_unit)\n");
          }
          MPI_Finalize();
          return 1;
      }
  
-     char *input_file = argv[1];
-     char *output_file = argv[2];
+     char *input_file = argv[optind];
+     char *output_file = argv[optind + 1];
      
      int ncid_in, ncid_out;
      int ndims, nvars, natts, unlimdimid;
@@ -107,11 +472,18 @@ nc2mpitype(nc_type xtype)
          printf("Output file: %s\n", output_file);
      }
      
-     printf("1111\n");
+     if (hints_file != NULL && hints_load(hints_file, &hints, MPI_COMM_WORLD) < 0) {
+         MPI_Finalize();
+         return 1;
+     }
+
+     prof_init(trace_file != NULL, counters, MPI_COMM_WORLD);
+     double phase_start = prof_begin();
      // Open input file
-     ret = ncmpi_open(MPI_COMM_WORLD, input_file, NC_NOWRITE, MPI_INFO_NULL, &ncid_in);
+     ret = ncmpi_open(MPI_COMM_WORLD, input_file, NC_NOWRITE, hints, &ncid_in);
      ERR(ret);
-    //  printf("****\n");
+     prof_end(PHASE_OPEN, phase_start, 0);
+     phase_start = prof_begin();
      // Get file information
      ret = ncmpi_inq(ncid_in, &ndims, &nvars, &natts, &unlimdimid);
      ERR(ret);
@@ -153,14 +525,54 @@ nc2mpitype(nc_type xtype)
          return 1;
      }
 
+     // Packed land-only layout: the land mask comes from the first time step
+     // of the main variable and fixes the gridcell order (row-major y, x)
+     MPI_Offset land_ny = 0, land_nx = 0, nland = 0;
+     MPI_Offset *land_index = NULL;
+     if (gridcell_mode) {
+         int mv_id, mv_ndims;
+         int mv_dimids[MAX_DIMS];
+         ret = ncmpi_inq_varid(ncid_in, main_var_name, &mv_id);
+         ERR(ret);
+         ret = ncmpi_inq_var(ncid_in, mv_id, NULL, NULL, &mv_ndims, mv_dimids, NULL);
+         ERR(ret);
+         if (mv_ndims != 3 || mv_dimids[0] != time_dim_id) {
+             if (rank == 0) {
+                 printf("Error: -g requires the main variable to be (time, y, x).\n");
+             }
+             ncmpi_close(ncid_in);
+             MPI_Finalize();
+             return 1;
+         }
+         land_ny = dim_lens[mv_dimids[1]];
+         land_nx = dim_lens[mv_dimids[2]];
+
+         unsigned char *land_mask = (unsigned char *)malloc(land_ny * land_nx);
+         nland = build_land_mask(ncid_in, mv_id, land_ny, land_nx, land_mask, rank, nprocs);
+         land_index = (MPI_Offset *)malloc((nland + 1) * sizeof(MPI_Offset));
+         MPI_Offset g = 0;
+         for (MPI_Offset i = 0; i < land_ny * land_nx; i++) {
+             if (land_mask[i]) land_index[g++] = i;
+         }
+         free(land_mask);
+
+         if (rank == 0) {
+             printf("Land cells: %lld of %lld (%.1f%%)\n", nland, land_ny * land_nx,
+                    100.0 * nland / (land_ny * land_nx));
+         }
+     }
+
+     prof_end(PHASE_HEADER, phase_start, 0);
+
      MPI_Info info;
      MPI_Info_create(&info);
      MPI_Info_set(info, "nc_chunk_default_filter", "sz");
      MPI_Info_set(info, "nc_chunking", "enable");
+     hints_apply(info, hints);
      // Create output file
+     phase_start = prof_begin();
      ret = ncmpi_create(MPI_COMM_WORLD, output_file, NC_CLOBBER, info, &ncid_out);
      ERR(ret);
-    //  printf("2222\n");
      // Define dimensions in output file
      int out_dim_ids[MAX_DIMS];
      for (int i = 0; i < ndims; i++) {
@@ -172,6 +584,11 @@ nc2mpitype(nc_type xtype)
          }
          ERR(ret);
      }
+     int gridcell_dim_id = -1;
+     if (gridcell_mode) {
+         ret = ncmpi_def_dim(ncid_out, GRIDCELL_DIM_NAME, nland, &gridcell_dim_id);
+         ERR(ret);
+     }
      
      // Copy global attributes
      for (int i = 0; i < natts; i++) {
@@ -194,6 +611,14 @@ nc2mpitype(nc_type xtype)
          
          free(att_val);
      }
+     if (gridcell_mode) {
+         // Raster shape, so readers can scatter gridcells back to [y, x]
+         int raster_shape[2] = {(int)land_ny, (int)land_nx};
+         ret = ncmpi_put_att_int(ncid_out, NC_GLOBAL, "gridcell_ny", NC_INT, 1, &raster_shape[0]);
+         ERR(ret);
+         ret = ncmpi_put_att_int(ncid_out, NC_GLOBAL, "gridcell_nx", NC_INT, 1, &raster_shape[1]);
+         ERR(ret);
+     }
 
      // Define variables in output file
      int var_ids[MAX_VARS];
@@ -201,6 +626,8 @@ nc2mpitype(nc_type xtype)
      char var_names[MAX_VARS][MAX_VAR_NAME];
      int main_var_id = -1;
      int out_main_var_id = -1;
+     int static_vars[MAX_VARS];
+     int num_static_vars = 0;
      
      for (int i = 0; i < nvars; i++) {
          int var_ndims;
@@ -218,23 +645,49 @@ nc2mpitype(nc_type xtype)
          for (int j = 0; j < var_ndims; j++) {
              out_var_dimids[j] = out_dim_ids[var_dimids[j]];
          }
+         int is_main_var = (strcmp(var_names[i], main_var_name) == 0);
+         int has_time_dim = 0;
+         for (int j = 0; j < var_ndims; j++) {
+             if (var_dimids[j] == time_dim_id) has_time_dim = 1;
+         }
+         if (gridcell_mode && is_main_var) {
+             var_ndims = 2;
+             out_var_dimids[1] = gridcell_dim_id;
+         }
+         // Only float and double are packed; other types are rejected once the main variable is inspected
+         int packed = is_main_var && pack.method != PACK_NONE && (var_type == NC_FLOAT || var_type == NC_DOUBLE);
          
-         ret = ncmpi_def_var(ncid_out, var_names[i], var_type, var_ndims, out_var_dimids, &out_var_ids[i]);
+         ret = ncmpi_def_var(ncid_out, var_names[i], packed ? pack_type(pack.method) : var_type, var_ndims,
+                             out_var_dimids, &out_var_ids[i]);
          ERR(ret);
          
          // If this is the main variable, save its ID
-         if (strcmp(var_names[i], main_var_name) == 0) {
+         if (is_main_var) {
              main_var_id = i;
              out_main_var_id = out_var_ids[i];
              int chunk_dim[3] = {1, dim_lens[1], dim_lens[2]};
+             if (gridcell_mode) {
+                 chunk_dim[1] = (int)nland;
+             }
              ret = ncmpi_var_set_chunk(ncid_out, out_main_var_id, chunk_dim);
              ERR(ret);
+             if (codec.level > 0) {
+                 ret = codec_def_var(ncid_out, out_main_var_id, &codec);
+                 ERR(ret);
+             }
             //  ret = ncmpi_var_set_filter(ncid_out, out_main_var_id, NC_FILTER_SZ);
             //  ERR(ret);
              if (rank == 0) {
                  printf("Found main variable %s with ID %d\n", main_var_name, main_var_id);
              }
          }
+         else if (!has_time_dim) {
+             // Time-invariant variables (LATIXY, LONGXY, ...) georeference the
+             // grid, so they are copied without the lossy default filter
+             ret = ncmpi_var_set_filter(ncid_out, out_var_ids[i], NC_FILTER_NONE);
+             ERR(ret);
+             static_vars[num_static_vars++] = i;
+         }
          else {
             continue; // Skip other variables for now
             // int chunk_dim[var_ndims];
@@ -261,6 +714,17 @@ nc2mpitype(nc_type xtype)
              
              ret = ncmpi_inq_att(ncid_in, i, att_name, &att_type, &att_len);
              ERR(ret);
+
+             // The fill value and any packing attributes are rewritten for the packed type below
+             if (packed && (strcmp(att_name, "_FillValue") == 0 || strcmp(att_name, "missing_value") == 0 ||
+                            strcmp(att_name, "scale_factor") == 0 || strcmp(att_name, "add_offset") == 0)) {
+                 if (!pack.has_fill && (strcmp(att_name, "_FillValue") == 0 || strcmp(att_name, "missing_value") == 0)) {
+                     ret = ncmpi_get_att_double(ncid_in, i, att_name, &pack.fill);
+                     ERR(ret);
+                     pack.has_fill = 1;
+                 }
+                 continue;
+             }
              
              void *att_val = malloc(att_len * sizeof(char) * MAX_ATTR_VAL);
              ret = ncmpi_get_att(ncid_in, i, att_name, att_val);
@@ -271,6 +735,10 @@ nc2mpitype(nc_type xtype)
              
              free(att_val);
          }
+         if (packed) {
+             ret = pack_def_var(ncid_out, out_var_ids[i], var_type, &pack);
+             ERR(ret);
+         }
      }
      
      if (main_var_id == -1) {
@@ -282,11 +750,30 @@ nc2mpitype(nc_type xtype)
          MPI_Finalize();
          return 1;
      }
+
+     // Gridcell -> (y, x) index; kept lossless since SZ is the default filter
+     int out_gridcell_y_id = -1, out_gridcell_x_id = -1;
+     if (gridcell_mode) {
+         ret = ncmpi_def_var(ncid_out, GRIDCELL_Y_NAME, NC_INT, 1, &gridcell_dim_id, &out_gridcell_y_id);
+         ERR(ret);
+         ret = ncmpi_def_var(ncid_out, GRIDCELL_X_NAME, NC_INT, 1, &gridcell_dim_id, &out_gridcell_x_id);
+         ERR(ret);
+         ret = ncmpi_var_set_filter(ncid_out, out_gridcell_y_id, NC_FILTER_NONE);
+         ERR(ret);
+         ret = ncmpi_var_set_filter(ncid_out, out_gridcell_x_id, NC_FILTER_NONE);
+         ERR(ret);
+         const char *y_desc = "0-based y index of the land gridcell";
+         const char *x_desc = "0-based x index of the land gridcell";
+         ret = ncmpi_put_att_text(ncid_out, out_gridcell_y_id, "long_name", strlen(y_desc), y_desc);
+         ERR(ret);
+         ret = ncmpi_put_att_text(ncid_out, out_gridcell_x_id, "long_name", strlen(x_desc), x_desc);
+         ERR(ret);
+     }
      
      // End define mode for output file
      ret = ncmpi_enddef(ncid_out);
      ERR(ret);
-     printf("3333\n");
+     prof_end(PHASE_CREATE, phase_start, 0);
      // Process the main variable by distributing time steps
      int main_var_ndims;
      int main_var_dimids[MAX_DIMS];
@@ -294,6 +781,11 @@ nc2mpitype(nc_type xtype)
      
      ret = ncmpi_inq_var(ncid_in, main_var_id, NULL, &main_var_type, &main_var_ndims, main_var_dimids, NULL);
      ERR(ret);
+     // Fill cells must still equal _FillValue/missing_value after BitRound
+     if (ncmpi_get_att_double(ncid_in, main_var_id, "_FillValue", &codec.fill) != NC_NOERR &&
+         ncmpi_get_att_double(ncid_in, main_var_id, "missing_value", &codec.fill) != NC_NOERR) {
+         codec.fill = NAN;
+     }
     //  printf("type %d\n", main_var_type);
 
      // Find the time dimension in the main variable
@@ -315,17 +807,38 @@ nc2mpitype(nc_type xtype)
          return 1;
      }
      
+     if ((codec.level > 0 && time_dim_index != 0) ||
+         ((codec.error > 0 || pack.method != PACK_NONE) && main_var_type != NC_FLOAT && main_var_type != NC_DOUBLE)) {
+         if (rank == 0) {
+             printf("Error: -z needs time as the first dimension of the main variable, and -e/-Q a float or double variable.\n");
+         }
+         ncmpi_close(ncid_in);
+         ncmpi_close(ncid_out);
+         MPI_Finalize();
+         return 1;
+     }
+
      // Calculate time steps distribution per process
      MPI_Offset time_len = dim_lens[time_dim_id];
-     MPI_Offset time_per_proc = time_len / nprocs;
-     MPI_Offset time_remainder = time_len % nprocs;
-     
-     MPI_Offset start_time = rank * time_per_proc + (rank < time_remainder ? rank : time_remainder);
-     MPI_Offset count_time = time_per_proc + (rank < time_remainder ? 1 : 0);
+     MPI_Offset start_time, count_time;
+     forcing_var_t main_var;
+     split_layout_t time_layout;
+     split_plan_t time_plan;
+     if (align) {
+         ret = forcing_var_inq(ncid_in, main_var_id, &main_var);
+         ERR(ret);
+         split_layout_inq(&main_var, time_dim_index, hints, &time_layout);
+     }
+     if (split_plan(time_len, nprocs, align ? &time_layout : NULL, &time_plan) != 0) {
+         printf("Error: Failed to allocate the time split on process %d\n", rank);
+         MPI_Abort(MPI_COMM_WORLD, 1);
+     }
+     split_plan_part(&time_plan, rank, &start_time, &count_time);
      
      if (rank == 0) {
          printf("Total time steps: %lld\n", time_len);
          printf("Distributing across %d processes\n", nprocs);
+         if (align) split_plan_report(&time_plan, &time_layout, "time");
      }
      
      printf("Process %d: processing time steps %lld to %lld (count: %lld)\n", 
@@ -350,25 +863,35 @@ nc2mpitype(nc_type xtype)
          buffer_size *= count[i];
      }
      
+     double write_start_time, write_end_time, write_time, total_write_time;
      void *buffer = NULL;
-     switch (main_var_type) {
-         case NC_BYTE:
-         case NC_CHAR:
-             buffer = malloc(buffer_size * sizeof(char));
-             break;
-         case NC_SHORT:
-             buffer = malloc(buffer_size * sizeof(short));
-             break;
-         case NC_INT:
-             buffer = malloc(buffer_size * sizeof(int));
-             break;
-         case NC_FLOAT:
-             buffer = malloc(buffer_size * sizeof(float));
-             break;
-         case NC_DOUBLE:
-             buffer = malloc(buffer_size * sizeof(double));
-             break;
-         default:
+     if (pipeline_depth > 0) {
+         // The reader thread calls PnetCDF while the main thread is inside the
+         // collective put, and SZ keeps global state shared by both directions
+         int in_filter = NC_FILTER_NONE;
+         int threaded = thread_level >= MPI_THREAD_MULTIPLE && FORCING_PNETCDF_THREAD_SAFE;
+         if (ncmpi_var_get_filter(ncid_in, main_var_id, &in_filter) == NC_NOERR && in_filter == NC_FILTER_SZ) {
+             threaded = 0;
+         }
+         if (!threaded && rank == 0) {
+             if (thread_level < MPI_THREAD_MULTIPLE) {
+                 printf("Warning: MPI_THREAD_MULTIPLE not available, pipeline reads run inline\n");
+             } else if (!FORCING_PNETCDF_THREAD_SAFE) {
+                 printf("Warning: PnetCDF is not built with --enable-thread-safe, pipeline reads run inline\n");
+             } else {
+                 printf("Warning: input is SZ-compressed, pipeline reads run inline\n");
+             }
+         }
+         // Reading is part of the pipeline, so the write timer covers all of it
+         write_start_time = MPI_Wtime();
+         ret = pipelined_copy(input_file, main_var_id, main_var_type, main_var_ndims, time_dim_index,
+                              start, count, ncid_out, out_main_var_id, split_plan_max(&time_plan),
+                              pipeline_depth, threaded,
+                              gridcell_mode ? land_index : NULL, nland, rank);
+         ERR(ret);
+     } else {
+         buffer = alloc_typed(main_var_type, buffer_size);
+         if (nc2mpitype(main_var_type) == MPI_DATATYPE_NULL) {
              if (rank == 0) {
                  printf("Error: Unsupported variable type %d\n", main_var_type);
              }
@@ -376,69 +899,190 @@ nc2mpitype(nc_type xtype)
              ncmpi_close(ncid_out);
              MPI_Finalize();
              return 1;
-     }
+         }
 
-     if (buffer == NULL) {
-         printf("Error: Failed to allocate buffer of size %lld bytes on process %d\n", 
-                buffer_size * sizeof(double), rank);
-         ncmpi_close(ncid_in);
-         ncmpi_close(ncid_out);
-         MPI_Finalize();
-         return 1;
-     }
+         if (buffer == NULL) {
+             printf("Error: Failed to allocate buffer of size %lld bytes on process %d\n", 
+                    buffer_size * sizeof(double), rank);
+             ncmpi_close(ncid_in);
+             ncmpi_close(ncid_out);
+             MPI_Finalize();
+             return 1;
+         }
 
-     // Read the main variable
-     ret = ncmpi_get_vara_all(ncid_in, main_var_id, start, count, buffer, buffer_size, nc2mpitype(main_var_type));
-     ERR(ret);
+         // Read the main variable
+         int elem_size;
+         MPI_Type_size(nc2mpitype(main_var_type), &elem_size);
+         phase_start = prof_begin();
+         hwc_begin(&hwc_mark);
+         ret = ncmpi_get_vara_all(ncid_in, main_var_id, start, count, buffer, buffer_size, nc2mpitype(main_var_type));
+         ERR(ret);
+         hwc_end(HWC_DECOMPRESS, &hwc_mark, buffer_size * elem_size, 0);
+         prof_end(PHASE_READ, phase_start, buffer_size * elem_size);
 
-    //  // 打印变量 ID 和类型
-    // printf("[Rank %d] Calling ncmpi_put_vara_all:\n", rank);
-    // printf("  -> ncid_out        = %d\n", ncid_out);
-    // printf("  -> out_main_var_id = %d\n", out_main_var_id);
-    // printf("  -> main_var_type   = %d (MPI type = %d)\n", main_var_type, nc2mpitype(main_var_type));
-
-    // // 打印 start 和 count 数组内容
-    // printf("  -> start = [");
-    // for (int i = 0; i < main_var_ndims; i++) {
-    //     printf("%lld", start[i]);
-    //     if (i != main_var_ndims - 1) printf(", ");
-    // }
-    // printf("]\n");
-
-    // printf("  -> count = [");
-    // for (int i = 0; i < main_var_ndims; i++) {
-    //     printf("%lld", count[i]);
-    //     if (i != main_var_ndims - 1) printf(", ");
-    // }
-    // printf("]\n");
-
-    // // 打印 buffer 地址和大小
-    // printf("  -> buffer = %p\n", buffer);
-    // printf("  -> buffer_size = %lld (elements)\n", buffer_size);
-
-    // float new_buffer[4][8075][7814];
-    // int i,j,k;
-    // for (i=0; i<8075; i++)
-    //     for (j=0; j<7814; j++)
-    //         for (k=0; k<4; k++)
-    //             new_buffer[k][i][j] = 0.0;
-    double write_start_time, write_end_time, write_time, total_write_time;
-    write_start_time = MPI_Wtime();
-    printf("vvvvv\n");
-     ret = ncmpi_put_vara_all(ncid_out, out_main_var_id, start, count, buffer, buffer_size, nc2mpitype(main_var_type));
-     ERR(ret);
-     printf("wwwww\n");
+         // Drop the non-land cells: [count_time, y, x] -> [count_time, gridcell]
+         if (gridcell_mode) {
+             pack_land_cells(buffer, elem_size, count_time, land_ny * land_nx, land_index, nland);
+             start[1] = 0;
+             count[1] = nland;
+             buffer_size = count_time * nland;
+         }
+
+        //  // 打印变量 ID 和类型
+        // printf("[Rank %d] Calling ncmpi_put_vara_all:\n", rank);
+        // printf("  -> ncid_out        = %d\n", ncid_out);
+        // printf("  -> out_main_var_id = %d\n", out_main_var_id);
+        // printf("  -> main_var_type   = %d (MPI type = %d)\n", main_var_type, nc2mpitype(main_var_type));
+
+        // // 打印 start 和 count 数组内容
+        // printf("  -> start = [");
+        // for (int i = 0; i < main_var_ndims; i++) {
+        //     printf("%lld", start[i]);
+        //     if (i != main_var_ndims - 1) printf(", ");
+        // }
+        // printf("]\n");
+
+        // printf("  -> count = [");
+        // for (int i = 0; i < main_var_ndims; i++) {
+        //     printf("%lld", count[i]);
+        //     if (i != main_var_ndims - 1) printf(", ");
+        // }
+        // printf("]\n");
+
+        // // 打印 buffer 地址和大小
+        // printf("  -> buffer = %p\n", buffer);
+        // printf("  -> buffer_size = %lld (elements)\n", buffer_size);
+
+        // float new_buffer[4][8075][7814];
+        // int i,j,k;
+        // for (i=0; i<8075; i++)
+        //     for (j=0; j<7814; j++)
+        //         for (k=0; k<4; k++)
+        //             new_buffer[k][i][j] = 0.0;
+        write_start_time = MPI_Wtime();
+         // The chunk driver compresses inside the put, so the write phase includes it
+         phase_start = prof_begin();
+         hwc_begin(&hwc_mark);
+         // Bytes handed to the write: raw, packed or coded
+         MPI_Offset written_bytes = buffer_size * elem_size;
+         if (codec.level > 0) {
+             // Steps are contiguous planes since time is the first dimension
+             double coded_before = codec_stats.coded_bytes;
+             ret = codec_write_steps(ncid_out, out_main_var_id, &codec, main_var_type, buffer, start_time, count_time,
+                                     count_time > 0 ? buffer_size / count_time : 0, MPI_COMM_WORLD, &codec_stats);
+             written_bytes = (MPI_Offset)(codec_stats.coded_bytes - coded_before);
+         } else if (pack.method != PACK_NONE) {
+             // One min/max pass over all ranks' steps fixes scale_factor/add_offset before packing
+             double vmin, vmax;
+             pack_choose(&pack, main_var_type, buffer, buffer_size, MPI_COMM_WORLD, &vmin, &vmax);
+             // vmin/vmax are global, so every rank takes this exit together
+             if (pack.method == PACK_FLOAT16 && (vmax > 65504.0 || vmin < -65504.0)) {
+                 if (rank == 0) {
+                     printf("Error: %s range [%g, %g] exceeds the float16 range +-65504, use -Q int16\n",
+                            main_var_name, vmin, vmax);
+                 }
+                 free(buffer);
+                 ncmpi_close(ncid_in);
+                 ncmpi_close(ncid_out);
+                 MPI_Finalize();
+                 return 1;
+             }
+             ret = pack_put_params(ncid_out, out_main_var_id, main_var_type, &pack);
+             ERR(ret);
+             void *packed_buffer = alloc_typed(pack_type(pack.method), buffer_size);
+             if (packed_buffer == NULL) {
+                 printf("Error: Failed to allocate the packed buffer on process %d\n", rank);
+                 MPI_Abort(MPI_COMM_WORLD, -1);
+             }
+             pack_values(&pack, main_var_type, buffer, buffer_size, packed_buffer);
+             if (rank == 0) {
+                 if (pack.method == PACK_INT16) {
+                     printf("Packed %s to int16: range [%g, %g], scale_factor %g, add_offset %g, max error %g\n",
+                            main_var_name, vmin, vmax, pack.scale, pack.offset, pack.scale / 2);
+                 } else {
+                     printf("Packed %s to float16: range [%g, %g], relative error 2^-11\n", main_var_name, vmin, vmax);
+                 }
+             }
+             ret = ncmpi_put_vara_all(ncid_out, out_main_var_id, start, count, packed_buffer, buffer_size,
+                                      nc2mpitype(pack_type(pack.method)));
+             written_bytes = buffer_size * nc_type_size(pack_type(pack.method));
+             free(packed_buffer);
+         } else {
+             bitround(main_var_type, buffer, buffer_size, codec.keep_bits, codec.fill);
+             ret = ncmpi_put_vara_all(ncid_out, out_main_var_id, start, count, buffer, buffer_size, nc2mpitype(main_var_type));
+         }
+         ERR(ret);
+         hwc_end(HWC_COMPRESS, &hwc_mark, written_bytes, 0);
+         prof_end(PHASE_WRITE, phase_start, written_bytes);
+     }
     //  ret = ncmpi_put_vara_float_all(ncid_out, out_main_var_id, start, count, buffer);
     //  ERR(ret);
+
+     // Write the gridcell index, split across processes along gridcell
+     if (gridcell_mode) {
+         MPI_Offset g_start, g_count;
+         phase_start = prof_begin();
+         split_range(nland, nprocs, rank, &g_start, &g_count);
+         int *gridcell_y = (int *)malloc((g_count + 1) * sizeof(int));
+         int *gridcell_x = (int *)malloc((g_count + 1) * sizeof(int));
+         for (MPI_Offset g = 0; g < g_count; g++) {
+             gridcell_y[g] = (int)(land_index[g_start + g] / land_nx);
+             gridcell_x[g] = (int)(land_index[g_start + g] % land_nx);
+         }
+         ret = ncmpi_put_vara_int_all(ncid_out, out_gridcell_y_id, &g_start, &g_count, gridcell_y);
+         ERR(ret);
+         ret = ncmpi_put_vara_int_all(ncid_out, out_gridcell_x_id, &g_start, &g_count, gridcell_x);
+         ERR(ret);
+         prof_end(PHASE_WRITE, phase_start, 2 * g_count * sizeof(int));
+         free(gridcell_y);
+         free(gridcell_x);
+         free(land_index);
+     }
     write_end_time = MPI_Wtime();
     write_time = write_end_time - write_start_time;
-    /* 使用MPI_Reduce收集所有进程的计算时间，取最大值 */
-    MPI_Reduce(&write_time, &total_write_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    /* 收集所有进程的写入时间，取最大值 */
+    total_write_time = max_time(write_time, MPI_COMM_WORLD);
      if (rank == 0) {
         printf("总写入时间: %.4f 秒\n", total_write_time);
      }
-     printf("Rank: %d, Write Time: %.4f\n", rank, write_time);
+     if (codec.level > 0) {
+         codec_report(&codec_stats, codec.error > 0 ? "delta+zstd" : "zstd", MPI_COMM_WORLD);
+     }
      free(buffer);
+
+     // Copy the time-invariant variables, split along their first dimension
+     for (int k = 0; k < num_static_vars; k++) {
+         int var_id = static_vars[k];
+         int var_ndims;
+         int var_dimids[MAX_DIMS];
+         nc_type var_type;
+         ret = ncmpi_inq_var(ncid_in, var_id, NULL, &var_type, &var_ndims, var_dimids, NULL);
+         ERR(ret);
+
+         MPI_Offset var_start[MAX_DIMS], var_count[MAX_DIMS];
+         for (int d = 0; d < var_ndims; d++) {
+             var_start[d] = 0;
+             var_count[d] = dim_lens[var_dimids[d]];
+         }
+         if (var_ndims > 0) {
+             split_range(dim_lens[var_dimids[0]], nprocs, rank, &var_start[0], &var_count[0]);
+         }
+         MPI_Offset var_size = 1;
+         for (int d = 0; d < var_ndims; d++) {
+             var_size *= var_count[d];
+         }
+
+         void *var_buffer = alloc_typed(var_type, var_size);
+         phase_start = prof_begin();
+         ret = ncmpi_get_vara_all(ncid_in, var_id, var_start, var_count, var_buffer, var_size, nc2mpitype(var_type));
+         ERR(ret);
+         prof_end(PHASE_READ, phase_start, var_size * nc_type_size(var_type));
+         phase_start = prof_begin();
+         ret = ncmpi_put_vara_all(ncid_out, out_var_ids[var_id], var_start, var_count, var_buffer, var_size, nc2mpitype(var_type));
+         ERR(ret);
+         prof_end(PHASE_WRITE, phase_start, var_size * nc_type_size(var_type));
+         free(var_buffer);
+     }
      
     //  // Copy other variables
     //  for (int i = 0; i < nvars; i++) {
@@ -544,16 +1188,20 @@ nc2mpitype(nc_type xtype)
     //  }
      
      // Close files
+     phase_start = prof_begin();
      ret = ncmpi_close(ncid_in);
      ERR(ret);
      
      ret = ncmpi_close(ncid_out);
      ERR(ret);
+     prof_end(PHASE_CLOSE, phase_start, 0);
     //  MPI_Info_free(&info);
+     split_plan_free(&time_plan);
      
      if (rank == 0) {
          printf("Processing completed successfully.\n");
      }
+     prof_report("forcing2d_raw2chunk", profile_file, trace_file, MPI_COMM_WORLD);
      
      MPI_Finalize();
      return 0;
@@ -0,0 +1,302 @@
+/*
+ * 合成 Daymet 形状的测试数据：forcing2d_synth
+ * 功能：按 clmforc.Daymet4.1km.VAR.YYYY-MM.nc 的布局生成 CDF5 文件，主变量为 (time, y, x) 的 float，
+ * 海洋格点为 _FillValue，并带有 LATIXY/LONGXY。每个变量使用平滑、日变化或噪声场模型，
+ * 数值只由 (变量, 时间步, y, x) 决定，与进程数无关，因此不同进程数生成的数据完全相同。
+ * 写入时按y维度分割，每个进程逐个时间步写出自己的行
+ */
+
+#include <math.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "forcing2d_lib.h"
+
+#define SYNTH_PI 3.14159265358979323846
+/* Daymet 的海洋格点填充值 */
+#define SYNTH_FILL_VALUE 1.0e36f
+
+/* 场模型 */
+#define FIELD_SMOOTH 0      /* 大尺度空间梯度加缓慢的时间变化 */
+#define FIELD_DIURNAL 1     /* 随太阳高度的日变化，夜间为0（短波辐射）或按振幅变化 */
+#define FIELD_NOISY 2       /* 平滑背景上叠加逐格点噪声，低于阈值的值截为0（降水） */
+
+typedef struct {
+    const char *name;
+    const char *units;
+    int model;
+    float base;             /* 平均值 */
+    float spatial;          /* 南北梯度的幅度 */
+    float amplitude;        /* 日变化或时间变化的幅度 */
+    float noise;            /* 噪声幅度 */
+} synth_field_t;
+
+static const synth_field_t synth_fields[] = {
+    {"FLDS", "W/m**2", FIELD_DIURNAL, 300.0f, 60.0f, 30.0f, 5.0f},
+    {"FSDS", "W/m**2", FIELD_DIURNAL, 0.0f, 0.0f, 1000.0f, 20.0f},
+    {"PRECTmms", "mm/s", FIELD_NOISY, 0.0f, 0.0f, 2.0e-4f, 4.0e-4f},
+    {"PSRF", "Pa", FIELD_SMOOTH, 95000.0f, 8000.0f, 500.0f, 50.0f},
+    {"QBOT", "kg/kg", FIELD_SMOOTH, 0.008f, 0.006f, 0.001f, 0.0005f},
+    {"TBOT", "K", FIELD_DIURNAL, 285.0f, 25.0f, 6.0f, 0.5f},
+    {"WIND", "m/s", FIELD_NOISY, 3.0f, 1.0f, 1.5f, 2.0f},
+};
+
+/* 由 (变量, t, y, x) 得到 [-1, 1) 上的可复现伪随机数 */
+static float synth_hash(unsigned int v, MPI_Offset t, MPI_Offset y, MPI_Offset x) {
+    unsigned long long h = 0x9E3779B97F4A7C15ULL * (v + 1);
+    h ^= (unsigned long long)t * 0xBF58476D1CE4E5B9ULL;
+    h ^= (unsigned long long)y * 0x94D049BB133111EBULL;
+    h ^= (unsigned long long)x * 0xD6E8FEB86659FD93ULL;
+    h ^= h >> 31;
+    h *= 0x9E3779B97F4A7C15ULL;
+    h ^= h >> 29;
+    return (float)((h >> 40) * (2.0 / 16777216.0) - 1.0);
+}
+
+/* 陆地：中心在网格中央、边界起伏的椭圆，面积约为 land_fraction */
+static int synth_is_land(MPI_Offset y, MPI_Offset x, MPI_Offset ny, MPI_Offset nx, double land_fraction) {
+    double u = 2.0 * (x + 0.5) / nx - 1.0;
+    double v = 2.0 * (y + 0.5) / ny - 1.0;
+    double r2 = land_fraction * 4.0 / SYNTH_PI;
+    double theta = atan2(v, u);
+    return u * u + v * v < r2 * (1.0 + 0.2 * sin(3.0 * theta));
+}
+
+/* 计算一个时间步中 [row_start, row_start + row_count) 行的值。day 为年内日序（UTC） */
+static void synth_plane(const synth_field_t *f, unsigned int v, MPI_Offset t, double day,
+                        MPI_Offset row_start, MPI_Offset row_count, MPI_Offset ny, MPI_Offset nx,
+                        const double *lat, const double *lon, double land_fraction, float *out) {
+    double decl = 0.409 * sin(2.0 * SYNTH_PI * (day + 284.0) / 365.0);
+    double h0 = 2.0 * SYNTH_PI * (day - floor(day)) - SYNTH_PI;
+    double season = cos(2.0 * SYNTH_PI * (day - 200.0) / 365.0);
+
+    for (MPI_Offset r = 0; r < row_count; r++) {
+        MPI_Offset y = row_start + r;
+        double south = (double)y / (ny > 1 ? ny - 1 : 1);     /* 0 为北端，1 为南端 */
+        for (MPI_Offset x = 0; x < nx; x++) {
+            MPI_Offset k = r * nx + x;
+            if (!synth_is_land(y, x, ny, nx, land_fraction)) {
+                out[k] = SYNTH_FILL_VALUE;
+                continue;
+            }
+            double value = f->base + f->spatial * (south - 0.5);
+            if (f->base != 0.0f) {
+                value += 0.25 * f->amplitude * season;      /* 基值为0的场（FSDS、降水）没有季节项 */
+            }
+            double noise = f->noise * synth_hash(v, t, y, x);
+            if (f->model == FIELD_DIURNAL) {
+                double phi = lat[k] * SYNTH_PI / 180.0;
+                double cosz = sin(phi) * sin(decl) + cos(phi) * cos(decl) * cos(h0 + lon[k] * SYNTH_PI / 180.0);
+                value += f->amplitude * (cosz > 0.0 ? cosz : 0.0);
+                value += noise;
+                if (f->base == 0.0f && cosz <= 0.0) {
+                    value = 0.0;
+                }
+            } else if (f->model == FIELD_NOISY) {
+                value += noise + f->amplitude * sin(2.0 * SYNTH_PI * (x / 97.0 + y / 131.0 + t / 24.0));
+            } else {
+                value += noise + f->amplitude * sin(2.0 * SYNTH_PI * (t / 240.0 + x / (double)nx));
+            }
+            out[k] = (float)(value > 0.0 ? value : 0.0);
+        }
+    }
+}
+
+/* 显示使用帮助 */
+static void show_usage(const char *program_name) {
+    printf("Usage: %s [options]\n", program_name);
+    printf("Options:\n");
+    printf("  -o <output_dir>  输出目录\n");
+    printf("  -y <year>        年份(默认2014)\n");
+    printf("  -m <month>       月份(默认1)\n");
+    printf("  -v <variables>   变量列表，以逗号分隔(默认全部: FLDS,FSDS,PRECTmms,PSRF,QBOT,TBOT,WIND)\n");
+    printf("  -Y <ny>          y维度大小(默认512)\n");
+    printf("  -X <nx>          x维度大小(默认512)\n");
+    printf("  -T <nt>          时间步数(默认为该月天数*8，即3小时一步)\n");
+    printf("  -L <fraction>    陆地格点比例(默认0.6)，其余为 _FillValue\n");
+    printf("  -h               显示帮助信息\n");
+    printf("Example:\n");
+    printf("  mpiexec -n 8 %s -o /tmp/synth -y 2014 -m 1 -Y 1024 -X 1024 -v FSDS,TBOT\n", program_name);
+}
+
+int main(int argc, char **argv) {
+    static const int month_days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    int ret, i, rank, nprocs, opt;
+    char output_dir[MAX_PATH_LEN] = "";
+    char var_string[MAX_PATH_LEN] = "FLDS,FSDS,PRECTmms,PSRF,QBOT,TBOT,WIND";
+    char *var_types[MAX_VAR_TYPES];
+    int num_var_types = 0;
+    int year = 2014, month = 1;
+    MPI_Offset ny = 512, nx = 512, nt = 0;
+    double land_fraction = 0.6;
+    double start_time;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+    start_time = MPI_Wtime();
+
+    while ((opt = getopt(argc, argv, "o:y:m:v:Y:X:T:L:h")) != -1) {
+        switch (opt) {
+            case 'o': strcpy(output_dir, optarg); break;
+            case 'y': year = atoi(optarg); break;
+            case 'm': month = atoi(optarg); break;
+            case 'v': strcpy(var_string, optarg); break;
+            case 'Y': ny = atoll(optarg); break;
+            case 'X': nx = atoll(optarg); break;
+            case 'T': nt = atoll(optarg); break;
+            case 'L': land_fraction = atof(optarg); break;
+            case 'h':
+                if (rank == 0) show_usage(argv[0]);
+                MPI_Finalize();
+                return 0;
+            default:
+                if (rank == 0) show_usage(argv[0]);
+                MPI_Finalize();
+                return 1;
+        }
+    }
+    if (output_dir[0] == '\0' || month < 1 || month > 12 || ny < 1 || nx < 1 || nt < 0 ||
+        land_fraction <= 0.0 || land_fraction > 1.0) {
+        if (rank == 0) {
+            fprintf(stderr, "Error: Missing or invalid parameters\n");
+            show_usage(argv[0]);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    if (nt == 0) {
+        nt = month_days[month - 1] * 8;
+    }
+    parse_variable_list(var_string, var_types, &num_var_types);
+
+    /* 本进程负责的行及其经纬度：纬度从北向南 55°N 到 15°N，经度从西向东 130°W 到 60°W */
+    MPI_Offset row_start, row_count;
+    split_range(ny, nprocs, rank, &row_start, &row_count);
+    double *lat = (double *)malloc((row_count * nx + 1) * sizeof(double));
+    double *lon = (double *)malloc((row_count * nx + 1) * sizeof(double));
+    float *plane = (float *)malloc((row_count * nx + 1) * sizeof(float));
+    double *time_values = (double *)malloc((nt + 1) * sizeof(double));
+    if (lat == NULL || lon == NULL || plane == NULL || time_values == NULL) {
+        printf("Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, -1);
+        return 1;
+    }
+    for (MPI_Offset r = 0; r < row_count; r++) {
+        for (MPI_Offset x = 0; x < nx; x++) {
+            lat[r * nx + x] = 55.0 - 40.0 * (row_start + r) / (double)(ny > 1 ? ny - 1 : 1);
+            lon[r * nx + x] = -130.0 + 70.0 * x / (double)(nx > 1 ? nx - 1 : 1);
+        }
+    }
+
+    /* 时间轴均匀覆盖整个月（365天历），记录每步的起点 */
+    double step_days = (double)month_days[month - 1] / nt;
+    double day0 = 0.0;
+    for (i = 0; i < month - 1; i++) {
+        day0 += month_days[i];
+    }
+    for (MPI_Offset t = 0; t < nt; t++) {
+        time_values[t] = t * step_days;
+    }
+
+    if (rank == 0) {
+        printf("输出目录: %s\n", output_dir);
+        printf("网格: time %lld, y %lld, x %lld, 陆地比例 %.2f\n", nt, ny, nx, land_fraction);
+    }
+
+    for (int v = 0; v < num_var_types; v++) {
+        const synth_field_t *f = NULL;
+        for (i = 0; i < (int)(sizeof(synth_fields) / sizeof(synth_fields[0])); i++) {
+            if (strcmp(synth_fields[i].name, var_types[v]) == 0) {
+                f = &synth_fields[i];
+                break;
+            }
+        }
+        if (f == NULL) {
+            if (rank == 0) {
+                printf("Error: No field model for variable %s\n", var_types[v]);
+            }
+            MPI_Abort(MPI_COMM_WORLD, -1);
+            return 1;
+        }
+
+        char path[MAX_PATH_LEN], name[MAX_PATH_LEN], units[64];
+        int ncid, dimids[3], varid, varid_time, varid_lat, varid_lon;
+        float fill = SYNTH_FILL_VALUE;
+        sprintf(name, FORCING_FILE_FORMAT, f->name, year, month);
+        sprintf(path, "%s/%s", output_dir, name);
+
+        ret = ncmpi_create(MPI_COMM_WORLD, path, NC_CLOBBER | NC_64BIT_DATA, MPI_INFO_NULL, &ncid);
+        CHECK_ERR(ret);
+        ret = ncmpi_def_dim(ncid, "time", nt, &dimids[0]);
+        CHECK_ERR(ret);
+        ret = ncmpi_def_dim(ncid, "y", ny, &dimids[1]);
+        CHECK_ERR(ret);
+        ret = ncmpi_def_dim(ncid, "x", nx, &dimids[2]);
+        CHECK_ERR(ret);
+        ret = ncmpi_def_var(ncid, "time", NC_DOUBLE, 1, dimids, &varid_time);
+        CHECK_ERR(ret);
+        sprintf(units, "days since %04d-%02d-01 00:00:00", year, month);
+        ret = ncmpi_put_att_text(ncid, varid_time, "units", strlen(units), units);
+        CHECK_ERR(ret);
+        ret = ncmpi_put_att_text(ncid, varid_time, "calendar", strlen("noleap"), "noleap");
+        CHECK_ERR(ret);
+        ret = ncmpi_def_var(ncid, "LATIXY", NC_DOUBLE, 2, &dimids[1], &varid_lat);
+        CHECK_ERR(ret);
+        ret = ncmpi_put_att_text(ncid, varid_lat, "units", strlen("degrees_north"), "degrees_north");
+        CHECK_ERR(ret);
+        ret = ncmpi_def_var(ncid, "LONGXY", NC_DOUBLE, 2, &dimids[1], &varid_lon);
+        CHECK_ERR(ret);
+        ret = ncmpi_put_att_text(ncid, varid_lon, "units", strlen("degrees_east"), "degrees_east");
+        CHECK_ERR(ret);
+        ret = ncmpi_def_var(ncid, f->name, NC_FLOAT, 3, dimids, &varid);
+        CHECK_ERR(ret);
+        ret = ncmpi_put_att_text(ncid, varid, "units", strlen(f->units), f->units);
+        CHECK_ERR(ret);
+        ret = ncmpi_put_att_float(ncid, varid, "_FillValue", NC_FLOAT, 1, &fill);
+        CHECK_ERR(ret);
+        ret = ncmpi_put_att_float(ncid, varid, "missing_value", NC_FLOAT, 1, &fill);
+        CHECK_ERR(ret);
+        ret = ncmpi_put_att_text(ncid, NC_GLOBAL, "source", strlen("forcing2d_synth"), "forcing2d_synth");
+        CHECK_ERR(ret);
+        ret = ncmpi_enddef(ncid);
+        CHECK_ERR(ret);
+
+        /* time 由0号进程写出，经纬度和主变量按行写出 */
+        MPI_Offset tstart = 0, tcount = (rank == 0) ? nt : 0;
+        ret = ncmpi_put_vara_double_all(ncid, varid_time, &tstart, &tcount, time_values);
+        CHECK_ERR(ret);
+        MPI_Offset start[3] = {0, row_start, 0}, count[3] = {1, row_count, nx};
+        ret = ncmpi_put_vara_double_all(ncid, varid_lat, &start[1], &count[1], lat);
+        CHECK_ERR(ret);
+        ret = ncmpi_put_vara_double_all(ncid, varid_lon, &start[1], &count[1], lon);
+        CHECK_ERR(ret);
+        for (MPI_Offset t = 0; t < nt; t++) {
+            synth_plane(f, (unsigned int)i, t, day0 + t * step_days, row_start, row_count, ny, nx,
+                        lat, lon, land_fraction, plane);
+            start[0] = t;
+            ret = ncmpi_put_vara_float_all(ncid, varid, start, count, plane);
+            CHECK_ERR(ret);
+        }
+        ret = ncmpi_close(ncid);
+        CHECK_ERR(ret);
+        if (rank == 0) {
+            printf("文件 %d: %s\n", v, path);
+        }
+    }
+
+    double total_time = max_time(MPI_Wtime() - start_time, MPI_COMM_WORLD);
+    if (rank == 0) {
+        double mb = (double)num_var_types * nt * ny * nx * sizeof(float) / 1048576.0;
+        printf("总执行时间: %.4f 秒, 写出 %.1f MB (%.1f MB/s)\n", total_time, mb, mb / total_time);
+    }
+
+    for (i = 0; i < num_var_types; i++) {
+        free(var_types[i]);
+    }
+    free(lat);
+    free(lon);
+    free(plane);
+    free(time_values);
+    MPI_Finalize();
+    return 0;
+}